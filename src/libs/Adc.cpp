@@ -9,49 +9,123 @@
 #include "libs/nuts_bolts.h"
 #include "libs/Kernel.h"
 #include "libs/Pin.h"
-#include "libs/ADC/adc.h"
-#include "libs/Pin.h"
+#include "libs/Gpdma.h"
 
+// The ADC converts the enabled channels in burst mode, and the GPDMA copies each result from ADGDR into a circular
+// buffer, with no interrupt per conversion. Each time the buffer is full, it is decimated into one result per channel,
+// so reading a channel is a single load.
 
-using namespace std;
-#include <vector>
-// This is an interface to the mbed.org ADC library you can find in libs/ADC/adc.h
-// TODO : Having the same name is confusing, should change that
+// Written round and round by the DMA, straight from ADGDR, and the descriptor linking the transfer to itself so it
+// never stops. The GPDMA cannot reach the local RAM, so both are in AHB RAM
+static uint32_t adc_samples[ADC_DMA_SAMPLES] __attribute__ ((section ("AHBSRAM0")));
+static GpdmaLli adc_lli __attribute__ ((section ("AHBSRAM0")));
 
 Adc::Adc(){
-    this->adc = new ADC(1000, 1);
+    for (int i = 0; i < 8; i++) this->results[i] = 0;
+
+    // ADC powered, clocked at CCLK / 8, with the divider giving ADC_SAMPLE_RATE at 65 clocks per conversion
+    LPC_SC->PCONP    |= (1 << 12);
+    LPC_SC->PCLKSEL0 = (LPC_SC->PCLKSEL0 & ~(0x3 << 24)) | (0x3 << 24);
+    uint32_t clock_div = (SystemCoreClock / 8) / (ADC_SAMPLE_RATE * 65);
+    clock_div = confine(clock_div, 1U, 256U);
+    LPC_ADC->ADCR    = ((clock_div - 1) << 8) | (1 << 21); // powered up, no channel selected yet
+    LPC_ADC->ADINTEN = (1 << 8);                           // every conversion requests a DMA transfer, ADC_IRQn stays disabled
+
+    // Words from ADGDR into the buffer, round and round, with an interrupt each time it is full
+    adc_lli.source      = (uint32_t) &LPC_ADC->ADGDR;
+    adc_lli.destination = (uint32_t) adc_samples;
+    adc_lli.next        = (uint32_t) &adc_lli;
+    adc_lli.control     = ADC_DMA_SAMPLES | GPDMA_CONTROL_WORD | GPDMA_CONTROL_DST_INC | GPDMA_CONTROL_INTERRUPT;
+
+    Gpdma::attach(GPDMA_ADC_CHANNEL, this, &Adc::on_dma_complete);
+    this->start_dma();
+}
+
+void Adc::start_dma(){
+    LPC_GPDMACH_TypeDef* channel = Gpdma::channel(GPDMA_ADC_CHANNEL);
+    channel->DMACCSrcAddr  = adc_lli.source;
+    channel->DMACCDestAddr = adc_lli.destination;
+    channel->DMACCLLI      = adc_lli.next;
+    channel->DMACCControl  = adc_lli.control;
+    channel->DMACCConfig   = GPDMA_CONFIG_ENABLE | GPDMA_CONFIG_SRC_REQUEST(GPDMA_REQUEST_ADC) | GPDMA_CONFIG_PERIPHERAL_TO_MEMORY | GPDMA_CONFIG_INTERRUPTS;
 }
 
 // Enables ADC on a given pin
 void Adc::enable_pin(Pin* pin){
-    PinName pin_name = this->_pin_to_pinname(pin);
-    this->adc->burst(1);
-    this->adc->setup(pin_name,1);
-    this->adc->interrupt_state(pin_name,1);
+    int channel = this->_pin_to_channel(pin);
+    if (channel < 0) return;
+
+    // Analog function, and neither pull-up nor pull-down
+    int index = (pin->port_number * 2) + (pin->pin / 16);
+    int shift = (pin->pin % 16) * 2;
+    volatile uint32_t *pinsel  = &LPC_PINCON->PINSEL0 + index;
+    volatile uint32_t *pinmode = &LPC_PINCON->PINMODE0 + index;
+    *pinsel  = (*pinsel & ~(3 << shift)) | ((pin->port_number == 1 ? 3 : 1) << shift);
+    *pinmode = (*pinmode & ~(3 << shift)) | (2 << shift);
+
+    // The channels to convert can only change with burst mode stopped
+    uint32_t adcr = LPC_ADC->ADCR & ~(1 << 16);
+    LPC_ADC->ADCR = adcr;
+    LPC_ADC->ADCR = adcr | (1 << channel) | (1 << 16);
 }
 
-// Read the last value ( burst mode ) on a given pin
+// Read the last decimated value on a given pin
 unsigned int Adc::read(Pin* pin){
-    return this->adc->read(this->_pin_to_pinname(pin));
+    int channel = this->_pin_to_channel(pin);
+    if (channel < 0) return 0;
+    return this->results[channel];
+}
+
+// Called when the DMA has filled the buffer : the average of each channel's samples, without the highest and lowest
+// ones so a single spike does not get in
+uint32_t Adc::on_dma_complete(uint32_t error){
+    if (error) {
+        this->start_dma();
+        return 0;
+    }
+
+    uint32_t sum[8], count[8];
+    uint16_t lowest[8], highest[8];
+    for (int i = 0; i < 8; i++) {
+        sum[i] = 0;
+        count[i] = 0;
+        lowest[i] = 0xFFFF;
+        highest[i] = 0;
+    }
+
+    for (int i = 0; i < ADC_DMA_SAMPLES; i++) {
+        uint32_t sample = adc_samples[i];
+        if (!(sample & (1UL << 31))) continue; // not converted yet, on the first pass
+
+        int channel = (sample >> 24) & 7;
+        uint16_t value = (sample >> 4) & 0xFFF;
+        sum[channel] += value;
+        count[channel]++;
+        if (value < lowest[channel]) lowest[channel] = value;
+        if (value > highest[channel]) highest[channel] = value;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        if (count[i] > 2) {
+            this->results[i] = (sum[i] - lowest[i] - highest[i] + ((count[i] - 2) / 2)) / (count[i] - 2);
+        } else if (count[i] > 0) {
+            this->results[i] = sum[i] / count[i];
+        }
+    }
+    return 0;
 }
 
-// Convert a smoothie Pin into a mBed Pin
-PinName Adc::_pin_to_pinname(Pin* pin){
-    if( pin->port == LPC_GPIO0 && pin->pin == 23 ){
-        return p15;
-    }else if( pin->port == LPC_GPIO0 && pin->pin == 24 ){
-        return p16;
-    }else if( pin->port == LPC_GPIO0 && pin->pin == 25 ){
-        return p17;
-    }else if( pin->port == LPC_GPIO0 && pin->pin == 26 ){
-        return p18;
+// The ADC channel of a smoothie Pin, -1 if it has none
+int Adc::_pin_to_channel(Pin* pin){
+    if( pin->port == LPC_GPIO0 && pin->pin >= 23 && pin->pin <= 26 ){
+        return pin->pin - 23;
     }else if( pin->port == LPC_GPIO1 && pin->pin == 30 ){
-        return p19;
+        return 4;
     }else if( pin->port == LPC_GPIO1 && pin->pin == 31 ){
-        return p20;
+        return 5;
     }else{
         //TODO: Error
-        return NC;
+        return -1;
     }
 }
 
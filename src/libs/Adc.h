@@ -11,19 +11,27 @@
 #define ADC_H
 
 #include "libs/Module.h"
-#include "PinNames.h" // mbed.h lib
-#include "libs/ADC/adc.h"
+#include <stdint.h>
 
 class Pin;
 
+// Conversions per second over all enabled channels
+#define ADC_SAMPLE_RATE 8000
+// Conversions the DMA writes before each decimation, about ADC_SAMPLE_RATE / ADC_DMA_SAMPLES times per second
+#define ADC_DMA_SAMPLES 128
+
 class Adc : public Module{
     public:
         Adc();
         void enable_pin(Pin* pin);
         unsigned int read(Pin* pin);
-        PinName _pin_to_pinname(Pin* pin);
+        uint32_t on_dma_complete(uint32_t error);
+
+    private:
+        int _pin_to_channel(Pin* pin);
+        void start_dma();
 
-        ADC* adc;
+        volatile uint16_t results[8];        // Decimated result of each channel, 12 bits
 };
 
 
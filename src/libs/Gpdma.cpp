@@ -0,0 +1,42 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Gpdma.h"
+
+FPointer Gpdma::handlers[8];
+
+// Only does something the first time, owners may be set up before the kernel exists
+void Gpdma::power_up()
+{
+    if (LPC_SC->PCONP & (1 << 29)) return;
+
+    LPC_SC->PCONP |= (1 << 29);
+    LPC_GPDMA->DMACIntTCClear = 0xFF;
+    LPC_GPDMA->DMACIntErrClr  = 0xFF;
+    LPC_GPDMA->DMACConfig     = 1; // enabled, little endian
+    NVIC_EnableIRQ(DMA_IRQn);
+}
+
+void Gpdma::irq()
+{
+    uint32_t done  = LPC_GPDMA->DMACIntTCStat;
+    uint32_t error = LPC_GPDMA->DMACIntErrStat;
+    LPC_GPDMA->DMACIntTCClear = done;
+    LPC_GPDMA->DMACIntErrClr  = error;
+
+    for (int n = 0; n < 8; n++) {
+        if (error & (1 << n)) {
+            handlers[n].call(1);
+        } else if (done & (1 << n)) {
+            handlers[n].call(0);
+        }
+    }
+}
+
+extern "C" void DMA_IRQHandler (void){
+    Gpdma::irq();
+}
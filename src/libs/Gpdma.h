@@ -0,0 +1,72 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GPDMA_H
+#define GPDMA_H
+
+#include <stdint.h>
+
+#include "libs/LPC17xx/sLPC17xx.h" // smoothed mbed.h lib
+#include "libs/FPointer.h"
+
+// Who owns which GPDMA channel, the lower the number the higher the priority
+#define GPDMA_SSP0_RX_CHANNEL 0
+#define GPDMA_SSP0_TX_CHANNEL 1
+#define GPDMA_SSP1_RX_CHANNEL 2
+#define GPDMA_SSP1_TX_CHANNEL 3
+#define GPDMA_ADC_CHANNEL     7
+
+// Peripheral DMA request lines
+#define GPDMA_REQUEST_SSP0_TX 0
+#define GPDMA_REQUEST_SSP0_RX 1
+#define GPDMA_REQUEST_SSP1_TX 2
+#define GPDMA_REQUEST_SSP1_RX 3
+#define GPDMA_REQUEST_ADC     4
+
+// DMACCControl fields
+#define GPDMA_CONTROL_BURST_4    ((1 << 12) | (1 << 15))
+#define GPDMA_CONTROL_WORD       ((2 << 18) | (2 << 21))
+#define GPDMA_CONTROL_SRC_INC    (1 << 26)
+#define GPDMA_CONTROL_DST_INC    (1 << 27)
+#define GPDMA_CONTROL_INTERRUPT  (1UL << 31)
+
+// DMACCConfig fields
+#define GPDMA_CONFIG_ENABLE              1
+#define GPDMA_CONFIG_SRC_REQUEST(n)      ((n) << 1)
+#define GPDMA_CONFIG_DST_REQUEST(n)      ((n) << 6)
+#define GPDMA_CONFIG_MEMORY_TO_PERIPHERAL (1 << 11)
+#define GPDMA_CONFIG_PERIPHERAL_TO_MEMORY (2 << 11)
+#define GPDMA_CONFIG_INTERRUPTS          ((1 << 14) | (1 << 15))
+
+// A GPDMA linked list item
+struct GpdmaLli {
+    uint32_t source;
+    uint32_t destination;
+    uint32_t next;
+    uint32_t control;
+};
+
+// The eight GPDMA channels share one interrupt, the owner of a channel attaches its handler here. It is called with 0
+// when the channel reached its terminal count, and with 1 on a bus error, which also disables the channel
+class Gpdma {
+    public:
+        static LPC_GPDMACH_TypeDef* channel(int n) { return (LPC_GPDMACH_TypeDef*) (LPC_GPDMACH0_BASE + (0x20 * n)); }
+
+        template<class T> static void attach(int n, T* object, uint32_t (T::*method)(uint32_t)){
+            power_up();
+            handlers[n].attach(object, method);
+        }
+
+        static void irq();
+
+    private:
+        static void power_up();
+
+        static FPointer handlers[8];
+};
+
+#endif
@@ -5,4 +5,11 @@ extern "C"{
 
 // Hook is just a glorified FPointer
 
-Hook::Hook(){}
+Hook::Hook(){
+    interval = 0;
+    deadline = 0;
+    next = NULL;
+    calls = 0;
+    max_cycles = 0;
+    cycles = 0;
+}
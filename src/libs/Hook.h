@@ -2,13 +2,21 @@
 #define HOOK_H
 #include "libs/FPointer.h"
 
-// Hook is just a glorified FPointer
+// Hook is just a glorified FPointer, that SlowTicker keeps in a list ordered by deadline
 
 class Hook : public FPointer {
     public:
         Hook();
-        int     interval;
-        int     countdown;
+        const void* get_object() const { return obj_callback; }
+
+        uint32_t interval;      // in timer ticks
+        uint32_t deadline;      // timer count it is next called at
+        Hook*    next;          // the hook due after this one
+
+        // what the calls cost, for reports
+        uint32_t calls;
+        uint32_t max_cycles;
+        uint64_t cycles;
 };
 
 #endif
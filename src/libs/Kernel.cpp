@@ -17,9 +17,13 @@
 #include "ConfigValue.h"
 
 #include "libs/StepTicker.h"
+#include "libs/SerialMessage.h"
+#include "libs/utils.h"
 #include "libs/PublicData.h"
 #include "modules/communication/SerialConsole.h"
 #include "modules/communication/GcodeDispatch.h"
+#include "modules/communication/RealtimeCommands.h"
+#include "modules/communication/utils/Gcode.h"
 #include "modules/robot/Planner.h"
 #include "modules/robot/Robot.h"
 #include "modules/robot/Stepper.h"
@@ -28,6 +32,9 @@
 
 #include <malloc.h>
 #include <array>
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
 
 #define baud_rate_setting_checksum CHECKSUM("baud_rate")
 #define uart0_checksum             CHECKSUM("uart0")
@@ -40,6 +47,12 @@ Kernel* Kernel::instance;
 // The kernel is the central point in Smoothie : it stores modules, and handles event calls
 Kernel::Kernel(){
     instance= this; // setup the Singleton instance of the kernel
+    this->event_tables.fill(NULL);
+    this->gcode_fallback = NULL;
+    this->profile_events = false;
+
+    // the serial receive interrupt passes chars to this as soon as serial is up, it ignores them until it is loaded
+    this->realtime_commands = new RealtimeCommands();
 
     // serial first at fixed baud rate (DEFAULT_SERIAL_BAUD_RATE) so config can report errors to serial
 	// Set to UART0, this will be changed to use the same UART as MRI if it's enabled
@@ -84,11 +97,11 @@ Kernel::Kernel(){
         this->serial = new SerialConsole(USBTX, USBRX, this->config->value(uart0_checksum,baud_rate_setting_checksum)->by_default(DEFAULT_SERIAL_BAUD_RATE)->as_number());
     }
 
-    this->add_module( this->config );
-    this->add_module( this->serial );
+    this->add_module( this->config, "config" );
+    this->add_module( this->serial, "serial_console" );
 
     // HAL stuff
-    add_module( this->slow_ticker          = new SlowTicker());
+    add_module( this->slow_ticker          = new SlowTicker(), "slow_ticker" );
     this->step_ticker          = new StepTicker();
     this->adc                  = new Adc();
 
@@ -99,9 +112,10 @@ Kernel::Kernel(){
     NVIC_SetPriority(TIMER1_IRQn, 1);
     NVIC_SetPriority(TIMER2_IRQn, 3);
 
-    // Set other priorities lower than the timers
-    NVIC_SetPriority(ADC_IRQn, 4);
-    NVIC_SetPriority(USB_IRQn, 4);
+    // Set other priorities lower than the timers. USB goes below the DMA, so an SD card transfer always finishes
+    // whatever the USB interrupt is doing
+    NVIC_SetPriority(DMA_IRQn, 4);
+    NVIC_SetPriority(USB_IRQn, 5);
 
     // If MRI is enabled
     if( MRI_ENABLE ){
@@ -125,36 +139,235 @@ Kernel::Kernel(){
     this->step_ticker->set_frequency( this->base_stepping_frequency );
 
     // Core modules
-    this->add_module( this->gcode_dispatch = new GcodeDispatch() );
-    this->add_module( this->robot          = new Robot()         );
-    this->add_module( this->stepper        = new Stepper()       );
-    this->add_module( this->conveyor       = new Conveyor()      );
-    this->add_module( this->pauser         = new Pauser()        );
+    this->add_module( this->gcode_dispatch = new GcodeDispatch(), "gcode_dispatch" );
+    this->add_module( this->robot          = new Robot(),         "robot" );
+    this->add_module( this->stepper        = new Stepper(),       "stepper" );
+    this->add_module( this->conveyor       = new Conveyor(),      "conveyor" );
+    this->add_module( this->pauser         = new Pauser(),        "pauser" );
+    this->add_module( this->realtime_commands,                  "realtime_commands" );
 
     this->planner = new Planner();
 
 }
 
 // Add a module to Kernel. We don't actually hold a list of modules, we just tell it where Kernel is
-void Kernel::add_module(Module* module){
+void Kernel::add_module(Module* module, const char* name){
+    module->module_name = name;
     module->on_module_loaded();
 }
 
 // Adds a hook for a given module and event
 void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod){
+    // a module registering for the event gets every gcode
+    if(id_event == ON_GCODE_RECEIVED) {
+        this->add_gcode_route(GCODE_ROUTE_ALL, mod);
+        return;
+    }
+
     this->hooks[id_event].push_back(mod);
+
+    // a module added after loading, from the panel for example
+    if(this->event_tables[id_event] != NULL) this->freeze_event(id_event);
+}
+
+// Adds a hook for the gcodes with a given G or M number, instead of registering for every gcode with ON_GCODE_RECEIVED
+void Kernel::register_for_gcode(char letter, unsigned int code, Module *mod){
+    this->add_gcode_route((letter == 'M' ? GCODE_ROUTE_M : 0) | code, mod);
+}
+
+void Kernel::add_gcode_route(uint16_t key, Module *mod){
+    this->gcode_codes.push_back(std::make_pair(key, mod));
+
+    // lines with no number, or several, still go to every module handling gcodes
+    std::vector<Module*> &modules = this->hooks[ON_GCODE_RECEIVED];
+    if(std::find(modules.begin(), modules.end(), mod) == modules.end()) modules.push_back(mod);
+
+    if(this->event_tables[ON_GCODE_RECEIVED] != NULL) this->freeze_event(ON_GCODE_RECEIVED);
+}
+
+// Called once every module is loaded : from now on events are called from compact tables, and each handler is timed
+void Kernel::freeze_events(){
+    // the DWT cycle counter times the handlers
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for(int i = 0; i < NUMBER_OF_DEFINED_EVENTS; i++) {
+        this->freeze_event((_EVENT_ENUM)i);
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpmf-conversions"
+
+// A NULL terminated table calling the modules' callback for an event
+static EventHandler* new_event_table(const std::vector<Module*> &modules, _EVENT_ENUM id_event){
+    EventHandler *table = new EventHandler[modules.size() + 1]();
+
+    for(unsigned int i = 0; i < modules.size(); i++) {
+        table[i].module = modules[i];
+        // GCC extension : the function a bound pointer to member calls, so the virtual lookup is done once here
+        table[i].function = (void (*)(Module*, void*))(modules[i]->*kernel_callback_functions[id_event]);
+    }
+    table[modules.size()].module = NULL;
+
+    return table;
+}
+
+#pragma GCC diagnostic pop
+
+// Adds a shell command, lines starting with it go to this module only instead of to every module getting console lines
+void Kernel::register_for_command(const char *name, Module *mod){
+    ConsoleCommand command = {get_checksum(name), name, new_event_table(std::vector<Module*>(1, mod), ON_CONSOLE_LINE_RECEIVED)};
+    auto position = std::upper_bound(this->console_commands.begin(), this->console_commands.end(), command,
+                                     [](const ConsoleCommand &a, const ConsoleCommand &b) { return a.checksum < b.checksum; });
+    this->console_commands.insert(position, command);
+}
+
+// The module a shell command goes to, NULL for gcodes and anything else nobody registered
+EventHandler* Kernel::route_console_line(SerialMessage *message){
+    const string &line = message->message;
+
+    // gcodes, comments and blank lines are never commands, they go to the gcode dispatcher
+    if(line.empty() || strchr(";( \n\rGMTN", line[0]) != NULL) return NULL;
+
+    // the first word, commands are not case sensitive
+    char name[16];
+    size_t n = 0;
+    for(; n < line.size() && !isspace((unsigned char)line[n]); n++) {
+        if(n == sizeof(name) - 1) return NULL; // longer than any command
+        name[n] = tolower((unsigned char)line[n]);
+    }
+    name[n] = '\0';
+
+    uint16_t checksum = get_checksum(name);
+    auto command = std::lower_bound(this->console_commands.begin(), this->console_commands.end(), checksum,
+                                    [](const ConsoleCommand &c, uint16_t k) { return c.checksum < k; });
+    for(; command != this->console_commands.end() && command->checksum == checksum; ++command) {
+        if(strcmp(command->name, name) == 0) return command->handler;
+    }
+    return NULL;
+}
+
+// (Re)build the table an event is called from
+void Kernel::freeze_event(_EVENT_ENUM id_event){
+    if(id_event == ON_GCODE_RECEIVED) this->freeze_gcode_routes();
+
+    // a single store, so an interrupt calling this event sees either the old table or the new one. The old tables are not
+    // freed as they may be being walked right now, this only happens when a module is added after loading
+    this->event_tables[id_event] = new_event_table(this->hooks[id_event], id_event);
+}
+
+// The gcode modules, in the order they registered, that handle a number or get every gcode
+EventHandler* Kernel::gcode_table(uint16_t key){
+    std::vector<Module*> modules;
+    for(auto m : this->hooks[ON_GCODE_RECEIVED]) {
+        for(auto &code : this->gcode_codes) {
+            if(code.second == m && (code.first == key || code.first == GCODE_ROUTE_ALL)) {
+                modules.push_back(m);
+                break;
+            }
+        }
+    }
+    return new_event_table(modules, ON_GCODE_RECEIVED);
+}
+
+// One table per registered number, sorted so a gcode finds its own with a binary search
+void Kernel::freeze_gcode_routes(){
+    std::vector<uint16_t> keys;
+    for(auto &code : this->gcode_codes) {
+        if(code.first != GCODE_ROUTE_ALL) keys.push_back(code.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<GcodeRoute> routes;
+    routes.reserve(keys.size());
+    for(auto key : keys) {
+        routes.push_back({key, this->gcode_table(key)});
+    }
+
+    this->gcode_fallback = this->gcode_table(GCODE_ROUTE_ALL);
+    this->gcode_routes.swap(routes);
+}
+
+// The table to call for a gcode, lines with no G or M number, or both, go to every gcode module
+EventHandler* Kernel::route_gcode(Gcode *gcode){
+    if(gcode->has_g == gcode->has_m) return this->event_tables[ON_GCODE_RECEIVED];
+
+    uint16_t key = gcode->has_m ? (GCODE_ROUTE_M | gcode->m) : gcode->g;
+    auto route = std::lower_bound(this->gcode_routes.begin(), this->gcode_routes.end(), key,
+                                  [](const GcodeRoute &r, uint16_t k) { return r.key < k; });
+    if(route != this->gcode_routes.end() && route->key == key) return route->handlers;
+
+    // nobody asked for this number, the modules getting every gcode may still take it
+    return this->gcode_fallback;
 }
 
 // Call a specific event without arguments
 void Kernel::call_event(_EVENT_ENUM id_event){
-    for (auto m : hooks[id_event]) {
-        (m->*kernel_callback_functions[id_event])(this);
-    }
+    this->call_event(id_event, this);
 }
 
 // Call a specific event with an argument
 void Kernel::call_event(_EVENT_ENUM id_event, void * argument){
-    for (auto m : hooks[id_event]) {
-        (m->*kernel_callback_functions[id_event])(argument);
+    EventHandler *handler = this->event_tables[id_event];
+
+    // a shell command goes to the module that registered it, and to nobody else
+    if(id_event == ON_CONSOLE_LINE_RECEIVED) {
+        EventHandler *command = this->route_console_line(static_cast<SerialMessage*>(argument));
+        if(command != NULL) handler = command;
+    }
+
+    // still loading
+    if(handler == NULL) {
+        for (auto m : hooks[id_event]) {
+            (m->*kernel_callback_functions[id_event])(argument);
+        }
+        return;
+    }
+
+    if(id_event == ON_GCODE_RECEIVED) {
+        handler = this->route_gcode(static_cast<Gcode*>(argument));
+    }
+
+    // this may be an interrupt, the cycle counting is only paid for while someone looks at it
+    if(!this->profile_events) {
+        for (; handler->module != NULL; handler++) {
+            handler->function(handler->module, argument);
+        }
+        return;
+    }
+
+    for (; handler->module != NULL; handler++) {
+        uint32_t start = DWT->CYCCNT;
+        handler->function(handler->module, argument);
+        uint32_t cycles = DWT->CYCCNT - start;
+
+        handler->calls++;
+        handler->cycles += cycles;
+        if(cycles > handler->max_cycles) handler->max_cycles = cycles;
+    }
+}
+
+static void reset_event_table(EventHandler *handler){
+    for(; handler != NULL && handler->module != NULL; handler++) {
+        handler->calls = 0;
+        handler->max_cycles = 0;
+        handler->cycles = 0;
+    }
+}
+
+// Start profiling the handlers over
+void Kernel::reset_event_profile(){
+    for(int i = 0; i < NUMBER_OF_DEFINED_EVENTS; i++) {
+        reset_event_table(this->event_tables[i]);
+    }
+    for(auto &route : this->gcode_routes) {
+        reset_event_table(route.handlers);
+    }
+    reset_event_table(this->gcode_fallback);
+    for(auto &command : this->console_commands) {
+        reset_event_table(command.handler);
     }
 }
@@ -14,6 +14,7 @@
 #include <array>
 #include <vector>
 #include <string>
+#include <stdint.h>
 
 //Module manager
 class Config;
@@ -24,12 +25,40 @@ class Pauser;
 class SerialConsole;
 class StreamOutputPool;
 class GcodeDispatch;
+class RealtimeCommands;
 class Robot;
 class Stepper;
 class Planner;
 class StepTicker;
 class Adc;
 class PublicData;
+class Gcode;
+struct SerialMessage;
+
+// A module's callback for one event, as events are dispatched once loading is done, with what it has cost so far
+struct EventHandler {
+    Module*  module;                             // NULL at the end of the table
+    void     (*function)(Module*, void*);        // resolved when the table is built, instead of on every call
+    uint32_t calls;
+    uint32_t max_cycles;
+    uint64_t cycles;                             // includes the events called from inside the handler
+};
+
+// Modules handling the gcodes with one G or M number, looked up by number instead of calling every gcode module
+struct GcodeRoute {
+    uint16_t      key;                           // the G number, or the M number plus GCODE_ROUTE_M
+    EventHandler* handlers;
+};
+
+// A shell command, and the module it goes to instead of every module getting console lines
+struct ConsoleCommand {
+    uint16_t      checksum;                      // get_checksum() of the name, what the table is sorted by
+    const char*   name;                          // lower case
+    EventHandler* handler;
+};
+
+#define GCODE_ROUTE_M   0x8000
+#define GCODE_ROUTE_ALL 0xFFFF                   // registered for ON_GCODE_RECEIVED, gets every gcode
 
 class Kernel {
     public:
@@ -37,16 +66,26 @@ class Kernel {
         static Kernel* instance; // the Singleton instance of Kernel usable anywhere
         const char* config_override_filename(){ return "/sd/config-override"; }
 
-        void add_module(Module* module);
+        void add_module(Module* module, const char* name);
         void register_for_event(_EVENT_ENUM id_event, Module *module);
+        void register_for_gcode(char letter, unsigned int code, Module *module);
+        void register_for_command(const char *name, Module *module);
         void call_event(_EVENT_ENUM id_event);
         void call_event(_EVENT_ENUM id_event, void * argument);
+        void freeze_events();
+        const EventHandler* get_event_handlers(_EVENT_ENUM id_event) const { return this->event_tables[id_event]; }
+        const std::vector<GcodeRoute>& get_gcode_routes() const { return this->gcode_routes; }
+        const EventHandler* get_gcode_fallback() const { return this->gcode_fallback; }
+        const std::vector<ConsoleCommand>& get_console_commands() const { return this->console_commands; }
+        void reset_event_profile();
+
 
         // These modules are aviable to all other modules
         SerialConsole*    serial;
         StreamOutputPool* streams;
 
         GcodeDispatch*    gcode_dispatch;
+        RealtimeCommands* realtime_commands;
         Robot*            robot;
         Stepper*          stepper;
         Planner*          planner;
@@ -59,6 +98,7 @@ class Kernel {
         StepTicker*       step_ticker;
         Adc*              adc;
         bool              use_leds;
+        bool              profile_events;  // time every handler call, off until the events command turns it on
         std::string       current_path;
         int               base_stepping_frequency;
 
@@ -66,6 +106,23 @@ class Kernel {
         // When a module asks to be called for a specific event ( a hook ), this is where that request is remembered
         std::array<std::vector<Module*>, NUMBER_OF_DEFINED_EVENTS> hooks;
 
+        // Once every module is loaded, events are called from these instead, NULL until then
+        void freeze_event(_EVENT_ENUM id_event);
+        std::array<EventHandler*, NUMBER_OF_DEFINED_EVENTS> event_tables;
+
+        // The codes each gcode module registered for, every module in hooks[ON_GCODE_RECEIVED] has at least one
+        void add_gcode_route(uint16_t key, Module *module);
+        EventHandler* route_gcode(Gcode *gcode);
+        void freeze_gcode_routes();
+        EventHandler* gcode_table(uint16_t key);
+        std::vector<std::pair<uint16_t, Module*>> gcode_codes;
+        std::vector<GcodeRoute> gcode_routes;    // sorted by key
+        EventHandler* gcode_fallback;            // for numbers nobody registered, the modules getting every gcode
+
+        // Lines starting with a registered command go to that module only, the rest to hooks[ON_CONSOLE_LINE_RECEIVED]
+        EventHandler* route_console_line(SerialMessage *message);
+        std::vector<ConsoleCommand> console_commands;
+
 };
 
 #endif
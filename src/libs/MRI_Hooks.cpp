@@ -25,9 +25,11 @@ extern "C" {
     };
 
     static uint32_t _previous_state[5];
+    static uint32_t _previous_pinsel[10];
 
     static LPC_GPIO_TypeDef* io;
-    static int i;
+    static volatile uint32_t* pinsel = &LPC_PINCON->PINSEL0;
+    static int i, j;
 
     void __mriPlatform_EnteringDebuggerHook()
     {
@@ -41,6 +43,18 @@ extern "C" {
             io->FIOSET   = _set_high_on_debug[i];
             io->FIOCLR   = _set_low_on_debug[i];
         }
+
+        // Pins driven by a peripheral, like a heater on a hardware PWM channel, go back to GPIO so the above applies
+        for (i = 0; i < 10; i++)
+            _previous_pinsel[i] = pinsel[i];
+        for (i = 0; i < 5; i++)
+        {
+            for (j = 0; j < 32; j++)
+            {
+                if ((_set_high_on_debug[i] | _set_low_on_debug[i]) & (1 << j))
+                    pinsel[(i * 2) + (j / 16)] &= ~(3 << ((j % 16) * 2));
+            }
+        }
     }
 
     void __mriPlatform_LeavingDebuggerHook()
@@ -52,6 +66,12 @@ extern "C" {
             io->FIOSET   =   _previous_state[i]  & (_set_high_on_debug[i] | _set_low_on_debug[i]);
             io->FIOCLR   = (~_previous_state[i]) & (_set_high_on_debug[i] | _set_low_on_debug[i]);
         }
+
+        for (i = 0; i < 10; i++)
+        {
+            if (pinsel[i] != _previous_pinsel[i])
+                pinsel[i] = _previous_pinsel[i];
+        }
     }
 
     void set_high_on_debug(int port, int pin)
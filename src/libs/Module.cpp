@@ -7,8 +7,9 @@
 
 #include "libs/Module.h"
 #include "libs/Kernel.h"
+#include "libs/PublicData.h"
 
-Module::Module(){}
+Module::Module() : module_name(NULL) {}
 Module::~Module(){}
 
 // this is used to callback the specific method in the Module instance, there must be one for each _EVENT_ENUM and in the same order
@@ -18,7 +19,6 @@ const ModuleCallback kernel_callback_functions[NUMBER_OF_DEFINED_EVENTS] = {
     &Module::on_console_line_received,
     &Module::on_gcode_received,
     &Module::on_gcode_execute,
-    &Module::on_speed_change,
     &Module::on_block_begin,
     &Module::on_block_end,
     &Module::on_play,
@@ -31,9 +31,44 @@ const ModuleCallback kernel_callback_functions[NUMBER_OF_DEFINED_EVENTS] = {
 
 };
 
+// names of the events, for reports, in the same order
+const char * const kernel_event_names[NUMBER_OF_DEFINED_EVENTS] = {
+    "main_loop",
+    "console_line_received",
+    "gcode_received",
+    "gcode_execute",
+    "block_begin",
+    "block_end",
+    "play",
+    "pause",
+    "idle",
+    "second_tick",
+    "get_public_data",
+    "set_public_data",
+    "halt"
+};
+
 
 void Module::register_for_event(_EVENT_ENUM event_id){
     // Events are the basic building blocks of Smoothie. They register for events, and then do stuff when those events are called.
     // You add things to Smoothie by making a new class that inherits the Module class. See http://smoothieware.org/moduleexample for a crude introduction
     THEKERNEL->register_for_event(event_id, this);
 }
+
+void Module::register_for_gcode(char letter, unsigned int code){
+    // Instead of getting every gcode with ON_GCODE_RECEIVED, a module can ask for only the G or M numbers it handles, on_gcode_received
+    // is then only called for those, and for the lines with no G or M number
+    THEKERNEL->register_for_gcode(letter, code, this);
+}
+
+void Module::register_for_command(const char *name){
+    // A shell command, lower case : on_console_line_received is called for the lines starting with it, and those lines are not
+    // sent to the modules registered for ON_CONSOLE_LINE_RECEIVED. The name must stay valid, a string literal usually
+    THEKERNEL->register_for_command(name, this);
+}
+
+void Module::register_for_public_data(uint16_t csa, uint16_t csb, uint16_t csc){
+    // Instead of every public data request with ON_GET_PUBLIC_DATA and ON_SET_PUBLIC_DATA, on_get_public_data and on_set_public_data
+    // are only called for the requests starting with these checksums
+    PublicData::add_provider(this, csa, csb, csc);
+}
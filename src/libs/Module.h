@@ -8,15 +8,16 @@
 #ifndef MODULE_H
 #define MODULE_H
 
+#include <stdint.h>
+
 // See : http://smoothieware.org/listofevents
-// When adding a new event the virtual method needs to be defined in class Module and the method pointer need to be defined in
-// Module.cpp:16 in the same order
+// When adding a new event the virtual method needs to be defined in class Module and the method pointer and name need to be
+// defined in Module.cpp:16 in the same order
 enum _EVENT_ENUM {
     ON_MAIN_LOOP,
     ON_CONSOLE_LINE_RECEIVED,
     ON_GCODE_RECEIVED,
     ON_GCODE_EXECUTE,
-    ON_SPEED_CHANGE,
     ON_BLOCK_BEGIN,
     ON_BLOCK_END,
     ON_PLAY,
@@ -32,6 +33,7 @@ enum _EVENT_ENUM {
 class Module;
 typedef void (Module::*ModuleCallback)(void * argument);
 extern const ModuleCallback kernel_callback_functions[NUMBER_OF_DEFINED_EVENTS];
+extern const char * const kernel_event_names[NUMBER_OF_DEFINED_EVENTS];
 
 // Module base class
 // All modules must extend this class, see http://smoothieware.org/moduleexample
@@ -43,6 +45,9 @@ public:
     virtual void on_module_loaded(){};
 
     void register_for_event(_EVENT_ENUM event_id);
+    void register_for_gcode(char letter, unsigned int code);
+    void register_for_command(const char *name);
+    void register_for_public_data(uint16_t csa, uint16_t csb = 0, uint16_t csc = 0);
 
     // event callbacks, not every module will implement all of these
     // there should be one for each _EVENT_ENUM
@@ -50,7 +55,6 @@ public:
     virtual void on_console_line_received(void*){};
     virtual void on_gcode_received(void*){};
     virtual void on_gcode_execute(void*){};
-    virtual void on_speed_change(void*){};
     virtual void on_block_begin(void*){};
     virtual void on_block_end(void*){};
     virtual void on_play(void*){};
@@ -61,6 +65,7 @@ public:
     virtual void on_set_public_data(void*){};
     virtual void on_halt(void*){};
 
+    const char *module_name;    // what the events command shows it as, given to Kernel::add_module()
 };
 
 #endif
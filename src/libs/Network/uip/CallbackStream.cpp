@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "SerialConsole.h"
+#include "GcodeDispatch.h"
 #define DEBUG_PRINTF THEKERNEL->serial->printf
 
 CallbackStream::CallbackStream(cb_t cb, void *u)
@@ -17,6 +18,8 @@ CallbackStream::CallbackStream(cb_t cb, void *u)
 CallbackStream::~CallbackStream()
 {
     DEBUG_PRINTF("Callbackstream dtor: %p\n", this);
+    // moves parsed ahead and held lines may still answer to this connection
+    THEKERNEL->gcode_dispatch->forget_stream(this);
 }
 
 int CallbackStream::puts(const char *s)
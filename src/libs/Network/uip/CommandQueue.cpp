@@ -7,6 +7,7 @@
 #include "Kernel.h"
 #include "libs/SerialMessage.h"
 #include "CallbackStream.h"
+#include "GcodeDispatch.h"
 
 static CommandQueue *command_queue_instance;
 CommandQueue *CommandQueue::instance = NULL;
@@ -43,10 +44,10 @@ int CommandQueue::add(const char *cmd, StreamOutput *pstream)
     return q.size();
 }
 
-// pops the next command off the queue and submits it.
+// pops the next command off the queue and submits it, unless the gcode dispatch has enough lines held already
 bool CommandQueue::pop()
 {
-    if (q.size() == 0) return false;
+    if (q.size() == 0 || !THEKERNEL->gcode_dispatch->can_take_line()) return false;
 
     cmd_t c= q.pop();
     char *cmd= c.str;
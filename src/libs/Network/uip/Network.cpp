@@ -188,13 +188,13 @@ void Network::on_module_loaded()
         }
     }
 
-    THEKERNEL->add_module( ethernet );
+    THEKERNEL->add_module( ethernet, "ethernet" );
     THEKERNEL->slow_ticker->attach( 100, this, &Network::tick );
 
     // Register for events
     this->register_for_event(ON_IDLE);
     this->register_for_event(ON_MAIN_LOOP);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_public_data(network_checksum);
 
     this->init();
 }
@@ -35,6 +35,8 @@
 #include "uip.h"
 #include "telnetd.h"
 #include "shell.h"
+#include "Kernel.h"
+#include "RealtimeCommands.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -304,7 +306,8 @@ void Telnetd::newdata(void)
             case STATE_NORMAL:
                 if (c == TELNET_IAC) {
                     state = STATE_IAC;
-                } else {
+                } else if (!THEKERNEL->realtime_commands->char_received(c, shell->getStream(), realtime_in_line)) {
+                    // realtime commands are acted on above rather than queued behind the received lines
                     get_char(c);
                 }
                 break;
@@ -335,6 +338,7 @@ Telnetd::Telnetd()
     }
 
     reporting_buffer = false;
+    realtime_in_line = false;
     first_time= true;
     bufptr = 0;
     state = STATE_NORMAL;
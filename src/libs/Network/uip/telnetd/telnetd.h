@@ -73,6 +73,9 @@ private:
 
     bool reporting_buffer;
 
+    // realtime commands are only recognised at the start of a line
+    bool realtime_in_line;
+
     int sendline(char *line);
     void acked(void);
     void senddata(void);
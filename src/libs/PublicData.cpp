@@ -2,9 +2,18 @@
 #include "PublicData.h"
 #include "PublicDataRequest.h"
 
+#include <algorithm>
+
+std::vector<PublicData::Provider> PublicData::providers;
+
+static bool key_less(const uint16_t a[3], const uint16_t b[3]) {
+    return std::lexicographical_compare(a, a + 3, b, b + 3);
+}
+
 bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void **data) {
     PublicDataRequest pdr(csa, csb, csc);
-    THEKERNEL->call_event(ON_GET_PUBLIC_DATA, &pdr );
+    if(!ask_providers(ON_GET_PUBLIC_DATA, &pdr, csa, csb, csc))
+        THEKERNEL->call_event(ON_GET_PUBLIC_DATA, &pdr );
     *data= pdr.get_data_ptr();
     return pdr.is_taken();
 }
@@ -12,6 +21,35 @@ bool PublicData::get_value(uint16_t csa, uint16_t csb, uint16_t csc, void **data
 bool PublicData::set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data) {
     PublicDataRequest pdr(csa, csb, csc);
     pdr.set_data_ptr(data);
-    THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
+    if(!ask_providers(ON_SET_PUBLIC_DATA, &pdr, csa, csb, csc))
+        THEKERNEL->call_event(ON_SET_PUBLIC_DATA, &pdr );
     return pdr.is_taken();
 }
+
+// A module answers the requests starting with csa, or csa and csb, or all three, csb and csc are 0 when not used
+void PublicData::add_provider(Module *module, uint16_t csa, uint16_t csb, uint16_t csc) {
+    Provider provider = {{csa, csb, csc}, module};
+    auto position = std::upper_bound(providers.begin(), providers.end(), provider,
+                                     [](const Provider &a, const Provider &b) { return key_less(a.key, b.key); });
+    providers.insert(position, provider);
+}
+
+// Ask the providers registered for the whole request, then for its first two checksums, then for the first one
+bool PublicData::ask_providers(int id_event, PublicDataRequest *pdr, uint16_t csa, uint16_t csb, uint16_t csc) {
+    const uint16_t keys[3][3] = {{csa, csb, csc}, {csa, csb, 0}, {csa, 0, 0}};
+
+    for(int i = 0; i < 3; i++) {
+        // a shorter request is the same key again
+        if(i > 0 && !key_less(keys[i], keys[i - 1])) continue;
+
+        Provider probe = {{keys[i][0], keys[i][1], keys[i][2]}, NULL};
+        auto range = std::equal_range(providers.begin(), providers.end(), probe,
+                                      [](const Provider &a, const Provider &b) { return key_less(a.key, b.key); });
+        for(auto p = range.first; p != range.second; ++p) {
+            (p->module->*kernel_callback_functions[id_event])(pdr);
+            if(pdr->is_taken()) return true;
+        }
+    }
+
+    return false;
+}
@@ -8,6 +8,14 @@
 #ifndef PUBLICDATA_H
 #define PUBLICDATA_H
 
+#include <stdint.h>
+#include <vector>
+
+class Module;
+class PublicDataRequest;
+
+// Requests go first to the modules that registered as providers for them, then, if none took it, to every module
+// registered for ON_GET_PUBLIC_DATA or ON_SET_PUBLIC_DATA
 class PublicData {
     public:
         static bool get_value(uint16_t csa, void **data) { return get_value(csa, 0, 0, data); }
@@ -19,6 +27,18 @@ class PublicData {
         static bool set_value(uint16_t csa, uint16_t csb, void *data) { return set_value(csa, csb, 0, data); }
         static bool set_value(uint16_t cs[3], void *data) { return set_value(cs[0], cs[1], cs[2], data); }
         static bool set_value(uint16_t csa, uint16_t csb, uint16_t csc, void *data);
+
+        static void add_provider(Module *module, uint16_t csa, uint16_t csb, uint16_t csc);
+
+    private:
+        // A module answering the requests starting with these checksums, the unused trailing ones are 0
+        struct Provider {
+            uint16_t key[3];
+            Module*  module;
+        };
+
+        static bool ask_providers(int id_event, PublicDataRequest *pdr, uint16_t csa, uint16_t csb, uint16_t csc);
+        static std::vector<Provider> providers; // sorted by key
 };
 
 #endif
@@ -1,10 +1,89 @@
 #include "Pwm.h"
 
 #include "nuts_bolts.h"
+#include "Kernel.h"
+#include "SlowTicker.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+
+#include <vector>
 
 #define PID_PWM_MAX 256
 
-// What ?
+#define laser_module_pin_checksum CHECKSUM("laser_module_pin")
+
+// The software modulated pins sharing a frequency. One slow ticker hook advances all of their accumulators, then
+// writes each GPIO port once, instead of one interrupt and one write per pin
+class PwmGroup {
+    public:
+        PwmGroup(uint32_t frequency) : frequency(frequency) {}
+        uint32_t tick(uint32_t dummy);
+
+        uint32_t frequency;
+        std::vector<Pwm*> pins;
+};
+
+static std::vector<PwmGroup*> pwm_groups;
+
+// PWM1 counts per period, 0 until a pin claims PWM1. All six channels share this period
+static uint32_t hardware_period = 0;
+static uint8_t  hardware_channels_used = 0;
+// Set by claim_pwm1() when something else runs PWM1, with a period of its own
+static bool     pwm1_claimed = false;
+
+static volatile uint32_t* const hardware_match[7] = {
+    &LPC_PWM1->MR0, &LPC_PWM1->MR1, &LPC_PWM1->MR2, &LPC_PWM1->MR3, &LPC_PWM1->MR4, &LPC_PWM1->MR5, &LPC_PWM1->MR6
+};
+
+static LPC_GPIO_TypeDef* const gpio_ports[5] = { LPC_GPIO0, LPC_GPIO1, LPC_GPIO2, LPC_GPIO3, LPC_GPIO4 };
+
+// PWM1 channel wired to a pin, and the PINSEL function selecting it, 0 if there is none
+static int hardware_channel(int port, int pin, int &function)
+{
+    if (port == 1) {
+        function = 2;
+        switch (pin) {
+            case 18: return 1;
+            case 20: return 2;
+            case 21: return 3;
+            case 23: return 4;
+            case 24: return 5;
+            case 26: return 6;
+        }
+    } else if (port == 2 && pin <= 5) {
+        function = 1;
+        return pin + 1;
+    } else if (port == 3) {
+        function = 3;
+        if (pin == 25) return 2;
+        if (pin == 26) return 3;
+    }
+    return 0;
+}
+
+uint32_t PwmGroup::tick(uint32_t dummy)
+{
+    uint32_t high[5] = { 0, 0, 0, 0, 0 };
+    uint32_t low[5]  = { 0, 0, 0, 0, 0 };
+
+    for (auto pin : this->pins) {
+        int out = pin->sigma_delta();
+        if (out < 0) continue; // set() digitally, leave it alone
+        if ((out != 0) != pin->inverting) {
+            high[pin->port_number] |= 1 << pin->pin;
+        } else {
+            low[pin->port_number]  |= 1 << pin->pin;
+        }
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (high[i]) gpio_ports[i]->FIOSET = high[i];
+        if (low[i])  gpio_ports[i]->FIOCLR = low[i];
+    }
+
+    return dummy;
+}
 
 Pwm::Pwm()
 {
@@ -12,17 +91,120 @@ Pwm::Pwm()
     _pwm = -1;
     _sd_direction= false;
     _sd_accumulator= 0;
+    _hardware_channel = 0;
+}
+
+// Start modulating the pin, at this frequency in Hz for software modulation
+Pwm* Pwm::frequency(uint32_t frequency)
+{
+    if (!this->connected() || this->_hardware_channel != 0 || frequency == 0) return this;
+
+    if (this->use_hardware(frequency)) return this;
+
+    PwmGroup *group = NULL;
+    for (auto g : pwm_groups) {
+        for (auto pin : g->pins) {
+            if (pin == this) return this; // already modulated
+        }
+        if (g->frequency == frequency) group = g;
+    }
+
+    if (group == NULL) {
+        group = new PwmGroup(frequency);
+        pwm_groups.push_back(group);
+        THEKERNEL->slow_ticker->attach(frequency, group, &PwmGroup::tick);
+    }
+
+    // the slow ticker may be walking the vector
+    __disable_irq();
+    group->pins.push_back(this);
+    __enable_irq();
+
+    return this;
+}
+
+// Drive the pin from its PWM1 channel if it has a free one, so it costs no interrupt at all. The channels share one
+// period, so only pins at the frequency of the first one get it, and none if the laser may take PWM1 for itself
+bool Pwm::use_hardware(uint32_t frequency)
+{
+    int function;
+    int channel = hardware_channel(this->port_number, this->pin, function);
+    if (channel == 0 || (hardware_channels_used & (1 << channel))) return false;
+
+    // The laser can be added at any time by selecting its toolhead, so look at its pin whether it is enabled or not
+    Pin laser;
+    laser.from_string(THEKERNEL->config->value(laser_module_pin_checksum)->by_default("nc")->as_string());
+    if (laser.connected() && laser.port_number == 2 && laser.pin <= 5) return false;
+
+    uint32_t period = (SystemCoreClock / 4) / frequency;
+    if (period < PID_PWM_MAX) return false;
+
+    if (hardware_period == 0) {
+        if (pwm1_claimed) return false;
+
+        LPC_SC->PCONP  |= 1 << 6;
+        LPC_PWM1->TCR   = 2;        // reset
+        LPC_PWM1->PR    = 0;
+        LPC_PWM1->MR0   = period;
+        LPC_PWM1->MCR   = 2;        // reset on MR0
+        LPC_PWM1->LER   = 1;
+        LPC_PWM1->TCR   = 1 | 8;    // counter and PWM mode enabled
+        hardware_period = period;
+    } else if (hardware_period != period) {
+        return false;
+    }
+
+    hardware_channels_used |= 1 << channel;
+    this->_hardware_channel = channel;
+
+    // Carry on from what the pin outputs now
+    if (_pwm >= 0) {
+        this->pwm(_pwm);
+    } else {
+        this->hardware_write(((this->port->FIOPIN >> this->pin) & 1) ? hardware_period : 0);
+    }
+
+    LPC_PWM1->PCR |= 1 << (8 + channel); // single edge, output enabled
+
+    volatile uint32_t *pinsel = &LPC_PINCON->PINSEL0 + (this->port_number * 2) + (this->pin / 16);
+    int shift = (this->pin % 16) * 2;
+    *pinsel = (*pinsel & ~(3 << shift)) | (function << shift);
+
+    return true;
+}
+
+// Whoever drives PWM1 directly, like the laser's mbed PwmOut, claims it first so no pin is put on it. Fails if pins
+// already are. PCONP says nothing about it, SystemInit powers PWM1 whether it is used or not
+bool Pwm::claim_pwm1()
+{
+    if (hardware_period != 0) return false;
+    pwm1_claimed = true;
+    return true;
+}
+
+// Counts the output is high for each period, latched at the start of the next one
+void Pwm::hardware_write(uint32_t high)
+{
+    // a match value past the period never resets the output, it stays high
+    if (high >= hardware_period) high = hardware_period + 1;
+    *hardware_match[_hardware_channel] = high;
+    LPC_PWM1->LER |= 1 << _hardware_channel;
 }
 
 void Pwm::pwm(int new_pwm)
 {
     _pwm = confine(new_pwm, 0, _max);
+
+    if (_hardware_channel != 0) {
+        uint32_t high = ((uint64_t)hardware_period * _pwm) / (PID_PWM_MAX - 1);
+        this->hardware_write(this->inverting ? hardware_period - high : high);
+    }
 }
 
 Pwm* Pwm::max_pwm(int new_max)
 {
     _max = confine(new_max, 0, PID_PWM_MAX - 1);
-    _pwm = confine(   _pwm, 0, _max);
+    this->pwm(_pwm);
     return this;
 }
 
@@ -34,21 +216,26 @@ int Pwm::max_pwm()
 void Pwm::set(bool value)
 {
     _pwm = -1;
+
+    if (_hardware_channel != 0) {
+        this->hardware_write((value != this->inverting) ? hardware_period : 0);
+        return;
+    }
+
     Pin::set(value);
 }
 
-uint32_t Pwm::on_tick(uint32_t dummy)
+// Advances the sigma-delta modulation, returns the next output, or -1 when the pin is set() digitally
+int Pwm::sigma_delta()
 {
     if ((_pwm < 0) || _pwm >= PID_PWM_MAX) {
-        return dummy;
+        return -1;
     }
     else if (_pwm == 0) {
-        Pin::set(false);
-        return dummy;
+        return 0;
     }
     else if (_pwm == PID_PWM_MAX - 1) {
-        Pin::set(true);
-        return dummy;
+        return 1;
     }
 
     /*
@@ -129,7 +316,5 @@ uint32_t Pwm::on_tick(uint32_t dummy)
         if (_sd_accumulator <= 0)
             _sd_direction = false;
     }
-    Pin::set(_sd_direction);
-
-    return dummy;
+    return _sd_direction ? 1 : 0;
 }
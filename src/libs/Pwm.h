@@ -6,24 +6,39 @@
 #include "Pin.h"
 #include "Module.h"
 
+class PwmGroup;
+
+// Sigma-delta modulated output. The software modulated pins at the same frequency are advanced together by one slow
+// ticker hook, a pin with a PWM1 channel is driven by it when possible instead
 class Pwm : public Module, public Pin {
 public:
     Pwm();
 
     void     on_module_load(void);
-    uint32_t on_tick(uint32_t);
 
+    Pwm*     frequency(uint32_t);
     Pwm*     max_pwm(int);
     int      max_pwm(void);
 
     void     pwm(int);
     void     set(bool);
 
+    bool     is_hardware(void) const { return _hardware_channel != 0; }
+
+    static bool claim_pwm1(void);
+
 private:
+    friend class PwmGroup;
+
+    int      sigma_delta(void);
+    bool     use_hardware(uint32_t frequency);
+    void     hardware_write(uint32_t high);
+
     int  _max;
     int  _pwm;
     int  _sd_accumulator;
     bool _sd_direction;
+    uint8_t _hardware_channel; // PWM1 channel, 0 when modulated in software
 };
 
 #endif /* _PWM_H */
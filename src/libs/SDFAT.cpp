@@ -1,12 +1,58 @@
 #include "SDFAT.h"
+#include "platform_memory.h"
 
-SDFAT::SDFAT(const char *n, MSD_Disk *disk) : mbed::FATFileSystem(n)
+#include <string.h>
+
+#define SECTOR_SIZE 512
+#define CACHE_BYTES (SDFAT_CACHE_SECTORS * SECTOR_SIZE)
+#define AHEAD_BYTES (SDFAT_READ_AHEAD_SECTORS * SECTOR_SIZE)
+
+// FatFs reads the FAT, directories and small pieces of files a sector at a time, the last few sectors it used are
+// kept here and written back to the disk later. Reads that go through a file sector after sector have the next ones
+// read in the background, in two windows so one is being filled while the other is used. Writes of several sectors,
+// which is how FatFs writes files, are copied into a window and written from there in the background, as are the
+// sectors written back. The card does one transfer at a time, the firmware only waits for it when it needs the card
+// again, or the memory being written from.
+//
+// USB mass storage goes through SharedDisk, so the host sees what the cache has yet to write back, and its writes
+// drop the sectors they replace. FatFs' own sector buffer and open files are only in step with the card again after
+// remount(), which M21 and the remount command do.
+
+SDFAT::SDFAT(const char *n, MSD_Disk *disk) : mbed::FATFileSystem(n), shared(this)
 {
     d = disk;
+
+    cache = (char *)AHB1.alloc(CACHE_BYTES + (2 * AHEAD_BYTES));
+    for (int i = 0; i < SDFAT_CACHE_SECTORS; i++) {
+        slots[i].valid = false;
+        slots[i].dirty = false;
+        slots[i].used = 0;
+    }
+    use_count = 0;
+
+    last_read = 0;
+    for (int i = 0; i < 2; i++) {
+        ahead_sector[i] = 0;
+        ahead_valid[i] = false;
+    }
+    transfer_window = -1;
+    transfer_slot = -1;
+    transfer_writing = false;
+    write_failed = false;
+}
+
+SDFAT::~SDFAT()
+{
+    flush_all();
+    invalidate();
+    if (cache != NULL)
+        AHB1.dealloc(cache);
 }
 
 int SDFAT::disk_initialize()
 {
+    // possibly another card, nothing cached is worth keeping
+    invalidate();
     return d->disk_initialize();
 }
 
@@ -17,26 +63,399 @@ int SDFAT::disk_status()
 
 int SDFAT::disk_read(char *buffer, int sector)
 {
-    return d->disk_read(buffer, sector);
+    return disk_read_blocks(buffer, sector, 1);
 }
 
 int SDFAT::disk_write(const char *buffer, int sector)
 {
-    return d->disk_write(buffer, sector);
+    return disk_write_blocks(buffer, sector, 1);
+}
+
+int SDFAT::disk_read_blocks(char *buffer, int sector, int count)
+{
+    if (cache == NULL)
+        return d->disk_read_blocks(buffer, sector, count);
+
+    // Several sectors at once are a large read of a file. Going on from the last read, they are taken a sector at a
+    // time so the read ahead keeps up, otherwise from the disk once it has what the cache holds. Through the windows,
+    // the buffer is rarely where the DMA reaches
+    if (count > 1) {
+        if ((uint32_t)sector == last_read + 1 || find_ahead(sector) >= 0) {
+            for (int i = 0; i < count; i++) {
+                if (disk_read_blocks(buffer + (i * SECTOR_SIZE), sector + i, 1))
+                    return 1;
+            }
+            return 0;
+        }
+        if (flush_range(sector, count))
+            return 1;
+        last_read = sector + count - 1;
+        for (int i = 0; i < count; i += SDFAT_READ_AHEAD_SECTORS) {
+            int n = count - i;
+            if (n > SDFAT_READ_AHEAD_SECTORS)
+                n = SDFAT_READ_AHEAD_SECTORS;
+            int window = free_window();
+            wait_transfer();
+            ahead_valid[window] = false;
+            if (d->disk_read_blocks(cache + CACHE_BYTES + (window * AHEAD_BYTES), sector + i, n))
+                return 1;
+            memcpy(buffer + (i * SECTOR_SIZE), cache + CACHE_BYTES + (window * AHEAD_BYTES), n * SECTOR_SIZE);
+            ahead_sector[window] = sector + i;
+            ahead_valid[window] = (n == SDFAT_READ_AHEAD_SECTORS);
+        }
+        return 0;
+    }
+
+    bool sequential = ((uint32_t)sector == last_read + 1);
+    last_read = sector;
+
+    int slot = find(sector);
+    if (slot >= 0) {
+        memcpy(buffer, cache + (slot * SECTOR_SIZE), SECTOR_SIZE);
+        slots[slot].used = ++use_count;
+        return 0;
+    }
+
+    int window = find_ahead(sector);
+    if (window >= 0) {
+        while (transfer_window == window && !transfer_writing);
+        if (ahead_valid[window]) {
+            memcpy(buffer, cache + CACHE_BYTES + (window * AHEAD_BYTES) + ((sector - ahead_sector[window]) * SECTOR_SIZE), SECTOR_SIZE);
+
+            // the reader got into this window, the other one is refilled with what comes after it
+            if ((uint32_t)sector == ahead_sector[window])
+                read_ahead(1 - window, sector + SDFAT_READ_AHEAD_SECTORS);
+            return 0;
+        }
+    }
+
+    slot = take_slot(sector);
+    if (slot < 0)
+        return 1;
+    if (d->disk_read(cache + (slot * SECTOR_SIZE), sector))
+        return 1;
+    slots[slot].valid = true;
+    slots[slot].dirty = false;
+    slots[slot].used = ++use_count;
+    memcpy(buffer, cache + (slot * SECTOR_SIZE), SECTOR_SIZE);
+
+    if (sequential && !is_fat(sector))
+        read_ahead(0, sector + 1);
+
+    return 0;
+}
+
+int SDFAT::disk_write_blocks(const char *buffer, int sector, int count)
+{
+    if (cache == NULL)
+        return d->disk_write_blocks(buffer, sector, count);
+
+    drop_ahead(sector, count);
+
+    // Several sectors at once are written from the windows, what the cache held of them is older
+    if (count > 1) {
+        for (int i = 0; i < count; i++) {
+            int slot = find(sector + i);
+            if (slot >= 0)
+                slots[slot].valid = false;
+        }
+        for (int i = 0; i < count; i += SDFAT_READ_AHEAD_SECTORS) {
+            int n = count - i;
+            if (n > SDFAT_READ_AHEAD_SECTORS)
+                n = SDFAT_READ_AHEAD_SECTORS;
+            if (write_behind(buffer + (i * SECTOR_SIZE), sector + i, n))
+                return 1;
+        }
+        return 0;
+    }
+
+    int slot = find(sector);
+    if (slot < 0)
+        slot = take_slot(sector);
+    if (slot < 0)
+        return 1;
+    // still being written back from
+    while (transfer_slot == slot);
+    memcpy(cache + (slot * SECTOR_SIZE), buffer, SECTOR_SIZE);
+    slots[slot].valid = true;
+    slots[slot].dirty = true;
+    slots[slot].used = ++use_count;
+    return 0;
 }
 
 int SDFAT::disk_sync()
 {
-    return d->disk_sync();
+    if (flush_all())
+        return 1;
+    wait_transfer();
+    bool failed = write_failed;
+    write_failed = false;
+    if (d->disk_sync())
+        return 1;
+    return failed ? 1 : 0;
 }
 
 int SDFAT::disk_sectors()
 {
     return d->disk_sectors();
 }
+
+// USB mass storage may have changed the card behind FatFs, what the firmware wrote is written back, and the rest read
+// again. The sectors the host wrote are no longer in the cache, nothing older is written over them
 int SDFAT::remount() {
+    flush_all();
+    invalidate();
     f_mount(_fsid, NULL);
     f_mount(_fsid, &_fs);
-    
+
 	return 0;
-}
\ No newline at end of file
+}
+
+uint32_t SDFAT::on_transfer_done(uint32_t error)
+{
+    if (error) {
+        if (transfer_window >= 0)
+            ahead_valid[transfer_window] = false;
+        if (transfer_writing)
+            write_failed = true;
+    }
+    transfer_window = -1;
+    transfer_slot = -1;
+    return 0;
+}
+
+bool SDFAT::is_fat(uint32_t sector)
+{
+    return (_fs.fs_type != 0) && (sector >= _fs.fatbase) && (sector < _fs.fatbase + (_fs.fsize * _fs.n_fats));
+}
+
+int SDFAT::find(uint32_t sector)
+{
+    for (int i = 0; i < SDFAT_CACHE_SECTORS; i++) {
+        if (slots[i].valid && slots[i].sector == sector)
+            return i;
+    }
+    return -1;
+}
+
+// A free slot for the sector, or the least recently used one once written back. FAT sectors only push out FAT sectors,
+// and the rest only the rest
+int SDFAT::take_slot(uint32_t sector)
+{
+    int first = is_fat(sector) ? 0 : SDFAT_CACHE_FAT_SECTORS;
+    int last  = is_fat(sector) ? SDFAT_CACHE_FAT_SECTORS : SDFAT_CACHE_SECTORS;
+
+    int slot = first;
+    for (int i = first; i < last; i++) {
+        if (!slots[i].valid) {
+            slot = i;
+            break;
+        }
+        if (slots[i].used < slots[slot].used)
+            slot = i;
+    }
+
+    if (flush(slot))
+        return -1;
+    while (transfer_slot == slot);
+    slots[slot].valid = false;
+    slots[slot].sector = sector;
+    return slot;
+}
+
+// Starts writing the slot back, it must not be changed or reused until transfer_slot moves on
+int SDFAT::flush(int slot)
+{
+    if (!slots[slot].valid || !slots[slot].dirty)
+        return 0;
+
+    FPointer done;
+    done.attach(this, &SDFAT::on_transfer_done);
+
+    wait_transfer();
+    transfer_slot = slot;
+    transfer_writing = true;
+    if (d->disk_write_async(cache + (slot * SECTOR_SIZE), slots[slot].sector, 1, done) != 0) {
+        transfer_slot = -1;
+        return 1;
+    }
+    slots[slot].dirty = false;
+    return 0;
+}
+
+int SDFAT::flush_range(uint32_t sector, uint32_t count)
+{
+    for (int i = 0; i < SDFAT_CACHE_SECTORS; i++) {
+        if (slots[i].valid && slots[i].sector >= sector && slots[i].sector < sector + count) {
+            if (flush(i))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+int SDFAT::flush_all()
+{
+    if (cache == NULL)
+        return 0;
+    return flush_range(0, 0xFFFFFFFF);
+}
+
+// Forgets these sectors, dirty ones included
+void SDFAT::forget(uint32_t sector, uint32_t count)
+{
+    if (cache == NULL)
+        return;
+    drop_ahead(sector, count);
+    for (int i = 0; i < SDFAT_CACHE_SECTORS; i++) {
+        if (slots[i].valid && slots[i].sector >= sector && slots[i].sector < sector + count)
+            slots[i].valid = false;
+    }
+}
+
+// Forgets everything, dirty sectors included
+void SDFAT::invalidate()
+{
+    wait_transfer();
+    for (int i = 0; i < 2; i++)
+        ahead_valid[i] = false;
+    for (int i = 0; i < SDFAT_CACHE_SECTORS; i++)
+        slots[i].valid = false;
+    last_read = 0;
+}
+
+// on_transfer_done() has to know what a transfer is for, so the next one only starts after it
+void SDFAT::wait_transfer()
+{
+    while (transfer_window >= 0 || transfer_slot >= 0);
+}
+
+int SDFAT::find_ahead(uint32_t sector)
+{
+    for (int i = 0; i < 2; i++) {
+        if (ahead_valid[i] && sector >= ahead_sector[i] && sector < ahead_sector[i] + SDFAT_READ_AHEAD_SECTORS)
+            return i;
+    }
+    return -1;
+}
+
+// The window no transfer is using, to copy into while the card is busy with the other
+int SDFAT::free_window()
+{
+    return (transfer_window == 0) ? 1 : 0;
+}
+
+// Starts filling a window, unless the card is still busy
+void SDFAT::read_ahead(int window, uint32_t sector)
+{
+    if (transfer_window >= 0 || transfer_slot >= 0)
+        return;
+    if (sector + SDFAT_READ_AHEAD_SECTORS > (uint32_t)d->disk_sectors())
+        return;
+
+    FPointer done;
+    done.attach(this, &SDFAT::on_transfer_done);
+
+    ahead_sector[window] = sector;
+    ahead_valid[window] = true;
+    transfer_window = window;
+    transfer_writing = false;
+    if (d->disk_read_async(cache + CACHE_BYTES + (window * AHEAD_BYTES), sector, SDFAT_READ_AHEAD_SECTORS, done) != 0) {
+        ahead_valid[window] = false;
+        transfer_window = -1;
+    }
+}
+
+// Copies the sectors into a window and starts writing them from there, the caller's buffer is free again on return.
+// A full window then holds them for reading too
+int SDFAT::write_behind(const char *buffer, uint32_t sector, int count)
+{
+    FPointer done;
+    done.attach(this, &SDFAT::on_transfer_done);
+
+    int window = free_window();
+    ahead_valid[window] = false;
+    memcpy(cache + CACHE_BYTES + (window * AHEAD_BYTES), buffer, count * SECTOR_SIZE);
+
+    wait_transfer();
+    ahead_sector[window] = sector;
+    ahead_valid[window] = (count == SDFAT_READ_AHEAD_SECTORS);
+    transfer_window = window;
+    transfer_writing = true;
+    if (d->disk_write_async(cache + CACHE_BYTES + (window * AHEAD_BYTES), sector, count, done) != 0) {
+        ahead_valid[window] = false;
+        transfer_window = -1;
+        return 1;
+    }
+    return 0;
+}
+
+// Windows holding any of these sectors are out of date. One still being read or written is left to finish, the card
+// does the transfers in order and nothing is copied into it meanwhile
+void SDFAT::drop_ahead(uint32_t sector, uint32_t count)
+{
+    for (int i = 0; i < 2; i++) {
+        if (ahead_sector[i] < sector + count && sector < ahead_sector[i] + SDFAT_READ_AHEAD_SECTORS)
+            ahead_valid[i] = false;
+    }
+}
+
+// SHARED DISK
+
+int SDFAT::SharedDisk::disk_initialize()
+{
+    return fs->d->disk_initialize();
+}
+
+int SDFAT::SharedDisk::disk_status()
+{
+    return fs->d->disk_status();
+}
+
+int SDFAT::SharedDisk::disk_read(char *buffer, uint32_t block)
+{
+    return disk_read_blocks(buffer, block, 1);
+}
+
+int SDFAT::SharedDisk::disk_write(const char *buffer, uint32_t block)
+{
+    return disk_write_blocks(buffer, block, 1);
+}
+
+int SDFAT::SharedDisk::disk_read_blocks(char *buffer, uint32_t block, uint32_t count)
+{
+    if (fs->flush_range(block, count))
+        return 1;
+    return fs->d->disk_read_blocks(buffer, block, count);
+}
+
+int SDFAT::SharedDisk::disk_write_blocks(const char *buffer, uint32_t block, uint32_t count)
+{
+    fs->forget(block, count);
+    return fs->d->disk_write_blocks(buffer, block, count);
+}
+
+int SDFAT::SharedDisk::disk_sync()
+{
+    return fs->d->disk_sync();
+}
+
+uint32_t SDFAT::SharedDisk::disk_sectors()
+{
+    return fs->d->disk_sectors();
+}
+
+uint64_t SDFAT::SharedDisk::disk_size()
+{
+    return fs->d->disk_size();
+}
+
+uint32_t SDFAT::SharedDisk::disk_blocksize()
+{
+    return fs->d->disk_blocksize();
+}
+
+bool SDFAT::SharedDisk::busy()
+{
+    return fs->d->busy();
+}
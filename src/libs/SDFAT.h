@@ -4,21 +4,98 @@
 #include "disk.h"
 #include "FATFileSystem.h"
 
+// Sectors kept in AHB RAM, the first few only for the FAT so scanning through data does not push them out
+#define SDFAT_CACHE_SECTORS         8
+#define SDFAT_CACHE_FAT_SECTORS     2
+// Once sectors are read one after the other, the next ones are read in the background into two windows of this many.
+// Writes of several sectors go through the same windows
+#define SDFAT_READ_AHEAD_SECTORS    4
+
 class SDFAT : public mbed::FATFileSystem {
 public:
     SDFAT(const char *n, MSD_Disk *disk);
+    virtual ~SDFAT();
 
     virtual int disk_initialize();
     virtual int disk_status();
     virtual int disk_read(char *buffer, int sector);
     virtual int disk_write(const char *buffer, int sector);
+    virtual int disk_read_blocks(char *buffer, int sector, int count);
+    virtual int disk_write_blocks(const char *buffer, int sector, int count);
     virtual int disk_sync();
     virtual int disk_sectors();
 
-    int remount();
+    int remount();          // Writes back and forgets the cache too, the card may have been changed over USB
+
+    uint32_t on_transfer_done(uint32_t error);
+
+    // What USB mass storage reads and writes the card through. The host reads what the cache has yet to write back,
+    // and what the host writes replaces what the cache held of it
+    class SharedDisk : public MSD_Disk {
+    public:
+        SharedDisk(SDFAT *f) : fs(f) {}
+
+        virtual int disk_initialize();
+        virtual int disk_status();
+        virtual int disk_read(char *buffer, uint32_t block);
+        virtual int disk_write(const char *buffer, uint32_t block);
+        virtual int disk_read_blocks(char *buffer, uint32_t block, uint32_t count);
+        virtual int disk_write_blocks(const char *buffer, uint32_t block, uint32_t count);
+        virtual int disk_sync();
+        virtual uint32_t disk_sectors();
+        virtual uint64_t disk_size();
+        virtual uint32_t disk_blocksize();
+        virtual bool busy();
+
+    private:
+        SDFAT *fs;
+    };
+    MSD_Disk *usb_disk() { return &shared; }
 
 protected:
+    // A sector in the cache, dirty ones are written back when pushed out or on disk_sync(), in the background
+    struct CacheSlot {
+        uint32_t sector;
+        uint32_t used;      // use_count when last used, the lowest is pushed out first
+        bool valid;
+        bool dirty;
+    };
+
+    bool is_fat(uint32_t sector);
+    int find(uint32_t sector);
+    int take_slot(uint32_t sector);
+    int flush(int slot);
+    int flush_range(uint32_t sector, uint32_t count);
+    int flush_all();
+    void forget(uint32_t sector, uint32_t count);
+    void invalidate();
+    void wait_transfer();
+
+    int find_ahead(uint32_t sector);
+    int free_window();
+    void read_ahead(int window, uint32_t sector);
+    int write_behind(const char *buffer, uint32_t sector, int count);
+    void drop_ahead(uint32_t sector, uint32_t count);
+
     MSD_Disk *d;
+    SharedDisk shared;
+
+    // SDFAT_CACHE_SECTORS sectors then the two windows, in AHB1 where the DMA reaches. NULL if it did not fit,
+    // everything then goes straight to the disk
+    char *cache;
+    CacheSlot slots[SDFAT_CACHE_SECTORS];
+    uint32_t use_count;
+
+    uint32_t last_read;             // The last sector read on its own, to spot reads going through a file
+    uint32_t ahead_sector[2];       // First sector of each window
+    volatile bool ahead_valid[2];   // Cleared by on_transfer_done() if the read failed
+
+    // The card does one transfer at a time, what is being read or written until on_transfer_done(): a window, or a
+    // slot written back. -1 for neither
+    volatile int transfer_window;
+    volatile int transfer_slot;
+    bool transfer_writing;
+    volatile bool write_failed;     // A write in the background failed, disk_sync() reports it
 };
 
 #endif /* _SDFAT_H */
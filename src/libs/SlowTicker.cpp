@@ -20,87 +20,168 @@ using namespace std;
 
 // This module uses a Timer to periodically call hooks
 // Modules register with a function ( callback ) and a frequency, and we then call that function at the given frequency.
+// The timer runs freely, and its match register is set to the deadline of the next hook due, so the interrupt only
+// happens when a hook has to be called, instead of at the highest frequency with every hook counting down.
 
 SlowTicker* global_slow_ticker;
 
 SlowTicker::SlowTicker(){
-    max_frequency = 0;
     global_slow_ticker = this;
-
+    queue = NULL;
+    resync = NULL;
+    wakes = 0;
 
     // ISP button FIXME: WHy is this here?
     ispbtn.from_string("2.10")->as_input()->pull_up();
 
     // TODO: What is this ??
     flag_1s_flag = 0;
-    flag_1s_count = SystemCoreClock>>2;
 
     g4_ticks = 0;
+    g4_last = 0;
     g4_pause = false;
 
     // Configure the actual timer after setup to avoid race conditions
     LPC_SC->PCONP |= (1 << 22);     // Power Ticker ON
-    LPC_TIM2->MR0 = 10000;          // Initial dummy value for Match Register
-    LPC_TIM2->MCR = 3;              // Match on MR0, reset on MR0
+    LPC_TIM2->MR0 = 0xFFFFFFFF;     // Nothing due yet
+    LPC_TIM2->MCR = 1;              // Interrupt on MR0, the counter keeps running
     LPC_TIM2->TCR = 1;              // Enable interrupt
     NVIC_EnableIRQ(TIMER2_IRQn);    // Enable interrupt handler
+
+    this->attach(1, this, &SlowTicker::second_tick);
+    this->attach(20, this, &SlowTicker::ispbtn_tick);
 }
 
 void SlowTicker::on_module_loaded(){
     register_for_event(ON_IDLE);
-    register_for_event(ON_GCODE_RECEIVED);
+    register_for_gcode('G', 4);
     register_for_event(ON_GCODE_EXECUTE);
 }
 
-// Set the base frequency we use for all sub-frequencies
-void SlowTicker::set_frequency( int frequency ){
-    this->interval = (SystemCoreClock >> 2) / frequency;   // SystemCoreClock/4 = Timer increments in a second
-    LPC_TIM2->MR0 = this->interval;
-    LPC_TIM2->TCR = 3;  // Reset
-    LPC_TIM2->TCR = 1;  // Reset
-    flag_1s_count= SystemCoreClock>>2;
+void SlowTicker::add_hook(Hook* hook){
+    // to avoid race conditions we must stop the interupts before updating this non thread safe vector and the queue
+    __disable_irq();
+
+    // hooks at the same frequency are called together and in the order they were attached, the acceleration tick
+    // hooks rely on it
+    hook->deadline = LPC_TIM2->TC + hook->interval;
+    for (auto h : this->hooks) {
+        if (h->interval == hook->interval) {
+            hook->deadline = h->deadline;
+            break;
+        }
+    }
+
+    this->hooks.push_back(hook);
+    this->insert(hook);
+    this->schedule();
+    __enable_irq();
+}
+
+// Keep the queue ordered by deadline, after the hooks due at the same time
+void SlowTicker::insert(Hook* hook){
+    Hook** position = &this->queue;
+    while (*position != NULL && (int32_t)((*position)->deadline - hook->deadline) <= 0) {
+        position = &(*position)->next;
+    }
+    hook->next = *position;
+    *position = hook;
+}
+
+void SlowTicker::remove(Hook* hook){
+    Hook** position = &this->queue;
+    while (*position != NULL && *position != hook) {
+        position = &(*position)->next;
+    }
+    if (*position != NULL) *position = hook->next;
+}
+
+// The step interrupt calls this, above ours, so it may come in the middle of tick(): it only leaves the hook for
+// tick() to move, and has it run now. The timer itself keeps running, the other hooks' deadlines stay as they are
+void SlowTicker::call_now(Hook* hook){
+    this->resync = hook;
+    NVIC_SetPendingIRQ(TIMER2_IRQn);
+}
+
+// Set the timer to interrupt when the next hook is due
+void SlowTicker::schedule(){
+    if (this->queue == NULL) return;
+
+    LPC_TIM2->MR0 = this->queue->deadline;
+
+    // the deadline went by while we were setting it, the match would only come once the counter wraps
+    if ((int32_t)(this->queue->deadline - LPC_TIM2->TC) <= 0) {
+        NVIC_SetPendingIRQ(TIMER2_IRQn);
+    }
 }
 
 // The actual interrupt being called by the timer, this is where work is done
 void SlowTicker::tick(){
+    this->wakes++;
 
-    // Call all hooks that need to be called ( bresenham )
-    for (uint32_t i=0; i<this->hooks.size(); i++){
-        Hook* hook = this->hooks.at(i);
-        hook->countdown -= this->interval;
-        if (hook->countdown < 0)
-        {
-            hook->countdown += hook->interval;
-            hook->call();
+    uint32_t now = LPC_TIM2->TC;
+
+    // A hook asked to be called now, with the hooks at its frequency that are called together with it
+    __disable_irq();
+    Hook* moved = this->resync;
+    this->resync = NULL;
+    __enable_irq();
+    if (moved != NULL) {
+        uint32_t deadline = moved->deadline;
+        for (auto hook : this->hooks) {
+            if (hook->interval == moved->interval && hook->deadline == deadline) {
+                this->remove(hook);
+                hook->deadline = now;
+                this->insert(hook);
+            }
         }
     }
 
-    // deduct tick time from secound counter
-    flag_1s_count -= this->interval;
-    // if a whole second has elapsed,
-    if (flag_1s_count < 0)
-    {
-        // add a second to our counter
-        flag_1s_count += SystemCoreClock >> 2;
-        // and set a flag for idle event to pick up
-        flag_1s_flag++;
+    // Call the hooks that are due
+    while (this->queue != NULL && (int32_t)(this->queue->deadline - now) <= 0) {
+        Hook* hook = this->queue;
+        this->queue = hook->next;
+
+        uint32_t start = DWT->CYCCNT;
+        hook->call();
+        uint32_t cycles = DWT->CYCCNT - start;
+        hook->calls++;
+        hook->cycles += cycles;
+        if (cycles > hook->max_cycles) hook->max_cycles = cycles;
+
+        hook->deadline += hook->interval;
+        // after a long stall ( the debugger ) do not call it over and over to catch up
+        if ((int32_t)(hook->deadline - now) <= 0) hook->deadline = now + hook->interval;
+        this->insert(hook);
     }
 
-    // if we're counting down a pause
-    if (g4_ticks > 0)
-    {
-        // deduct tick time from timeout
-        if (g4_ticks > interval)
-            g4_ticks -= interval;
-        else
-            g4_ticks = 0;
+    this->schedule();
+}
+
+// Start profiling the hooks over
+void SlowTicker::reset_profile(){
+    __disable_irq();
+    for (auto hook : this->hooks) {
+        hook->calls = 0;
+        hook->max_cycles = 0;
+        hook->cycles = 0;
     }
+    this->wakes = 0;
+    __enable_irq();
+}
+
+// A whole second has elapsed, set a flag for idle event to pick up
+uint32_t SlowTicker::second_tick(uint32_t dummy){
+    flag_1s_flag++;
+    return 0;
+}
 
-    // Enter MRI mode if the ISP button is pressed
-    // TODO: This should have it's own module
+// Enter MRI mode if the ISP button is pressed
+// TODO: This should have it's own module
+uint32_t SlowTicker::ispbtn_tick(uint32_t dummy){
     if (ispbtn.get() == 0)
         __debugbreak();
-
+    return 0;
 }
 
 bool SlowTicker::flag_1s(){
@@ -137,11 +218,22 @@ void SlowTicker::on_idle(void*)
         // fire the on_second_tick event
         THEKERNEL->call_event(ON_SECOND_TICK);
 
-    // if G4 has finished, release our pause
-    if (g4_pause && (g4_ticks == 0))
+    // if we're counting down a pause, deduct the time since we last did
+    if (g4_pause)
     {
-        g4_pause = false;
-        THEKERNEL->pauser->release();
+        uint32_t now = LPC_TIM2->TC;
+        __disable_irq(); // a G4 may be adding to it
+        uint32_t elapsed = now - g4_last;
+        g4_last = now;
+        g4_ticks = (g4_ticks > elapsed) ? g4_ticks - elapsed : 0;
+        __enable_irq();
+
+        // if G4 has finished, release our pause
+        if (g4_ticks == 0)
+        {
+            g4_pause = false;
+            THEKERNEL->pauser->release();
+        }
     }
 }
 
@@ -176,6 +268,7 @@ void SlowTicker::on_gcode_execute(void* argument){
                 // G4 Smm Pnn should pause for mm seconds + nn milliseconds
                 // at 120MHz core clock, the longest possible delay is (2^32 / (120MHz / 4)) = 143 seconds
                 if (!g4_pause){
+                    g4_last = LPC_TIM2->TC;
                     g4_pause = true;
                     THEKERNEL->pauser->take();
                 }
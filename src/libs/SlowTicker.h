@@ -30,7 +30,6 @@ class SlowTicker : public Module{
         void on_gcode_received(void*);
         void on_gcode_execute(void*);
 
-        void set_frequency( int frequency );
         void tick();
         // For some reason this can't go in the .cpp, see :  http://mbed.org/forum/mbed/topic/2774/?page=1#comment-14221
         // TODO replace this with std::function()
@@ -38,32 +37,38 @@ class SlowTicker : public Module{
             Hook* hook = new Hook();
             hook->interval = int(floor((SystemCoreClock/4)/frequency));
             hook->attach(optr, fptr);
-            hook->countdown = hook->interval;
-
-            // to avoid race conditions we must stop the interupts before updating this non thread safe vector
-            __disable_irq();
-            if( frequency > this->max_frequency ){
-                this->max_frequency = frequency;
-                this->set_frequency(frequency);
-            }
-            this->hooks.push_back(hook);
-            __enable_irq();
+            this->add_hook(hook);
             return hook;
         }
 
+        // Call the hook, and those called together with it, right away and then every interval from there
+        void call_now(Hook* hook);
+
+        // In the order they were attached, for reports
+        const vector<Hook*>& get_hooks() const { return this->hooks; }
+        uint32_t get_wakes() const { return this->wakes; }
+        void reset_profile();
+
     private:
+        void add_hook(Hook* hook);
+        void insert(Hook* hook);
+        void remove(Hook* hook);
+        void schedule();
+        uint32_t second_tick(uint32_t dummy);
+        uint32_t ispbtn_tick(uint32_t dummy);
         bool flag_1s();
 
         vector<Hook*> hooks;
-        uint32_t max_frequency;
-        uint32_t interval;
+        Hook* queue;            // the next hook due, then the others by deadline
+        Hook* volatile resync;  // to be moved to now by the next tick(), see call_now()
+        uint32_t wakes;         // interrupts taken
 
         uint32_t g4_ticks;
+        uint32_t g4_last;       // when g4_ticks was last counted down
         bool     g4_pause;
 
         Pin ispbtn;
 protected:
-    int flag_1s_count;
     volatile int flag_1s_flag;
 };
 
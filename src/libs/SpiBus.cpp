@@ -0,0 +1,280 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SpiBus.h"
+#include "libs/Pin.h"
+#include "libs/Gpdma.h"
+#include "libs/nuts_bolts.h"
+#include "mri.h"
+
+#define SSP_SR_TNF  (1 << 1)
+#define SSP_SR_RNE  (1 << 2)
+#define SSP_SR_BSY  (1 << 4)
+
+// Most the GPDMA moves in one go
+#define SPIBUS_MAX_CHUNK 4095
+
+SpiBus* SpiBus::buses[2] = { NULL, NULL };
+
+// Sent when a transaction has nothing to send, and where what it does not want goes. The GPDMA cannot reach the
+// local RAM, and AHB RAM is only zeroed at startup, so dummy_tx is set by the constructor
+static uint8_t dummy_tx __attribute__ ((section ("AHBSRAM0")));
+static uint8_t dummy_rx __attribute__ ((section ("AHBSRAM0")));
+
+static void pin_function(int port, int pin, int function)
+{
+    volatile uint32_t *pinsel = &LPC_PINCON->PINSEL0 + (port * 2) + (pin / 16);
+    int shift = (pin % 16) * 2;
+    *pinsel = (*pinsel & ~(3 << shift)) | (function << shift);
+}
+
+SpiBus* SpiBus::get(PinName mosi, PinName miso, PinName sclk)
+{
+    int ssp;
+    if (mosi == P0_9 && miso == P0_8 && sclk == P0_7) {
+        ssp = 1;
+    } else if ((mosi == P0_18 && miso == P0_17 && sclk == P0_15) || (mosi == P1_24 && miso == P1_23 && sclk == P1_20)) {
+        ssp = 0;
+    } else {
+        return NULL;
+    }
+
+    if (buses[ssp] == NULL) buses[ssp] = new SpiBus(ssp);
+
+    // Route the pins, the same SSP can come out on more than one set of them
+    if (ssp == 1) {
+        pin_function(0, 7, 2); pin_function(0, 8, 2); pin_function(0, 9, 2);
+    } else if (sclk == P0_15) {
+        pin_function(0, 15, 2); pin_function(0, 17, 2); pin_function(0, 18, 2);
+    } else {
+        pin_function(1, 20, 3); pin_function(1, 23, 3); pin_function(1, 24, 3);
+    }
+
+    return buses[ssp];
+}
+
+SpiBus* SpiBus::get(int channel)
+{
+    if (channel == 1) return get(P0_9, P0_8, P0_7);
+    return get(P0_18, P0_17, P0_15);
+}
+
+SpiBus::SpiBus(int ssp)
+{
+    static const uint8_t pclk_dividers[4] = { 4, 1, 2, 8 };
+    if (ssp == 0) {
+        LPC_SC->PCONP |= (1 << 21);
+        this->ssp        = LPC_SSP0;
+        this->pclk       = SystemCoreClock / pclk_dividers[(LPC_SC->PCLKSEL1 >> 10) & 3];
+        this->rx_channel = GPDMA_SSP0_RX_CHANNEL;
+        this->tx_channel = GPDMA_SSP0_TX_CHANNEL;
+        this->rx_request = GPDMA_REQUEST_SSP0_RX;
+        this->tx_request = GPDMA_REQUEST_SSP0_TX;
+    } else {
+        LPC_SC->PCONP |= (1 << 10);
+        this->ssp        = LPC_SSP1;
+        this->pclk       = SystemCoreClock / pclk_dividers[(LPC_SC->PCLKSEL0 >> 20) & 3];
+        this->rx_channel = GPDMA_SSP1_RX_CHANNEL;
+        this->tx_channel = GPDMA_SSP1_TX_CHANNEL;
+        this->rx_request = GPDMA_REQUEST_SSP1_RX;
+        this->tx_request = GPDMA_REQUEST_SSP1_TX;
+    }
+
+    dummy_tx = 0xFF;
+
+    this->current = this->head = this->tail = NULL;
+    this->offset = this->chunk = 0;
+    this->active = false;
+    this->held = false;
+
+    // 8 bits, SPI mode 0, master
+    this->ssp->CR1   = 0;
+    this->ssp->CR0   = 7;
+    this->ssp->DMACR = 0;
+    this->frequency  = 0;
+    this->set_frequency(1000000);
+    this->ssp->CR1   = (1 << 1);
+
+    Gpdma::attach(this->rx_channel, this, &SpiBus::on_dma_done);
+}
+
+// Only while nothing is being transferred
+void SpiBus::set_frequency(uint32_t frequency)
+{
+    if (frequency == this->frequency || frequency == 0) return;
+    this->frequency = frequency;
+
+    // SSP clock is pclk / ( CPSR * ( SCR + 1 ) ), with an even CPSR from 2 to 254 and SCR from 0 to 255
+    uint32_t divider = (this->pclk + frequency - 1) / frequency;
+    uint32_t prescale = 2;
+    while (((divider + prescale - 1) / prescale) > 256 && prescale < 254) prescale += 2;
+    uint32_t scr = confine((divider + prescale - 1) / prescale, 1U, 256U) - 1;
+
+    this->ssp->CPSR = prescale;
+    this->ssp->CR0  = (this->ssp->CR0 & 0xFF) | (scr << 8);
+}
+
+void SpiBus::queue(SpiTransaction* transaction)
+{
+    transaction->busy = true;
+    transaction->failed = false;
+    transaction->next = NULL;
+
+    __disable_irq();
+    if (this->tail) {
+        this->tail->next = transaction;
+    } else {
+        this->head = transaction;
+    }
+    this->tail = transaction;
+
+    if (!this->active && !this->held) this->start_next();
+    __enable_irq();
+}
+
+void SpiBus::transfer(SpiTransaction* transaction)
+{
+    this->queue(transaction);
+    while (transaction->busy);
+}
+
+// The holder's transaction goes ahead of the queue, which waits for release() anyway
+void SpiBus::exchange(SpiTransaction* transaction)
+{
+    transaction->busy = true;
+    transaction->failed = false;
+    transaction->next = NULL;
+
+    __disable_irq();
+    this->start(transaction);
+    __enable_irq();
+}
+
+void SpiBus::start_next()
+{
+    SpiTransaction* transaction = this->head;
+    this->head = transaction->next;
+    if (this->head == NULL) this->tail = NULL;
+    this->start(transaction);
+}
+
+// Select the transaction's device and start moving its bytes
+void SpiBus::start(SpiTransaction* transaction)
+{
+    this->current = transaction;
+    this->active = true;
+    this->set_frequency(transaction->frequency);
+
+    // Whatever is left in the receive FIFO is not for this transaction
+    while (this->ssp->SR & SSP_SR_RNE) (void)this->ssp->DR;
+
+    if (transaction->cs) transaction->cs->set(false);
+    this->offset = 0;
+    this->start_chunk();
+}
+
+void SpiBus::start_chunk()
+{
+    SpiTransaction* transaction = this->current;
+    uint32_t remaining = transaction->length - this->offset;
+    this->chunk = remaining > SPIBUS_MAX_CHUNK ? SPIBUS_MAX_CHUNK : remaining;
+
+    // Receive first, so nothing sent is received before the DMA is there to take it
+    LPC_GPDMACH_TypeDef* rx = Gpdma::channel(this->rx_channel);
+    rx->DMACCSrcAddr  = (uint32_t) &this->ssp->DR;
+    rx->DMACCDestAddr = transaction->rx ? (uint32_t) (transaction->rx + this->offset) : (uint32_t) &dummy_rx;
+    rx->DMACCLLI      = 0;
+    rx->DMACCControl  = this->chunk | GPDMA_CONTROL_BURST_4 | (transaction->rx ? GPDMA_CONTROL_DST_INC : 0) | GPDMA_CONTROL_INTERRUPT;
+    rx->DMACCConfig   = GPDMA_CONFIG_ENABLE | GPDMA_CONFIG_SRC_REQUEST(this->rx_request) | GPDMA_CONFIG_PERIPHERAL_TO_MEMORY | GPDMA_CONFIG_INTERRUPTS;
+
+    LPC_GPDMACH_TypeDef* tx = Gpdma::channel(this->tx_channel);
+    tx->DMACCSrcAddr  = transaction->tx ? (uint32_t) (transaction->tx + this->offset) : (uint32_t) &dummy_tx;
+    tx->DMACCDestAddr = (uint32_t) &this->ssp->DR;
+    tx->DMACCLLI      = 0;
+    tx->DMACCControl  = this->chunk | GPDMA_CONTROL_BURST_4 | (transaction->tx ? GPDMA_CONTROL_SRC_INC : 0);
+    tx->DMACCConfig   = GPDMA_CONFIG_ENABLE | GPDMA_CONFIG_DST_REQUEST(this->tx_request) | GPDMA_CONFIG_MEMORY_TO_PERIPHERAL;
+
+    this->ssp->DMACR = 3;
+}
+
+// The receive channel is done, so every byte of the chunk went both ways
+uint32_t SpiBus::on_dma_done(uint32_t error)
+{
+    SpiTransaction* transaction = this->current;
+    if (!this->active || transaction == NULL) return 0;
+
+    this->offset += this->chunk;
+    if (!error && this->offset < transaction->length) {
+        this->start_chunk();
+        return 0;
+    }
+
+    this->ssp->DMACR = 0;
+    Gpdma::channel(this->tx_channel)->DMACCConfig = 0;
+    if (transaction->cs) transaction->cs->set(true);
+
+    this->current = NULL;
+    this->active = false;
+
+    transaction->failed = (error != 0);
+    transaction->busy = false;
+    transaction->done.call(error);
+
+    // Unless the callback exchanged another transaction, or released the bus, which starts the next one itself
+    if (!this->active && !this->held && this->head) this->start_next();
+    return 0;
+}
+
+// Waits for the bus to be free and the transaction in progress, then keeps the bus until release(). From an interrupt
+// the holder or the DMA interrupt might never get to run again, so that is a bug
+void SpiBus::acquire(uint32_t frequency)
+{
+    if (__get_IPSR() != 0)
+        __debugbreak();
+
+    while (true) {
+        __disable_irq();
+        if (!this->held) break;
+        __enable_irq();
+    }
+    this->held = true;
+    __enable_irq();
+
+    while (this->active);
+    this->set_frequency(frequency);
+}
+
+// Keeps the bus until release() only if nobody has it and nothing is being transferred, without waiting for either
+bool SpiBus::try_acquire(uint32_t frequency)
+{
+    __disable_irq();
+    if (this->held || this->active) {
+        __enable_irq();
+        return false;
+    }
+    this->held = true;
+    __enable_irq();
+
+    this->set_frequency(frequency);
+    return true;
+}
+
+uint8_t SpiBus::write(uint8_t data)
+{
+    while (!(this->ssp->SR & SSP_SR_TNF));
+    this->ssp->DR = data;
+    while (!(this->ssp->SR & SSP_SR_RNE));
+    return this->ssp->DR;
+}
+
+void SpiBus::release()
+{
+    __disable_irq();
+    this->held = false;
+    if (!this->active && this->head) this->start_next();
+    __enable_irq();
+}
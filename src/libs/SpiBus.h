@@ -0,0 +1,84 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPIBUS_H
+#define SPIBUS_H
+
+#include <stdint.h>
+
+#include "libs/LPC17xx/sLPC17xx.h" // smoothed mbed.h lib
+#include "PinNames.h" // mbed.h lib
+#include "libs/FPointer.h"
+
+class Pin;
+
+// One transfer on a SpiBus, the device's chip select is held low for its whole length. The GPDMA only reaches the
+// AHB RAM, so tx and rx must be in AHB0, AHB1 or an AHBSRAM section
+class SpiTransaction {
+    public:
+        SpiTransaction() : tx(NULL), rx(NULL), length(0), frequency(1000000), cs(NULL), busy(false), failed(false), next(NULL) {}
+
+        const uint8_t* tx;      // Bytes sent, 0xFF is sent if NULL
+        uint8_t* rx;            // Bytes received, dropped if NULL
+        uint16_t length;
+        uint32_t frequency;     // Clock in Hz, the bus goes as close as it can without exceeding it
+        Pin* cs;                // Set low during the transfer, and high after, if not NULL
+        FPointer done;          // Called from the DMA interrupt once the transfer is over, may queue another one
+
+        volatile bool busy;     // From being queued until done
+        volatile bool failed;   // The DMA hit a bus error, what was received is not valid
+
+        SpiTransaction* next;
+};
+
+// An SSP peripheral shared by every device wired to it. Transactions are queued from anywhere, interrupts included,
+// and the GPDMA moves them while the processor does something else. Drivers that talk a byte at a time acquire()
+// the bus for as long as their chip select is low, or try_acquire() it from an interrupt and come back later if it is
+// taken. Queued transactions wait until they release() it. While it has the bus, a driver can also exchange()
+// transactions, and keep it across interrupts until the last one is done.
+class SpiBus {
+    public:
+        // The bus on these pins, or on spi_channel 0 or 1 as the configuration names them. NULL if there is no SSP there
+        static SpiBus* get(PinName mosi, PinName miso, PinName sclk);
+        static SpiBus* get(int channel);
+
+        void queue(SpiTransaction* transaction);
+        void transfer(SpiTransaction* transaction); // Queue and wait, not from an interrupt
+
+        void acquire(uint32_t frequency);           // Not from an interrupt, waits for any other holder to release()
+        bool try_acquire(uint32_t frequency);       // Interrupts included, false if the bus is not free right now
+        uint8_t write(uint8_t data);                // Only while acquired, and nothing is being exchanged
+        void exchange(SpiTransaction* transaction); // Starts right away, only while acquired, interrupts included
+        void release();
+
+        uint32_t on_dma_done(uint32_t error);
+
+    private:
+        SpiBus(int ssp);
+        void set_frequency(uint32_t frequency);
+        void start(SpiTransaction* transaction);
+        void start_next();
+        void start_chunk();
+
+        LPC_SSP_TypeDef* ssp;
+        uint32_t pclk;
+        uint32_t frequency;
+        int rx_channel, tx_channel;
+        int rx_request, tx_request;
+
+        SpiTransaction* current;    // Being transferred while active
+        SpiTransaction* head;       // Waiting
+        SpiTransaction* tail;
+        uint16_t offset;            // Bytes of the current transaction already moved
+        uint16_t chunk;             // Bytes the DMA is moving now
+        volatile bool active;
+        volatile bool held;
+
+        static SpiBus* buses[2];
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "StepTicker.h"
 
 #include <math.h>
+#include "LPC17xx.h"
 
 // A StepperMotor represents an actual stepper motor. It is used to generate steps that move the actual motor at a given speed
 // TODO : Abstract this into Actuator
@@ -20,18 +21,21 @@ StepperMotor::StepperMotor(){
     this->paused = false;
     this->fx_counter = 0;
     this->stepped = 0;
+    this->direction = false;
     this->fx_ticks_per_step = 0;
     this->steps_to_move = 0;
     this->remove_from_active_list_next_reset = false;
     this->is_move_finished = false;
     this->signal_step = false;
     this->step_signal_hook = new Hook();
+    this->follower = NULL;
 
     steps_per_mm         = 1.0F;
     max_rate             = 50.0F;
 
     last_milestone_steps = 0;
     last_milestone_mm    = 0.0F;
+    current_position_steps = 0;
 }
 
 StepperMotor::StepperMotor(Pin& step, Pin& dir, Pin& en) : step_pin(step), dir_pin(dir), en_pin(en) {
@@ -39,12 +43,14 @@ StepperMotor::StepperMotor(Pin& step, Pin& dir, Pin& en) : step_pin(step), dir_p
     this->paused = false;
     this->fx_counter = 0;
     this->stepped = 0;
+    this->direction = false;
     this->fx_ticks_per_step = 0;
     this->steps_to_move = 0;
     this->remove_from_active_list_next_reset = false;
     this->is_move_finished = false;
     this->signal_step = false;
     this->step_signal_hook = new Hook();
+    this->follower = NULL;
 
     enable(false);
     set_high_on_debug(en.port_number, en.pin);
@@ -54,6 +60,7 @@ StepperMotor::StepperMotor(Pin& step, Pin& dir, Pin& en) : step_pin(step), dir_p
 
     last_milestone_steps = 0;
     last_milestone_mm    = 0.0F;
+    current_position_steps = 0;
 }
 
 // This is called ( see the .h file, we had to put a part of things there for obscure inline reasons ) when a step has to be generated
@@ -70,6 +77,11 @@ void StepperMotor::step(){
     // we have moved a step 9t
     this->stepped++;
 
+    // A motor following us steps along
+    if( this->follower != NULL ){
+        this->step_follower();
+    }
+
     // Do we need to signal this step
     if( this->stepped == this->signal_step_number && this->signal_step ){
         this->step_signal_hook->call();
@@ -86,6 +98,23 @@ void StepperMotor::step(){
 }
 
 
+// The follower's steps for a phase are spread evenly over ours, Bresenham style, starting half way so they are centred
+inline void StepperMotor::step_follower(){
+
+    // On to the next phase, skipping empty ones
+    while( this->stepped > this->follow_ends[this->follow_phase] ){
+        this->follow_phase++;
+        this->follow_length = this->follow_ends[this->follow_phase] - this->follow_ends[this->follow_phase - 1];
+        this->follow_counter = this->follow_length / 2;
+    }
+
+    this->follow_counter += this->follow_steps[this->follow_phase];
+    if( this->follow_counter >= this->follow_length ){
+        this->follow_counter -= this->follow_length;
+        this->follower->step();
+    }
+}
+
 // If the move is finished, the StepTicker will call this ( because we asked it to in tick() )
 void StepperMotor::signal_move_finished(){
 
@@ -123,18 +152,24 @@ inline void StepperMotor::update_exit_tick(){
 void StepperMotor::move( bool direction, unsigned int steps ){
     // We do not set the direction directly, we will set the pin just before the step pin on the next tick
     this->dir_pin.set(direction);
-    this->direction = direction;
 
     // How many steps we have to move until the move is done
     this->steps_to_move = steps;
 
+    // The previous move is done, account for it in our actual position
+    this->current_position_steps += this->signed_stepped();
+
     // Zero our tool counters
     this->fx_counter = 0;      // Bresenheim counter
     this->stepped = 0;
+    this->direction = direction;
 
     // Do not signal steps until we get instructed to
     this->signal_step = false;
 
+    // Nothing follows a new move until told to
+    this->follower = NULL;
+
     // Starting now we are moving
     if( steps > 0 ){
         this->moving = true;
@@ -145,6 +180,28 @@ void StepperMotor::move( bool direction, unsigned int steps ){
 
 }
 
+// Move by stepping along with the leader until the end of its current move, rather than at a speed of our own : steps[i]
+// of ours over its steps up to ends[i]. The step ticker keeps us in its active list only to reset the step pin and to
+// see the move finish
+void StepperMotor::follow( StepperMotor *leader, bool direction, const uint32_t ends[3], const uint32_t steps[3] ){
+    this->paused = false;
+    this->fx_ticks_per_step = 0xFFFFFFFF; // never reached by fx_counter, which goes up by 1<<16
+    this->move( direction, steps[0] + steps[1] + steps[2] );
+    if( !this->moving ){ return; }
+
+    // the leader may be stepping already
+    __disable_irq();
+    leader->follow_ends[0] = leader->stepped;
+    for( int i = 0; i < 3; i++ ){
+        leader->follow_ends[i + 1] = ends[i];
+        leader->follow_steps[i + 1] = steps[i];
+    }
+    leader->follow_phase = 0;
+    leader->follow_steps[0] = 0;
+    leader->follower = this;
+    __enable_irq();
+}
+
 // Set the speed at which this steper moves
 void StepperMotor::set_speed( float speed ){
 
@@ -181,12 +238,26 @@ void StepperMotor::change_steps_per_mm(float new_steps)
 {
     steps_per_mm = new_steps;
     last_milestone_steps = lround(last_milestone_mm * steps_per_mm);
+    current_position_steps = last_milestone_steps - signed_stepped();
 }
 
 void StepperMotor::change_last_milestone(float new_milestone)
 {
     last_milestone_mm = new_milestone;
     last_milestone_steps = lround(last_milestone_mm * steps_per_mm);
+    current_position_steps = last_milestone_steps - signed_stepped();
+}
+
+// Where this actuator actually is right now in millimeters, from the steps it has done, as opposed to last_milestone
+// which is where the planner will have taken it once the queue is empty. Cheap enough to be polled while moving
+float StepperMotor::get_current_position()
+{
+    // don't let a move begin between reading both counters
+    __disable_irq();
+    int32_t steps = current_position_steps + signed_stepped();
+    __enable_irq();
+
+    return steps / steps_per_mm;
 }
 
 int  StepperMotor::steps_to_target(float target)
@@ -28,6 +28,7 @@ class StepperMotor {
         bool is_moving() { return moving; }
         void move_finished();
         void move( bool direction, unsigned int steps );
+        void follow( StepperMotor *leader, bool direction, const uint32_t ends[3], const uint32_t steps[3] );
         void signal_move_finished();
         void set_speed( float speed );
         void update_exit_tick();
@@ -41,6 +42,7 @@ class StepperMotor {
         void change_last_milestone(float);
 
         int  steps_to_target(float);
+        float get_current_position();
         uint32_t get_steps_to_move() const { return steps_to_move; }
         uint32_t get_stepped() const { return stepped; }
 
@@ -83,6 +85,9 @@ class StepperMotor {
 
         int32_t last_milestone_steps;
         float   last_milestone_mm;
+        int32_t current_position_steps; // Actual position in steps before the current move began
+
+        int32_t signed_stepped() const { return direction ? -(int32_t)stepped : (int32_t)stepped; }
 
         uint32_t steps_to_move;
         uint32_t stepped;
@@ -96,6 +101,16 @@ class StepperMotor {
 
         bool is_move_finished; // Whether the move just finished
 
+        // A motor stepped from our steps rather than by the step ticker, see follow()
+        StepperMotor *follower;
+        uint32_t follow_ends[4];    // Our step count where each of its phases ends, after the one we were at when it started following
+        uint32_t follow_steps[4];   // Its steps in each phase, never more than ours
+        uint32_t follow_length;     // Our steps in the phase we are in
+        uint32_t follow_counter;    // Bresenham counter for that phase
+        uint8_t  follow_phase;
+
+        void step_follower();
+
         // Called a great many times per second, to step if we have to now
         inline void tick() {
             // increase the ( fixed point ) counter by one tick 11t
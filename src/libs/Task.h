@@ -0,0 +1,46 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TASK_H
+#define TASK_H
+
+class StreamOutput;
+
+// A stackless task, in the style of the uIP protothreads ( libs/Network/uip/uip/pt.h ) : instead of spinning on ON_IDLE
+// until something happens, run() returns and is called again from the main loop, resuming where it was waiting. A gcode
+// handler hands one to GcodeDispatch::hold(), its ok waits for it to end.
+// run() is written between TASK_BEGIN() and TASK_END(). Locals do not survive a wait, keep state in members, and
+// as the resume point is a case label, do not wait from inside a switch statement.
+class Task {
+    public:
+        Task() : resume_line(0) {}
+        virtual ~Task() {}
+
+        // Called repeatedly until it returns true, when the task has ended
+        virtual bool run() = 0;
+
+        // The stream it answers to is about to be deleted
+        virtual void forget_stream(StreamOutput *stream) {}
+
+    protected:
+        unsigned short resume_line;
+};
+
+#define TASK_BEGIN()          switch(this->resume_line) { case 0:
+
+// Return, and resume here once the condition is true
+#define TASK_WAIT_UNTIL(c)    do { this->resume_line = __LINE__; case __LINE__: if(!(c)) return false; } while(0)
+
+// Let everything else run once before carrying on
+#define TASK_YIELD()          do { this->resume_line = __LINE__; return false; case __LINE__: ; } while(0)
+
+// End the task from anywhere in run()
+#define TASK_EXIT()           do { this->resume_line = 0; return true; } while(0)
+
+#define TASK_END()            } this->resume_line = 0; return true
+
+#endif
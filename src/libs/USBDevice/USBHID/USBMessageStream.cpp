@@ -6,6 +6,8 @@
 
 #include "libs/Kernel.h"
 #include "libs/SerialMessage.h"
+#include "RealtimeCommands.h"
+#include "GcodeDispatch.h"
 
 #define iprintf(...) do {} while(0) //THEKERNEL->streams->printf
 
@@ -13,7 +15,8 @@ USBMessageStream::USBMessageStream(USB *u) : USBHID(u, 64,64),
 	rxbuf(256 + 8), 
 	txbuf(128 + 8),
 	nl_in_rx(0),
-	flush_to_nl(false)
+	flush_to_nl(false),
+	realtime_in_line(false)
 {}
 
 
@@ -30,7 +33,8 @@ uint8_t USBMessageStream::available()
 
 void USBMessageStream::on_main_loop(void *argument)
 {
-    if (nl_in_rx)
+    // the lines wait in rxbuf while the gcode dispatch has enough of them held
+    if (nl_in_rx && THEKERNEL->gcode_dispatch->can_take_line())
     {
     	iprintf("on_main_loop: there is nl in rx\n");
 
@@ -177,6 +181,10 @@ bool USBMessageStream::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
 		if (report.data[i] == 0x00)
 			continue;
 
+		// realtime commands are acted on here rather than queued behind the received lines
+		if (THEKERNEL->realtime_commands->char_received(report.data[i], this, realtime_in_line))
+			continue;
+
         if (flush_to_nl == false)
             rxbuf.queue(report.data[i]);
 
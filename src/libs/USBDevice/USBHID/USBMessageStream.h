@@ -39,6 +39,7 @@ protected:
 	
     volatile int nl_in_rx;
     bool flush_to_nl;
+    bool realtime_in_line; // realtime commands are only recognised at the start of a line
 };
 
 #endif
\ No newline at end of file
@@ -119,6 +119,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "SDCard.h"
 
@@ -126,12 +127,23 @@ static const uint8_t OXFF = 0xFF;
 
 #define SD_COMMAND_TIMEOUT 5000
 
+// The GPDMA only reaches the AHB RAM
+#ifndef DMA_REACHABLE
+#define DMA_REACHABLE(p, n) (((uint32_t)(p) >= 0x2007C000) && (((uint32_t)(p) + (n)) <= 0x20084000))
+#endif
+
 SDCard::SDCard(PinName mosi, PinName miso, PinName sclk, PinName cs, uint32_t frequency) :
-  _spi(mosi, miso, sclk), _cs(cs), frequency(frequency) {
+  _spi(NULL), _mosi(mosi), _miso(miso), _sclk(sclk), _cs(cs), frequency(frequency) {
     _cs.output();
     _cs = 1;
     busyflag = false;
     _sectors = 0;
+    cardtype = SDCARD_FAIL;
+    _card_busy = false;
+    _transaction.done.attach(this, &SDCard::on_transfer_done);
+
+    // main.cpp puts the card in AHB RAM, anywhere else it is moved a byte at a time
+    _dma = DMA_REACHABLE(_poll_buffer, sizeof(_poll_buffer));
 }
 
 #define R1_IDLE_STATE           (1 << 0)
@@ -199,12 +211,11 @@ SDCard::SDCard(PinName mosi, PinName miso, PinName sclk, PinName cs, uint32_t fr
 #define BLOCK2ADDR(block)   (((cardtype == SDCARD_V1) || (cardtype == SDCARD_V2))?(block << 9):((cardtype == SDCARD_V2HC)?(block):0))
 
 SDCard::CARD_TYPE SDCard::initialise_card() {
-    // Set to 25kHz for initialisation, and clock card with cs = 1
-    _spi.frequency(25000);
+    // Set to 25kHz for initialisation ( done by disk_initialize ), and clock card with cs = 1
     _cs = 1;
 
     for(int i=0; i<24; i++) {
-        _spi.write(0xFF);
+        _spi->write(0xFF);
     }
 
     // send CMD0, should return with all zeros except IDLE STATE set (bit 0)
@@ -257,13 +268,24 @@ SDCard::CARD_TYPE SDCard::initialise_card_v2() {
 
 int SDCard::disk_initialize()
 {
-    busyflag = true;
+    if (_spi == NULL)
+        _spi = SpiBus::get(_mosi, _miso, _sclk);
+    if (_spi == NULL) {
+        fprintf(stderr, "SD card is not on an SSP\n");
+        return 1;
+    }
+
+    // The bus is kept from the other devices on it for the whole command, card select goes low and high inside it
+    if (!_claim(25000))
+        return 1;
 
     _sectors = 0;
+    _card_busy = false;
 
     CARD_TYPE i = initialise_card();
 
     if (i == SDCARD_FAIL) {
+        _spi->release();
         busyflag = false;
         return 1;
     }
@@ -273,11 +295,12 @@ int SDCard::disk_initialize()
     // Set block length to 512 (CMD16)
     if(_cmd(SDCMD_SET_BLOCKLEN, 512) != 0) {
         fprintf(stderr, "Set 512-byte block timed out\n");
+        _spi->release();
         busyflag = false;
         return 1;
     }
 
-    _spi.frequency(this->frequency);
+    _spi->release();
 
     busyflag = false;
 
@@ -286,57 +309,72 @@ int SDCard::disk_initialize()
 
 int SDCard::disk_write(const char *buffer, uint32_t block_number)
 {
-    if (busyflag)
-        return 0;
+    return disk_write_blocks(buffer, block_number, 1);
+}
 
-    busyflag = true;
+int SDCard::disk_read(char *buffer, uint32_t block_number)
+{
+    return disk_read_blocks(buffer, block_number, 1);
+}
 
-    if (cardtype == SDCARD_FAIL)
-        return -1;
-    // set write address for single block (CMD24)
-    if(_cmd(SDCMD_WRITE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+// Consecutive blocks with a single command ( CMD25 ), instead of a command and a busy wait per block. Returns once
+// the card has the last block, it programs it in the background
+int SDCard::disk_write_blocks(const char *buffer, uint32_t block_number, uint32_t count)
+{
+    if (!_can_wait())
         return 1;
-    }
 
-    // send the data block
-    _write(buffer, 512);
+    int r = _start((char *)buffer, block_number, count, true, FPointer());
+    if (r != 0)
+        return r;
 
-    busyflag = false;
+    while (busyflag);
 
-    return 0;
+    return _result;
 }
 
-int SDCard::disk_read(char *buffer, uint32_t block_number)
+// Consecutive blocks with a single command ( CMD18 ), the card streams them until told to stop
+int SDCard::disk_read_blocks(char *buffer, uint32_t block_number, uint32_t count)
 {
-    if (busyflag)
-        return 0;
+    if (!_can_wait())
+        return 1;
 
-    busyflag = true;
+    int r = _start(buffer, block_number, count, false, FPointer());
+    if (r != 0)
+        return r;
 
-    if (cardtype == SDCARD_FAIL)
-        return -1;
-    // set read address for single block (CMD17)
-    if(_cmd(SDCMD_READ_SINGLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
-        return 1;
-    }
+    while (busyflag);
 
-    // receive the data
-    _read(buffer, 512);
+    return _result;
+}
 
-    busyflag = false;
+int SDCard::disk_write_async(const char *buffer, uint32_t block_number, uint32_t count, FPointer done)
+{
+    return _start((char *)buffer, block_number, count, true, done);
+}
 
-    return 0;
+int SDCard::disk_read_async(char *buffer, uint32_t block_number, uint32_t count, FPointer done)
+{
+    return _start(buffer, block_number, count, false, done);
 }
 
 int SDCard::disk_status() { return (_sectors > 0)?0:1; }
 int SDCard::disk_sync() {
-    // TODO: wait for DMA, wait for card not busy
+    if (_spi == NULL)
+        return 0;
+
+    // wait for the transfer in the background, then for the card to finish with it
+    if (!_claim(this->frequency))
+        return 1;
+    _wait_ready();
+    _spi->release();
+    busyflag = false;
     return 0;
 }
 uint32_t SDCard::disk_sectors() { return _sectors; }
 uint64_t SDCard::disk_size() { return ((uint64_t) _sectors) << 9; }
 uint32_t SDCard::disk_blocksize() { return (1<<9); }
-bool SDCard::disk_canDMA() { return false; }
+bool SDCard::disk_canDMA() { return _dma; }
 
 SDCard::CARD_TYPE SDCard::card_type()
 {
@@ -349,46 +387,46 @@ int SDCard::_cmd(int cmd, uint32_t arg) {
     _cs = 0;
 
     // send a command
-    _spi.write(0x40 | cmd);
-    _spi.write(arg >> 24);
-    _spi.write(arg >> 16);
-    _spi.write(arg >> 8);
-    _spi.write(arg >> 0);
-    _spi.write(0x95);
+    _spi->write(0x40 | cmd);
+    _spi->write(arg >> 24);
+    _spi->write(arg >> 16);
+    _spi->write(arg >> 8);
+    _spi->write(arg >> 0);
+    _spi->write(0x95);
 
     // wait for the repsonse (response[7] == 0)
     for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
-        int response = _spi.write(0xFF);
+        int response = _spi->write(0xFF);
         if(!(response & 0x80)) {
             _cs = 1;
-            _spi.write(0xFF);
+            _spi->write(0xFF);
             return response;
         }
     }
     _cs = 1;
-    _spi.write(0xFF);
+    _spi->write(0xFF);
     return -1; // timeout
 }
 int SDCard::_cmdx(int cmd, uint32_t arg) {
     _cs = 0;
 
     // send a command
-    _spi.write(0x40 | cmd);
-    _spi.write(arg >> 24);
-    _spi.write(arg >> 16);
-    _spi.write(arg >> 8);
-    _spi.write(arg >> 0);
-    _spi.write(0x95);
+    _spi->write(0x40 | cmd);
+    _spi->write(arg >> 24);
+    _spi->write(arg >> 16);
+    _spi->write(arg >> 8);
+    _spi->write(arg >> 0);
+    _spi->write(0x95);
 
     // wait for the repsonse (response[7] == 0)
     for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
-        int response = _spi.write(0xFF);
+        int response = _spi->write(0xFF);
         if(!(response & 0x80)) {
             return response;
         }
     }
     _cs = 1;
-    _spi.write(0xFF);
+    _spi->write(0xFF);
     return -1; // timeout
 }
 
@@ -398,29 +436,29 @@ int SDCard::_cmd58(uint32_t *ocr) {
     int arg = 0;
 
     // send a command
-    _spi.write(0x40 | 58);
-    _spi.write(arg >> 24);
-    _spi.write(arg >> 16);
-    _spi.write(arg >> 8);
-    _spi.write(arg >> 0);
-    _spi.write(0x95);
+    _spi->write(0x40 | 58);
+    _spi->write(arg >> 24);
+    _spi->write(arg >> 16);
+    _spi->write(arg >> 8);
+    _spi->write(arg >> 0);
+    _spi->write(0x95);
 
     // wait for the repsonse (response[7] == 0)
     for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
-        int response = _spi.write(0xFF);
+        int response = _spi->write(0xFF);
         if(!(response & 0x80)) {
-            *ocr = _spi.write(0xFF) << 24;
-            *ocr |= _spi.write(0xFF) << 16;
-            *ocr |= _spi.write(0xFF) << 8;
-            *ocr |= _spi.write(0xFF) << 0;
+            *ocr = _spi->write(0xFF) << 24;
+            *ocr |= _spi->write(0xFF) << 16;
+            *ocr |= _spi->write(0xFF) << 8;
+            *ocr |= _spi->write(0xFF) << 0;
 //            printf("OCR = 0x%08X\n", ocr);
             _cs = 1;
-            _spi.write(0xFF);
+            _spi->write(0xFF);
             return response;
         }
     }
     _cs = 1;
-    _spi.write(0xFF);
+    _spi->write(0xFF);
     return -1; // timeout
 }
 
@@ -428,28 +466,28 @@ int SDCard::_cmd8() {
     _cs = 0;
 
     // send a command
-    _spi.write(0x40 | SDCMD_SEND_IF_COND); // CMD8
-    _spi.write(0x00);     // reserved
-    _spi.write(0x00);     // reserved
-    _spi.write(0x01);     // 3.3v
-    _spi.write(0xAA);     // check pattern
-    _spi.write(0x87);     // crc
+    _spi->write(0x40 | SDCMD_SEND_IF_COND); // CMD8
+    _spi->write(0x00);     // reserved
+    _spi->write(0x00);     // reserved
+    _spi->write(0x01);     // 3.3v
+    _spi->write(0xAA);     // check pattern
+    _spi->write(0x87);     // crc
 
     // wait for the repsonse (response[7] == 0)
     for(int i=0; i<SD_COMMAND_TIMEOUT * 1000; i++) {
         char response[5];
-        response[0] = _spi.write(0xFF);
+        response[0] = _spi->write(0xFF);
         if(!(response[0] & 0x80)) {
                 for(int j=1; j<5; j++) {
-                    response[i] = _spi.write(0xFF);
+                    response[i] = _spi->write(0xFF);
                 }
                 _cs = 1;
-                _spi.write(0xFF);
+                _spi->write(0xFF);
                 return response[0];
         }
     }
     _cs = 1;
-    _spi.write(0xFF);
+    _spi->write(0xFF);
     return -1; // timeout
 }
 
@@ -457,9 +495,9 @@ int SDCard::_read(char *buffer, int length) {
     _cs = 0;
 
     // read until start byte (0xFF)
-    while(_spi.write(0xFF) != 0xFE);
+    while(_spi->write(0xFF) != 0xFE);
 //     uint8_t r;
-//     while((r = _spi.write(0xFF)) != 0xFE)
+//     while((r = _spi->write(0xFF)) != 0xFE)
 //     {
 //         iprintf("0x%02X ", r);
 //         for (volatile uint32_t j = 262144; j; j--);
@@ -469,46 +507,98 @@ int SDCard::_read(char *buffer, int length) {
 
     // read data
     for(int i=0; i<length; i++) {
-        buffer[i] = _spi.write(0xFF);
+        buffer[i] = _spi->write(0xFF);
     }
-    _spi.write(0xFF); // checksum
-    _spi.write(0xFF);
+    _spi->write(0xFF); // checksum
+    _spi->write(0xFF);
 
     _cs = 1;
-    _spi.write(0xFF);
+    _spi->write(0xFF);
     return 0;
 }
 
-int SDCard::_write(const char *buffer, int length) {
+int SDCard::_write(const char *buffer, int length, uint8_t token) {
     _cs = 0;
 
-    // indicate start of block
-    _spi.write(0xFE);
+    // indicate start of block, 0xFC inside a multiple block write
+    _spi->write(token);
 
     // write the data
     for(int i=0; i<length; i++) {
-        _spi.write(buffer[i]);
+        _spi->write(buffer[i]);
     }
 
     // write the checksum
-    _spi.write(0xFF);
-    _spi.write(0xFF);
+    _spi->write(0xFF);
+    _spi->write(0xFF);
 
     // check the repsonse token
-    if((_spi.write(0xFF) & 0x1F) != 0x05) {
+    if((_spi->write(0xFF) & 0x1F) != 0x05) {
         _cs = 1;
-        _spi.write(0xFF);
+        _spi->write(0xFF);
         return 1;
     }
 
     // wait for write to finish
-    while(_spi.write(0xFF) == 0);
+    while(_spi->write(0xFF) == 0);
+
+    _cs = 1;
+    _spi->write(0xFF);
+    return 0;
+}
+
+// Ends a multiple block read with CMD12, its response comes after a stuff byte, and the card may be busy after it until
+// the next command waits for it
+int SDCard::_stop_read() {
+    _cs = 0;
+
+    _spi->write(0x40 | SDCMD_STOP_TRANSMISSION);
+    _spi->write(0x00);
+    _spi->write(0x00);
+    _spi->write(0x00);
+    _spi->write(0x00);
+    _spi->write(0x95);
+    _spi->write(0xFF); // stuff byte
+
+    int response = -1;
+    for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
+        response = _spi->write(0xFF);
+        if(!(response & 0x80))
+            break;
+    }
+    _card_busy = true;
+
+    _cs = 1;
+    _spi->write(0xFF);
+    return (response == 0) ? 0 : 1;
+}
+
+// Ends a multiple block write with the stop token, the card programs the last block while the next command waits
+int SDCard::_stop_write() {
+    _cs = 0;
+
+    _spi->write(0xFD);
+    _spi->write(0xFF);
+    _card_busy = true;
 
     _cs = 1;
-    _spi.write(0xFF);
+    _spi->write(0xFF);
     return 0;
 }
 
+// Waits, with the bus acquired, for the card to be done with what _card_busy was left set for
+void SDCard::_wait_ready() {
+    if (!_card_busy)
+        return;
+
+    _cs = 0;
+    while(_spi->write(0xFF) == 0);
+    _cs = 1;
+    _spi->write(0xFF);
+
+    _card_busy = false;
+}
+
 static int ext_bits(char *data, int msb, int lsb) {
     int bits = 0;
     int size = 1 + msb - lsb;
@@ -583,3 +673,260 @@ bool SDCard::busy()
 {
     return busyflag;
 }
+
+// BACKGROUND TRANSFERS
+
+// The command and the few bytes around each block are clocked by the processor, the GPDMA moves the blocks and
+// polls for the card to be ready, and on_transfer_done() goes on with the next step from the DMA interrupt. The bus
+// is kept from the other devices until the transfer is over. Buffers out of the GPDMA's reach, in the local RAM or
+// on the heap like the FatFs file buffers, are moved a byte at a time before returning instead, so only transfers
+// into AHB RAM, such as SDFAT's windows and write back, really go on in the background. disk_read_blocks() and
+// disk_write_blocks() wait for the transfer either way.
+
+#define SD_PHASE_TOKEN  0   // Waiting for the data token of a block being read
+#define SD_PHASE_READ   1
+#define SD_PHASE_WRITE  2
+#define SD_PHASE_BUSY   3   // Waiting for the card to program a block written
+
+// Waits for the card longer than this are given up, a read takes up to 100ms to start and a write 250ms to program
+#define SD_WAIT_TIMEOUT_MS 500
+
+int SDCard::_start(char *buffer, uint32_t block_number, uint32_t count, bool writing, FPointer done)
+{
+    if (cardtype == SDCARD_FAIL || _spi == NULL)
+        return -1;
+
+    // one transfer at a time, the previous one may still be going on in the background
+    if (!_claim(this->frequency))
+        return 1;
+    _wait_ready();
+
+    int cmd;
+    if (writing)
+        cmd = (count > 1) ? SDCMD_WRITE_MULTIPLE_BLOCK : SDCMD_WRITE_BLOCK;
+    else
+        cmd = (count > 1) ? SDCMD_READ_MULTIPLE_BLOCK : SDCMD_READ_SINGLE_BLOCK;
+
+    if(_cmd(cmd, BLOCK2ADDR(block_number)) != 0) {
+        _spi->release();
+        busyflag = false;
+        return 1;
+    }
+
+    if (!_dma || !DMA_REACHABLE(buffer, count * 512)) {
+        int r = 0;
+        for (uint32_t i = 0; i < count && r == 0; i++) {
+            if (writing)
+                r = _write(buffer + (i * 512), 512, (count > 1) ? 0xFC : 0xFE);
+            else
+                r = _read(buffer + (i * 512), 512);
+        }
+        if (count > 1) {
+            if ((writing ? _stop_write() : _stop_read()) != 0)
+                r = 1;
+        }
+
+        _spi->release();
+        _result = r;
+        busyflag = false;
+
+        if (r == 0)
+            done.call(0);
+        return r;
+    }
+
+    _buffer = buffer;
+    _count = count;
+    _writing = writing;
+    _multiple = (count > 1);
+    _done = done;
+    _transaction.frequency = this->frequency;
+
+    _cs = 0;
+    if (writing)
+        _send_block();
+    else
+        _poll_token();
+
+    return 0;
+}
+
+// Takes the card, then the bus for it, until released with busyflag cleared. Outside interrupts both are waited for.
+// An interrupt cannot wait for the code it interrupted to let go of them, so there it fails instead
+bool SDCard::_claim(uint32_t frequency)
+{
+    bool interrupt = (__get_IPSR() != 0);
+
+    while (true) {
+        __disable_irq();
+        if (!busyflag) break;
+        __enable_irq();
+        if (interrupt) return false;
+    }
+    busyflag = true;
+    __enable_irq();
+
+    if (!interrupt) {
+        _spi->acquire(frequency);
+    } else if (!_spi->try_acquire(frequency)) {
+        busyflag = false;
+        return false;
+    }
+    return true;
+}
+
+// The blocking calls wait for the DMA interrupt to finish the transfer, so only code it can interrupt may make them
+bool SDCard::_can_wait()
+{
+    uint32_t exception = __get_IPSR();
+    if (exception == 0)
+        return true;
+    if (exception < 16)
+        return false;
+    return NVIC_GetPriority((IRQn_Type)(exception - 16)) > NVIC_GetPriority(DMA_IRQn);
+}
+
+void SDCard::_exchange(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+    _transaction.tx = tx;
+    _transaction.rx = rx;
+    _transaction.length = length;
+    _spi->exchange(&_transaction);
+}
+
+void SDCard::_poll_token()
+{
+    _phase = SD_PHASE_TOKEN;
+    _polled = 0;
+    _exchange(NULL, _poll_buffer, sizeof(_poll_buffer));
+}
+
+void SDCard::_send_block()
+{
+    // indicate start of block, 0xFC inside a multiple block write
+    _spi->write(_multiple ? 0xFC : 0xFE);
+
+    _phase = SD_PHASE_WRITE;
+    _exchange((const uint8_t *)_buffer, NULL, 512);
+}
+
+uint32_t SDCard::on_transfer_done(uint32_t error)
+{
+    if (error) {
+        _fail();
+        return 0;
+    }
+
+    switch (_phase) {
+        case SD_PHASE_TOKEN: {
+            // the card sends 0xFF until the start byte, or an error token
+            unsigned int i = 0;
+            while (i < sizeof(_poll_buffer) && _poll_buffer[i] == 0xFF)
+                i++;
+
+            if (i == sizeof(_poll_buffer)) {
+                _polled += sizeof(_poll_buffer);
+                if (_polled > (this->frequency / 8) * SD_WAIT_TIMEOUT_MS / 1000)
+                    _fail();
+                else
+                    _exchange(NULL, _poll_buffer, sizeof(_poll_buffer));
+                return 0;
+            }
+
+            if (_poll_buffer[i] != 0xFE) {
+                _fail();
+                return 0;
+            }
+
+            // what came after the start byte is the beginning of the block
+            int n = sizeof(_poll_buffer) - i - 1;
+            memcpy(_buffer, &_poll_buffer[i + 1], n);
+
+            _phase = SD_PHASE_READ;
+            _exchange(NULL, (uint8_t *)_buffer + n, 512 - n);
+            return 0;
+        }
+
+        case SD_PHASE_READ:
+            _spi->write(0xFF); // checksum
+            _spi->write(0xFF);
+
+            _buffer += 512;
+            if (--_count > 0) {
+                _poll_token();
+            } else {
+                _finish(_multiple ? _stop_read() : 0);
+            }
+            return 0;
+
+        case SD_PHASE_WRITE:
+            // write the checksum
+            _spi->write(0xFF);
+            _spi->write(0xFF);
+
+            // check the repsonse token
+            if((_spi->write(0xFF) & 0x1F) != 0x05) {
+                _fail();
+                return 0;
+            }
+
+            _buffer += 512;
+            _count--;
+
+            // a single block is programmed in the background, the next command waits for it
+            if (!_multiple) {
+                _card_busy = true;
+                _finish(0);
+                return 0;
+            }
+
+            _phase = SD_PHASE_BUSY;
+            _polled = 0;
+            _exchange(NULL, _poll_buffer, sizeof(_poll_buffer));
+            return 0;
+
+        case SD_PHASE_BUSY:
+            // the card holds its output low until the block is programmed
+            if (_poll_buffer[sizeof(_poll_buffer) - 1] == 0) {
+                _polled += sizeof(_poll_buffer);
+                if (_polled > (this->frequency / 8) * SD_WAIT_TIMEOUT_MS / 1000)
+                    _fail();
+                else
+                    _exchange(NULL, _poll_buffer, sizeof(_poll_buffer));
+                return 0;
+            }
+
+            if (_count > 0) {
+                _send_block();
+            } else {
+                _finish(_stop_write());
+            }
+            return 0;
+    }
+    return 0;
+}
+
+// Something went wrong halfway, a card in the middle of a multiple block transfer is told to stop
+void SDCard::_fail()
+{
+    if (_multiple) {
+        if (_writing)
+            _stop_write();
+        else
+            _stop_read();
+    }
+    _card_busy = true;
+    _finish(1);
+}
+
+void SDCard::_finish(int result)
+{
+    _cs = 1;
+    _spi->write(0xFF);
+    _spi->release();
+
+    _result = result;
+    busyflag = false;
+
+    _done.call(result);
+}
@@ -28,6 +28,7 @@
 
 #include "spi.h"
 #include "gpio.h"
+#include "SpiBus.h"
 
 #include "disk.h"
 #include "mbed.h"
@@ -72,6 +73,10 @@ public:
     virtual int disk_initialize();
     virtual int disk_write(const char *buffer, uint32_t block_number);
     virtual int disk_read(char *buffer, uint32_t block_number);
+    virtual int disk_write_blocks(const char *buffer, uint32_t block_number, uint32_t count);
+    virtual int disk_read_blocks(char *buffer, uint32_t block_number, uint32_t count);
+    virtual int disk_write_async(const char *buffer, uint32_t block_number, uint32_t count, FPointer done);
+    virtual int disk_read_async(char *buffer, uint32_t block_number, uint32_t count, FPointer done);
     virtual int disk_status();
     virtual int disk_sync();
     virtual uint32_t disk_sectors();
@@ -83,6 +88,8 @@ public:
 
     bool busy();
 
+    uint32_t on_transfer_done(uint32_t error);
+
 protected:
 
     int _cmd(int cmd, uint32_t arg);
@@ -94,18 +101,49 @@ protected:
     CARD_TYPE initialise_card_v2();
 
     int _read(char *buffer, int length);
-    int _write(const char *buffer, int length);
+    int _write(const char *buffer, int length, uint8_t token = 0xFE);
+    int _stop_read();
+    int _stop_write();
+    void _wait_ready();
+
+    // A transfer in the background, the GPDMA moves the blocks and on_transfer_done() goes on with the rest
+    int _start(char *buffer, uint32_t block_number, uint32_t count, bool writing, FPointer done);
+    bool _claim(uint32_t frequency);
+    bool _can_wait();
+    void _exchange(const uint8_t *tx, uint8_t *rx, uint16_t length);
+    void _poll_token();
+    void _send_block();
+    void _fail();
+    void _finish(int result);
 
     uint32_t _sd_sectors();
     uint32_t _sectors;
 
-    mbed::SPI _spi;
+    // Found on disk_initialize(), not at construction as that can happen before the DMA is set up
+    SpiBus* _spi;
+    PinName _mosi, _miso, _sclk;
     GPIO _cs;
 
     uint32_t frequency;
 
     volatile bool busyflag;
     CARD_TYPE cardtype;
+
+    // Only when the SDCard is in AHB RAM, where the GPDMA can poll into _poll_buffer
+    bool _dma;
+    // The card was left programming a block, or finishing a read, and is waited for before the next command
+    bool _card_busy;
+
+    SpiTransaction _transaction;
+    uint8_t _poll_buffer[16];
+    FPointer _done;
+    char *_buffer;
+    uint32_t _count;        // Blocks still to move
+    uint32_t _polled;       // Bytes clocked waiting for the card
+    uint8_t _phase;
+    bool _writing;
+    bool _multiple;
+    volatile int _result;
 };
 
 #endif
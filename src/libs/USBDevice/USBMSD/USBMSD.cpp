@@ -29,6 +29,8 @@
 
 #include "platform_memory.h"
 
+#include <LPC17xx.h>
+
 #define DISK_OK         0x00
 #define NO_INIT         0x01
 #define NO_DISK         0x02
@@ -70,6 +72,9 @@
 // max packet size
 #define MAX_PACKET  MAX_PACKET_SIZE_EPBULK
 
+// Blocks read ahead, or gathered before writing, in one disk command
+#define MSD_PAGE_BLOCKS 4
+
 // #define iprintf(...) THEKERNEL->streams->printf(__VA_ARGS__)
 #define iprintf(...) do { } while (0)
 
@@ -83,6 +88,7 @@ enum Status {
 USBMSD::USBMSD(USB *u, MSD_Disk *d) {
     this->usb = u;
     this->disk = d;
+    this->pending = PENDING_NONE;
 
     usbdesc_interface i = {
         DL_INTERFACE,           // bLength
@@ -191,9 +197,15 @@ bool USBMSD::connect()
     BlockSize = disk->disk_blocksize();
 
     if ((BlockCount > 0) && (BlockSize != 0)) {
-        page = (uint8_t*) AHB0.alloc(BlockSize);
+        page_blocks = MSD_PAGE_BLOCKS;
+        page = (uint8_t*) AHB0.alloc(BlockSize * page_blocks);
+        if (page == NULL) {
+            page_blocks = 1;
+            page = (uint8_t*) AHB0.alloc(BlockSize);
+        }
         if (page == NULL)
             return false;
+        page_count = 0;
     } else {
         return false;
     }
@@ -204,6 +216,7 @@ bool USBMSD::connect()
 
 void USBMSD::reset() {
     stage = READ_CBW;
+    pending = PENDING_NONE;
     usb->endpointSetInterrupt(MSC_BulkOut.bEndpointAddress, true);
     usb->endpointSetInterrupt(MSC_BulkIn.bEndpointAddress, false);
 }
@@ -243,6 +256,10 @@ bool USBMSD::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus) {
             break;
     }
 
+    // on_idle() reactivates readings once the disk is done, the host is NAKed until then
+    if (pending != PENDING_NONE)
+        return false;
+
     //reactivate readings on the OUT bulk endpoint
     usb->readStart(MSC_BulkOut.bEndpointAddress, MAX_PACKET_SIZE_EPBULK);
     return true;
@@ -270,7 +287,8 @@ bool USBMSD::USBEvent_EPIn(uint8_t bEP, uint8_t bEPStatus) {
                 case READ10:
                 case READ12:
                     memoryRead();
-                    gotMoreData = true;
+                    // or waiting for on_idle() to read the disk
+                    gotMoreData = (pending == PENDING_NONE);
                     break;
             }
             break;
@@ -309,15 +327,19 @@ void USBMSD::memoryWrite (uint8_t * buf, uint16_t size) {
         usb->stallEndpoint(MSC_BulkOut.bEndpointAddress);
     }
 
-    // we fill an array in RAM of 1 block before writing it in memory
+    // we fill an array in RAM of consecutive blocks before writing them in memory
+    if ((addr_in_block == 0) && (page_count == 0))
+        page_lba = lba;
+    uint8_t *block = page + ((lba - page_lba) * BlockSize);
     for (int i = 0; i < size; i++)
-        page[addr_in_block + i] = buf[i];
+        block[addr_in_block + i] = buf[i];
 
-    // if the array is filled, write it in memory
+    // if the array is filled, or this is the last block, on_idle() writes it in memory
+    bool full = false;
     if ((addr_in_block + size) >= BlockSize) {
-        if (!(disk->disk_status() & WRITE_PROTECT)) {
-            disk->disk_write((const char *)page, lba);
-        }
+        page_count++;
+        if ((page_count >= page_blocks) || (length <= size))
+            full = true;
     }
 
     addr_in_block += size;
@@ -329,6 +351,13 @@ void USBMSD::memoryWrite (uint8_t * buf, uint16_t size) {
         lba++;
     }
 
+    if (full && (stage == PROCESS_CBW)) {
+        pending = PENDING_WRITE;
+        return;
+    }
+    if (full)
+        page_count = 0;
+
     if ((!length) || (stage != PROCESS_CBW)) {
         csw.Status = (stage == ERROR) ? CSW_FAILED : CSW_PASSED;
         sendCSW();
@@ -344,9 +373,12 @@ void USBMSD::memoryVerify (uint8_t * buf, uint16_t size) {
         usb->stallEndpoint(MSC_BulkOut.bEndpointAddress);
     }
 
-    // beginning of a new block -> load a whole block in RAM
-    if (addr_in_block == 0)
-        disk->disk_read((char *)page, lba);
+    // beginning of a new block -> on_idle() loads a whole block in RAM and calls this again
+    if ((addr_in_block == 0) && ((page_count == 0) || (page_lba != lba))) {
+        pending_size = size;
+        pending = PENDING_VERIFY;
+        return;
+    }
 
     // info are in RAM -> no need to re-read memory
     for (n = 0; n < size; n++) {
@@ -647,17 +679,23 @@ void USBMSD::memoryRead (void) {
         stage = ERROR;
     }
 
-    // we read an entire block
-    if (addr_in_block == 0)
+    // we read entire blocks, as many of the ones left as the page holds. on_idle() reads them and calls this again
+    if ((addr_in_block == 0) && ((page_count == 0) || (lba < page_lba) || (lba >= page_lba + page_count)))
     {
         iprintf("MSD:LBA %lu:", lba);
-        disk->disk_read((char *)page, lba);
+        page_lba = lba;
+        page_count = (length + BlockSize - 1) / BlockSize;
+        if (page_count > page_blocks)
+            page_count = page_blocks;
+        pending = PENDING_READ;
+        return;
     }
 
     iprintf(" %u", addr_in_block / MAX_PACKET_SIZE_EPBULK);
 
     // write data which are in RAM
-    usb->writeNB(MSC_BulkIn.bEndpointAddress, &page[addr_in_block], n, MAX_PACKET_SIZE_EPBULK);
+    uint8_t *block = page + ((lba - page_lba) * BlockSize);
+    usb->writeNB(MSC_BulkIn.bEndpointAddress, &block[addr_in_block], n, MAX_PACKET_SIZE_EPBULK);
 
     addr_in_block += n;
 
@@ -727,6 +765,9 @@ bool USBMSD::infoTransfer (void) {
 
     addr_in_block = 0;
 
+    // the page is only reused within a command, the firmware may have written to the disk since the last one
+    page_count = 0;
+
 //     iprintf("MSD:transferring %lu blocks from LBA %lu.\n", blocks, lba);
 
     return true;
@@ -734,9 +775,84 @@ bool USBMSD::infoTransfer (void) {
 
 void USBMSD::on_module_loaded()
 {
+    register_for_event(ON_IDLE);
     connect();
 }
 
+// Does the disk access the USB interrupt left, the main loop may wait for the card where the interrupt could not.
+// Then carries on with the transfer as the interrupt would have
+void USBMSD::on_idle(void*)
+{
+    Pending p = pending;
+    if (p == PENDING_NONE)
+        return;
+
+    int failed = 0;
+    switch (p) {
+        case PENDING_READ:
+            failed = disk->disk_read_blocks((char *)page, page_lba, page_count);
+            break;
+        case PENDING_WRITE:
+            if (!(disk->disk_status() & WRITE_PROTECT))
+                failed = disk->disk_write_blocks((const char *)page, page_lba, page_count);
+            break;
+        case PENDING_VERIFY:
+            failed = disk->disk_read((char *)page, lba);
+            break;
+        default:
+            break;
+    }
+
+    NVIC_DisableIRQ(USB_IRQn);
+
+    // a reset in the meantime, the host has given up on this command
+    if (pending != p) {
+        NVIC_EnableIRQ(USB_IRQn);
+        return;
+    }
+    pending = PENDING_NONE;
+
+    switch (p) {
+        case PENDING_READ:
+            if (failed) {
+                page_count = 0;
+                csw.Status = CSW_FAILED;
+                stage = ERROR;
+                usb->endpointSetInterrupt(MSC_BulkIn.bEndpointAddress, true);
+            } else {
+                memoryRead();
+            }
+            break;
+
+        case PENDING_WRITE:
+            page_count = 0;
+            if (failed) {
+                stage = ERROR;
+                usb->stallEndpoint(MSC_BulkOut.bEndpointAddress);
+            }
+            if ((!length) || (stage != PROCESS_CBW)) {
+                csw.Status = (stage == ERROR) ? CSW_FAILED : CSW_PASSED;
+                sendCSW();
+            }
+            usb->readStart(MSC_BulkOut.bEndpointAddress, MAX_PACKET_SIZE_EPBULK);
+            break;
+
+        case PENDING_VERIFY:
+            if (failed)
+                memOK = false;
+            page_lba = lba;
+            page_count = 1;
+            memoryVerify(buffer, pending_size);
+            usb->readStart(MSC_BulkOut.bEndpointAddress, MAX_PACKET_SIZE_EPBULK);
+            break;
+
+        default:
+            break;
+    }
+
+    NVIC_EnableIRQ(USB_IRQn);
+}
+
 bool USBMSD::USBEvent_busReset(void)
 {
 	return true;
@@ -90,6 +90,7 @@ public:
     bool USBEvent_suspendStateChanged(bool suspended);
 
     virtual void on_module_loaded(void);
+    virtual void on_idle(void*);
 
     // USB descriptors
     usbdesc_interface MSC_Interface;
@@ -160,10 +161,26 @@ private:
 
     // cache in RAM before writing in memory. Useful also to read a block.
     uint8_t * page;
+    // consecutive blocks the page holds, so the disk reads and writes several with one command
+    uint32_t page_blocks;
+    // first block in the page, and how many are read or written so far
+    uint32_t page_lba;
+    uint32_t page_count;
 
     // USB packet buffer
     uint8_t buffer[MAX_PACKET_SIZE_EPBULK];
 
+    // Disk access the USB interrupt leaves to on_idle(), where it may wait for the card. The bulk endpoint's
+    // interrupt stays off until it is done, so the host is NAKed meanwhile
+    enum Pending {
+        PENDING_NONE,
+        PENDING_READ,     // the page, then memoryRead() again
+        PENDING_WRITE,    // the page, then the CSW or the next packet
+        PENDING_VERIFY,   // the block, then memoryVerify() again with the packet in buffer
+    };
+    volatile Pending pending;
+    uint16_t pending_size;
+
     uint32_t BlockSize;
 //     uint32_t MemorySize;
     uint32_t BlockCount;
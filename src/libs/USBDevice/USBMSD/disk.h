@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "libs/FPointer.h"
+
 class MSD_Disk {
 public:
     /*
@@ -23,6 +25,44 @@ public:
      */
     virtual int disk_write(const char * data, uint32_t block) { return 0; };
 
+    /*
+     * read or write consecutive blocks, disks that can do it in one go override these. From an interrupt, a disk busy
+     * with something else fails rather than wait for it
+     *
+     * @returns 0 if successful
+     */
+    virtual int disk_read_blocks(char * data, uint32_t block, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            int r = disk_read(data + (i * disk_blocksize()), block + i);
+            if (r) return r;
+        }
+        return 0;
+    };
+    virtual int disk_write_blocks(const char * data, uint32_t block, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            int r = disk_write(data + (i * disk_blocksize()), block + i);
+            if (r) return r;
+        }
+        return 0;
+    };
+
+    /*
+     * start reading or writing consecutive blocks, done is called with 0 once they are, or 1 if it failed, possibly
+     * from an interrupt. Disks that cannot do it in the background do it before returning
+     *
+     * @returns 0 if started, done is not called otherwise
+     */
+    virtual int disk_read_async(char * data, uint32_t block, uint32_t count, FPointer done) {
+        int r = disk_read_blocks(data, block, count);
+        if (r == 0) done.call(0);
+        return r;
+    };
+    virtual int disk_write_async(const char * data, uint32_t block, uint32_t count, FPointer done) {
+        int r = disk_write_blocks(data, block, count);
+        if (r == 0) done.call(0);
+        return r;
+    };
+
     /*
      * Disk initilization
      */
@@ -56,6 +96,9 @@ public:
      */
     virtual bool disk_canDMA() { return 0; };
 
+    /*
+     * wait for anything still going on in the background
+     */
     virtual int disk_sync() { return 0; };
 
     virtual bool busy() = 0;
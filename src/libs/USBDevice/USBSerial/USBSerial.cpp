@@ -24,6 +24,8 @@
 #include "libs/Kernel.h"
 #include "libs/SerialMessage.h"
 #include "StreamOutputPool.h"
+#include "RealtimeCommands.h"
+#include "GcodeDispatch.h"
 
 // extern void setled(int, bool);
 #define setled(a, b) do {} while (0)
@@ -36,6 +38,7 @@ USBSerial::USBSerial(USB *u): USBCDC(u), rxbuf(256 + 8), txbuf(128 + 8)
     nl_in_rx = 0;
     attach = attached = false;
     flush_to_nl = false;
+    realtime_in_line = false;
 }
 
 void USBSerial::ensure_tx_space(int space)
@@ -196,6 +199,10 @@ bool USBSerial::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
     iprintf("Read %ld bytes:\n\t", size);
     for (uint8_t i = 0; i < size; i++) {
 
+        // realtime commands are acted on here rather than queued behind the received lines
+        if (THEKERNEL->realtime_commands->char_received(c[i], this, realtime_in_line))
+            continue;
+
         if (flush_to_nl == false)
             rxbuf.queue(c[i]);
 
@@ -279,7 +286,8 @@ void USBSerial::on_main_loop(void *argument)
             nl_in_rx = 0;
         }
     }
-    if (nl_in_rx)
+    // the lines wait in rxbuf while the gcode dispatch has enough of them held
+    if (nl_in_rx && THEKERNEL->gcode_dispatch->can_take_line())
     {
         string received;
         while (available())
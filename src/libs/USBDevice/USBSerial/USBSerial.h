@@ -74,6 +74,9 @@ protected:
     // flushing until we find a newline.
     // this flag asserts when we are doing this
     bool flush_to_nl;
+
+    // realtime commands are only recognised at the start of a line
+    bool realtime_in_line;
 private:
     USB *usb;
 //     mbed::FunctionPointer rx;
@@ -28,6 +28,15 @@ along with Grbl. If not, see <http://www.gnu.org/licenses/>.
 #define ALPHA_STEPPER 0
 #define BETA_STEPPER 1
 #define GAMMA_STEPPER 2
+#define DELTA_STEPPER 3
+#define EPSILON_STEPPER 4
+#define ZETA_STEPPER 5
+
+// Number of actuators the motion core ( blocks, planner and stepper ) handles, the first three are driven by the arm solution
+// Build with -DN_ACTUATORS=4 ( up to 6 ) for extra actuators, loops over the actuators then have a constant bound the compiler unrolls
+#ifndef N_ACTUATORS
+#define N_ACTUATORS 3
+#endif
 
 #define clear_vector(a) memset(a, 0, sizeof(a))
 #define clear_vector_float(a) memset(a, 0, sizeof(a))
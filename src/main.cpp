@@ -112,7 +112,7 @@ void init() {
         size_t n= sizeof(USBMSD);
         void *v = AHB0.alloc(n);
         memset(v, 0, n); // clear the allocated memory
-        msc= new(v) USBMSD(&u, &sd); // allocate object using zeroed memory
+        msc= new(v) USBMSD(&u, mounter.usb_disk()); // allocate object using zeroed memory
     }else{
         msc= NULL;
         kernel->streams->printf("MSD is disabled\r\n");
@@ -121,13 +121,13 @@ void init() {
 
 
     // Create and add main modules
-    kernel->add_module( new SimpleShell() );
-    kernel->add_module( new Configurator() );
-    kernel->add_module( new CurrentControl() );
-    kernel->add_module( new PauseButton() );
-    kernel->add_module( new PlayLed() );
-    kernel->add_module( new Endstops() );
-    kernel->add_module( new Player() );
+    kernel->add_module( new SimpleShell(), "simple_shell" );
+    kernel->add_module( new Configurator(), "configurator" );
+    kernel->add_module( new CurrentControl(), "current_control" );
+    kernel->add_module( new PauseButton(), "pause_button" );
+    kernel->add_module( new PlayLed(), "play_led" );
+    kernel->add_module( new Endstops(), "endstops" );
+    kernel->add_module( new Player(), "player" );
 
 
     // these modules can be completely disabled in the Makefile by adding to EXCLUDE_MODULES
@@ -149,26 +149,26 @@ void init() {
     delete tp;
     #endif
     #ifndef NO_TOOLS_LASER
-    kernel->add_module( new Laser() );
+    kernel->add_module( new Laser(), "laser" );
     #endif
     #ifndef NO_UTILS_PANEL
-    kernel->add_module( new Panel() );
+    kernel->add_module( new Panel(), "panel" );
     #endif
     #ifndef NO_TOOLS_TOUCHPROBE
-    kernel->add_module( new Touchprobe() );
+    kernel->add_module( new Touchprobe(), "touchprobe" );
     #endif
     #ifndef NO_TOOLS_ZPROBE
-    kernel->add_module( new ZProbe() );
+    kernel->add_module( new ZProbe(), "zprobe" );
     #endif
     #ifndef NO_TOOLS_SCARACAL
-    kernel->add_module( new SCARAcal() );
+    kernel->add_module( new SCARAcal(), "scaracal" );
     #endif
     #ifndef NONETWORK
-    kernel->add_module( new Network() );
+    kernel->add_module( new Network(), "network" );
     #endif
     #ifndef NO_TOOLS_TEMPERATURESWITCH
     // Must be loaded after TemperatureControlPool
-    kernel->add_module( new TemperatureSwitch() );
+    kernel->add_module( new TemperatureSwitch(), "temperature_switch" );
     #endif
 
     // Create and initialize USB stuff
@@ -176,13 +176,13 @@ void init() {
 
 //#ifdef DISABLEMSD
     if(sdok && msc != NULL){
-        kernel->add_module( msc );
+        kernel->add_module( msc, "usb_msd" );
     }
 //#else
 //    kernel->add_module( &msc );
 //#endif
 
-    kernel->add_module( &usbmessagestream );
+    kernel->add_module( &usbmessagestream, "usb_message_stream" );
     //kernel->add_module( &mouse );
    
     //kernel->add_module( &usbserial );
@@ -193,7 +193,10 @@ void init() {
     //if( kernel->config->value( dfu_enable_checksum )->by_default(false)->as_bool() ){
     //    kernel->add_module( new(AHB0) DFU(&u));
     //}
-    kernel->add_module( &u );
+    kernel->add_module( &u, "usb" );
+
+    // every module is loaded, events are called from fixed tables from now on
+    kernel->freeze_events();
 
     // clear up the config cache to save some memory
     kernel->config->config_cache_clear();
@@ -11,10 +11,11 @@ using std::string;
 #include "libs/Module.h"
 #include "libs/Kernel.h"
 #include "utils/Gcode.h"
-#include "Pauser.h"
+#include "RealtimeCommands.h"
 #include "libs/nuts_bolts.h"
 #include "GcodeDispatch.h"
 #include "modules/robot/Conveyor.h"
+#include "modules/robot/Robot.h"
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
@@ -22,6 +23,27 @@ using std::string;
 #include "Config.h"
 #include "checksumm.h"
 #include "ConfigValue.h"
+#include "Task.h"
+
+// Ends once the robot took enough of the queued moves for another one to fit
+class QueueRoomTask : public Task {
+    public:
+        bool run() {
+            TASK_BEGIN();
+            TASK_WAIT_UNTIL(THEKERNEL->gcode_dispatch->feed_moves());
+            TASK_END();
+        }
+};
+
+// Ends once the robot took every queued move, for a gcode that has to act after them
+class FlushTask : public Task {
+    public:
+        bool run() {
+            TASK_BEGIN();
+            TASK_WAIT_UNTIL(THEKERNEL->gcode_dispatch->flushed());
+            TASK_END();
+        }
+};
 
 GcodeDispatch::GcodeDispatch() {}
 
@@ -30,13 +52,185 @@ void GcodeDispatch::on_module_loaded()
 {
     return_error_on_unhandled_gcode = THEKERNEL->config->value( return_error_on_unhandled_gcode_checksum )->by_default(false)->as_bool();
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
+    this->register_for_event(ON_MAIN_LOOP);
     currentline = -1;
     uploading = false;
     last_g= 255;
+    inserting = -1;
 }
 
-// When a command is received, if it is a Gcode, dispatch it as an object via an event
+void GcodeDispatch::on_main_loop(void *argument)
+{
+    if(THEKERNEL->realtime_commands->is_halted()) {
+        this->discard_queued();
+        return;
+    }
+
+    this->resume_held();
+    this->feed_moves();
+}
+
+// Moves are fed to the robot as long as it can take them without waiting for room in the block queue,
+// returns true when there is room for another one
+bool GcodeDispatch::feed_moves()
+{
+    if(THEKERNEL->realtime_commands->is_halted())
+        return true;
+
+    while(this->queued_moves.size() > 0 && !THEKERNEL->robot->is_segmenting() && !THEKERNEL->conveyor->is_queue_full())
+        this->dispatch_next();
+
+    return this->queued_moves.size() < this->queued_moves.capacity();
+}
+
+// A gcode that has to wait for something hands over a task instead of spinning on ON_IDLE : its ok, and the lines
+// received after it, wait for the task to end while the main loop keeps running. The task is deleted once it has ended.
+// One handed over by a gcode that a running task sent goes before that task, which yields to let it run.
+void GcodeDispatch::hold(Task *task)
+{
+    HeldTask held = {task, NULL};
+    if(this->inserting >= 0)
+        this->tasks.insert(this->tasks.begin() + this->inserting++, held);
+    else
+        this->tasks.push_back(held);
+}
+
+// Give the first task a turn, once it has ended the gcode that handed it over is acknowledged,
+// returns true when no task holds the dispatch anymore
+bool GcodeDispatch::run_held()
+{
+    if(this->tasks.empty())
+        return true;
+
+    // waiting for something from inside a task
+    if(this->inserting >= 0)
+        return false;
+
+    this->inserting = 0;
+    bool ended = this->tasks[0].task->run();
+    int at = this->inserting;
+    this->inserting = -1;
+    if(!ended)
+        return false;
+
+    StreamOutput *stream = this->tasks[at].stream;
+    delete this->tasks[at].task;
+    this->tasks.erase(this->tasks.begin() + at);
+    if(at > 0) {
+        // it handed over others as it ended, the ok waits for them
+        this->tasks[at - 1].stream = stream;
+    } else if(stream != NULL) {
+        stream->printf("ok\r\n");
+    }
+    return this->tasks.empty();
+}
+
+// Run the task holding the dispatch, once there is none left let the rest of its line or one of the lines
+// that came in meanwhile through, returns true when nothing is held anymore
+bool GcodeDispatch::resume_held()
+{
+    if(!this->run_held())
+        return false;
+
+    if(!this->rest_of_line.message.empty()) {
+        SerialMessage message = this->rest_of_line;
+        this->rest_of_line.message.clear();
+        this->dispatch_line(&message);
+    } else if(!this->held_lines.empty()) {
+        SerialMessage message = this->held_lines.front();
+        this->held_lines.pop_front();
+        this->dispatch_line(&message);
+    }
+
+    return this->tasks.empty() && this->rest_of_line.message.empty() && this->held_lines.empty();
+}
+
+// The commands after one that handed over a task are dispatched once it has ended, before any other line
+void GcodeDispatch::keep_rest(const string &rest, StreamOutput *stream)
+{
+    this->rest_of_line.message = rest;
+    this->rest_of_line.stream = stream;
+}
+
+// Feed the queued moves to the robot as the block queue has room, returns true once it has appended every segment
+// of them, so whatever follows sees their effect
+bool GcodeDispatch::flushed()
+{
+    if(THEKERNEL->realtime_commands->is_halted()) {
+        this->discard_queued();
+        return true;
+    }
+
+    this->feed_moves();
+    return this->queued_moves.size() == 0 && !THEKERNEL->robot->is_segmenting();
+}
+
+// Hand the oldest queued move to the modules, it was acknowledged when it was queued
+void GcodeDispatch::dispatch_next()
+{
+    Gcode *gcode;
+    this->queued_moves.pop_front(gcode);
+
+    THEKERNEL->call_event(ON_GCODE_RECEIVED, gcode);
+
+    delete gcode;
+}
+
+void GcodeDispatch::discard_queued()
+{
+    while(this->queued_moves.size() > 0) {
+        Gcode *gcode;
+        this->queued_moves.pop_front(gcode);
+        delete gcode;
+    }
+
+    // a task stopping while it runs is deleted from on_main_loop
+    if(this->inserting < 0) {
+        for(auto &held : this->tasks)
+            delete held.task;
+        this->tasks.clear();
+    }
+    this->rest_of_line.message.clear();
+    this->held_lines.clear();
+}
+
+// The stream is about to be deleted, whatever still refers to it answers nowhere instead
+void GcodeDispatch::forget_stream(StreamOutput *stream)
+{
+    for(int i = 0; i < this->queued_moves.size(); i++) {
+        Gcode *gcode = *this->queued_moves.get_ref(i);
+        if(gcode->stream == stream)
+            gcode->stream = &(StreamOutput::NullStream);
+    }
+
+    for(auto &message : this->held_lines) {
+        if(message.stream == stream)
+            message.stream = &(StreamOutput::NullStream);
+    }
+    if(this->rest_of_line.stream == stream)
+        this->rest_of_line.stream = &(StreamOutput::NullStream);
+
+    for(auto &held : this->tasks) {
+        if(held.stream == stream)
+            held.stream = &(StreamOutput::NullStream);
+        held.task->forget_stream(stream);
+    }
+}
+
+// Lines received while a gcode holds the dispatch are kept until it is released, in order. The streams stop
+// reading while can_take_line() is false, so only the lines sent in one go pile up here
 void GcodeDispatch::on_console_line_received(void *line)
+{
+    if(!this->tasks.empty() || !this->rest_of_line.message.empty() || !this->held_lines.empty()) {
+        this->held_lines.push_back(*static_cast<SerialMessage *>(line));
+        return;
+    }
+
+    this->dispatch_line(line);
+}
+
+// When a command is received, if it is a Gcode, dispatch it as an object via an event
+void GcodeDispatch::dispatch_line(void *line)
 {
     SerialMessage new_message = *static_cast<SerialMessage *>(line);
     string possible_command = new_message.message;
@@ -115,6 +309,30 @@ try_again:
 
                     if(gcode->has_g) {
                         last_g= gcode->g;
+
+                        // Moves are parsed ahead : they are acknowledged and queued, on_main_loop feeds them to the robot
+                        // as the block queue has room, so we keep receiving while the planner is full
+                        if(!gcode->has_m && gcode->g <= 3) {
+                            this->queued_moves.push_back(gcode.release());
+                            if(this->queued_moves.size() < this->queued_moves.capacity()) {
+                                new_message.stream->printf("ok\r\n");
+                                continue;
+                            }
+
+                            // that filled it, the ok and the rest of the line wait until the robot took one
+                            this->hold(new QueueRoomTask());
+                            this->tasks.back().stream = new_message.stream;
+                            this->keep_rest(possible_command, new_message.stream);
+                            return;
+                        }
+                    }
+
+                    // Anything else is handled in order with the moves before it, except an emergency stop
+                    if(!(gcode->has_m && gcode->m == 112) && !this->flushed()) {
+                        // they are not all in the block queue yet, this command and the rest of the line wait for them
+                        this->hold(new FlushTask());
+                        this->keep_rest(single_command + possible_command, new_message.stream);
+                        return;
                     }
                     if(gcode->has_m) {
                         switch (gcode->m) {
@@ -124,6 +342,8 @@ try_again:
                                 upload_fd = fopen(this->upload_filename.c_str(), "w");
                                 if(upload_fd != NULL) {
                                     this->uploading = true;
+                                    // the host waits for this answer before sending the file, so nothing is filtered from it
+                                    THEKERNEL->realtime_commands->set_uploading(true);
                                     new_message.stream->printf("Writing to file: %s\r\n", this->upload_filename.c_str());
                                 } else {
                                     new_message.stream->printf("open failed, File: %s.\r\n", this->upload_filename.c_str());
@@ -131,13 +351,9 @@ try_again:
                                 //printf("Start Uploading file: %s, %p\n", upload_filename.c_str(), upload_fd);
                                 continue;
 
-                            case 112: // emergency stop, do the best we can with this
-                                // TODO this really needs to be handled out-of-band
-                                // stops block queue
-                                THEKERNEL->pauser->take();
-                                // disables heaters and motors
-                                THEKERNEL->call_event(ON_HALT);
-                                THEKERNEL->streams->printf("ok Emergency Stop Requested - reset required to continue\r\n");
+                            case 112: // emergency stop, the out-of-band equivalent is the ^X realtime command
+                                // stops block queue, disables heaters and motors and reports it
+                                THEKERNEL->realtime_commands->emergency_stop();
                                 return;
 
                             case 500: // M500 save volatile settings to config-override
@@ -171,7 +387,15 @@ try_again:
 
                     //printf("dispatch %p: '%s' G%d M%d...", gcode.get(), gcode->command.c_str(), gcode->g, gcode->m);
                     //Dispatch message!
+                    size_t held = this->tasks.size();
                     THEKERNEL->call_event(ON_GCODE_RECEIVED, gcode.get() );
+                    if(this->tasks.size() > held) {
+                        // the ok is sent when the task handed to hold() ends, the rest of the line follows it
+                        this->tasks.back().stream = new_message.stream;
+                        this->keep_rest(possible_command, new_message.stream);
+                        return;
+                    }
+
                     if(gcode->add_nl)
                         new_message.stream->printf("\r\n");
 
@@ -189,6 +413,7 @@ try_again:
                         fclose(upload_fd);
                         upload_fd = NULL;
                         uploading = false;
+                        THEKERNEL->realtime_commands->set_uploading(false);
                         upload_filename.clear();
                         new_message.stream->printf("Done saving file.\r\n");
                         continue;
@@ -9,22 +9,56 @@
 #define GCODE_DISPATCH_H
 
 #include <string>
+#include <vector>
+#include <deque>
 using std::string;
 #include "libs/Module.h"
 #include "libs/Kernel.h"
 #include "utils/Gcode.h"
 
 #include "libs/StreamOutput.h"
+#include "libs/RingBuffer.h"
+#include "libs/SerialMessage.h"
+
+class Task;
 #define return_error_on_unhandled_gcode_checksum    CHECKSUM("return_error_on_unhandled_gcode")
 
+// Moves parsed ahead of the planner, the ring buffer holds one less than this, which has to be a power of two
+#define GCODE_DISPATCH_QUEUE_SIZE 8
+// Lines received while a gcode holds the dispatch, the streams stop reading more once this many wait
+#define GCODE_DISPATCH_HELD_LINES 8
+
 class GcodeDispatch : public Module {
     public:
         GcodeDispatch();
 
         virtual void on_module_loaded();
         virtual void on_console_line_received(void* line);
+        virtual void on_main_loop(void* argument);
+        bool flushed();
+        bool feed_moves();
+        void hold(Task* task);
+        bool can_take_line() const { return this->held_lines.size() < GCODE_DISPATCH_HELD_LINES; }
+        void forget_stream(StreamOutput* stream);
         bool return_error_on_unhandled_gcode;
     private:
+        void dispatch_line(void* line);
+        void dispatch_next();
+        void discard_queued();
+        bool run_held();
+        bool resume_held();
+        void keep_rest(const string& rest, StreamOutput* stream);
+
+        RingBuffer<Gcode*, GCODE_DISPATCH_QUEUE_SIZE> queued_moves;
+
+        struct HeldTask {
+            Task *task;
+            StreamOutput *stream;       // The ok goes there once the task ends, null for a gcode sent by a module
+        };
+        std::vector<HeldTask> tasks;    // Handed over by the gcodes, the first one runs and the next lines wait for all of them
+        int inserting;                  // Where the tasks handed over by the one running go, -1 when none runs
+        SerialMessage rest_of_line;     // The commands after the one that handed over a task, on the same line
+        std::deque<SerialMessage> held_lines;
         int currentline;
         bool uploading;
         string upload_filename;
@@ -0,0 +1,166 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RealtimeCommands.h"
+
+#include "libs/Kernel.h"
+#include "libs/StreamOutput.h"
+#include "libs/StreamOutputPool.h"
+#include "Pauser.h"
+#include "Conveyor.h"
+#include "Robot.h"
+#include "Stepper.h"
+
+#include "LPC17xx.h"
+
+// Realtime commands are single bytes that the serial, USB and telnet receive paths hand to us before buffering,
+// so feed hold, resume, abort and status queries do not wait behind the gcode that is already queued.
+// The motors are stopped from the receive interrupt itself: abort drops the enable pins and feed hold has the stepper
+// decelerate to a stop. The rest raises events and uses the streams, so it is done from on_idle, or right away when
+// we were called from thread mode.
+
+RealtimeCommands::RealtimeCommands()
+{
+    this->query_stream = NULL;
+    this->halt_pending = false;
+    this->halted = false;
+    this->holding = false;
+    this->hold_requested = false;
+    this->hold_taken = false;
+    this->uploading = false;
+    this->enabled = false;
+}
+
+void RealtimeCommands::on_module_loaded()
+{
+    this->register_for_event(ON_IDLE);
+
+    // the receive paths may call us before the core modules exist, ignore realtime commands until then
+    this->enabled = true;
+}
+
+// Called from the receive paths for every received char, returns true if it was a realtime command and must not be buffered.
+// in_line belongs to the receive path, it tells whether chars other than line endings were received since the last one
+bool RealtimeCommands::char_received(char c, StreamOutput *stream, bool &in_line)
+{
+    if(!this->enabled) return false;
+
+    if(c == REALTIME_ABORT) {
+        this->emergency_stop();
+        return true;
+    }
+
+    // The file being uploaded gets every char as it was sent
+    if(this->uploading) return false;
+
+    if(c == '\n' || c == '\r') {
+        in_line = false;
+        return false;
+    }
+
+    if(in_line) return false;
+
+    switch(c) {
+        case REALTIME_FEED_HOLD:
+            this->holding = true;
+            this->hold_requested = true;
+            THEKERNEL->stepper->hold();
+            break;
+
+        case REALTIME_RESUME:
+            this->holding = false;
+            break;
+
+        case REALTIME_STATUS:
+            this->query_stream = stream;
+            break;
+
+        default:
+            in_line = true;
+            return false;
+    }
+
+    if(__get_IPSR() == 0) {
+        // not in an interrupt, so it is safe to act right away
+        this->on_idle(NULL);
+    }
+    return true;
+}
+
+// Stop the block queue and turn off heaters and motors, a reset is required to continue
+void RealtimeCommands::emergency_stop()
+{
+    if(this->halted) return;
+    this->halted = true;
+    this->halt_pending = true;
+    THEKERNEL->stepper->emergency_stop();
+
+    if(__get_IPSR() == 0) {
+        this->apply_requests();
+    }
+}
+
+// Act on what was received, from thread mode only
+void RealtimeCommands::apply_requests()
+{
+    if(this->halt_pending) {
+        this->halt_pending = false;
+        // stops block queue
+        if(!this->hold_taken) THEKERNEL->pauser->take();
+        this->hold_taken = true;
+        // disables heaters and motors
+        THEKERNEL->call_event(ON_HALT);
+        THEKERNEL->streams->printf("ok Emergency Stop Requested - reset required to continue\r\n");
+    }
+
+    // The stepper is already stopping, take the pauser for it even if ~ came before we got here, the release below
+    // then restarts it
+    if(this->hold_requested) {
+        this->hold_requested = false;
+        if(!this->hold_taken) THEKERNEL->pauser->take();
+        this->hold_taken = true;
+    }
+
+    if(!this->halted && this->holding != this->hold_taken) {
+        this->hold_taken = this->holding;
+        if(this->hold_taken) {
+            THEKERNEL->pauser->take();
+        } else {
+            THEKERNEL->pauser->release();
+        }
+    }
+}
+
+void RealtimeCommands::report_status(StreamOutput *stream)
+{
+    const char *state;
+    if(this->halted) {
+        state = "Alarm";
+    } else if(THEKERNEL->pauser->paused()) {
+        state = "Hold";
+    } else if(!THEKERNEL->conveyor->is_queue_empty()) {
+        state = "Run";
+    } else {
+        state = "Idle";
+    }
+
+    float pos[N_ACTUATORS];
+    THEKERNEL->robot->get_current_machine_position(pos);
+    stream->printf("<%s,MPos:%1.4f,%1.4f,%1.4f>\r\n", state, THEKERNEL->robot->from_millimeters(pos[0]), THEKERNEL->robot->from_millimeters(pos[1]), THEKERNEL->robot->from_millimeters(pos[2]));
+}
+
+// Act on and answer realtime commands received in interrupt context
+void RealtimeCommands::on_idle(void *argument)
+{
+    this->apply_requests();
+
+    StreamOutput *stream = this->query_stream;
+    if(stream != NULL) {
+        this->query_stream = NULL;
+        this->report_status(stream);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REALTIMECOMMANDS_H
+#define REALTIMECOMMANDS_H
+
+#include "libs/Module.h"
+
+class StreamOutput;
+
+// Single byte commands that are acted on as soon as they are received, ahead of any buffered gcode.
+// Except for abort, they are only recognised at the start of a line, so they can still appear in comments and M117 text
+#define REALTIME_FEED_HOLD '!'
+#define REALTIME_RESUME    '~'
+#define REALTIME_STATUS    '?'
+#define REALTIME_ABORT     0x18 // ^X
+
+class RealtimeCommands : public Module {
+    public:
+        RealtimeCommands();
+
+        void on_module_loaded();
+        void on_idle(void *argument);
+
+        bool char_received(char c, StreamOutput *stream, bool &in_line);
+        void emergency_stop();
+        void report_status(StreamOutput *stream);
+        void set_uploading(bool uploading) { this->uploading = uploading; }
+
+        bool is_halted() const { return halted; }
+
+    private:
+        void apply_requests();
+
+        StreamOutput * volatile query_stream;
+        volatile bool halt_pending;  // Abort received in an interrupt, ON_HALT is sent from on_idle
+        volatile bool halted;
+        volatile bool holding;       // Feed hold asked for by ! and ended by ~
+        volatile bool hold_requested; // The stepper was told to stop by !, the pauser is taken from on_idle
+        bool hold_taken;             // The pauser is taken for the feed hold
+        volatile bool uploading;     // M28 upload in progress, everything received goes into the file
+        bool enabled;
+};
+
+#endif
@@ -16,6 +16,8 @@ using std::string;
 #include "libs/SerialMessage.h"
 #include "libs/StreamOutput.h"
 #include "libs/StreamOutputPool.h"
+#include "RealtimeCommands.h"
+#include "GcodeDispatch.h"
 
 // Serial reading module
 // Treats every received line as a command and passes it ( via event call ) to the command dispatcher.
@@ -23,6 +25,7 @@ using std::string;
 SerialConsole::SerialConsole( PinName rx_pin, PinName tx_pin, int baud_rate ){
     this->serial = new mbed::Serial( rx_pin, tx_pin );
     this->serial->baud(baud_rate);
+    this->realtime_in_line = false;
 }
 
 // Called when the module has just been loaded
@@ -41,6 +44,8 @@ void SerialConsole::on_module_loaded() {
 void SerialConsole::on_serial_char_received(){
     while(this->serial->readable()){
         char received = this->serial->getc();
+        // realtime commands are acted on here rather than queued behind the received lines
+        if( THEKERNEL->realtime_commands->char_received(received, this, this->realtime_in_line) ){ continue; }
         // convert CR to NL (for host OSs that don't send NL)
         if( received == '\r' ){ received = '\n'; }
         this->buffer.push_back(received);
@@ -48,8 +53,9 @@ void SerialConsole::on_serial_char_received(){
 }
 
 // Actual event calling must happen in the main loop because if it happens in the interrupt we will loose data
+// The lines wait in the buffer while the gcode dispatch has enough of them held
 void SerialConsole::on_main_loop(void * argument){
-    if( this->has_char('\n') ){
+    if( this->has_char('\n') && THEKERNEL->gcode_dispatch->can_take_line() ){
         string received;
         received.reserve(20);
         while(1){
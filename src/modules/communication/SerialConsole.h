@@ -36,6 +36,7 @@ class SerialConsole : public Module, public StreamOutput {
         //string receive_buffer;                 // Received chars are stored here until a newline character is received
         //vector<std::string> received_lines;    // Received lines are stored here until they are requested
         RingBuffer<char,256> buffer;             // Receive buffer
+        bool realtime_in_line;                   // Realtime commands are only recognised at the start of a line
         mbed::Serial* serial;
 };
 
@@ -42,12 +42,18 @@ void Block::clear()
     clear_vector(this->steps);
 
     steps_event_count   = 0;
+    extruder            = NULL;
+    extruder_steps      = 0;
     nominal_rate        = 0;
     nominal_speed       = 0.0F;
+    requested_speed     = 0.0F;
+    max_speed           = 0.0F;
     millimeters         = 0.0F;
     entry_speed         = 0.0F;
     exit_speed          = 0.0F;
     rate_delta          = 0.0F;
+    acceleration        = 0.0F;
+    junction_deviation  = 0.0F;
     initial_rate        = -1;
     final_rate          = -1;
     accelerate_until    = 0;
@@ -56,28 +62,32 @@ void Block::clear()
     recalculate_flag    = false;
     nominal_length_flag = false;
     max_entry_speed     = 0.0F;
+    max_junction_speed  = 0.0F;
     is_ready            = false;
     times_taken         = 0;
 }
 
 void Block::debug()
 {
-    THEKERNEL->streams->printf("%p: steps:X%04d Y%04d Z%04d(max:%4d) nominal:r%10d/s%6.1f mm:%9.6f rdelta:%8f acc:%5d dec:%5d rates:%10d>%10d  entry/max: %10.4f/%10.4f taken:%d ready:%d recalc:%d nomlen:%d\r\n",
-                               this,
-                                         this->steps[0],
-                                               this->steps[1],
-                                                      this->steps[2],
+    // One step count for each actuator, X Y Z then the extra actuators' A B C
+    THEKERNEL->streams->printf("%p: steps:", this);
+    for (int i = 0; i < N_ACTUATORS; i++)
+        THEKERNEL->streams->printf("%c%04d ", "XYZABC"[i], this->steps[i]);
+
+    THEKERNEL->streams->printf("E%04d(max:%4d) nominal:r%10d/s%6.1f mm:%9.6f rdelta:%8f dec:%5d rates:%10d>%10d  entry/max: %10.4f/%10.4f accel:%8.2f jd:%6.4f taken:%d ready:%d recalc:%d nomlen:%d\r\n",
+                                                      this->extruder_steps,
                                                                this->steps_event_count,
                                                                              this->nominal_rate,
                                                                                    this->nominal_speed,
                                                                                             this->millimeters,
                                                                                                          this->rate_delta,
-                                                                                                                 this->accelerate_until,
                                                                                                                          this->decelerate_after,
                                                                                                                                    this->initial_rate,
                                                                                                                                         this->final_rate,
                                                                                                                                                           this->entry_speed,
                                                                                                                                                                 this->max_entry_speed,
+                                                                                                                                                                             this->acceleration,
+                                                                                                                                                                             this->junction_deviation,
                                                                                                                                                                              this->times_taken,
                                                                                                                                                                                       this->is_ready,
                                                                                                                                                                                                 recalculate_flag?1:0,
@@ -128,6 +138,35 @@ void Block::calculate_trapezoid( float entryspeed, float exitspeed )
     this->exit_speed = exitspeed;
 }
 
+// Called by the stepper when a feed hold stopped this block after stopped_at steps and it is resumed.
+// What is left of the block starts again from a standstill, so its trapezoid is recalculated for the remaining steps,
+// and its exit speed lowered if it can't be reached anymore, the planner then replans the following blocks from it.
+void Block::restart_from_standstill( unsigned int stopped_at )
+{
+    float acceleration_per_second = this->rate_delta * THEKERNEL->stepper->get_acceleration_ticks_per_second(); // ( step/s^2)
+    int steps_left = this->steps_event_count - stopped_at;
+
+    float reachable_rate = sqrtf(2.0F * acceleration_per_second * steps_left);
+    if (this->final_rate > reachable_rate) {
+        this->final_rate = floor(reachable_rate);
+        this->exit_speed = this->nominal_speed * this->final_rate / this->nominal_rate;
+    }
+    this->initial_rate = 0;
+
+    int accelerate_steps = ceil( this->estimate_acceleration_distance( 0, this->nominal_rate, acceleration_per_second ) );
+    int decelerate_steps = floor( this->estimate_acceleration_distance( this->nominal_rate, this->final_rate,  -acceleration_per_second ) );
+    int plateau_steps = steps_left - accelerate_steps - decelerate_steps;
+
+    if (plateau_steps < 0) {
+        accelerate_steps = ceil(this->intersection_distance(0, this->final_rate, acceleration_per_second, steps_left));
+        accelerate_steps = max( accelerate_steps, 0 ); // Check limits due to numerical round-off
+        accelerate_steps = min( accelerate_steps, steps_left );
+        plateau_steps = 0;
+    }
+    this->accelerate_until = stopped_at + accelerate_steps;
+    this->decelerate_after = stopped_at + accelerate_steps + plateau_steps;
+}
+
 // Calculates the distance (not time) it takes to accelerate from initial_rate to target_rate using the
 // given acceleration:
 float Block::estimate_acceleration_distance(float initialrate, float targetrate, float acceleration)
@@ -174,7 +213,7 @@ float Block::reverse_pass(float exit_speed)
         // for max allowable speed if block is decelerating and nominal length is false.
         if ((!this->nominal_length_flag) && (this->max_entry_speed > exit_speed))
         {
-            float max_entry_speed = max_allowable_speed(-THEKERNEL->planner->get_acceleration(), exit_speed, this->millimeters);
+            float max_entry_speed = max_allowable_speed(-this->acceleration, exit_speed, this->millimeters);
 
             this->entry_speed = min(max_entry_speed, this->max_entry_speed);
 
@@ -231,7 +270,7 @@ float Block::max_exit_speed()
         return nominal_speed;
 
     // otherwise, we have to work out max exit speed based on entry and acceleration
-    float max = max_allowable_speed(-THEKERNEL->planner->get_acceleration(), this->entry_speed, this->millimeters);
+    float max = max_allowable_speed(-this->acceleration, this->entry_speed, this->millimeters);
 
     return min(max, nominal_speed);
 }
@@ -11,12 +11,16 @@
 #include <vector>
 #include <bitset>
 
+#include "libs/nuts_bolts.h"
+
 class Gcode;
+class StepperMotor;
 
 class Block {
     public:
         Block();
         void calculate_trapezoid( float entry_speed, float exit_speed );
+        void restart_from_standstill( unsigned int stopped_at );
         float estimate_acceleration_distance( float initial_rate, float target_rate, float acceleration );
         float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance);
         float get_duration_left(unsigned int already_taken_steps);
@@ -42,19 +46,25 @@ class Block {
 
         std::vector<Gcode> gcodes;
 
-        unsigned int   steps[3];           // Number of steps for each axis for this block
+        unsigned int   steps[N_ACTUATORS]; // Number of steps for each actuator for this block
         unsigned int   steps_event_count;  // Steps for the longest axis
+        StepperMotor  *extruder;           // Extruder following this block, stepped from the steps of its longest axis
+        unsigned int   extruder_steps;     // Number of steps for that extruder
         unsigned int   nominal_rate;       // Nominal rate in steps per second
         float          nominal_speed;      // Nominal speed in mm per second
+        float          requested_speed;    // Speed asked for by the gcode in mm per second, before the feed override
+        float          max_speed;          // Fastest this move may go without exceeding axis and actuator limits, in mm per second
         float          millimeters;        // Distance for this move
         float          entry_speed;
         float          exit_speed;
         float          rate_delta;         // Nomber of steps to add to the speed for each acceleration tick
+        float          acceleration;       // Acceleration for this move in mm/s^2, captured when the block is planned
+        float          junction_deviation; // Junction deviation used to plan the entry of this block
         unsigned int   initial_rate;       // Initial speed in steps per second
         unsigned int   final_rate;         // Final speed in steps per second
         unsigned int   accelerate_until;   // Stop accelerating after this number of steps
         unsigned int   decelerate_after;   // Start decelerating after this number of steps
-        std::bitset<3> direction_bits;     // Direction for each axis in bit form, relative to the direction port's mask
+        std::bitset<N_ACTUATORS> direction_bits; // Direction for each actuator in bit form, relative to the direction port's mask
 
         struct {
             bool recalculate_flag:1;             // Planner flag to recalculate trapezoids on entry junction
@@ -63,6 +73,7 @@ class Block {
         };
 
         float max_entry_speed;
+        float max_junction_speed;   // Entry speed limit from the junction angle alone, max_entry_speed is also limited by the nominal speeds
 
         short times_taken;    // A block can be "taken" by any number of modules, and the next block is not moved to until all the modules have "released" it. This value serves as a tracker.
 
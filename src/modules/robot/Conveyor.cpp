@@ -17,6 +17,8 @@ using namespace std;
 #include "Block.h"
 #include "Conveyor.h"
 #include "Planner.h"
+#include "Robot.h"
+#include "modules/communication/GcodeDispatch.h"
 #include "mri.h"
 #include "checksumm.h"
 #include "Config.h"
@@ -25,6 +27,18 @@ using namespace std;
 
 #define planner_queue_size_checksum CHECKSUM("planner_queue_size")
 
+// Ends once the head block that found the queue full has been pushed, the gcodes after it wait for that
+class QueueHeadTask : public Task
+{
+public:
+    bool run()
+    {
+        TASK_BEGIN();
+        TASK_WAIT_UNTIL(!THEKERNEL->conveyor->head_pending);
+        TASK_END();
+    }
+};
+
 /*
  * The conveyor holds the queue of blocks, takes care of creating them, and starting the executing chain of blocks
  *
@@ -55,6 +69,7 @@ using namespace std;
 Conveyor::Conveyor(){
     gc_pending = queue.tail_i;
     running = false;
+    head_pending = false;
 }
 
 void Conveyor::on_module_loaded(){
@@ -101,6 +116,12 @@ void Conveyor::on_idle(void* argument){
 
 void Conveyor::on_main_loop(void*)
 {
+    if (head_pending && !queue.is_full())
+    {
+        head_pending = false;
+        queue_head_block();
+    }
+
     if (running)
         return;
 
@@ -149,25 +170,35 @@ void Conveyor::on_block_end(void* block)
     next->begin();
 }
 
-// Wait for the queue to be empty
-void Conveyor::wait_for_empty_queue()
+// True once the queue is empty and the robot has no segments of a move left to append to it
+bool Conveyor::is_idle()
 {
-    while (!queue.is_empty())
-    {
-        ensure_running();
-        THEKERNEL->call_event(ON_IDLE, this);
-    }
+    return queue.is_empty() && !head_pending && !THEKERNEL->robot->is_segmenting();
+}
+
+bool EmptyQueueTask::run()
+{
+    TASK_BEGIN();
+    TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+    TASK_END();
 }
 
 /*
  * push the pre-prepared head block onto the queue
+ * when the queue is full the head is left pending instead of waiting for room : is_queue_full() stays true so nothing
+ * else is appended, the gcode dispatch is held until on_main_loop pushes it
  */
 void Conveyor::queue_head_block()
 {
-    while (queue.is_full())
+    if (queue.is_full())
     {
+        if (!head_pending)
+        {
+            head_pending = true;
+            THEKERNEL->gcode_dispatch->hold(new QueueHeadTask());
+        }
         ensure_running();
-        THEKERNEL->call_event(ON_IDLE, this);
+        return;
     }
 
     queue.head_ref()->ready();
@@ -10,6 +10,7 @@
 
 #include "libs/Module.h"
 #include "HeapRing.h"
+#include "Task.h"
 
 using namespace std;
 #include <string>
@@ -31,8 +32,9 @@ public:
 
     void notify_block_finished(Block *);
 
-    void wait_for_empty_queue();
+    bool is_idle();
     bool is_queue_empty() { return queue.is_empty(); };
+    bool is_queue_full() { return head_pending || queue.is_full(); };
 
     void ensure_running(void);
 
@@ -42,6 +44,7 @@ public:
     void dump_queue(void);
 
     friend class Planner; // for queue
+    friend class QueueHeadTask; // for head_pending
 
 private:
     typedef HeapRing<Block> Queue_t;
@@ -49,8 +52,16 @@ private:
     Queue_t queue;  // Queue of Blocks
 
     volatile bool running;
+    bool head_pending;  // The head block found the queue full, on_main_loop pushes it once there is room
 
     volatile unsigned int gc_pending;
 };
 
+// Ends once every move sent so far has been done, for the gcodes that have to wait for that before they act
+class EmptyQueueTask : public Task
+{
+public:
+    bool run();
+};
+
 #endif // CONVEYOR_H
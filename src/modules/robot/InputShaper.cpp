@@ -0,0 +1,182 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "InputShaper.h"
+
+#include "cmsis.h"
+
+#include <math.h>
+#include <string.h>
+
+// The input shaper sits between the trapezoid generator and the stepper motors : every acceleration tick the speed
+// along the path is convolved with a train of impulses, so that the vibration excited by each speed change is
+// cancelled by the following ones. Each actuator has its own resonance frequency and damping, and the shapers of
+// the actuators a block moves are applied one after the other, which is the same as convolving them together but
+// costs at most three impulses per actuator each tick. Every shaper keeps its input history even when the block
+// does not go through it, so it can be switched in at the next block.
+// Shaping delays are whole acceleration ticks, so acceleration_ticks_per_second must be well above twice the highest
+// resonance frequency ( 1000 is a good value ) for the shaper to be accurate.
+
+InputShaper::InputShaper()
+{
+    this->type = INPUT_SHAPER_ZVD;
+    for (int i = 0; i < N_ACTUATORS; i++) {
+        this->frequency[i] = 0.0F;
+        this->damping[i] = 0.1F;
+        memset(&this->stages[i], 0, sizeof(Stage));
+    }
+    this->ticks_per_second = 0;
+    this->active = 0;
+    this->selected = 0;
+    this->shaped_speed = 0.0F;
+}
+
+InputShaper::~InputShaper()
+{
+    for (int i = 0; i < N_ACTUATORS; i++)
+        delete [] this->stages[i].history;
+}
+
+void InputShaper::set_actuator(int actuator, float frequency, float damping)
+{
+    this->frequency[actuator] = frequency > 0.0F ? frequency : 0.0F;
+    this->damping[actuator] = damping < 0.0F ? 0.0F : (damping > 0.9F ? 0.9F : damping);
+}
+
+// Must be called after the settings changed. This can be done while moving : the new shapers are swapped in with
+// interrupts off, and their histories carry on from the old ones so the speed does not jump
+void InputShaper::update(int ticks_per_second)
+{
+    Stage next[N_ACTUATORS];
+    uint8_t active = 0;
+
+    for (int i = 0; i < N_ACTUATORS; i++) {
+        float amplitudes[INPUT_SHAPER_MAX_IMPULSES], times[INPUT_SHAPER_MAX_IMPULSES];
+        next[i].count = this->actuator_impulses(i, amplitudes, times);
+        next[i].history = 0;
+        next[i].size = 0;
+        next[i].index = 0;
+        if (next[i].count == 0) continue;
+
+        // The history must cover the longest delay
+        int size = lroundf(times[next[i].count - 1] * ticks_per_second) + 1;
+        if (size > INPUT_SHAPER_MAX_HISTORY) size = INPUT_SHAPER_MAX_HISTORY;
+
+        for (int m = 0; m < next[i].count; m++) {
+            int delay = lroundf(times[m] * ticks_per_second);
+            next[i].amplitude[m] = amplitudes[m];
+            next[i].delay[m] = delay < size ? delay : size - 1;
+        }
+        next[i].history = new float[size];
+        next[i].size = size;
+        active |= (1 << i);
+    }
+
+    __disable_irq();
+    for (int i = 0; i < N_ACTUATORS; i++) {
+        // The sample k ticks old goes k places before the next one to be written, which is at index 0. Further back
+        // than the old history goes, its oldest sample is repeated, or the last shaped speed if there was no history
+        Stage &old = this->stages[i];
+        float speed = this->shaped_speed;
+        for (int k = 1; k <= next[i].size; k++) {
+            if (k <= old.size) {
+                int index = old.index - k;
+                speed = old.history[index < 0 ? index + old.size : index];
+            }
+            next[i].history[next[i].size - k] = speed;
+        }
+        float *history = old.history;
+        old = next[i];
+        next[i].history = history;
+    }
+    this->ticks_per_second = ticks_per_second;
+    this->active = active;
+    this->selected &= active;
+    __enable_irq();
+
+    for (int i = 0; i < N_ACTUATORS; i++)
+        delete [] next[i].history;
+}
+
+// Impulse amplitudes and times in seconds for one actuator's shaper, returns how many there are
+int InputShaper::actuator_impulses(int actuator, float amplitudes[], float times[])
+{
+    float f = this->frequency[actuator];
+    if (f <= 0.0F) return 0;
+
+    float zeta = this->damping[actuator];
+    float root = sqrtf(1.0F - zeta * zeta);
+    float damped_period = 1.0F / (f * root);
+    float k = expf(-zeta * M_PI / root);
+    int count;
+
+    switch (this->type) {
+        case INPUT_SHAPER_ZV:
+            amplitudes[0] = 1.0F;
+            amplitudes[1] = k;
+            times[0] = 0.0F;
+            times[1] = 0.5F * damped_period;
+            count = 2;
+            break;
+
+        case INPUT_SHAPER_MZV: {
+            k = expf(-0.75F * zeta * M_PI / root);
+            float a1 = 1.0F - 1.0F / sqrtf(2.0F);
+            amplitudes[0] = a1;
+            amplitudes[1] = (sqrtf(2.0F) - 1.0F) * k;
+            amplitudes[2] = a1 * k * k;
+            times[0] = 0.0F;
+            times[1] = 0.375F * damped_period;
+            times[2] = 0.75F * damped_period;
+            count = 3;
+            break;
+        }
+
+        default: // INPUT_SHAPER_ZVD
+            amplitudes[0] = 1.0F;
+            amplitudes[1] = 2.0F * k;
+            amplitudes[2] = k * k;
+            times[0] = 0.0F;
+            times[1] = 0.5F * damped_period;
+            times[2] = damped_period;
+            count = 3;
+            break;
+    }
+
+    // The amplitudes must add up to one so the shaped move covers the same distance
+    float sum = 0.0F;
+    for (int i = 0; i < count; i++) sum += amplitudes[i];
+    for (int i = 0; i < count; i++) amplitudes[i] /= sum;
+
+    return count;
+}
+
+// Called every acceleration tick with the speed along the path in mm/s, returns the speed to actually move at
+float InputShaper::shape(float speed)
+{
+    for (int i = 0; i < N_ACTUATORS; i++) {
+        Stage &stage = this->stages[i];
+        if (stage.size == 0) continue;
+
+        stage.history[stage.index] = speed;
+
+        if (this->selected & (1 << i)) {
+            float shaped = 0.0F;
+            for (int m = 0; m < stage.count; m++) {
+                int index = stage.index - stage.delay[m];
+                if (index < 0) index += stage.size;
+                shaped += stage.amplitude[m] * stage.history[index];
+            }
+            speed = shaped;
+        }
+
+        if (++stage.index >= stage.size) stage.index = 0;
+    }
+
+    this->shaped_speed = speed;
+    return speed;
+}
@@ -0,0 +1,67 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INPUTSHAPER_H
+#define INPUTSHAPER_H
+
+#include <stdint.h>
+
+#include "libs/nuts_bolts.h"
+
+#define INPUT_SHAPER_ZV  0
+#define INPUT_SHAPER_ZVD 1
+#define INPUT_SHAPER_MZV 2
+
+// Longest delay we keep speed history for, in acceleration ticks, for each actuator
+#define INPUT_SHAPER_MAX_HISTORY 256
+// Most impulses a shaper has, ZVD and MZV have three
+#define INPUT_SHAPER_MAX_IMPULSES 3
+
+class InputShaper
+{
+public:
+    InputShaper();
+    ~InputShaper();
+
+    void set_type(uint8_t type) { this->type = type; }
+    uint8_t get_type() const { return type; }
+    void set_actuator(int actuator, float frequency, float damping);
+    float get_frequency(int actuator) const { return frequency[actuator]; }
+    float get_damping(int actuator) const { return damping[actuator]; }
+    void update(int ticks_per_second);
+
+    bool is_active() const { return active != 0; }
+    void select_actuators(uint8_t actuators) { this->selected = actuators & this->active; }
+    float shape(float speed);
+    float get_shaped_speed() const { return shaped_speed; }
+
+private:
+    int actuator_impulses(int actuator, float amplitudes[], float times[]);
+
+    // The shaper of one actuator, they are applied one after the other
+    struct Stage {
+        float amplitude[INPUT_SHAPER_MAX_IMPULSES];
+        uint16_t delay[INPUT_SHAPER_MAX_IMPULSES];  // In acceleration ticks
+        uint8_t count;
+        float *history;     // Speeds in mm/s going into this stage for the last size acceleration ticks
+        uint16_t size;
+        uint16_t index;
+    };
+
+    Stage stages[N_ACTUATORS];
+    uint8_t active;         // A bit for each actuator that has a shaper
+    volatile uint8_t selected; // A bit for each shaper the current block goes through
+
+    uint8_t type;
+    float frequency[N_ACTUATORS];   // Resonance frequency in Hz for each actuator, 0 to not shape it
+    float damping[N_ACTUATORS];     // Damping ratio for each actuator
+    int ticks_per_second;
+
+    float shaped_speed;
+};
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "libs/Kernel.h"
 #include "Block.h"
+#include "Stepper.h"
 #include "libs/nuts_bolts.h"
 #include "libs/utils.h"
 
@@ -30,7 +31,8 @@ void Pauser::on_block_begin(void* argument)
 {
     Block* block = static_cast<Block*>(argument);
 
-    if (counter)
+    // While the stepper decelerates to a stop for a feed hold it carries on into the next block, so don't hold that one
+    if (counter && !THEKERNEL->stepper->is_stopping_for_hold())
     {
         block->take();
         paused_block = block;
@@ -38,6 +38,11 @@ using namespace std;
 
 Planner::Planner(){
     clear_vector_float(this->previous_unit_vec);
+    this->feed_override = 1.0F;
+    this->path_tolerance = 0.0F;
+    this->exact_stop = false;
+    this->batching = false;
+    this->unplanned_blocks = 0;
     config_load();
 }
 
@@ -52,7 +57,7 @@ void Planner::config_load(){
 
 
 // Append a block to the queue, compute it's speed factors
-void Planner::append_block( float actuator_pos[], float rate_mm_s, float distance, float unit_vec[] )
+void Planner::append_block( float actuator_pos[], float rate_mm_s, float max_rate_mm_s, float distance, float unit_vec[] )
 {
     float acceleration;
 
@@ -61,7 +66,7 @@ void Planner::append_block( float actuator_pos[], float rate_mm_s, float distanc
 
 
     // Direction bits
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < N_ACTUATORS; i++)
     {
         int steps = THEKERNEL->robot->actuators[i]->steps_to_target(actuator_pos[i]);
 
@@ -82,20 +87,27 @@ void Planner::append_block( float actuator_pos[], float rate_mm_s, float distanc
         acceleration= this->acceleration;
     }
 
-    // Max number of steps, for all axes
-    block->steps_event_count = max( block->steps[ALPHA_STEPPER], max( block->steps[BETA_STEPPER], block->steps[GAMMA_STEPPER] ) );
+    // Acceleration and junction deviation are captured in the block so they can be changed by
+    // M204/M205 while the queue is running without affecting moves that are already planned
+    block->acceleration = acceleration;
+    // G64 P : the junction deviation is the distance from the corner to the arc the move could be blended with,
+    // so a blending tolerance is used as the junction deviation
+    block->junction_deviation = this->path_tolerance > 0.0F ? this->path_tolerance : this->junction_deviation;
+
+    // Max number of steps, for all actuators
+    block->steps_event_count = 0;
+    for (int i = 0; i < N_ACTUATORS; i++)
+        block->steps_event_count = max( block->steps_event_count, block->steps[i] );
 
     block->millimeters = distance;
 
+    // Keep the requested speed and the speed limit so the feed override can be changed while the block is queued
+    block->requested_speed = rate_mm_s;
+    block->max_speed = max_rate_mm_s;
+
     // Calculate speed in mm/sec for each axis. No divide by zero due to previous checks.
     // NOTE: Minimum stepper speed is limited by MINIMUM_STEPS_PER_MINUTE in stepper.c
-    if( distance > 0.0F ){
-        block->nominal_speed = rate_mm_s;           // (mm/s) Always > 0
-        block->nominal_rate = ceil(block->steps_event_count * rate_mm_s / distance); // (step/s) Always > 0
-    }else{
-        block->nominal_speed = 0.0F;
-        block->nominal_rate  = 0;
-    }
+    this->apply_feed_override(block);
 
     // Compute the acceleration rate for the trapezoid generator. Depending on the slope of the line
     // average travel per step event changes. For a line along one axis the travel per step event
@@ -116,26 +128,31 @@ void Planner::append_block( float actuator_pos[], float rate_mm_s, float distanc
     // from path, but used as a robust way to compute cornering speeds, as it takes into account the
     // nonlinearities of both the junction angle and junction velocity.
     float vmax_junction = minimum_planner_speed; // Set default max junction speed
+    block->max_junction_speed = minimum_planner_speed;
 
-    if (!THEKERNEL->conveyor->is_queue_empty())
+    // In G61 exact stop mode, every block keeps the default and starts from minimum_planner_speed
+    if (!this->exact_stop && !THEKERNEL->conveyor->is_queue_empty())
     {
         float previous_nominal_speed = THEKERNEL->conveyor->queue.item_ref(THEKERNEL->conveyor->queue.prev(THEKERNEL->conveyor->queue.head_i))->nominal_speed;
 
         if (previous_nominal_speed > 0.0F) {
             // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
             // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
-            float cos_theta = - this->previous_unit_vec[X_AXIS] * unit_vec[X_AXIS]
-                                - this->previous_unit_vec[Y_AXIS] * unit_vec[Y_AXIS]
-                                - this->previous_unit_vec[Z_AXIS] * unit_vec[Z_AXIS] ;
+            // The extra axes are part of the path, a reversal on one of them is a corner too
+            float cos_theta = 0.0F;
+            for (int axis = 0; axis < N_ACTUATORS; axis++)
+                cos_theta -= this->previous_unit_vec[axis] * unit_vec[axis];
 
             // Skip and use default max junction speed for 0 degree acute junction.
             if (cos_theta < 0.95F) {
                 vmax_junction = min(previous_nominal_speed, block->nominal_speed);
+                block->max_junction_speed = block->max_speed;
                 // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
                 if (cos_theta > -0.95F) {
                     // Compute maximum junction velocity based on maximum acceleration and junction deviation
                     float sin_theta_d2 = sqrtf(0.5F * (1.0F - cos_theta)); // Trig half angle identity. Always positive.
-                    vmax_junction = min(vmax_junction, sqrtf(acceleration * this->junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2)));
+                    block->max_junction_speed = sqrtf(acceleration * block->junction_deviation * sin_theta_d2 / (1.0F - sin_theta_d2));
+                    vmax_junction = min(vmax_junction, block->max_junction_speed);
                 }
             }
         }
@@ -163,8 +180,15 @@ void Planner::append_block( float actuator_pos[], float rate_mm_s, float distanc
     // Update previous path unit_vector and nominal speed
     memcpy(this->previous_unit_vec, unit_vec, sizeof(previous_unit_vec)); // previous_unit_vec[] = unit_vec[]
 
-    // Math-heavy re-computing of the whole queue to take the new
-    this->recalculate();
+    // Math-heavy re-computing of the whole queue to take the new block into account. When batching, this is done once
+    // for the whole batch instead, as long as enough planned blocks are queued ahead of it for the stepper to keep busy
+    if (this->batching && this->can_defer_recalculate()) {
+        // Until it is planned the block stops at its end, like the newest block does, so it is safe to execute
+        block->calculate_trapezoid(minimum_planner_speed, minimum_planner_speed);
+        this->unplanned_blocks++;
+    } else {
+        this->recalculate();
+    }
 
     // The block can now be used
     block->ready();
@@ -172,11 +196,149 @@ void Planner::append_block( float actuator_pos[], float rate_mm_s, float distanc
     THEKERNEL->conveyor->queue_head_block();
 }
 
+// Set the nominal speed and rate of a block from its requested speed and the current feed override
+void Planner::apply_feed_override(Block *block)
+{
+    if( block->millimeters > 0.0F ){
+        block->nominal_speed = min(block->requested_speed * this->feed_override, block->max_speed); // (mm/s) Always > 0
+        block->nominal_rate = ceil(block->steps_event_count * block->nominal_speed / block->millimeters); // (step/s) Always > 0
+    }else{
+        block->nominal_speed = 0.0F;
+        block->nominal_rate  = 0;
+    }
+}
+
+// Give the block being executed a new nominal rate, which the step generator ramps to with its own acceleration.
+// Its trapezoid can't be recalculated, but the step generator follows nominal_rate and decelerate_after live. When
+// slowing down, the exit speed is also lowered so the next block can still enter at it
+void Planner::apply_feed_override_live(Block *block, float ratio)
+{
+    float nominal_speed = min(block->requested_speed * this->feed_override, block->max_speed);
+    unsigned int nominal_rate = ceil(block->steps_event_count * nominal_speed / block->millimeters);
+    float exit_speed = block->exit_speed;
+    unsigned int final_rate = block->final_rate;
+    if (ratio < 1.0F) {
+        exit_speed *= ratio;
+        final_rate = min(nominal_rate, (unsigned int)ceil(final_rate * ratio));
+    }
+    float acceleration_per_second = block->rate_delta * THEKERNEL->stepper->get_acceleration_ticks_per_second();
+    int decelerate_steps = floor( block->estimate_acceleration_distance( nominal_rate, final_rate, -acceleration_per_second ) );
+    unsigned int decelerate_after = max(int(block->steps_event_count) - decelerate_steps, 0);
+
+    // The step generator reads these from its interrupt, it must never see half of them changed
+    __disable_irq();
+    block->nominal_speed    = nominal_speed;
+    block->nominal_rate     = nominal_rate;
+    block->exit_speed       = exit_speed;
+    block->final_rate       = final_rate;
+    block->decelerate_after = decelerate_after;
+    __enable_irq();
+}
+
+// Change the feed override, 1.0 is 100%. Blocks already in the queue are replanned at the new speed,
+// and the block being executed is changed in place
+void Planner::set_feed_override(float factor)
+{
+    Conveyor::Queue_t &queue = THEKERNEL->conveyor->queue;
+
+    float ratio = factor / this->feed_override;
+    this->feed_override = factor;
+
+    if (queue.is_empty())
+        return;
+
+    float previous_nominal_speed = 0.0F;
+
+    for (unsigned int index = THEKERNEL->conveyor->gc_pending; index != queue.head_i; index = queue.next(index)) {
+        Block *block = queue.item_ref(index);
+
+        if (block->millimeters == 0.0F) {
+            // gcode only block, planned with a zero nominal speed
+            previous_nominal_speed = 0.0F;
+            continue;
+        }
+
+        if (block->times_taken) {
+            this->apply_feed_override_live(block, ratio);
+
+        } else {
+            this->apply_feed_override(block);
+
+            // Recomputed from the junction limit, so the entry speed can go back up when the override is raised again.
+            // max_junction_speed is minimum_planner_speed when the block follows a stop
+            block->max_entry_speed = min(block->max_junction_speed, block->nominal_speed);
+            if (previous_nominal_speed > 0.0F)
+                block->max_entry_speed = min(block->max_entry_speed, previous_nominal_speed);
+
+            block->entry_speed = min(block->entry_speed, block->max_entry_speed);
+            block->nominal_length_flag = (block->nominal_speed <= max_allowable_speed(-block->acceleration, minimum_planner_speed, block->millimeters));
+            block->recalculate_flag = true;
+        }
+
+        previous_nominal_speed = block->nominal_speed;
+    }
+
+    this->recalculate(queue.prev(queue.head_i));
+}
+
+// Replan every block waiting after the executing one, called when the executing block had to lower its exit speed
+void Planner::replan()
+{
+    Conveyor::Queue_t &queue = THEKERNEL->conveyor->queue;
+
+    if (queue.is_empty())
+        return;
+
+    for (unsigned int index = THEKERNEL->conveyor->gc_pending; index != queue.head_i; index = queue.next(index)) {
+        Block *block = queue.item_ref(index);
+        if (block->millimeters > 0.0F && !block->times_taken)
+            block->recalculate_flag = true;
+    }
+
+    this->recalculate(queue.prev(queue.head_i));
+}
+
+// Blocks appended until end_batch() are planned together, used when a single move is cut into many segments
+void Planner::begin_batch()
+{
+    this->batching = true;
+}
+
+// Plan the blocks appended since begin_batch()
+void Planner::end_batch()
+{
+    this->batching = false;
+    if (this->unplanned_blocks > 0)
+        this->recalculate(THEKERNEL->conveyor->queue.prev(THEKERNEL->conveyor->queue.head_i));
+}
+
+// The recalculation for the block being appended can wait if the stepper is not about to reach the unplanned blocks,
+// and the queue is not full, as we would then be waiting for it with the unplanned blocks in it
+bool Planner::can_defer_recalculate()
+{
+    Conveyor::Queue_t &queue = THEKERNEL->conveyor->queue;
+
+    if (queue.is_full())
+        return false;
+
+    unsigned int queued = (queue.head_i + queue.length - THEKERNEL->conveyor->gc_pending) % queue.length;
+    return queued > this->unplanned_blocks + PLANNER_BATCH_LOOKAHEAD;
+}
+
+// Replan the whole queue, up to the new block being prepared at the head
 void Planner::recalculate() {
+    this->recalculate(THEKERNEL->conveyor->queue.head_i);
+}
+
+// Replan the queue, newest_index is the last block to be planned, which will decelerate to minimum_planner_speed
+void Planner::recalculate(unsigned int newest_index) {
     Conveyor::Queue_t &queue = THEKERNEL->conveyor->queue;
 
     unsigned int block_index;
 
+    // Every flagged block up to newest_index gets planned, including the ones a batch deferred
+    this->unplanned_blocks = 0;
+
     Block* previous;
     Block* current;
 
@@ -213,7 +375,7 @@ void Planner::recalculate() {
 
     float entry_speed = minimum_planner_speed;
 
-    block_index = queue.head_i;
+    block_index = newest_index;
     current     = queue.item_ref(block_index);
 
     if (!queue.is_empty())
@@ -237,7 +399,7 @@ void Planner::recalculate() {
 
         float exit_speed = current->max_exit_speed();
 
-        while (block_index != queue.head_i)
+        while (block_index != newest_index)
         {
             previous    = current;
             block_index = queue.next(block_index);
@@ -8,29 +8,48 @@
 #ifndef PLANNER_H
 #define PLANNER_H
 
+#include "libs/nuts_bolts.h"
+
 class Block;
 
+// While batching, a block is planned right away if fewer planned blocks than this are queued ahead of it
+#define PLANNER_BATCH_LOOKAHEAD 4
+
 class Planner
 {
 public:
     Planner();
-    void append_block( float target[], float rate_mm_s, float distance, float unit_vec[] );
+    void append_block( float target[], float rate_mm_s, float max_rate_mm_s, float distance, float unit_vec[] );
     float max_allowable_speed( float acceleration, float target_velocity, float distance);
     void recalculate();
+    void replan();
+    void begin_batch();
+    void end_batch();
+    void set_feed_override(float factor);
+    float get_feed_override() const { return feed_override; }
     Block *get_current_block();
     void cleanup_queue();
     float get_acceleration() const { return acceleration; }
     float get_z_acceleration() const { return z_acceleration > 0.0F ? z_acceleration : acceleration; }
 
-    friend class Robot; // for acceleration, junction deviation, minimum_planner_speed
+    friend class Robot; // for acceleration, junction deviation, minimum_planner_speed, path control
 
 private:
     void config_load();
-    float previous_unit_vec[3];
+    void recalculate(unsigned int newest_index);
+    bool can_defer_recalculate();
+    void apply_feed_override(Block *block);
+    void apply_feed_override_live(Block *block, float ratio);
+    float previous_unit_vec[N_ACTUATORS];
     float acceleration;          // Setting
     float z_acceleration;        // Setting
     float junction_deviation;    // Setting
     float minimum_planner_speed; // Setting
+    float feed_override;         // Realtime speed multiplier set by M220, applied to queued blocks too
+    float path_tolerance;        // G64 P, used instead of junction_deviation when set
+    bool exact_stop;             // G61, every block is entered at minimum_planner_speed
+    bool batching;               // Between begin_batch() and end_batch(), recalculation is deferred
+    unsigned int unplanned_blocks; // Blocks appended since the queue was last recalculated
 };
 
 
@@ -9,11 +9,14 @@
 #include "libs/Kernel.h"
 
 #include <math.h>
+#include <float.h>
 #include <string>
 using std::string;
 
 #include "Planner.h"
 #include "Conveyor.h"
+#include "RealtimeCommands.h"
+#include "GcodeDispatch.h"
 #include "Robot.h"
 #include "nuts_bolts.h"
 #include "Pin.h"
@@ -121,6 +124,7 @@ Robot::Robot()
     this->inch_mode = false;
     this->absolute_mode = true;
     this->motion_mode =  MOTION_MODE_SEEK;
+    this->path_control_mode = PATH_CONTROL_MODE_CONTINOUS;
     this->select_plane(X_AXIS, Y_AXIS, Z_AXIS);
     clear_vector(this->last_milestone);
     clear_vector(this->transformed_last_milestone);
@@ -128,14 +132,16 @@ Robot::Robot()
     seconds_per_minute = 60.0F;
     this->clearToolOffset();
     this->compensationTransform= nullptr;
+    this->segment_index = 0;
+    this->segment_count = 0;
 }
 
 //Called when the module has just been loaded
 void Robot::on_module_loaded()
 {
     this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(robot_checksum);
+    this->register_for_event(ON_MAIN_LOOP);
 
     // Configuration
     this->on_config_reload(this);
@@ -228,6 +234,24 @@ void Robot::on_config_reload(void *argument)
     actuators.push_back(beta_stepper_motor);
     actuators.push_back(gamma_stepper_motor);
 
+#if N_ACTUATORS > 3
+    // Actuators after the first three are not driven by the arm solution, they are configured like the others
+    // with delta_, epsilon_ and zeta_ prefixes and stay where they are unless a block moves them
+    static const char *extra_actuator_names[] = { "delta", "epsilon", "zeta" };
+    for (int i = 3; i < N_ACTUATORS; i++) {
+        string name = extra_actuator_names[i - 3];
+        Pin step_pin, dir_pin, en_pin;
+        step_pin.from_string( THEKERNEL->config->value(get_checksum(name + "_step_pin"))->by_default("nc")->as_string())->as_output();
+        dir_pin.from_string(  THEKERNEL->config->value(get_checksum(name + "_dir_pin" ))->by_default("nc")->as_string())->as_output();
+        en_pin.from_string(   THEKERNEL->config->value(get_checksum(name + "_en_pin"  ))->by_default("nc")->as_string())->as_output();
+
+        StepperMotor *motor = THEKERNEL->step_ticker->add_stepper_motor( new StepperMotor(step_pin, dir_pin, en_pin) );
+        motor->change_steps_per_mm(THEKERNEL->config->value(get_checksum(name + "_steps_per_mm"))->by_default(80.0F)->as_number());
+        motor->max_rate = THEKERNEL->config->value(get_checksum(name + "_max_rate"))->by_default(30000.0F)->as_number() / 60.0F;
+        actuators.push_back(motor);
+    }
+#endif
+
 
     // initialise actuator positions to current cartesian position (X0 Y0 Z0)
     // so the first move can be correct if homing is not performed
@@ -270,7 +294,7 @@ void Robot::on_get_public_data(void *argument)
 
     if(pdr->second_element_is(speed_override_percent_checksum)) {
         static float return_data;
-        return_data = 100.0F * 60.0F / seconds_per_minute;
+        return_data = 100.0F * THEKERNEL->planner->get_feed_override();
         pdr->set_data_ptr(&return_data);
         pdr->set_taken();
 
@@ -292,12 +316,11 @@ void Robot::on_set_public_data(void *argument)
     if(!pdr->starts_with(robot_checksum)) return;
 
     if(pdr->second_element_is(speed_override_percent_checksum)) {
-        // NOTE do not use this while printing!
         float t = *static_cast<float *>(pdr->get_data_ptr());
         // enforce minimum 10% speed
         if (t < 10.0F) t = 10.0F;
 
-        this->seconds_per_minute = t / 0.6F; // t * 60 / 100
+        THEKERNEL->planner->set_feed_override(t / 100.0F);
         pdr->set_taken();
     } else if(pdr->second_element_is(current_position_checksum)) {
         float *t = static_cast<float *>(pdr->get_data_ptr());
@@ -320,6 +343,8 @@ void Robot::on_gcode_received(void *argument)
 {
     Gcode *gcode = static_cast<Gcode *>(argument);
 
+    // The dispatch lets a gcode through only once every segment of the move before it has been appended, and the
+    // modules sending moves directly wait for the same, so this never lands in the middle of a move being cut
     this->motion_mode = -1;
 
     //G-letter Gcodes are mostly what the Robot module is interrested in, other modules also catch the gcode event and do stuff accordingly
@@ -334,6 +359,17 @@ void Robot::on_gcode_received(void *argument)
             case 19: this->select_plane(Y_AXIS, Z_AXIS, X_AXIS); gcode->mark_as_taken();  break;
             case 20: this->inch_mode = true; gcode->mark_as_taken();  break;
             case 21: this->inch_mode = false; gcode->mark_as_taken();  break;
+            case 61: // G61 exact stop, every move comes to a stop before the next one
+                this->path_control_mode = PATH_CONTROL_MODE_EXACT_STOP;
+                THEKERNEL->planner->exact_stop = true;
+                gcode->mark_as_taken();
+                break;
+            case 64: // G64 Pnnn continuous, corners may be rounded by up to P, without P the junction deviation setting is used
+                this->path_control_mode = PATH_CONTROL_MODE_CONTINOUS;
+                THEKERNEL->planner->exact_stop = false;
+                THEKERNEL->planner->path_tolerance = gcode->has_letter('P') ? this->to_millimeters(gcode->get_value('P')) : 0.0F;
+                gcode->mark_as_taken();
+                break;
             case 90: this->absolute_mode = true; gcode->mark_as_taken();  break;
             case 91: this->absolute_mode = false; gcode->mark_as_taken();  break;
             case 92: {
@@ -372,11 +408,25 @@ void Robot::on_gcode_received(void *argument)
                 check_max_actuator_speeds();
                 return;
             case 114: {
-                char buf[32];
-                int n = snprintf(buf, sizeof(buf), "C: X:%1.3f Y:%1.3f Z:%1.3f",
+                char buf[64];
+                int n;
+                if (gcode->has_letter('R')) {
+                    // where the tool actually is right now, rather than where the queued moves will take it
+                    float pos[N_ACTUATORS];
+                    get_current_machine_position(pos);
+                    n = snprintf(buf, sizeof(buf), "R: X:%1.3f Y:%1.3f Z:%1.3f",
+                                 from_millimeters(pos[0]),
+                                 from_millimeters(pos[1]),
+                                 from_millimeters(pos[2]));
+                } else {
+                    n = snprintf(buf, sizeof(buf), "C: X:%1.3f Y:%1.3f Z:%1.3f",
                                  from_millimeters(this->last_milestone[0]),
                                  from_millimeters(this->last_milestone[1]),
                                  from_millimeters(this->last_milestone[2]));
+                }
+                // snprintf returns what it would have written, which can be more than fits
+                if (n > (int)sizeof(buf) - 1)
+                    n = sizeof(buf) - 1;
                 gcode->txt_after_ok.append(buf, n);
                 gcode->mark_as_taken();
             }
@@ -408,9 +458,8 @@ void Robot::on_gcode_received(void *argument)
             case 204: // M204 Snnn - set acceleration to nnn, Znnn sets z acceleration
                 gcode->mark_as_taken();
 
+                // acceleration is stored in each block when it is planned, so this only applies to following moves
                 if (gcode->has_letter('S')) {
-                    // TODO for safety so it applies only to following gcodes, maybe a better way to do this?
-                    THEKERNEL->conveyor->wait_for_empty_queue();
                     float acc = gcode->get_value('S'); // mm/s^2
                     // enforce minimum
                     if (acc < 1.0F)
@@ -418,8 +467,6 @@ void Robot::on_gcode_received(void *argument)
                     THEKERNEL->planner->acceleration = acc;
                 }
                 if (gcode->has_letter('Z')) {
-                    // TODO for safety so it applies only to following gcodes, maybe a better way to do this?
-                    THEKERNEL->conveyor->wait_for_empty_queue();
                     float acc = gcode->get_value('Z'); // mm/s^2
                     // enforce positive
                     if (acc < 0.0F)
@@ -446,7 +493,7 @@ void Robot::on_gcode_received(void *argument)
                 }
                 break;
 
-            case 220: // M220 - speed override percentage
+            case 220: // M220 - speed override percentage, applied in realtime including to moves already queued
                 gcode->mark_as_taken();
                 if (gcode->has_letter('S')) {
                     float factor = gcode->get_value('S');
@@ -457,13 +504,13 @@ void Robot::on_gcode_received(void *argument)
                     if (factor > 1000.0F)
                         factor = 1000.0F;
 
-                    seconds_per_minute = 6000.0F / factor;
+                    THEKERNEL->planner->set_feed_override(factor / 100.0F);
                 }
                 break;
 
-            case 400: // wait until all moves are done up to this point
+            case 400: // wait until all moves are done up to this point, without blocking the main loop
                 gcode->mark_as_taken();
-                THEKERNEL->conveyor->wait_for_empty_queue();
+                THEKERNEL->gcode_dispatch->hold(new EmptyQueueTask());
                 break;
 
             case 500: // M500 saves some volatile settings to config override file
@@ -520,7 +567,7 @@ void Robot::on_gcode_received(void *argument)
         return;
 
     //Get parameters
-    float target[3], offset[3];
+    float target[N_ACTUATORS], offset[3];
     clear_vector(offset);
 
     memcpy(target, this->last_milestone, sizeof(target));    //default to last target
@@ -535,6 +582,13 @@ void Robot::on_gcode_received(void *argument)
             target[letter - 'X'] = this->to_millimeters(gcode->get_value(letter)) + (this->absolute_mode ? this->toolOffset[letter - 'X'] : target[letter - 'X']);
         }
     }
+    // The extra actuators are moved by the A, B and C words, they are not transformed by the arm solution
+    for (int axis = 3; axis < N_ACTUATORS; axis++) {
+        char letter = 'A' + axis - 3;
+        if( gcode->has_letter(letter) ) {
+            target[axis] = this->to_millimeters(gcode->get_value(letter)) + (this->absolute_mode ? 0.0F : target[axis]);
+        }
+    }
 
     if( gcode->has_letter('F') ) {
         if( this->motion_mode == MOTION_MODE_SEEK )
@@ -566,6 +620,20 @@ void Robot::distance_in_gcode_is_known(Gcode *gcode)
     THEKERNEL->conveyor->append_gcode(gcode);
 }
 
+// The position the actuators are actually at, converted back to cartesian, this is in machine coordinates
+// so it includes any compensation transform, and it lags last_milestone by whatever is in the queue.
+// Fills N_ACTUATORS axes, the extra actuators are their own axis
+void Robot::get_current_machine_position(float position[])
+{
+    float actuator_pos[N_ACTUATORS];
+    for (int i = 0; i < N_ACTUATORS; i++)
+        actuator_pos[i] = actuators[i]->get_current_position();
+
+    arm_solution->actuator_to_cartesian(actuator_pos, position);
+    for (int i = 3; i < N_ACTUATORS; i++)
+        position[i] = actuator_pos[i];
+}
+
 // reset the position for all axis (used in homing for delta as last_milestone may be bogus)
 void Robot::reset_axis_position(float x, float y, float z)
 {
@@ -599,9 +667,9 @@ void Robot::reset_axis_position(float position, int axis)
 // Convert target from millimeters to steps, and append this to the planner
 void Robot::append_milestone( float target[], float rate_mm_s )
 {
-    float deltas[3];
-    float unit_vec[3];
-    float actuator_pos[3];
+    float deltas[N_ACTUATORS];
+    float unit_vec[N_ACTUATORS];
+    float actuator_pos[N_ACTUATORS];
     float transformed_target[3]; // adjust target for bed compensation
     float millimeters_of_travel;
 
@@ -618,39 +686,57 @@ void Robot::append_milestone( float target[], float rate_mm_s )
     for (int axis = X_AXIS; axis <= Z_AXIS; axis++){
         deltas[axis] = transformed_target[axis] - transformed_last_milestone[axis];
     }
+    for (int axis = 3; axis < N_ACTUATORS; axis++){
+        deltas[axis] = target[axis] - this->last_milestone[axis];
+    }
     // store last transformed
     memcpy(this->transformed_last_milestone, transformed_target, sizeof(this->transformed_last_milestone));
 
-    // Compute how long this move moves, so we can attach it to the block for later use
-    millimeters_of_travel = sqrtf( powf( deltas[X_AXIS], 2 ) +  powf( deltas[Y_AXIS], 2 ) +  powf( deltas[Z_AXIS], 2 ) );
+    // Compute how long this move moves, so we can attach it to the block for later use. The extra axes count as
+    // much as the cartesian ones, so a move of those alone is fed along its own length
+    millimeters_of_travel = 0.0F;
+    for (int axis = 0; axis < N_ACTUATORS; axis++){
+        millimeters_of_travel += deltas[axis] * deltas[axis];
+    }
+    millimeters_of_travel = sqrtf(millimeters_of_travel);
 
     // find distance unit vector
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < N_ACTUATORS; i++)
         unit_vec[i] = deltas[i] / millimeters_of_travel;
 
+    // Find the fastest this move can go without exceeding the configured limits. The planner applies it
+    // after the feed override, so the override can be changed while the move is queued
+    float max_rate_mm_s = FLT_MAX;
+
     // Do not move faster than the configured cartesian limits
     for (int axis = X_AXIS; axis <= Z_AXIS; axis++) {
-        if ( max_speeds[axis] > 0 ) {
-            float axis_speed = fabs(unit_vec[axis] * rate_mm_s);
+        if ( max_speeds[axis] > 0 && unit_vec[axis] != 0.0F ) {
+            float axis_limit = max_speeds[axis] / fabs(unit_vec[axis]);
 
-            if (axis_speed > max_speeds[axis])
-                rate_mm_s *= ( max_speeds[axis] / axis_speed );
+            if (axis_limit < max_rate_mm_s)
+                max_rate_mm_s = axis_limit;
         }
     }
 
     // find actuator position given cartesian position, use actual adjusted target
     arm_solution->cartesian_to_actuator( transformed_target, actuator_pos );
+    for (int actuator = 3; actuator < N_ACTUATORS; actuator++)
+        actuator_pos[actuator] = target[actuator];
 
     // check per-actuator speed limits
-    for (int actuator = 0; actuator <= 2; actuator++) {
-        float actuator_rate  = fabs(actuator_pos[actuator] - actuators[actuator]->last_milestone_mm) * rate_mm_s / millimeters_of_travel;
+    for (int actuator = 0; actuator < N_ACTUATORS; actuator++) {
+        float actuator_distance = fabs(actuator_pos[actuator] - actuators[actuator]->last_milestone_mm);
+
+        if (actuator_distance > 0.0F) {
+            float actuator_limit = actuators[actuator]->max_rate * millimeters_of_travel / actuator_distance;
 
-        if (actuator_rate > actuators[actuator]->max_rate)
-            rate_mm_s *= (actuators[actuator]->max_rate / actuator_rate);
+            if (actuator_limit < max_rate_mm_s)
+                max_rate_mm_s = actuator_limit;
+        }
     }
 
     // Append the block to the planner
-    THEKERNEL->planner->append_block( actuator_pos, rate_mm_s, millimeters_of_travel, unit_vec );
+    THEKERNEL->planner->append_block( actuator_pos, rate_mm_s, max_rate_mm_s, millimeters_of_travel, unit_vec );
 
     // Update the last_milestone to the current target for the next time we use last_milestone, use the requested target not the adjusted one
     memcpy(this->last_milestone, target, sizeof(this->last_milestone)); // this->last_milestone[] = target[];
@@ -661,8 +747,10 @@ void Robot::append_milestone( float target[], float rate_mm_s )
 void Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
 {
 
-    // Find out the distance for this gcode
-    gcode->millimeters_of_travel = powf( target[X_AXIS] - this->last_milestone[X_AXIS], 2 ) +  powf( target[Y_AXIS] - this->last_milestone[Y_AXIS], 2 ) +  powf( target[Z_AXIS] - this->last_milestone[Z_AXIS], 2 );
+    // Find out the distance for this gcode, the extra axes included
+    gcode->millimeters_of_travel = 0.0F;
+    for (int axis = 0; axis < N_ACTUATORS; axis++)
+        gcode->millimeters_of_travel += powf( target[axis] - this->last_milestone[axis], 2 );
 
     // We ignore non-moves ( for example, extruder moves are not XYZ moves )
     if( gcode->millimeters_of_travel < 1e-8F ) {
@@ -684,7 +772,7 @@ void Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
         // segment based on current speed and requested segments per second
         // the faster the travel speed the fewer segments needed
         // NOTE rate is mm/sec and we take into account any speed override
-        float seconds = gcode->millimeters_of_travel / rate_mm_s;
+        float seconds = gcode->millimeters_of_travel / (rate_mm_s * THEKERNEL->planner->get_feed_override());
         segments = max(1, ceil(this->delta_segments_per_second * seconds));
         // TODO if we are only moving in Z on a delta we don't really need to segment at all
 
@@ -696,30 +784,93 @@ void Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
         }
     }
 
-    if (segments > 1) {
-        // A vector to keep track of the endpoint of each segment
-        float segment_delta[3];
-        float segment_end[3];
+    // How far do we move each segment?
+    for (int i = 0; i < N_ACTUATORS; i++)
+        this->segment_delta[i] = (target[i] - last_milestone[i]) / segments;
+
+    // segment 0 is already done - it's the end point of the previous move so we start at segment 1, the last segment ends on target
+    memcpy(this->segment_target, target, sizeof(this->segment_target));
+    this->segment_rate = rate_mm_s;
+    this->segment_arc = false;
+    this->segment_index = 1;
+    this->segment_count = segments;
 
-        // How far do we move each segment?
-        for (int i = X_AXIS; i <= Z_AXIS; i++)
-            segment_delta[i] = (target[i] - last_milestone[i]) / segments;
+    // Append what the queue has room for, on_main_loop appends the rest
+    this->append_segments();
 
-        // segment 0 is already done - it's the end point of the previous move so we start at segment 1
-        // We always add another point after this loop so we stop at segments-1, ie i < segments
-        for (int i = 1; i < segments; i++) {
-            for(int axis = X_AXIS; axis <= Z_AXIS; axis++ )
-                segment_end[axis] = last_milestone[axis] + segment_delta[axis];
+    // if adding these blocks didn't start executing, do that now
+    THEKERNEL->conveyor->ensure_running();
+}
 
-            // Append the end of this segment to the queue
-            this->append_milestone(segment_end, rate_mm_s);
+// Append the segments of the move being cut, as many as the block queue has room for
+void Robot::append_segments()
+{
+    float segment_end[N_ACTUATORS];
+
+    // The segments appended now are planned together when the last one is appended
+    THEKERNEL->planner->begin_batch();
+
+    while (this->segment_index <= this->segment_count) {
+        if (THEKERNEL->conveyor->is_queue_full())
+            break;
+
+        if (this->segment_index == this->segment_count) {
+            // Ensure last segment arrives at target location.
+            memcpy(segment_end, this->segment_target, sizeof(segment_end));
+
+        } else if (!this->segment_arc) {
+            for (int axis = 0; axis < N_ACTUATORS; axis++)
+                segment_end[axis] = this->last_milestone[axis] + this->segment_delta[axis];
+
+        } else {
+            if (this->arc_correction_count < this->arc_correction) {
+                // Apply vector rotation matrix
+                float r_axisi = this->arc_radius[0] * this->arc_sin_T + this->arc_radius[1] * this->arc_cos_T;
+                this->arc_radius[0] = this->arc_radius[0] * this->arc_cos_T - this->arc_radius[1] * this->arc_sin_T;
+                this->arc_radius[1] = r_axisi;
+                this->arc_correction_count++;
+            } else {
+                // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments.
+                // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
+                float cos_Ti = cosf(this->segment_index * this->arc_theta_per_segment);
+                float sin_Ti = sinf(this->segment_index * this->arc_theta_per_segment);
+                this->arc_radius[0] = -this->arc_offset[0] * cos_Ti + this->arc_offset[1] * sin_Ti;
+                this->arc_radius[1] = -this->arc_offset[0] * sin_Ti - this->arc_offset[1] * cos_Ti;
+                this->arc_correction_count = 0;
+            }
+
+            segment_end[this->plane_axis_0] = this->arc_center[0] + this->arc_radius[0];
+            segment_end[this->plane_axis_1] = this->arc_center[1] + this->arc_radius[1];
+            segment_end[this->plane_axis_2] = this->last_milestone[this->plane_axis_2] + this->arc_linear_per_segment;
+            for (int axis = 3; axis < N_ACTUATORS; axis++)
+                segment_end[axis] = this->last_milestone[axis] + this->segment_delta[axis];
         }
+
+        this->segment_index++;
+
+        // Append the end of this segment to the queue
+        this->append_milestone(segment_end, this->segment_rate);
     }
 
-    // Append the end of this full move to the queue
-    this->append_milestone(target, rate_mm_s);
+    THEKERNEL->planner->end_batch();
 
-    // if adding these blocks didn't start executing, do that now
+    if (this->segment_index > this->segment_count)
+        this->segment_count = 0;
+}
+
+// Keep appending the segments of the move being cut as the block queue empties
+void Robot::on_main_loop(void *argument)
+{
+    if (!this->is_segmenting())
+        return;
+
+    // After an emergency stop the rest of the move is dropped
+    if (THEKERNEL->realtime_commands->is_halted()) {
+        this->segment_count = 0;
+        return;
+    }
+
+    this->append_segments();
     THEKERNEL->conveyor->ensure_running();
 }
 
@@ -746,8 +897,11 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
         angular_travel -= 2 * M_PI;
     }
 
-    // Find the distance for this gcode
-    gcode->millimeters_of_travel = hypotf(angular_travel * radius, fabs(linear_travel));
+    // Find the distance for this gcode, the extra axes move linearly along the arc
+    float extra_travel = 0.0F;
+    for (int axis = 3; axis < N_ACTUATORS; axis++)
+        extra_travel += powf( target[axis] - this->last_milestone[axis], 2 );
+    gcode->millimeters_of_travel = sqrtf(powf(angular_travel * radius, 2) + powf(linear_travel, 2) + extra_travel);
 
     // We don't care about non-XYZ moves ( for example the extruder produces some of those )
     if( gcode->millimeters_of_travel < 0.0001F ) {
@@ -757,11 +911,13 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
     // Mark the gcode as having a known distance
     this->distance_in_gcode_is_known( gcode );
 
-    // Figure out how many segments for this gcode
-    uint16_t segments = floor(gcode->millimeters_of_travel / this->mm_per_arc_segment);
+    // Figure out how many segments for this gcode, a short arc is a single segment to the target
+    uint16_t segments = max(1.0F, floorf(gcode->millimeters_of_travel / this->mm_per_arc_segment));
 
     float theta_per_segment = angular_travel / segments;
     float linear_per_segment = linear_travel / segments;
+    for (int axis = 3; axis < N_ACTUATORS; axis++)
+        this->segment_delta[axis] = (target[axis] - this->last_milestone[axis]) / segments;
 
     /* Vector rotation by transformation matrix: r is the original vector, r_T is the rotated vector,
     and phi is the angle of rotation. Based on the solution approach by Jens Geisler.
@@ -787,49 +943,27 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
     This is important when there are successive arc motions.
     */
     // Vector rotation matrix values
-    float cos_T = 1 - 0.5F * theta_per_segment * theta_per_segment; // Small angle approximation
-    float sin_T = theta_per_segment;
-
-    float arc_target[3];
-    float sin_Ti;
-    float cos_Ti;
-    float r_axisi;
-    uint16_t i;
-    int8_t count = 0;
-
-    // Initialize the linear axis
-    arc_target[this->plane_axis_2] = this->last_milestone[this->plane_axis_2];
-
-    for (i = 1; i < segments; i++) { // Increment (segments-1)
-
-        if (count < this->arc_correction ) {
-            // Apply vector rotation matrix
-            r_axisi = r_axis0 * sin_T + r_axis1 * cos_T;
-            r_axis0 = r_axis0 * cos_T - r_axis1 * sin_T;
-            r_axis1 = r_axisi;
-            count++;
-        } else {
-            // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments.
-            // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-            cos_Ti = cosf(i * theta_per_segment);
-            sin_Ti = sinf(i * theta_per_segment);
-            r_axis0 = -offset[this->plane_axis_0] * cos_Ti + offset[this->plane_axis_1] * sin_Ti;
-            r_axis1 = -offset[this->plane_axis_0] * sin_Ti - offset[this->plane_axis_1] * cos_Ti;
-            count = 0;
-        }
-
-        // Update arc_target location
-        arc_target[this->plane_axis_0] = center_axis0 + r_axis0;
-        arc_target[this->plane_axis_1] = center_axis1 + r_axis1;
-        arc_target[this->plane_axis_2] += linear_per_segment;
-
-        // Append this segment to the queue
-        this->append_milestone(arc_target, this->feed_rate / seconds_per_minute);
-
-    }
-
-    // Ensure last segment arrives at target location.
-    this->append_milestone(target, this->feed_rate / seconds_per_minute);
+    this->arc_cos_T = 1 - 0.5F * theta_per_segment * theta_per_segment; // Small angle approximation
+    this->arc_sin_T = theta_per_segment;
+
+    this->arc_center[0] = center_axis0;
+    this->arc_center[1] = center_axis1;
+    this->arc_radius[0] = r_axis0;
+    this->arc_radius[1] = r_axis1;
+    this->arc_offset[0] = offset[this->plane_axis_0];
+    this->arc_offset[1] = offset[this->plane_axis_1];
+    this->arc_theta_per_segment = theta_per_segment;
+    this->arc_linear_per_segment = linear_per_segment;
+    this->arc_correction_count = 0;
+
+    memcpy(this->segment_target, target, sizeof(this->segment_target));
+    this->segment_rate = this->feed_rate / seconds_per_minute;
+    this->segment_arc = true;
+    this->segment_index = 1;
+    this->segment_count = segments;
+
+    // Append what the queue has room for, on_main_loop appends the rest
+    this->append_segments();
 }
 
 // Do the math for an arc and add it to the queue
@@ -14,6 +14,7 @@ using std::string;
 #include <functional>
 
 #include "libs/Module.h"
+#include "libs/nuts_bolts.h"
 
 class Gcode;
 class BaseSolution;
@@ -27,10 +28,14 @@ class Robot : public Module {
         void on_gcode_received(void* argument);
         void on_get_public_data(void* argument);
         void on_set_public_data(void* argument);
+        void on_main_loop(void* argument);
+
+        bool is_segmenting() const { return segment_count > 0; }
 
         void reset_axis_position(float position, int axis);
         void reset_axis_position(float x, float y, float z);
         void get_axis_position(float position[]);
+        void get_current_machine_position(float position[]);
         float to_millimeters(float value);
         float from_millimeters(float value);
         float get_seconds_per_minute() const { return seconds_per_minute; }
@@ -55,16 +60,18 @@ class Robot : public Module {
 
 
         void compute_arc(Gcode* gcode, float offset[], float target[]);
+        void append_segments();
 
         float theta(float x, float y);
         void select_plane(uint8_t axis_0, uint8_t axis_1, uint8_t axis_2);
         void clearToolOffset();
         void check_max_actuator_speeds();
 
-        float last_milestone[3];                             // Last position, in millimeters
+        float last_milestone[N_ACTUATORS];                   // Last position, in millimeters, X Y Z then the A B C axes of the extra actuators
         float transformed_last_milestone[3];                 // Last transformed position
         bool  inch_mode;                                     // true for inch mode, false for millimeter mode ( default )
         int8_t motion_mode;                                  // Motion mode for the current received Gcode
+        int8_t path_control_mode;                            // G61 exact stop or G64 continuous
         float seek_rate;                                     // Current rate for seeking moves ( mm/s )
         float feed_rate;                                     // Current rate for feeding moves ( mm/s )
         uint8_t plane_axis_0, plane_axis_1, plane_axis_2;    // Current plane ( XY, XZ, YZ )
@@ -83,6 +90,21 @@ class Robot : public Module {
 
         float toolOffset[3];
 
+        // The line or arc being cut into segments, they are appended as the block queue has room for them
+        uint16_t segment_index;                              // Next segment to append, counting from 1
+        uint16_t segment_count;                              // Number of segments, 0 when no move is being cut
+        bool  segment_arc;                                   // Arc segments rotate around arc_center, line segments move by segment_delta
+        float segment_rate;                                  // Rate for the segments ( mm/s )
+        float segment_target[N_ACTUATORS];                   // Where the last segment ends
+        float segment_delta[N_ACTUATORS];                    // Line : distance moved by each segment, arc : only the extra actuators' are used
+        float arc_center[2];                                 // Arc : center, radius vector to the last segment and initial offset, in the plane
+        float arc_radius[2];
+        float arc_offset[2];
+        float arc_cos_T, arc_sin_T;                          // Arc : rotation matrix for one segment
+        float arc_theta_per_segment;
+        float arc_linear_per_segment;
+        int8_t arc_correction_count;
+
         // Used by Stepper, Planner
         friend class Planner;
         friend class Stepper;
@@ -19,6 +19,9 @@
 #include "ConfigValue.h"
 #include "Gcode.h"
 #include "Block.h"
+#include "InputShaper.h"
+#include "libs/StreamOutput.h"
+#include "utils.h"
 
 #include <vector>
 using namespace std;
@@ -30,6 +33,22 @@ using namespace std;
 
 #define acceleration_ticks_per_second_checksum      CHECKSUM("acceleration_ticks_per_second")
 #define minimum_steps_per_minute_checksum           CHECKSUM("minimum_steps_per_minute")
+#define input_shaper_type_checksum                  CHECKSUM("input_shaper_type")
+#define alpha_shaper_frequency_checksum             CHECKSUM("alpha_shaper_frequency")
+#define beta_shaper_frequency_checksum              CHECKSUM("beta_shaper_frequency")
+#define gamma_shaper_frequency_checksum             CHECKSUM("gamma_shaper_frequency")
+#define alpha_shaper_damping_checksum               CHECKSUM("alpha_shaper_damping")
+#define beta_shaper_damping_checksum                CHECKSUM("beta_shaper_damping")
+#define gamma_shaper_damping_checksum               CHECKSUM("gamma_shaper_damping")
+
+#define zv_checksum                                 CHECKSUM("zv")
+#define mzv_checksum                                CHECKSUM("mzv")
+
+// The gcode letter of an actuator, the extra ones are moved by A, B and C
+static char axis_letter(int actuator)
+{
+    return actuator < 3 ? 'X' + actuator : 'A' + actuator - 3;
+}
 
 // The stepper reacts to blocks that have XYZ movement to transform them into actual stepper motor moves
 // TODO: This does accel, accel should be in StepperMotor
@@ -37,8 +56,14 @@ using namespace std;
 Stepper::Stepper(){
     this->current_block = NULL;
     this->paused = false;
+    this->halted = false;
+    this->held = false;
+    this->resume_pending = false;
+    this->hold_speed = 0.0F;
     this->trapezoid_generator_busy = false;
     this->force_speed_update = false;
+    this->step_events_per_second = 0.0F;
+    this->input_shaper = new InputShaper();
 }
 
 //Called when the module has just been loaded
@@ -46,10 +71,16 @@ void Stepper::on_module_loaded(){
     this->register_for_event(ON_BLOCK_BEGIN);
     this->register_for_event(ON_BLOCK_END);
     this->register_for_event(ON_GCODE_EXECUTE);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_gcode('M', 17);
+    this->register_for_gcode('M', 18);
+    this->register_for_gcode('M', 84);
+    this->register_for_gcode('M', 500);
+    this->register_for_gcode('M', 503);
+    this->register_for_gcode('M', 593);
     this->register_for_event(ON_PLAY);
     this->register_for_event(ON_PAUSE);
     this->register_for_event(ON_HALT);
+    this->register_for_event(ON_IDLE);
 
     // Get onfiguration
     this->on_config_reload(this);
@@ -58,9 +89,9 @@ void Stepper::on_module_loaded(){
     this->acceleration_tick_hook = THEKERNEL->slow_ticker->attach( this->acceleration_ticks_per_second, this, &Stepper::trapezoid_generator_tick );
 
     // Attach to the end_of_move stepper event
-    THEKERNEL->robot->alpha_stepper_motor->attach(this, &Stepper::stepper_motor_finished_move );
-    THEKERNEL->robot->beta_stepper_motor->attach( this, &Stepper::stepper_motor_finished_move );
-    THEKERNEL->robot->gamma_stepper_motor->attach(this, &Stepper::stepper_motor_finished_move );
+    for( int i = 0; i < N_ACTUATORS; i++ ){
+        THEKERNEL->robot->actuators[i]->attach(this, &Stepper::stepper_motor_finished_move );
+    }
 }
 
 // Get configuration from the config file
@@ -69,25 +100,72 @@ void Stepper::on_config_reload(void* argument){
     this->acceleration_ticks_per_second =  THEKERNEL->config->value(acceleration_ticks_per_second_checksum)->by_default(100   )->as_number();
     this->minimum_steps_per_second      =  THEKERNEL->config->value(minimum_steps_per_minute_checksum     )->by_default(3000  )->as_number() / 60.0F;
 
+    // Input shaping, off unless a resonance frequency is set for an actuator
+    int shaper_checksum = get_checksum(THEKERNEL->config->value(input_shaper_type_checksum)->by_default("zvd")->as_string());
+    this->input_shaper->set_type(shaper_checksum == zv_checksum ? INPUT_SHAPER_ZV : shaper_checksum == mzv_checksum ? INPUT_SHAPER_MZV : INPUT_SHAPER_ZVD);
+    this->input_shaper->set_actuator(ALPHA_STEPPER, THEKERNEL->config->value(alpha_shaper_frequency_checksum)->by_default(0.0F)->as_number(), THEKERNEL->config->value(alpha_shaper_damping_checksum)->by_default(0.1F)->as_number());
+    this->input_shaper->set_actuator(BETA_STEPPER,  THEKERNEL->config->value(beta_shaper_frequency_checksum )->by_default(0.0F)->as_number(), THEKERNEL->config->value(beta_shaper_damping_checksum )->by_default(0.1F)->as_number());
+    this->input_shaper->set_actuator(GAMMA_STEPPER, THEKERNEL->config->value(gamma_shaper_frequency_checksum)->by_default(0.0F)->as_number(), THEKERNEL->config->value(gamma_shaper_damping_checksum)->by_default(0.1F)->as_number());
+#if N_ACTUATORS > 3
+    // The extra actuators take delta_, epsilon_ and zeta_ prefixes, as in Robot
+    static const char *extra_actuator_names[] = { "delta", "epsilon", "zeta" };
+    for (int i = 3; i < N_ACTUATORS; i++) {
+        std::string name = extra_actuator_names[i - 3];
+        this->input_shaper->set_actuator(i, THEKERNEL->config->value(get_checksum(name + "_shaper_frequency"))->by_default(0.0F)->as_number(), THEKERNEL->config->value(get_checksum(name + "_shaper_damping"))->by_default(0.1F)->as_number());
+    }
+#endif
+    this->input_shaper->update(this->acceleration_ticks_per_second);
+
     // Steppers start off by default
     this->turn_enable_pins_off();
 }
 
 // When the play/pause button is set to pause, or a module calls the ON_PAUSE event
+// If we are moving, trapezoid_generator_tick decelerates along the path and stops the motors once slow enough
 void Stepper::on_pause(void* argument){
     this->paused = true;
-    THEKERNEL->robot->alpha_stepper_motor->pause();
-    THEKERNEL->robot->beta_stepper_motor->pause();
-    THEKERNEL->robot->gamma_stepper_motor->pause();
+    this->resume_pending = false;
+    if( this->current_block == NULL || !this->main_stepper->moving ){
+        this->pause_motors();
+    }
 }
 
-// When the play/pause button is set to play, or a module calls the ON_PLAY event
+// When the play/pause button is set to play, or a module calls the ON_PLAY event.
+// This can come from an interrupt, so if the motors are stopped they are restarted from on_idle
 void Stepper::on_play(void* argument){
-    // TODO: Re-compute the whole queue for a cold-start
     this->paused = false;
-    THEKERNEL->robot->alpha_stepper_motor->unpause();
-    THEKERNEL->robot->beta_stepper_motor->unpause();
-    THEKERNEL->robot->gamma_stepper_motor->unpause();
+    this->hold_speed = 0.0F;
+    if( this->held ){
+        this->resume_pending = true;
+    }
+    // If we had not stopped yet, trapezoid_generator_tick just accelerates back to the nominal rate
+}
+
+// Restart the motors after a feed hold, they stay paused, and the step generator idle, until the queue is replanned
+void Stepper::on_idle(void* argument){
+    if( !this->resume_pending ){ return; }
+    this->resume_pending = false;
+
+    // The motors stopped inside this block, what is left of it starts again from a standstill, and the queue after it is replanned to match
+    if( this->current_block != NULL ){
+        this->current_block->restart_from_standstill(this->main_stepper->stepped);
+        THEKERNEL->planner->replan();
+        this->trapezoid_generator_reset();
+        this->commanded_steps = this->main_stepper->stepped;
+    }
+
+    this->held = false;
+    for( int i = 0; i < N_ACTUATORS; i++ ){
+        THEKERNEL->robot->actuators[i]->unpause();
+    }
+}
+
+// Stop the motors where they are for a feed hold, the steps they have done in the current block are kept
+void Stepper::pause_motors(){
+    this->held = true;
+    for( int i = 0; i < N_ACTUATORS; i++ ){
+        THEKERNEL->robot->actuators[i]->pause();
+    }
 }
 
 void Stepper::on_halt(void* argument)
@@ -95,11 +173,48 @@ void Stepper::on_halt(void* argument)
     this->turn_enable_pins_off();
 }
 
+// Safe from interrupts : drop the enable pins right away and keep them off, ON_HALT follows from the main loop
+void Stepper::emergency_stop(){
+    this->halted = true;
+    this->paused = true;
+    this->turn_enable_pins_off();
+}
+
 void Stepper::on_gcode_received(void* argument){
     Gcode* gcode = static_cast<Gcode*>(argument);
     // Attach gcodes to the last block for on_gcode_execute
     if( gcode->has_m && (gcode->m == 84 || gcode->m == 17 || gcode->m == 18 )) {
         THEKERNEL->conveyor->append_gcode(gcode);
+
+    // M593 X/Y/Z/A/B/C Fnnn Dnnn : set the input shaper resonance frequency ( 0 disables ) and damping ratio of the given actuators, or all of them
+    }else if( gcode->has_m && gcode->m == 593 ){
+        bool all = true;
+        for( int i = 0; i < N_ACTUATORS; i++ ){
+            if( gcode->has_letter(axis_letter(i)) ) all = false;
+        }
+        if( gcode->has_letter('F') || gcode->has_letter('D') ){
+            // takes effect right away, the shaper carries on from the speeds it has seen so moving blocks are not disturbed
+            for( int i = 0; i < N_ACTUATORS; i++ ){
+                if( all || gcode->has_letter(axis_letter(i)) ){
+                    float frequency = gcode->has_letter('F') ? gcode->get_value('F') : this->input_shaper->get_frequency(i);
+                    float damping = gcode->has_letter('D') ? gcode->get_value('D') : this->input_shaper->get_damping(i);
+                    this->input_shaper->set_actuator(i, frequency, damping);
+                }
+            }
+            this->input_shaper->update(this->acceleration_ticks_per_second);
+        }else{
+            for( int i = 0; i < N_ACTUATORS; i++ ){
+                gcode->stream->printf("%c F%1.2f D%1.3f ", axis_letter(i), this->input_shaper->get_frequency(i), this->input_shaper->get_damping(i));
+            }
+            gcode->add_nl = true;
+        }
+        gcode->mark_as_taken();
+
+    }else if( gcode->has_m && (gcode->m == 500 || gcode->m == 503) ){ // M500 saves some volatile settings to config override file, M503 just prints the settings
+        gcode->stream->printf(";Input shaper frequency and damping:\n");
+        for( int i = 0; i < N_ACTUATORS; i++ ){
+            gcode->stream->printf("M593 %c F%1.2f D%1.3f\n", axis_letter(i), this->input_shaper->get_frequency(i), this->input_shaper->get_damping(i));
+        }
     }
 }
 
@@ -119,6 +234,7 @@ void Stepper::on_gcode_execute(void* argument){
 
 // Enable steppers
 void Stepper::turn_enable_pins_on(){
+    if( this->halted ){ return; }
     for (StepperMotor* m : THEKERNEL->robot->actuators)
         m->enable(true);
     this->enable_pins_status = true;
@@ -136,12 +252,13 @@ void Stepper::on_block_begin(void* argument){
     Block* block  = static_cast<Block*>(argument);
 
     // The stepper does not care about 0-blocks
-    if( block->millimeters == 0.0F ){ return; }
+    if( block->millimeters == 0.0F ){ this->hold_speed = 0.0F; return; }
 
     // Mark the new block as of interrest to us
-    if( block->steps[ALPHA_STEPPER] > 0 || block->steps[BETA_STEPPER] > 0 || block->steps[GAMMA_STEPPER] > 0 ){
+    if( block->steps_event_count > 0 ){
         block->take();
     }else{
+        this->hold_speed = 0.0F;
         return;
     }
 
@@ -151,19 +268,42 @@ void Stepper::on_block_begin(void* argument){
     }
 
     // Setup : instruct stepper motors to move
-    if( block->steps[ALPHA_STEPPER] > 0 ){ THEKERNEL->robot->alpha_stepper_motor->move( block->direction_bits[ALPHA_STEPPER], block->steps[ALPHA_STEPPER] ); }
-    if( block->steps[BETA_STEPPER ] > 0 ){ THEKERNEL->robot->beta_stepper_motor->move(  block->direction_bits[BETA_STEPPER], block->steps[BETA_STEPPER ] ); }
-    if( block->steps[GAMMA_STEPPER] > 0 ){ THEKERNEL->robot->gamma_stepper_motor->move( block->direction_bits[GAMMA_STEPPER], block->steps[GAMMA_STEPPER] ); }
+    for( int i = 0; i < N_ACTUATORS; i++ ){
+        if( block->steps[i] > 0 ){ THEKERNEL->robot->actuators[i]->move( block->direction_bits[i], block->steps[i] ); }
+    }
 
     this->current_block = block;
 
     // Setup acceleration for this block
     this->trapezoid_generator_reset();
 
+    // The previous block ended while we were decelerating for a feed hold, carry on decelerating from the speed it ended at
+    if( this->paused && this->held && this->hold_speed > 0.0F ){
+        float rate = this->hold_speed * block->steps_event_count / block->millimeters;
+        if( rate < this->trapezoid_adjusted_rate ){ this->trapezoid_adjusted_rate = rate; }
+        if( this->trapezoid_adjusted_rate > block->rate_delta * 1.5F && this->trapezoid_adjusted_rate > this->minimum_steps_per_second ){
+            this->held = false;
+            for( int i = 0; i < N_ACTUATORS; i++ ){
+                THEKERNEL->robot->actuators[i]->unpause();
+            }
+        }
+    }
+    this->hold_speed = 0.0F;
+
+    // The input shaper convolves the shapers of the actuators this block moves
+    if( this->input_shaper->is_active() ){
+        uint8_t moved = 0;
+        for( int i = 0; i < N_ACTUATORS; i++ ){
+            if( block->steps[i] > 0 ) moved |= (1 << i);
+        }
+        this->input_shaper->select_actuators(moved);
+    }
+
     // Find the stepper with the more steps, it's the one the speed calculations will want to follow
-    this->main_stepper = THEKERNEL->robot->alpha_stepper_motor;
-    if( THEKERNEL->robot->beta_stepper_motor->steps_to_move > this->main_stepper->steps_to_move ){ this->main_stepper = THEKERNEL->robot->beta_stepper_motor; }
-    if( THEKERNEL->robot->gamma_stepper_motor->steps_to_move > this->main_stepper->steps_to_move ){ this->main_stepper = THEKERNEL->robot->gamma_stepper_motor; }
+    this->main_stepper = THEKERNEL->robot->actuators[0];
+    for( int i = 1; i < N_ACTUATORS; i++ ){
+        if( THEKERNEL->robot->actuators[i]->steps_to_move > this->main_stepper->steps_to_move ){ this->main_stepper = THEKERNEL->robot->actuators[i]; }
+    }
 
     // Set the initial speed for this move
     this->trapezoid_generator_tick(0);
@@ -175,14 +315,25 @@ void Stepper::on_block_begin(void* argument){
 
 // Current block is discarded
 void Stepper::on_block_end(void* argument){
+    Block* block = static_cast<Block*>(argument);
+
+    // Decelerating for a feed hold : we are stopped for now, on_block_begin continues from this speed if a block follows right away
+    if( this->paused && !this->held && block == this->current_block ){
+        this->hold_speed = this->trapezoid_adjusted_rate * block->millimeters / block->steps_event_count;
+        this->pause_motors();
+    }
+
     this->current_block = NULL; //stfu !
 }
 
 // When a stepper motor has finished it's assigned movement
 uint32_t Stepper::stepper_motor_finished_move(uint32_t dummy){
 
-    // We care only if none is still moving
-    if( THEKERNEL->robot->alpha_stepper_motor->moving || THEKERNEL->robot->beta_stepper_motor->moving || THEKERNEL->robot->gamma_stepper_motor->moving ){ return 0; }
+    // We care only if none is still moving, including an extruder stepping with us, it takes its last step with our last one
+    for( int i = 0; i < N_ACTUATORS; i++ ){
+        if( THEKERNEL->robot->actuators[i]->moving ){ return 0; }
+    }
+    if( this->current_block != NULL && this->current_block->extruder != NULL && this->current_block->extruder->moving ){ return 0; }
 
     // This block is finished, release it
     if( this->current_block != NULL ){
@@ -199,29 +350,43 @@ uint32_t Stepper::stepper_motor_finished_move(uint32_t dummy){
 uint32_t Stepper::trapezoid_generator_tick( uint32_t dummy ) {
 
     // Do not do the accel math for nothing
-    if(this->current_block && !this->paused && this->main_stepper->moving ) {
+    if(this->current_block && !this->held && this->main_stepper->moving ) {
 
-        // Store this here because we use it a lot down there
-        uint32_t current_steps_completed = this->main_stepper->stepped;
+        // Store this here because we use it a lot down there. When shaping, the motors lag the trapezoid, which has to
+        // follow where it has taken the path itself, or it would still be accelerating when the motors reach the end
+        uint32_t current_steps_completed = this->input_shaper->is_active() ? (uint32_t)this->commanded_steps : this->main_stepper->stepped;
 
         // Do not accel, just set the value
         if( this->force_speed_update ){
           this->force_speed_update = false;
-          this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+          // A new block, its motors are given their speed even if it did not change. When shaping, keep moving at the
+          // speed the shaper is at, it gets its sample on the next tick
+          float rate = this->trapezoid_adjusted_rate;
+          if( this->input_shaper->is_active() ){
+              rate = this->input_shaper->get_shaped_speed() * this->current_block->steps_event_count / this->current_block->millimeters;
+          }
+          this->set_motor_speeds(rate);
+          this->commanded_steps += this->trapezoid_adjusted_rate / this->acceleration_ticks_per_second;
           return 0;
         }
 
-        // If we are accelerating
-        if(current_steps_completed <= this->current_block->accelerate_until + 1) {
-            // Increase speed
-            this->trapezoid_adjusted_rate += this->current_block->rate_delta;
-              if (this->trapezoid_adjusted_rate > this->current_block->nominal_rate ) {
-                  this->trapezoid_adjusted_rate = this->current_block->nominal_rate;
-              }
-              this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+        // Feed hold : decelerate along the path, and stop the motors where they are once slow enough
+        if( this->paused ){
+            float stop_rate = max(this->current_block->rate_delta * 1.5F, (float)this->minimum_steps_per_second);
+            if( this->trapezoid_adjusted_rate > stop_rate ){
+                this->trapezoid_adjusted_rate -= this->current_block->rate_delta;
+                this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+            }else if( this->step_events_per_second > stop_rate ){
+                // The input shaper is still catching up
+                this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+            }else{
+                this->pause_motors();
+            }
+            return 0;
+        }
 
         // If we are decelerating
-        }else if (current_steps_completed > this->current_block->decelerate_after) {
+        if (current_steps_completed > this->current_block->decelerate_after) {
              // Reduce speed
              // NOTE: We will only reduce speed if the result will be > 0. This catches small
               // rounding errors that might leave steps hanging after the last trapezoid tick.
@@ -235,14 +400,36 @@ uint32_t Stepper::trapezoid_generator_tick( uint32_t dummy ) {
               }
               this->set_step_events_per_second(this->trapezoid_adjusted_rate);
 
-        // If we are cruising
-        }else {
-              // Make sure we cruise at exactly nominal rate
-              if (this->trapezoid_adjusted_rate != this->current_block->nominal_rate) {
+        // If we are accelerating
+        }else if (this->trapezoid_adjusted_rate < this->current_block->nominal_rate) {
+            // Increase speed
+            this->trapezoid_adjusted_rate += this->current_block->rate_delta;
+              if (this->trapezoid_adjusted_rate > this->current_block->nominal_rate ) {
                   this->trapezoid_adjusted_rate = this->current_block->nominal_rate;
-                  this->set_step_events_per_second(this->trapezoid_adjusted_rate);
               }
-          }
+              this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+
+        // If the feed override lowered the nominal rate of this block while it executes
+        }else if (this->trapezoid_adjusted_rate > this->current_block->nominal_rate) {
+              // Slow down to the new nominal rate with the block's acceleration rather than jumping to it
+              this->trapezoid_adjusted_rate -= this->current_block->rate_delta;
+              if (this->trapezoid_adjusted_rate < this->current_block->nominal_rate ) {
+                  this->trapezoid_adjusted_rate = this->current_block->nominal_rate;
+              }
+              this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+
+        // Otherwise we are cruising at exactly nominal rate, only the input shaper needs a sample every tick
+        }else if( this->input_shaper->is_active() ){
+              this->set_step_events_per_second(this->trapezoid_adjusted_rate);
+        }
+
+        // Once the trapezoid has reached the end of the block it keeps going at the final rate, which is the next
+        // block's entry rate, until the shaped motion catches up
+        this->commanded_steps += this->trapezoid_adjusted_rate / this->acceleration_ticks_per_second;
+
+    }else if( this->input_shaper->is_active() ){
+        // Not moving, the shaper still has to see the speed drop to zero
+        this->input_shaper->shape(0.0F);
     }
 
     return 0;
@@ -254,33 +441,50 @@ uint32_t Stepper::trapezoid_generator_tick( uint32_t dummy ) {
 // block begins.
 inline void Stepper::trapezoid_generator_reset(){
     this->trapezoid_adjusted_rate = this->current_block->initial_rate;
+    this->commanded_steps = 0.0F;
     this->force_speed_update = true;
     this->trapezoid_tick_cycle_counter = 0;
 }
 
 // Update the speed for all steppers
 void Stepper::set_step_events_per_second( float steps_per_second )
+{
+    if( this->input_shaper->is_active() ){
+        // The shaper works on the speed along the path in mm/s, so it carries over from one block to the next
+        float steps_per_millimeter = this->current_block->steps_event_count / this->current_block->millimeters;
+        steps_per_second = this->input_shaper->shape(steps_per_second / steps_per_millimeter) * steps_per_millimeter;
+    }
+    if( steps_per_second < this->minimum_steps_per_second ){
+        steps_per_second = this->minimum_steps_per_second;
+    }
+
+    // Cruising, the speed settled and there is nothing to tell the motors
+    if( steps_per_second == this->step_events_per_second ){ return; }
+
+    this->set_motor_speeds(steps_per_second);
+}
+
+// Set the rate the motors step at for the current block, without shaping it
+void Stepper::set_motor_speeds( float steps_per_second )
 {
     // We do not step slower than this, FIXME shoul dbe calculated for the slowest axis not the fastest
     //steps_per_second = max(steps_per_second, this->minimum_steps_per_second);
     if( steps_per_second < this->minimum_steps_per_second ){
         steps_per_second = this->minimum_steps_per_second;
     }
+    this->step_events_per_second = steps_per_second;
 
     // Instruct the stepper motors
-    if( THEKERNEL->robot->alpha_stepper_motor->moving ){ THEKERNEL->robot->alpha_stepper_motor->set_speed( steps_per_second * ( (float)this->current_block->steps[ALPHA_STEPPER] / (float)this->current_block->steps_event_count ) ); }
-    if( THEKERNEL->robot->beta_stepper_motor->moving  ){ THEKERNEL->robot->beta_stepper_motor->set_speed(  steps_per_second * ( (float)this->current_block->steps[BETA_STEPPER ] / (float)this->current_block->steps_event_count ) ); }
-    if( THEKERNEL->robot->gamma_stepper_motor->moving ){ THEKERNEL->robot->gamma_stepper_motor->set_speed( steps_per_second * ( (float)this->current_block->steps[GAMMA_STEPPER] / (float)this->current_block->steps_event_count ) ); }
-
-    // Other modules might want to know the speed changed
-    THEKERNEL->call_event(ON_SPEED_CHANGE, this);
-
+    for( int i = 0; i < N_ACTUATORS; i++ ){
+        StepperMotor *motor = THEKERNEL->robot->actuators[i];
+        if( motor->moving ){ motor->set_speed( steps_per_second * ( (float)this->current_block->steps[i] / (float)this->current_block->steps_event_count ) ); }
+    }
 }
 
 // This function has the role of making sure acceleration and deceleration curves have their
 // rhythm synchronized. The accel/decel must start at the same moment as the speed update routine
 // This is caller in "step just occured" or "block just began" ( step Timer ) context, so we need to be fast.
-// All we do is reset the other timer so that it does what we want
+// All we do is have the slow ticker call the acceleration tick now, and every tick from there
 uint32_t Stepper::synchronize_acceleration(uint32_t dummy){
 
     // No move was done, this is called from on_block_begin
@@ -292,9 +496,7 @@ uint32_t Stepper::synchronize_acceleration(uint32_t dummy){
         // We also want to synchronize in case we start accelerating or decelerating now
 
         // Accel interrupt must happen asap
-        NVIC_SetPendingIRQ(TIMER2_IRQn);
-        // Synchronize both counters
-        LPC_TIM2->TC = LPC_TIM0->TC;
+        THEKERNEL->slow_ticker->call_now(this->acceleration_tick_hook);
 
         // If we start decelerating after this, we must ask the actuator to warn us
         // so we can do what we do in the "else" bellow
@@ -303,9 +505,7 @@ uint32_t Stepper::synchronize_acceleration(uint32_t dummy){
         }
     }else{
         // If we are called not at the first steps, this means we are beginning deceleration
-        NVIC_SetPendingIRQ(TIMER2_IRQn);
-        // Synchronize both counters
-        LPC_TIM2->TC = LPC_TIM0->TC;
+        THEKERNEL->slow_ticker->call_now(this->acceleration_tick_hook);
     }
 
     return 0;
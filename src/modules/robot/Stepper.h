@@ -14,6 +14,7 @@
 class Block;
 class Hook;
 class StepperMotor;
+class InputShaper;
 
 class Stepper : public Module
 {
@@ -28,6 +29,7 @@ public:
     void on_play(void *argument);
     void on_pause(void *argument);
     void on_halt(void *argument);
+    void on_idle(void *argument);
     uint32_t main_interrupt(uint32_t dummy);
     void trapezoid_generator_reset();
     void set_step_events_per_second(float);
@@ -37,11 +39,19 @@ public:
     void turn_enable_pins_on();
     void turn_enable_pins_off();
     uint32_t synchronize_acceleration(uint32_t dummy);
+    void pause_motors();
+    void hold() { paused = true; }
+    void emergency_stop();
+    void set_motor_speeds(float steps_per_second);
 
     int get_acceleration_ticks_per_second() const { return acceleration_ticks_per_second; }
     unsigned int get_minimum_steps_per_second() const { return minimum_steps_per_second; }
     float get_trapezoid_adjusted_rate() const { return trapezoid_adjusted_rate; }
+    float get_step_events_per_second() const { return step_events_per_second; }
     const Block *get_current_block() const { return current_block; }
+    StepperMotor *get_main_stepper() const { return main_stepper; }
+    bool is_held() const { return held; }
+    bool is_stopping_for_hold() const { return paused && !held; }
 
 private:
     Block *current_block;
@@ -53,6 +63,8 @@ private:
     float counter_gamma;
     unsigned int out_bits;
     float trapezoid_adjusted_rate;
+    float commanded_steps;          // Steps the trapezoid has taken the current block through, ahead of the motors when shaping
+    float step_events_per_second;   // Rate actually given to the motors, after input shaping
     int trapezoid_tick_cycle_counter;
     int cycles_per_step_event;
     bool trapezoid_generator_busy;
@@ -62,10 +74,15 @@ private:
     int base_stepping_frequency;
     unsigned short step_bits[3];
     int counter_increment;
-    bool paused;
+    volatile bool paused;       // Set by ON_PAUSE, or straight from a receive interrupt for a feed hold
+    volatile bool halted;       // Emergency stop, the enable pins stay off until reset
+    bool held;                  // Paused and the motors have come to a stop
+    volatile bool resume_pending; // Played while held, on_idle restarts the motors
+    float hold_speed;           // Speed in mm/s the previous block ended at while decelerating for a feed hold
     bool force_speed_update;
     bool enable_pins_status;
     Hook *acceleration_tick_hook;
+    InputShaper *input_shaper;
 
     StepperMotor *main_stepper;
 
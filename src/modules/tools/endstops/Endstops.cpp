@@ -27,6 +27,8 @@
 #include "EndstopsPublicAccess.h"
 #include "StreamOutputPool.h"
 #include "Pauser.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 
 #include <ctype.h>
 
@@ -134,9 +136,10 @@ void Endstops::on_module_loaded()
         return;
     }
 
-    register_for_event(ON_GCODE_RECEIVED);
-    register_for_event(ON_GET_PUBLIC_DATA);
-    register_for_event(ON_SET_PUBLIC_DATA);
+    register_for_gcode('G', 28);
+    static const uint16_t m_codes[] = {119, 206, 306, 500, 503, 665, 666, 910};
+    for (auto m : m_codes) register_for_gcode('M', m);
+    register_for_public_data(endstops_checksum);
 
     THEKERNEL->slow_ticker->attach( THEKERNEL->stepper->get_acceleration_ticks_per_second() , this, &Endstops::acceleration_tick );
 
@@ -260,8 +263,151 @@ void Endstops::on_idle(void *argument)
     }
 }
 
+// G28 runs as a task the dispatch holds on : homing waits for the endstops from the main loop instead of spinning on
+// ON_IDLE inside the gcode handler
+class HomingTask : public Task {
+    public:
+        HomingTask(Endstops *endstops, char axes_to_move, bool home_all);
+        ~HomingTask();
+        bool run();
+
+    private:
+        char next_axes();
+
+        Endstops *endstops;
+        char axes_to_move;      // Every axis G28 homes
+        char remaining;         // Those not homed yet
+        char axes;              // Those being homed together
+        uint8_t order;          // What is left of the homing order
+        int axis;
+        bool home_all;
+};
+
+HomingTask::HomingTask(Endstops *endstops, char axes_to_move, bool home_all)
+{
+    this->endstops = endstops;
+    this->axes_to_move = axes_to_move;
+    this->remaining = axes_to_move;
+    this->axes = 0;
+    this->order = endstops->homing_order;
+    this->axis = X_AXIS;
+    this->home_all = home_all;
+}
+
+// Stopped part way through, by a halt
+HomingTask::~HomingTask()
+{
+    if(endstops->status == NOT_HOMING || endstops->status == LIMIT_TRIGGERED) return;
+
+    for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
+        if ( STEPPER[c]->is_moving() ) STEPPER[c]->move(0, 0);
+    }
+    endstops->status = NOT_HOMING;
+}
+
+// The axes homed together next, in the homing order if one was set, 0 once they are done
+char HomingTask::next_axes()
+{
+    if(endstops->homing_order == 0) {
+        char a = this->remaining;
+        this->remaining = 0;
+        return a;
+    }
+
+    // homing order is 0b00ccbbaa where aa is 0,1,2 to specify the first axis, bb is the second and cc is the third
+    // eg 0b00100001 would be Y X Z, 0b00100100 would be X Y Z
+    while(this->order != 0) {
+        char a = (1 << (this->order & 0x03));
+        this->order >>= 2;
+        if((a & this->remaining) != 0) {
+            this->remaining &= ~a;
+            return a;
+        }
+    }
+    return 0;
+}
+
+bool HomingTask::run()
+{
+    TASK_BEGIN();
+
+    // First wait for the queue to be empty
+    TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+
+    // Enable the motors
+    THEKERNEL->stepper->turn_enable_pins_on();
+
+    while((this->axes = this->next_axes()) != 0) {
+        if(endstops->is_corexy) {
+            // corexy/HBot homing
+            // TODO should really make order configurable, and select whether to allow XY to home at the same time, diagonally
+            if((this->axes & 0x03) == 0x03) {
+                endstops->start_homing_diagonal();
+                TASK_WAIT_UNTIL(endstops->homed_diagonal());
+            }
+
+            // then X and Y each on their own, X means both motors in the same direction and Y in different directions
+            for(this->axis = X_AXIS; this->axis <= Y_AXIS; this->axis++) {
+                if(((this->axes >> this->axis) & 1) == 0) continue;
+
+                endstops->start_homing_corexy(this->axis, MOVING_TO_ENDSTOP_FAST);
+                TASK_WAIT_UNTIL(endstops->homed_corexy(this->axis));
+
+                // Move back a small distance
+                endstops->start_retract_corexy(this->axis);
+                TASK_WAIT_UNTIL(endstops->stopped(0x03));
+
+                // Start moving the axes to the origin slowly
+                endstops->start_homing_corexy(this->axis, MOVING_TO_ENDSTOP_SLOW);
+                TASK_WAIT_UNTIL(endstops->homed_corexy(this->axis));
+            }
+
+            // just home normally for Z
+            this->axes &= 0x04;
+        }
+
+        if(this->axes != 0) {
+            // this homing works for cartesian and delta printers
+            endstops->start_homing(this->axes, MOVING_TO_ENDSTOP_FAST);
+            TASK_WAIT_UNTIL(endstops->homed(this->axes));
+
+            // Move back a small distance
+            endstops->start_retract(this->axes);
+            TASK_WAIT_UNTIL(endstops->stopped(this->axes));
+
+            // Start moving the axes to the origin slowly
+            endstops->start_homing(this->axes, MOVING_TO_ENDSTOP_SLOW);
+            TASK_WAIT_UNTIL(endstops->homed(this->axes));
+
+            if (endstops->is_delta || endstops->is_scara) {
+                // move for soft trim
+                endstops->start_trim(this->axes);
+                TASK_WAIT_UNTIL(endstops->stopped(this->axes));
+            }
+        }
+
+        endstops->status = NOT_HOMING;
+    }
+
+    endstops->set_homed_position(this->axes_to_move, this->home_all);
+
+    // on some systems where 0,0 is bed center it is noce to have home goto 0,0 after homing
+    // default is off
+    if(endstops->move_to_origin_after_home && (this->axes_to_move & 0x03) == 0x03) {
+        endstops->move_to_origin();
+        TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+    }
+
+    // if limit switches are enabled we must back off endstop after setting home
+    endstops->back_off_home(this->axes_to_move);
+    TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+    endstops->status = NOT_HOMING;
+
+    TASK_END();
+}
+
 // if limit switches are enabled, then we must move off of the endstop otherwise we won't be able to move
-// checks if triggered and only backs off if triggered
+// checks if triggered and only backs off if triggered, the caller waits for the moves
 void Endstops::back_off_home(char axes_to_move)
 {
     this->status = BACK_OFF_HOME;
@@ -280,16 +426,11 @@ void Endstops::back_off_home(char axes_to_move)
             THEKERNEL->robot->absolute_mode= oldmode; // restore mode
         }
     }
-    // Wait for above to finish
-    THEKERNEL->conveyor->wait_for_empty_queue();
-    this->status = NOT_HOMING;
 }
 
-// If enabled will move the head to 0,0 after homing, but only if X and Y were set to home
-void Endstops::move_to_origin(char axes_to_move)
+// Move the head to 0,0 after homing X and Y, the caller waits for the move
+void Endstops::move_to_origin()
 {
-    if( (axes_to_move&0x03) != 3 ) return; // ignore if X and Y not homing
-
     // Do we need to check if we are already at 0,0? probably not as the G0 will not do anything if we are
     // float pos[3]; THEKERNEL->robot->get_axis_position(pos); if(pos[0] == 0 && pos[1] == 0) return;
 
@@ -300,256 +441,174 @@ void Endstops::move_to_origin(char axes_to_move)
     snprintf(buf, sizeof(buf), "G0 X0 Y0 F%1.4f", rate);
     Gcode gc(buf, &(StreamOutput::NullStream));
     THEKERNEL->robot->on_gcode_received(&gc); // send to robot directly
-
-    // Wait for above to finish
-    THEKERNEL->conveyor->wait_for_empty_queue();
-    this->status = NOT_HOMING;
-}
-
-void Endstops::wait_for_homed(char axes_to_move)
-{
-    bool running = true;
-    unsigned int debounce[3] = {0, 0, 0};
-    while (running) {
-        running = false;
-        THEKERNEL->call_event(ON_IDLE);
-        for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
-            if ( ( axes_to_move >> c ) & 1 ) {
-                if ( this->pins[c + (this->home_direction[c] ? 0 : 3)].get() ) {
-                    if ( debounce[c] < debounce_count ) {
-                        debounce[c]++;
-                        running = true;
-                    } else if ( STEPPER[c]->is_moving() ) {
-                        STEPPER[c]->move(0, 0);
-                    }
-                } else {
-                    // The endstop was not hit yet
-                    running = true;
-                    debounce[c] = 0;
-                }
-            }
-        }
-    }
 }
 
-void Endstops::do_homing_cartesian(char axes_to_move)
+// Start moving the axes towards their endstops, fast or slow depending on the phase
+void Endstops::start_homing(char axes_to_move, char phase)
 {
-    // this homing works for cartesian and delta printers
-    // Start moving the axes to the origin
-    this->status = MOVING_TO_ENDSTOP_FAST;
+    this->status = phase;
     for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
         if ( ( axes_to_move >> c) & 1 ) {
-            this->feed_rate[c]= this->fast_rates[c];
+            this->feed_rate[c]= (phase == MOVING_TO_ENDSTOP_FAST) ? this->fast_rates[c] : this->slow_rates[c];
+            this->debounce[c]= 0;
             STEPPER[c]->set_speed(0);
             STEPPER[c]->move(this->home_direction[c], 10000000);
         }
     }
+}
 
-    // Wait for all axes to have homed
-    this->wait_for_homed(axes_to_move);
-
-    // Move back a small distance
+// Move back a small distance off the endstops
+void Endstops::start_retract(char axes_to_move)
+{
     this->status = MOVING_BACK;
-    bool inverted_dir;
     for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
         if ( ( axes_to_move >> c ) & 1 ) {
-            inverted_dir = !this->home_direction[c];
             this->feed_rate[c]= this->slow_rates[c];
             STEPPER[c]->set_speed(0);
-            STEPPER[c]->move(inverted_dir, this->retract_mm[c]*STEPS_PER_MM(c));
-        }
-    }
-
-    // Wait for moves to be done
-    for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
-        if (  ( axes_to_move >> c ) & 1 ) {
-            while ( STEPPER[c]->is_moving() ) {
-                THEKERNEL->call_event(ON_IDLE);
-            }
+            STEPPER[c]->move(!this->home_direction[c], this->retract_mm[c]*STEPS_PER_MM(c));
         }
     }
+}
 
-    // Start moving the axes to the origin slowly
-    this->status = MOVING_TO_ENDSTOP_SLOW;
+// Move by the endstop trim, deltas and scaras use it to do soft adjusting
+void Endstops::start_trim(char axes_to_move)
+{
+    this->status = MOVING_BACK;
     for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
-        if ( ( axes_to_move >> c ) & 1 ) {
+        if ( this->trim_mm[c] != 0.0F && ( axes_to_move >> c ) & 1 ) {
+            bool inverted_dir = this->home_direction[c];
+            // move up or down depending on sign of trim, -ive is down away from home
+            if (this->trim_mm[c] < 0) inverted_dir = !inverted_dir;
             this->feed_rate[c]= this->slow_rates[c];
             STEPPER[c]->set_speed(0);
-            STEPPER[c]->move(this->home_direction[c], 10000000);
+            STEPPER[c]->move(inverted_dir, abs(round(this->trim_mm[c]*STEPS_PER_MM(c))));
         }
     }
+}
 
-    // Wait for all axes to have homed
-    this->wait_for_homed(axes_to_move);
-
-    if (this->is_delta || this->is_scara) {
-        // move for soft trim
-        this->status = MOVING_BACK;
-        for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
-            if ( this->trim_mm[c] != 0.0F && ( axes_to_move >> c ) & 1 ) {
-                inverted_dir = this->home_direction[c];
-                // move up or down depending on sign of trim, -ive is down away from home
-                if (this->trim_mm[c] < 0) inverted_dir = !inverted_dir;
-                this->feed_rate[c]= this->slow_rates[c];
-                STEPPER[c]->set_speed(0);
-                STEPPER[c]->move(inverted_dir, abs(round(this->trim_mm[c]*STEPS_PER_MM(c))));
-            }
-        }
-
-        // Wait for moves to be done
-        for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
-            if (  ( axes_to_move >> c ) & 1 ) {
-                //THEKERNEL->streams->printf("axis %c \r\n", c );
-                while ( STEPPER[c]->is_moving() ) {
-                    THEKERNEL->call_event(ON_IDLE);
+// Stops each axis once its endstop is hit and debounced, true when they all are
+bool Endstops::homed(char axes_to_move)
+{
+    bool running = false;
+    for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
+        if ( ( axes_to_move >> c ) & 1 ) {
+            if ( this->pins[c + (this->home_direction[c] ? 0 : 3)].get() ) {
+                if ( this->debounce[c] < debounce_count ) {
+                    this->debounce[c]++;
+                    running = true;
+                } else if ( STEPPER[c]->is_moving() ) {
+                    STEPPER[c]->move(0, 0);
                 }
+            } else {
+                // The endstop was not hit yet
+                running = true;
+                this->debounce[c] = 0;
             }
         }
     }
-
-    // Homing is done
-    this->status = NOT_HOMING;
+    return !running;
 }
 
-void Endstops::wait_for_homed_corexy(int axis)
+bool Endstops::stopped(char axes_to_move)
 {
-    bool running = true;
-    unsigned int debounce[3] = {0, 0, 0};
-    while (running) {
-        running = false;
-        THEKERNEL->call_event(ON_IDLE);
-        if ( this->pins[axis + (this->home_direction[axis] ? 0 : 3)].get() ) {
-            if ( debounce[axis] < debounce_count ) {
-                debounce[axis] ++;
-                running = true;
-            } else {
-                // turn both off if running
-                if (STEPPER[X_AXIS]->is_moving()) STEPPER[X_AXIS]->move(0, 0);
-                if (STEPPER[Y_AXIS]->is_moving()) STEPPER[Y_AXIS]->move(0, 0);
-            }
-        } else {
-            // The endstop was not hit yet
-            running = true;
-            debounce[axis] = 0;
-        }
+    for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
+        if ( (( axes_to_move >> c ) & 1) && STEPPER[c]->is_moving() ) return false;
     }
+    return true;
 }
 
-void Endstops::corexy_home(int home_axis, bool dirx, bool diry, float fast_rate, float slow_rate, unsigned int retract_steps)
+// To move XY at the same time only one motor needs to turn, determine which motor and which direction based on min or max
+// directions, it moves until either endstop triggers
+void Endstops::start_homing_diagonal()
 {
-    this->status = MOVING_TO_ENDSTOP_FAST;
-    this->feed_rate[X_AXIS]= fast_rate;
-    STEPPER[X_AXIS]->set_speed(0);
-    STEPPER[X_AXIS]->move(dirx, 10000000);
-    this->feed_rate[Y_AXIS]= fast_rate;
-    STEPPER[Y_AXIS]->set_speed(0);
-    STEPPER[Y_AXIS]->move(diry, 10000000);
-
-    // wait for primary axis
-    this->wait_for_homed_corexy(home_axis);
+    bool dirx= this->home_direction[X_AXIS];
+    bool diry= this->home_direction[Y_AXIS];
+    // min/min and max/max turn X, min/max and max/min turn Y, towards min if X homes to min
+    int motor= (dirx == diry) ? X_AXIS : Y_AXIS;
 
-    // Move back a small distance
-    this->status = MOVING_BACK;
-    this->feed_rate[X_AXIS]= slow_rate;
-    STEPPER[X_AXIS]->set_speed(0);
-    STEPPER[X_AXIS]->move(!dirx, retract_steps);
-    this->feed_rate[Y_AXIS]= slow_rate;
-    STEPPER[Y_AXIS]->set_speed(0);
-    STEPPER[Y_AXIS]->move(!diry, retract_steps);
+    this->status = MOVING_TO_ENDSTOP_FAST;
+    this->feed_rate[motor]= this->fast_rates[motor]*1.4142;
+    STEPPER[motor]->set_speed(0); // need to allow for more ground covered when moving diagonally
+    STEPPER[motor]->move(dirx, 10000000);
+}
 
-    // wait until done
-    while ( STEPPER[X_AXIS]->is_moving() || STEPPER[Y_AXIS]->is_moving()) {
-        THEKERNEL->call_event(ON_IDLE);
+bool Endstops::homed_diagonal()
+{
+    for(int m=X_AXIS;m<=Y_AXIS;m++) {
+        if(this->pins[m + (this->home_direction[m] ? 0 : 3)].get()) {
+            // turn off the motor
+            if(STEPPER[X_AXIS]->is_moving()) STEPPER[X_AXIS]->move(0, 0);
+            if(STEPPER[Y_AXIS]->is_moving()) STEPPER[Y_AXIS]->move(0, 0);
+            return true;
+        }
     }
+    return false;
+}
 
-    // Start moving the axes to the origin slowly
-    this->status = MOVING_TO_ENDSTOP_SLOW;
-    this->feed_rate[X_AXIS]= slow_rate;
-    STEPPER[X_AXIS]->set_speed(0);
-    STEPPER[X_AXIS]->move(dirx, 10000000);
-    this->feed_rate[Y_AXIS]= slow_rate;
-    STEPPER[Y_AXIS]->set_speed(0);
-    STEPPER[Y_AXIS]->move(diry, 10000000);
+// Homing X on a CoreXY/HBot turns both motors in the same direction, and Y in different directions
+void Endstops::start_homing_corexy(int axis, char phase)
+{
+    bool dir= this->home_direction[axis];
+    float rate= (phase == MOVING_TO_ENDSTOP_FAST) ? this->fast_rates[axis] : this->slow_rates[axis];
 
-    // wait for primary axis
-    this->wait_for_homed_corexy(home_axis);
+    this->status = phase;
+    this->debounce[axis] = 0;
+    move_corexy(dir, (axis == X_AXIS) ? dir : !dir, rate, 10000000);
 }
 
-// this homing works for HBots/CoreXY
-void Endstops::do_homing_corexy(char axes_to_move)
+void Endstops::start_retract_corexy(int axis)
 {
-    // TODO should really make order configurable, and select whether to allow XY to home at the same time, diagonally
-    // To move XY at the same time only one motor needs to turn, determine which motor and which direction based on min or max directions
-    // allow to move until an endstop triggers, then stop that motor. Speed up when moving diagonally to match X or Y speed
-    // continue moving in the direction not yet triggered (which means two motors turning) until endstop hit
-
-    if((axes_to_move & 0x03) == 0x03) { // both X and Y need Homing
-        // determine which motor to turn and which way
-        bool dirx= this->home_direction[X_AXIS];
-        bool diry= this->home_direction[Y_AXIS];
-        int motor;
-        bool dir;
-        if(dirx && diry) { // min/min
-            motor= X_AXIS;
-            dir= true;
-        }else if(dirx && !diry) { // min/max
-            motor= Y_AXIS;
-            dir= true;
-        }else if(!dirx && diry) { // max/min
-            motor= Y_AXIS;
-            dir= false;
-        }else if(!dirx && !diry) { // max/max
-            motor= X_AXIS;
-            dir= false;
-        }
+    bool dir= this->home_direction[axis];
 
-        // then move both X and Y until one hits the endstop
-        this->status = MOVING_TO_ENDSTOP_FAST;
-        this->feed_rate[motor]= this->fast_rates[motor]*1.4142;
-        STEPPER[motor]->set_speed(0); // need to allow for more ground covered when moving diagonally
-        STEPPER[motor]->move(dir, 10000000);
-        // wait until either X or Y hits the endstop
-        bool running= true;
-        while (running) {
-            THEKERNEL->call_event(ON_IDLE);
-            for(int m=X_AXIS;m<=Y_AXIS;m++) {
-                if(this->pins[m + (this->home_direction[m] ? 0 : 3)].get()) {
-                    // turn off motor
-                    if(STEPPER[motor]->is_moving()) STEPPER[motor]->move(0, 0);
-                    running= false;
-                    break;
-                }
-            }
-        }
-    }
+    this->status = MOVING_BACK;
+    move_corexy(!dir, (axis == X_AXIS) ? !dir : dir, this->slow_rates[axis], this->retract_mm[axis]*STEPS_PER_MM(axis));
+}
 
-    // move individual axis
-    if (axes_to_move & 0x01) { // Home X, which means both X and Y in same direction
-        bool dir= this->home_direction[X_AXIS];
-        corexy_home(X_AXIS, dir, dir, this->fast_rates[X_AXIS], this->slow_rates[X_AXIS], this->retract_mm[X_AXIS]*STEPS_PER_MM(X_AXIS));
-    }
+void Endstops::move_corexy(bool dirx, bool diry, float rate, unsigned int steps)
+{
+    this->feed_rate[X_AXIS]= rate;
+    STEPPER[X_AXIS]->set_speed(0);
+    STEPPER[X_AXIS]->move(dirx, steps);
+    this->feed_rate[Y_AXIS]= rate;
+    STEPPER[Y_AXIS]->set_speed(0);
+    STEPPER[Y_AXIS]->move(diry, steps);
+}
 
-    if (axes_to_move & 0x02) { // Home Y, which means both X and Y in different directions
-        bool dir= this->home_direction[Y_AXIS];
-        corexy_home(Y_AXIS, dir, !dir, this->fast_rates[Y_AXIS], this->slow_rates[Y_AXIS], this->retract_mm[Y_AXIS]*STEPS_PER_MM(Y_AXIS));
+// Stops both motors once the endstop of the axis is hit and debounced
+bool Endstops::homed_corexy(int axis)
+{
+    if ( !this->pins[axis + (this->home_direction[axis] ? 0 : 3)].get() ) {
+        // The endstop was not hit yet
+        this->debounce[axis] = 0;
+        return false;
     }
-
-    if (axes_to_move & 0x04) { // move Z
-        do_homing_cartesian(0x04); // just home normally for Z
+    if ( this->debounce[axis] < debounce_count ) {
+        this->debounce[axis]++;
+        return false;
     }
 
-    // Homing is done
-    this->status = NOT_HOMING;
+    // turn both off if running
+    if (STEPPER[X_AXIS]->is_moving()) STEPPER[X_AXIS]->move(0, 0);
+    if (STEPPER[Y_AXIS]->is_moving()) STEPPER[Y_AXIS]->move(0, 0);
+    return true;
 }
 
-void Endstops::home(char axes_to_move)
+// Where the homed axes are now, plus the home offset
+void Endstops::set_homed_position(char axes_to_move, bool home_all)
 {
-    if (is_corexy){
-        // corexy/HBot homing
-        do_homing_corexy(axes_to_move);
+    if(home_all) {
+        // for deltas this may be important rather than setting each individually
+        THEKERNEL->robot->reset_axis_position(
+            this->homing_position[X_AXIS] + this->home_offset[X_AXIS],
+            this->homing_position[Y_AXIS] + this->home_offset[Y_AXIS],
+            this->homing_position[Z_AXIS] + this->home_offset[Z_AXIS]);
     }else{
-        // cartesian/delta homing
-        do_homing_cartesian(axes_to_move);
+        // Zero the ax(i/e)s position, add in the home offset
+        for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
+            if ( (axes_to_move >> c)  & 1 ) {
+                THEKERNEL->robot->reset_axis_position(this->homing_position[c] + this->home_offset[c], c);
+            }
+        }
     }
 }
 
@@ -562,9 +621,6 @@ void Endstops::on_gcode_received(void *argument)
             gcode->mark_as_taken();
             // G28 is received, we have homing to do
 
-            // First wait for the queue to be empty
-            THEKERNEL->conveyor->wait_for_empty_queue();
-
             // Do we move select axes or all of them
             char axes_to_move = 0;
             // only enable homing if the endstop is defined, deltas, scaras always home all axis
@@ -576,46 +632,8 @@ void Endstops::on_gcode_received(void *argument)
                 }
             }
 
-            // Enable the motors
-            THEKERNEL->stepper->turn_enable_pins_on();
-
-            // do the actual homing
-            if(homing_order != 0){
-                // if an order has been specified do it in the specified order
-                // homing order is 0b00ccbbaa where aa is 0,1,2 to specify the first axis, bb is the second and cc is the third
-                // eg 0b00100001 would be Y X Z, 0b00100100 would be X Y Z
-                for (uint8_t m = homing_order; m != 0; m >>= 2) {
-                    int a= (1 << (m & 0x03)); // axis to move
-                    if((a & axes_to_move) != 0)
-                        home(a);
-                }
-            }else {
-                // they all home at the same time
-                home(axes_to_move);
-            }
-
-            if(home_all) {
-                // for deltas this may be important rather than setting each individually
-                THEKERNEL->robot->reset_axis_position(
-                    this->homing_position[X_AXIS] + this->home_offset[X_AXIS],
-                    this->homing_position[Y_AXIS] + this->home_offset[Y_AXIS],
-                    this->homing_position[Z_AXIS] + this->home_offset[Z_AXIS]);
-            }else{
-                // Zero the ax(i/e)s position, add in the home offset
-                for ( int c = X_AXIS; c <= Z_AXIS; c++ ) {
-                    if ( (axes_to_move >> c)  & 1 ) {
-                        THEKERNEL->robot->reset_axis_position(this->homing_position[c] + this->home_offset[c], c);
-                    }
-                }
-            }
-
-            // on some systems where 0,0 is bed center it is noce to have home goto 0,0 after homing
-            // default is off
-            if(this->move_to_origin_after_home)
-                move_to_origin(axes_to_move);
-
-            // if limit switches are enabled we must back off endstop after setting home
-            back_off_home(axes_to_move);
+            // the ok, and what comes after, wait for the homing to be done
+            THEKERNEL->gcode_dispatch->hold(new HomingTask(this, axes_to_move, home_all));
         }
 
     } else if (gcode->has_m) {
@@ -14,6 +14,7 @@
 #include <bitset>
 
 class StepperMotor;
+class HomingTask;
 
 class Endstops : public Module{
     public:
@@ -24,14 +25,22 @@ class Endstops : public Module{
         uint32_t acceleration_tick(uint32_t dummy);
 
     private:
-        void home(char axes_to_move);
-        void do_homing_cartesian(char axes_to_move);
-        void do_homing_corexy(char axes_to_move);
-        void wait_for_homed(char axes_to_move);
-        void wait_for_homed_corexy(int axis);
-        void corexy_home(int home_axis, bool dirx, bool diry, float fast_rate, float slow_rate, unsigned int retract_steps);
+        friend class HomingTask;
+
+        void start_homing(char axes_to_move, char phase);
+        void start_retract(char axes_to_move);
+        void start_trim(char axes_to_move);
+        bool homed(char axes_to_move);
+        bool stopped(char axes_to_move);
+        void start_homing_diagonal();
+        bool homed_diagonal();
+        void start_homing_corexy(int axis, char phase);
+        void start_retract_corexy(int axis);
+        void move_corexy(bool dirx, bool diry, float rate, unsigned int steps);
+        bool homed_corexy(int axis);
+        void set_homed_position(char axes_to_move, bool home_all);
         void back_off_home(char axes_to_move);
-        void move_to_origin(char);
+        void move_to_origin();
         void on_get_public_data(void* argument);
         void on_set_public_data(void* argument);
         void on_idle(void *argument);
@@ -43,6 +52,7 @@ class Endstops : public Module{
         std::bitset<3> limit_enable;
 
         unsigned int  debounce_count;
+        unsigned int  debounce[3];
         float  retract_mm[3];
         float  trim_mm[3];
         float  fast_rates[3];
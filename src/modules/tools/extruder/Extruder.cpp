@@ -58,6 +58,7 @@
 #define retract_recover_feedrate_checksum    CHECKSUM("retract_recover_feedrate")
 #define retract_zlift_length_checksum        CHECKSUM("retract_zlift_length")
 #define retract_zlift_feedrate_checksum      CHECKSUM("retract_zlift_feedrate")
+#define pressure_advance_checksum            CHECKSUM("pressure_advance")
 
 #define X_AXIS      0
 #define Y_AXIS      1
@@ -86,6 +87,7 @@ Extruder::Extruder( uint16_t config_identifier, bool single )
     this->retracted = false;
     this->volumetric_multiplier = 1.0F;
     this->extruder_multiplier = 1.0F;
+    this->advance_position = 0.0F;
 
     memset(this->offset, 0, sizeof(this->offset));
 }
@@ -94,6 +96,7 @@ void Extruder::on_halt(void *arg)
 {
     // turn off motor
     this->enabled= false;
+    this->advance_position = 0.0F;
     this->en_pin.set(1);
 }
 
@@ -106,13 +109,15 @@ void Extruder::on_module_loaded()
     // We work on the same Block as Stepper, so we need to know when it gets a new one and drops one
     this->register_for_event(ON_BLOCK_BEGIN);
     this->register_for_event(ON_BLOCK_END);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    static const uint16_t g_codes[] = {0, 1, 2, 3, 10, 11, 90, 91, 92};
+    static const uint16_t m_codes[] = {17, 18, 82, 83, 84, 92, 114, 200, 204, 207, 208, 221, 500, 503, 900};
+    for (auto g : g_codes) this->register_for_gcode('G', g);
+    for (auto m : m_codes) this->register_for_gcode('M', m);
     this->register_for_event(ON_GCODE_EXECUTE);
     this->register_for_event(ON_PLAY);
     this->register_for_event(ON_PAUSE);
     this->register_for_event(ON_HALT);
-    this->register_for_event(ON_SPEED_CHANGE);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_public_data(extruder_checksum);
 
     // Start values
     this->target_position = 0;
@@ -178,6 +183,7 @@ void Extruder::on_config_reload(void *argument)
     this->retract_recover_feedrate = THEKERNEL->config->value(extruder_checksum, this->identifier, retract_recover_feedrate_checksum)->by_default(8)->as_number();
     this->retract_zlift_length     = THEKERNEL->config->value(extruder_checksum, this->identifier, retract_zlift_length_checksum)->by_default(0)->as_number();
     this->retract_zlift_feedrate   = THEKERNEL->config->value(extruder_checksum, this->identifier, retract_zlift_feedrate_checksum)->by_default(100*60)->as_number(); // mm/min
+    this->pressure_advance         = THEKERNEL->config->value(extruder_checksum, this->identifier, pressure_advance_checksum)->by_default(0)->as_number(); // seconds, 0 disables
 
     if(filament_diameter > 0.01) {
         this->volumetric_multiplier = 1.0F / (powf(this->filament_diameter / 2, 2) * PI);
@@ -200,6 +206,10 @@ void Extruder::on_get_public_data(void* argument){
 void Extruder::on_pause(void *argument)
 {
     this->paused = true;
+
+    // Stepped from the robot's steps, we keep following it while it decelerates to a stop
+    const Block *robot_block = THEKERNEL->stepper->get_current_block();
+    if( robot_block != NULL && robot_block->extruder == this->stepper_motor ) return;
     this->stepper_motor->pause();
 }
 
@@ -235,13 +245,8 @@ void Extruder::on_gcode_received(void *argument)
 
         } else if (gcode->m == 200 && ( (this->enabled && !gcode->has_letter('P')) || (gcode->has_letter('P') && gcode->get_value('P') == this->identifier)) ) {
             if (gcode->has_letter('D')) {
-                THEKERNEL->conveyor->wait_for_empty_queue(); // only apply after the queue has emptied
-                this->filament_diameter = gcode->get_value('D');
-                if(filament_diameter > 0.01) {
-                    this->volumetric_multiplier = 1.0F / (powf(this->filament_diameter / 2, 2) * PI);
-                }else{
-                    this->volumetric_multiplier = 1.0F;
-                }
+                // only apply once the moves before it are done, on_gcode_execute does it
+                THEKERNEL->conveyor->append_gcode(gcode);
             }
             gcode->mark_as_taken();
 
@@ -265,6 +270,16 @@ void Extruder::on_gcode_received(void *argument)
             if(gcode->has_letter('F')) retract_recover_feedrate = gcode->get_value('F')/60.0F; // specified in mm/min converted to mm/sec
             gcode->mark_as_taken();
 
+        } else if (gcode->m == 900 && ( (this->enabled && !gcode->has_letter('P')) || (gcode->has_letter('P') && gcode->get_value('P') == this->identifier)) ) {
+            // M900 K[seconds] - set the pressure advance factor, 0 disables it
+            if(gcode->has_letter('K')) {
+                this->pressure_advance = max(gcode->get_value('K'), 0.0F);
+            } else {
+                gcode->stream->printf("K:%g ", this->pressure_advance);
+                gcode->add_nl = true;
+            }
+            gcode->mark_as_taken();
+
         } else if (gcode->m == 221 && this->enabled) { // M221 S100 change flow rate by percentage
             if(gcode->has_letter('S')) this->extruder_multiplier= gcode->get_value('S')/100.0F;
             gcode->mark_as_taken();
@@ -276,6 +291,7 @@ void Extruder::on_gcode_received(void *argument)
                 gcode->stream->printf(";E retract length, feedrate, zlift length, feedrate:\nM207 S%1.4f F%1.4f Z%1.4f Q%1.4f\n", this->retract_length, this->retract_feedrate*60.0F, this->retract_zlift_length, this->retract_zlift_feedrate);
                 gcode->stream->printf(";E retract recover length, feedrate:\nM208 S%1.4f F%1.4f\n", this->retract_recover_length, this->retract_recover_feedrate*60.0F);
                 gcode->stream->printf(";E acceleration mm/sec^2:\nM204 E%1.4f\n", this->acceleration);
+                gcode->stream->printf(";E pressure advance seconds:\nM900 K%1.4f\n", this->pressure_advance);
 
             } else {
                 gcode->stream->printf(";E Steps per mm:\nM92 E%1.4f P%d\n", this->steps_per_millimeter, this->identifier);
@@ -283,6 +299,7 @@ void Extruder::on_gcode_received(void *argument)
                 gcode->stream->printf(";E retract length, feedrate:\nM207 S%1.4f F%1.4f Z%1.4f Q%1.4f P%d\n", this->retract_length, this->retract_feedrate*60.0F, this->retract_zlift_length, this->retract_zlift_feedrate, this->identifier);
                 gcode->stream->printf(";E retract recover length, feedrate:\nM208 S%1.4f F%1.4f P%d\n", this->retract_recover_length, this->retract_recover_feedrate*60.0F, this->identifier);
                 gcode->stream->printf(";E acceleration mm/sec^2:\nM204 E%1.4f P%d\n", this->acceleration, this->identifier);
+                gcode->stream->printf(";E pressure advance seconds:\nM900 K%1.4f P%d\n", this->pressure_advance, this->identifier);
             }
             gcode->mark_as_taken();
         } else if( gcode->m == 17 || gcode->m == 18 || gcode->m == 82 || gcode->m == 83 || gcode->m == 84 ) {
@@ -378,6 +395,16 @@ void Extruder::on_gcode_execute(void *argument)
         case 84:
             this->en_pin.set(1);
             break;
+        case 200:
+            if( gcode->has_letter('D') && ( (this->enabled && !gcode->has_letter('P')) || (gcode->has_letter('P') && gcode->get_value('P') == this->identifier)) ) {
+                this->filament_diameter = gcode->get_value('D');
+                if(filament_diameter > 0.01) {
+                    this->volumetric_multiplier = 1.0F / (powf(this->filament_diameter / 2, 2) * PI);
+                }else{
+                    this->volumetric_multiplier = 1.0F;
+                }
+            }
+            break;
         }
         return;
 
@@ -453,6 +480,35 @@ void Extruder::on_gcode_execute(void *argument)
 
 }
 
+// Split the steps of a following extruder over the phases of the block the leader moves, its steps up to the end of
+// the acceleration, of the cruise and of the block : pushed are added while it accelerates and taken removed while it
+// decelerates, the rest is spread evenly. No phase gets more steps than the leader makes in it, what does not fit goes
+// to the others
+static void split_follow_steps( const Block *block, const StepperMotor *leader, int total, float pushed, float taken, uint32_t ends[3], uint32_t steps[3] )
+{
+    uint32_t start = leader->get_stepped();
+    ends[2] = leader->get_steps_to_move();
+    ends[0] = min( max( (uint32_t)block->accelerate_until, start ), ends[2] );
+    ends[1] = min( max( (uint32_t)block->decelerate_after, ends[0] ), ends[2] );
+    int room[3] = { (int)(ends[0] - start), (int)(ends[1] - ends[0]), (int)(ends[2] - ends[1]) };
+
+    float even = (total - pushed + taken) / (ends[2] - start);
+    int split[3];
+    split[0] = min( max( (int)lroundf(even * room[0] + pushed), 0 ), room[0] );
+    split[2] = min( max( (int)lroundf(even * room[2] - taken), 0 ), room[2] );
+    split[1] = min( max( total - split[0] - split[2], 0 ), room[1] );
+
+    int rest = total - split[0] - split[1] - split[2];
+    for( int i = 0; i < 3 && rest != 0; i += 2 ) {
+        int moved = rest > 0 ? min( rest, room[i] - split[i] ) : max( rest, -split[i] );
+        split[i] += moved;
+        rest -= moved;
+    }
+
+    for( int i = 0; i < 3; i++ )
+        steps[i] = split[i];
+}
+
 // When a new block begins, either follow the robot, or step by ourselves ( or stay back and do nothing )
 void Extruder::on_block_begin(void *argument)
 {
@@ -465,12 +521,16 @@ void Extruder::on_block_begin(void *argument)
 
         this->current_position += this->travel_distance ;
 
-        int steps_to_step = abs(int(floor(this->steps_per_millimeter * (this->travel_distance + this->unstepped_distance) )));
+        // Any filament still pushed ahead by pressure advance is taken back first, so retracts start from no pressure
+        float distance = this->travel_distance - this->advance_position;
+        this->advance_position = 0.0F;
 
-        if ( this->travel_distance > 0 ) {
-            this->unstepped_distance += this->travel_distance - (steps_to_step / this->steps_per_millimeter); //catch any overflow
+        int steps_to_step = abs(int(floor(this->steps_per_millimeter * (distance + this->unstepped_distance) )));
+
+        if ( distance > 0 ) {
+            this->unstepped_distance += distance - (steps_to_step / this->steps_per_millimeter); //catch any overflow
         }   else {
-            this->unstepped_distance += this->travel_distance + (steps_to_step / this->steps_per_millimeter); //catch any overflow
+            this->unstepped_distance += distance + (steps_to_step / this->steps_per_millimeter); //catch any overflow
         }
 
         if( steps_to_step != 0 ) {
@@ -480,32 +540,78 @@ void Extruder::on_block_begin(void *argument)
             this->current_block = block;
 
             this->stepper_motor->set_steps_per_second(0);
-            this->stepper_motor->move( ( this->travel_distance > 0 ), steps_to_step);
+            this->stepper_motor->move( ( distance > 0 ), steps_to_step);
 
         } else {
             this->current_block = NULL;
         }
 
-    } else if( this->mode == FOLLOW ) {
+    } else if( this->mode == FOLLOW || (this->mode == OFF && this->advance_position != 0.0F && block->millimeters > 0.0F) ) {
+        // A travel move after extruding releases what pressure advance pushed ahead along the way
+        if( this->mode == OFF ) {
+            this->mode = FOLLOW;
+            this->travel_ratio = 0.0F;
+        }
+
         // In non-solo mode, we just follow the stepper module
         this->travel_distance = block->millimeters * this->travel_ratio;
 
         this->current_position += this->travel_distance;
 
-        int steps_to_step = abs(int(floor(this->steps_per_millimeter * (this->travel_distance + this->unstepped_distance) )));
+        // Pressure advance : the filament pushed ahead must be pressure_advance * extrusion speed by the end of this block.
+        // As much as the robot speeds up is pushed while it accelerates, and as much as it slows down taken back while it
+        // decelerates, the rest is spread over the block.
+        float advance_change = 0.0F;
+        bool shape_advance = false;
+        if( block->millimeters > 0.0F && (this->pressure_advance > 0.0F || this->advance_position != 0.0F) ) {
+            float ratio = this->travel_ratio > 0.0F ? this->travel_ratio : 0.0F;
+            advance_change = this->pressure_advance * block->exit_speed * ratio - this->advance_position;
+            shape_advance = this->pressure_advance > 0.0F && ratio > 0.0F;
+
+            // Never reverse the extruder in the middle of an extrusion, what is left gets done on the next block
+            if( this->travel_distance > 0.0F && this->travel_distance + advance_change < 0.0F ) {
+                advance_change = -this->travel_distance;
+                shape_advance = false;
+            }
+            this->advance_position += advance_change;
+        }
+        float distance = this->travel_distance + advance_change;
+
+        int steps_to_step = abs(int(floor(this->steps_per_millimeter * (distance + this->unstepped_distance) )));
 
-        if ( this->travel_distance > 0 ) {
-            this->unstepped_distance += this->travel_distance - (steps_to_step / this->steps_per_millimeter); //catch any overflow
+        if ( distance > 0 ) {
+            this->unstepped_distance += distance - (steps_to_step / this->steps_per_millimeter); //catch any overflow
         }   else {
-            this->unstepped_distance += this->travel_distance + (steps_to_step / this->steps_per_millimeter); //catch any overflow
+            this->unstepped_distance += distance + (steps_to_step / this->steps_per_millimeter); //catch any overflow
         }
 
-        if( steps_to_step != 0 ) {
+        // The Stepper moves this block, we are stepped from the steps of its longest axis as long as we have no more than it does
+        StepperMotor *leader = THEKERNEL->stepper->get_main_stepper();
+        if( steps_to_step != 0 && THEKERNEL->stepper->get_current_block() == block && (uint32_t)steps_to_step <= leader->get_steps_to_move() - leader->get_stepped() ) {
+            float pushed = 0.0F, taken = 0.0F;
+            if( shape_advance && distance > 0.0F ) {
+                // the fastest it goes in this block, where it stops accelerating
+                float accelerate_distance = block->accelerate_until * block->millimeters / block->steps_event_count;
+                float peak_speed = min( block->nominal_speed, sqrtf(block->entry_speed * block->entry_speed + 2.0F * block->acceleration * accelerate_distance) );
+                pushed = this->pressure_advance * (peak_speed - block->entry_speed) * this->travel_ratio * this->steps_per_millimeter;
+                taken = this->pressure_advance * (peak_speed - block->exit_speed) * this->travel_ratio * this->steps_per_millimeter;
+            }
+            uint32_t ends[3], steps[3];
+            split_follow_steps( block, leader, steps_to_step, pushed, taken, ends, steps );
+
+            // The Stepper releases the block once we are done too, which is on the last step of its longest axis
+            this->current_block = NULL;
+            block->extruder = this->stepper_motor;
+            block->extruder_steps = steps_to_step;
+            this->stepper_motor->follow( leader, ( distance > 0 ), ends, steps );
+
+        } else if( steps_to_step != 0 ) {
+            // No axis steps, or they make fewer steps than we do : we take the block and extrude at the rate its nominal speed takes
             block->take();
             this->current_block = block;
 
-            this->stepper_motor->move( ( this->travel_distance > 0 ), steps_to_step );
-            this->on_speed_change(0); // initialise speed in case we get called first
+            this->stepper_motor->move( ( distance > 0 ), steps_to_step );
+            this->stepper_motor->set_speed( max( steps_to_step * block->nominal_speed / block->millimeters, (float)THEKERNEL->stepper->get_minimum_steps_per_second() ) );
         } else {
             this->current_block = NULL;
         }
@@ -553,29 +659,6 @@ uint32_t Extruder::acceleration_tick(uint32_t dummy)
     return 0;
 }
 
-// Speed has been updated for the robot's stepper, we must update accordingly
-void Extruder::on_speed_change( void *argument )
-{
-    if(!this->enabled) return;
-
-    // Avoid trying to work when we really shouldn't ( between blocks or re-entry )
-    if( this->current_block == NULL ||  this->paused || this->mode != FOLLOW || this->stepper_motor->is_moving() != true ) {
-        return;
-    }
-
-    /*
-    * nominal block duration = current block's steps / ( current block's nominal rate )
-    * nominal extruder rate = extruder steps / nominal block duration
-    * actual extruder rate = nominal extruder rate * ( ( stepper's steps per second ) / ( current block's nominal rate ) )
-    * or actual extruder rate = ( ( extruder steps * ( current block's nominal_rate ) ) / current block's steps ) * ( ( stepper's steps per second ) / ( current block's nominal rate ) )
-    * or simplified : extruder steps * ( stepper's steps per second ) ) / current block's steps
-    * or even : ( stepper steps per second ) * ( extruder steps / current block's steps )
-    */
-
-    this->stepper_motor->set_speed( max( ( THEKERNEL->stepper->get_trapezoid_adjusted_rate()) * ( (float)this->stepper_motor->get_steps_to_move() / (float)this->current_block->steps_event_count ), THEKERNEL->stepper->get_minimum_steps_per_second() ) );
-
-}
-
 // When the stepper has finished it's move
 uint32_t Extruder::stepper_motor_finished_move(uint32_t dummy)
 {
@@ -587,6 +670,10 @@ uint32_t Extruder::stepper_motor_finished_move(uint32_t dummy)
         Block *block = this->current_block;
         this->current_block = NULL;
         block->release();
+
+    } else if (THEKERNEL->stepper->get_current_block() != NULL && THEKERNEL->stepper->get_current_block()->extruder == this->stepper_motor) {
+        // We are stepped along with the axes, let the Stepper release the block if they are done too
+        THEKERNEL->stepper->stepper_motor_finished_move(0);
     }
     return 0;
 
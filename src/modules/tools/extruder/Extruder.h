@@ -31,7 +31,6 @@ class Extruder : public Tool {
         void     on_play(void* argument);
         void     on_pause(void* argument);
         void     on_halt(void* argument);
-        void     on_speed_change(void* argument);
         uint32_t acceleration_tick(uint32_t dummy);
         uint32_t stepper_motor_finished_move(uint32_t dummy);
         Block*   append_empty_block();
@@ -65,6 +64,10 @@ class Extruder : public Tool {
         float          travel_ratio;
         float          travel_distance;
 
+        // pressure advance
+        float          pressure_advance;             // Setting, filament is pushed ahead by pressure_advance ( s ) * extrusion speed
+        float          advance_position;             // Filament currently pushed ahead of current_position, in mm
+
         // for firmware retract
         float          retract_feedrate;
         float          retract_recover_feedrate;
@@ -33,7 +33,7 @@ void ExtruderMaker::load_tools(){
         Extruder* extruder = new Extruder(0, true);
 
         // Add the module to the kernel
-        THEKERNEL->add_module( extruder );
+        THEKERNEL->add_module( extruder, "extruder" );
 
         // no toolmanager required so do not create one
         return;
@@ -65,7 +65,7 @@ void ExtruderMaker::load_tools(){
     if(cnt > 1) {
         // ONLY do this if multitool enabled and more than one tool is defined
         toolmanager= new ToolManager();
-        THEKERNEL->add_module( toolmanager );
+        THEKERNEL->add_module( toolmanager, "tool_manager" );
 
     }else{
         // only one extruder so no tool manager required
@@ -82,7 +82,7 @@ void ExtruderMaker::load_tools(){
             Extruder* extruder = new Extruder(cs);
 
             // Add the Extruder module to the kernel
-            THEKERNEL->add_module( extruder );
+            THEKERNEL->add_module( extruder, "extruder" );
 
             if(toolmanager != nullptr) {
                 // Add the extruder module to the ToolsManager if it was created
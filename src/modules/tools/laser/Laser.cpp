@@ -9,6 +9,7 @@
 #include "libs/Kernel.h"
 #include "modules/communication/utils/Gcode.h"
 #include "modules/robot/Stepper.h"
+#include "SlowTicker.h"
 #include "Laser.h"
 #include "libs/nuts_bolts.h"
 #include "Config.h"
@@ -18,6 +19,7 @@
 #include "ConfigValue.h"
 
 #include "libs/Pin.h"
+#include "libs/Pwm.h"
 #include "Gcode.h"
 #include "PwmOut.h" // mbed.h lib
 
@@ -51,6 +53,14 @@ void Laser::on_module_loaded() {
 
     laser_pin = NULL;
 
+    // PwmOut sets PWM1 up with the laser's period, which Pwm pins on PWM1 channels would not follow
+    if( dummy_pin->port_number == 2 && dummy_pin->pin <= 5 && !Pwm::claim_pwm1() ){
+        THEKERNEL->streams->printf("Error: Laser cannot use PWM1, other pins already do. Laser module disabled.\n");
+        delete dummy_pin;
+        delete this;
+        return;
+    }
+
     // Get mBed-style pin from smoothie-style pin
     if( dummy_pin->port_number == 2 ){
         if( dummy_pin->pin == 0 ){ this->laser_pin = new mbed::PwmOut(p26); }
@@ -82,11 +92,13 @@ void Laser::on_module_loaded() {
 
     //register for events
     this->register_for_event(ON_GCODE_EXECUTE);
-    this->register_for_event(ON_SPEED_CHANGE);
     this->register_for_event(ON_PLAY);
     this->register_for_event(ON_PAUSE);
     this->register_for_event(ON_BLOCK_BEGIN);
     this->register_for_event(ON_BLOCK_END);
+
+    // The power follows the speed changes, at the rate the stepper makes them
+    THEKERNEL->slow_ticker->attach( THEKERNEL->stepper->get_acceleration_ticks_per_second(), this, &Laser::acceleration_tick );
 }
 
 // Turn laser off laser at the end of a move
@@ -129,17 +141,18 @@ void Laser::on_gcode_execute(void* argument){
 
 }
 
-// We follow the stepper module here, so speed must be proportional
-void Laser::on_speed_change(void* argument){
-    if( this->laser_on ){
+// We follow the stepper module here, so speed must be proportional, the laser stays off once stopped for a feed hold
+uint32_t Laser::acceleration_tick(uint32_t dummy){
+    if( this->laser_on && !THEKERNEL->stepper->is_held() ){
         this->set_proportional_power();
     }
+    return 0;
 }
 
 void Laser::set_proportional_power(){
     if( this->laser_on && THEKERNEL->stepper->get_current_block() ){
         // adjust power to maximum power and actual velocity
-        float proportional_power = float(float(this->laser_max_power) * float(THEKERNEL->stepper->get_trapezoid_adjusted_rate()) / float(THEKERNEL->stepper->get_current_block()->nominal_rate));
+        float proportional_power = float(float(this->laser_max_power) * float(THEKERNEL->stepper->get_step_events_per_second()) / float(THEKERNEL->stepper->get_current_block()->nominal_rate));
         this->laser_pin->write(this->laser_inverting ? 1 - proportional_power : proportional_power);
     }
 }
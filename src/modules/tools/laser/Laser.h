@@ -24,7 +24,7 @@ class Laser : public Module{
         void on_play(void* argument);
         void on_pause(void* argument);
         void on_gcode_execute(void* argument);
-        void on_speed_change(void* argument);
+        uint32_t acceleration_tick(uint32_t dummy);
 
         static bool isActivated();
         static void enableDynamicActivation();         
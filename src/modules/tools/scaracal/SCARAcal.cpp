@@ -21,6 +21,8 @@
 #include "SerialMessage.h"
 #include "EndstopsPublicAccess.h"
 #include "PublicData.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 
 #define scaracal_checksum CHECKSUM("scaracal")
 #define enable_checksum CHECKSUM("enable")
@@ -45,7 +47,10 @@ void SCARAcal::on_module_loaded()
     // load settings
     this->on_config_reload(this);
     // register event-handlers
-    register_for_event(ON_GCODE_RECEIVED);
+    register_for_gcode('M', 114);
+    register_for_gcode('M', 360);
+    register_for_gcode('M', 361);
+    register_for_gcode('M', 364);
 }
 
 void SCARAcal::on_config_reload(void *argument)
@@ -55,6 +60,26 @@ void SCARAcal::on_config_reload(void *argument)
 }
 
 
+// The calibration moves home first then go to the target angles, the homing goes ahead of this task which yields to it
+class CalibrationMoveTask : public Task {
+    public:
+        CalibrationMoveTask(SCARAcal *scaracal, float theta, float psi) : scaracal(scaracal), theta(theta), psi(psi) {}
+        bool run();
+
+    private:
+        SCARAcal *scaracal;
+        float theta, psi;
+};
+
+bool CalibrationMoveTask::run()
+{
+    TASK_BEGIN();
+    scaracal->home();
+    TASK_YIELD();
+    scaracal->SCARA_ang_move(this->theta, this->psi, 100.0F, scaracal->slow_rate * 3.0F); // move to target
+    TASK_END();
+}
+
 // issue home command
 void SCARAcal::home()
 {
@@ -161,8 +186,7 @@ void SCARAcal::on_gcode_received(void *argument)
                     set_trim(S_delta[0], S_trim[1], 0, gcode->stream);
                 } else {
                     set_trim(0, S_trim[1], 0, gcode->stream);               // reset trim for calibration move
-                    this->home();                                                   // home
-                    SCARA_ang_move(target[0], target[1], 100.0F, slow_rate * 3.0F); // move to target
+                    THEKERNEL->gcode_dispatch->hold(new CalibrationMoveTask(this, target[0], target[1])); // home, then move to target
                 }
                 gcode->mark_as_taken();
             }
@@ -180,8 +204,7 @@ void SCARAcal::on_gcode_received(void *argument)
                     STEPPER[0]->change_steps_per_mm(actuators[0] / target[0] * STEPPER[0]->get_steps_per_mm()); // Find angle difference
                     STEPPER[1]->change_steps_per_mm(STEPPER[0]->get_steps_per_mm());  // and change steps_per_mm to ensure correct steps per *angle* 
                 } else {
-                    this->home();                                                   // home - This time leave trims as adjusted.
-                    SCARA_ang_move(target[0], target[1], 100.0F, slow_rate * 3.0F); // move to target
+                    THEKERNEL->gcode_dispatch->hold(new CalibrationMoveTask(this, target[0], target[1])); // home - This time leave trims as adjusted.
                 }
                 gcode->mark_as_taken();
             }
@@ -205,8 +228,7 @@ void SCARAcal::on_gcode_received(void *argument)
                     set_trim(S_trim[0], S_delta[1], 0, gcode->stream);     // set trim to reflect the difference
                 } else {
                     set_trim(S_trim[0], 0, 0, gcode->stream);               // reset trim for calibration move
-                    this->home();                                                   // home
-                    SCARA_ang_move(target[0], target[1], 100.0F, slow_rate * 3.0F); // move to target
+                    THEKERNEL->gcode_dispatch->hold(new CalibrationMoveTask(this, target[0], target[1])); // home, then move to target
                 }
                 gcode->mark_as_taken();
             }
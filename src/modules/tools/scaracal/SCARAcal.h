@@ -14,6 +14,7 @@
 class StepperMotor;
 class Gcode;
 class StreamOutput;
+class CalibrationMoveTask;
 
 class SCARAcal: public Module
 {
@@ -27,6 +28,8 @@ public:
 
 
 private:
+    friend class CalibrationMoveTask;
+
     void home();
     bool set_trim(float x, float y, float z, StreamOutput *stream);
     bool get_trim(float& x, float& y, float& z);
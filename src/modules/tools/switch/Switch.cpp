@@ -49,14 +49,16 @@ void Switch::on_module_loaded()
 {
     this->switch_changed = false;
 
-    this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_GCODE_EXECUTE);
     this->register_for_event(ON_MAIN_LOOP);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(switch_checksum, this->name_checksum);
 
     // Settings
     this->on_config_reload(this);
+
+    // only the gcodes set in the config are ours
+    if(this->input_on_command_letter != 0) this->register_for_gcode(this->input_on_command_letter, this->input_on_command_code);
+    if(this->input_off_command_letter != 0) this->register_for_gcode(this->input_off_command_letter, this->input_off_command_code);
 }
 
 
@@ -127,7 +129,7 @@ void Switch::on_config_reload(void *argument)
 
     if(this->output_type == PWM && this->output_pin.connected()) {
         // PWM
-        THEKERNEL->slow_ticker->attach(1000, &this->output_pin, &Pwm::on_tick);
+        this->output_pin.frequency(1000);
     }
 }
 
@@ -84,14 +84,19 @@ void TemperatureControl::on_module_loaded()
     this->load_config();
 
     // Register for events
-    this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_gcode('M', this->get_m_code);
+    this->register_for_public_data(temperature_control_checksum, this->name_checksum);
+    this->register_for_public_data(temperature_control_checksum, pool_index_checksum, this->pool_index);
 
     if(!this->readonly) {
+        this->register_for_gcode('M', this->set_m_code);
+        this->register_for_gcode('M', this->set_and_wait_m_code);
+        this->register_for_gcode('M', 301);
+        this->register_for_gcode('M', 500);
+        this->register_for_gcode('M', 503);
         this->register_for_event(ON_GCODE_EXECUTE);
         this->register_for_event(ON_SECOND_TICK);
         this->register_for_event(ON_MAIN_LOOP);
-        this->register_for_event(ON_SET_PUBLIC_DATA);
         this->register_for_event(ON_HALT);
     }
 }
@@ -164,7 +169,7 @@ void TemperatureControl::load_config()
         this->heater_pin.set(0);
         set_low_on_debug(heater_pin.port_number, heater_pin.pin);
         // activate SD-DAC timer
-        THEKERNEL->slow_ticker->attach( THEKERNEL->config->value(temperature_control_checksum, this->name_checksum, pwm_frequency_checksum)->by_default(2000)->as_number(), &heater_pin, &Pwm::on_tick);
+        this->heater_pin.frequency( THEKERNEL->config->value(temperature_control_checksum, this->name_checksum, pwm_frequency_checksum)->by_default(2000)->as_number() );
     }
 
 
@@ -310,6 +315,9 @@ void TemperatureControl::on_set_public_data(void *argument)
 
     if(!pdr->second_element_is(this->name_checksum)) return;
 
+    // readonly sensors have no temperature to set
+    if(this->readonly) return;
+
     // ok this is targeted at us, so set the temp
     float t = *static_cast<float *>(pdr->get_data_ptr());
     this->set_desired_temperature(t);
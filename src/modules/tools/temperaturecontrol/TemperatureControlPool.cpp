@@ -30,14 +30,14 @@ void TemperatureControlPool::load_tools(){
         if( THEKERNEL->config->value(temperature_control_checksum, cs, enable_checksum )->as_bool() ){
             TemperatureControl* controller = new TemperatureControl(cs, cnt++);
             //controllers.push_back( controller );
-            THEKERNEL->add_module(controller);
+            THEKERNEL->add_module(controller, "temperature_control");
         }
     }
 
     // no need to create one of these if no heaters defined
     if(cnt > 0) {
       PID_Autotuner* pidtuner = new PID_Autotuner();
-      THEKERNEL->add_module( pidtuner );
+      THEKERNEL->add_module( pidtuner, "pid_autotuner" );
     }
 }
 
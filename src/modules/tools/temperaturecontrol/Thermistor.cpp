@@ -12,7 +12,6 @@
 #include "checksumm.h"
 #include "Adc.h"
 #include "ConfigValue.h"
-#include "libs/Median.h"
 #include "Thermistor.h"
 
 // a const list of predefined thermistors
@@ -70,9 +69,8 @@ void Thermistor::UpdateConfig(uint16_t module_checksum, uint16_t name_checksum)
     this->r1 = THEKERNEL->config->value(module_checksum, name_checksum, r1_checksum  )->by_default(this->r1  )->as_number();
     this->r2 = THEKERNEL->config->value(module_checksum, name_checksum, r2_checksum  )->by_default(this->r2  )->as_number();
 
-    // Thermistor math
-    j = (1.0 / beta);
-    k = (1.0 / (t0 + 273.15));
+    // Thermistor math, worked out once for the readings to be looked up
+    this->table.build(this->beta, this->r0, this->t0, this->r1, this->r2);
 
     // Thermistor pin for ADC readings
     this->thermistor_pin.from_string(THEKERNEL->config->value(module_checksum, name_checksum, thermistor_pin_checksum )->required()->as_string());
@@ -86,25 +84,14 @@ float Thermistor::get_temperature()
 
 float Thermistor::adc_value_to_temperature(int adc_value)
 {
-    if ((adc_value == 4095) || (adc_value == 0))
+    if ((adc_value >= 4095) || (adc_value <= 0))
         return infinityf();
-    float r = r2 / ((4095.0 / adc_value) - 1.0);
-    if (r1 > 0)
-        r = (r1 * r) / (r1 - r);
-    return (1.0 / (k + (j * log(r / r0)))) - 273.15;
+
+    return this->table.temperature(adc_value);
 }
 
+// Already oversampled and decimated by the ADC
 int Thermistor::new_thermistor_reading()
 {
-    int last_raw = THEKERNEL->adc->read(&thermistor_pin);
-    if (queue.size() >= queue.capacity()) {
-        uint16_t l;
-        queue.pop_front(l);
-    }
-    uint16_t r = last_raw;
-    queue.push_back(r);
-    for (int i=0; i<queue.size(); i++)
-      median_buffer[i] = *queue.get_ref(i);
-    uint16_t m = median_buffer[quick_median(median_buffer, queue.size())];
-    return m;
+    return THEKERNEL->adc->read(&thermistor_pin);
 }
@@ -9,10 +9,8 @@
 #define thermistor_h
 
 #include "TempSensor.h"
-#include "RingBuffer.h"
-
-#define QUEUE_LEN 32
-
+#include "ThermistorTable.h"
+#include "Pin.h"
 
 class Thermistor : public TempSensor
 {
@@ -34,14 +32,10 @@ class Thermistor : public TempSensor
         int r1;
         int r2;
         float beta;
-        float j;
-        float k;
 
         Pin  thermistor_pin;
 
-        RingBuffer<uint16_t,QUEUE_LEN> queue;  // Queue of readings
-        uint16_t median_buffer[QUEUE_LEN];
-        
+        ThermistorTable table;
 };
 
 #endif
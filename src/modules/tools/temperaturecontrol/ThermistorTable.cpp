@@ -0,0 +1,40 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThermistorTable.h"
+#include <math.h>
+
+// Values are here : http://reprap.org/wiki/Thermistor
+void ThermistorTable::build(float beta, float r0, float t0, int r1, int r2)
+{
+    for (int i = 0; i < THERMISTOR_TABLE_SIZE; i++) {
+        float t = THERMISTOR_TABLE_COLDEST + (i * THERMISTOR_TABLE_STEP);
+
+        // The thermistor resistance at that temperature, r1 in parallel with it, and r2 the other half of the divider
+        float r = r0 * expf(beta * ((1.0F / (t + 273.15F)) - (1.0F / (t0 + 273.15F))));
+        if (r1 > 0)
+            r = (r1 * r) / (r1 + r);
+        this->adc[i] = 4095.0F * r / (r + r2);
+    }
+}
+
+// Readings past either end of the table carry on along its first or last interval
+float ThermistorTable::temperature(int adc_value) const
+{
+    int colder = 0;
+    int hotter = THERMISTOR_TABLE_SIZE - 1;
+    while (hotter - colder > 1) {
+        int i = (colder + hotter) / 2;
+        if (this->adc[i] > adc_value)
+            colder = i;
+        else
+            hotter = i;
+    }
+
+    float fraction = (this->adc[colder] - adc_value) / (this->adc[colder] - this->adc[hotter]);
+    return THERMISTOR_TABLE_COLDEST + ((colder + fraction) * THERMISTOR_TABLE_STEP);
+}
@@ -0,0 +1,30 @@
+/*
+      this file is part of smoothie (http://smoothieware.org/). the motion control part is heavily based on grbl (https://github.com/simen/grbl).
+      smoothie is free software: you can redistribute it and/or modify it under the terms of the gnu general public license as published by the free software foundation, either version 3 of the license, or (at your option) any later version.
+      smoothie is distributed in the hope that it will be useful, but without any warranty; without even the implied warranty of merchantability or fitness for a particular purpose. see the gnu general public license for more details.
+      you should have received a copy of the gnu general public license along with smoothie. if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef thermistortable_h
+#define thermistortable_h
+
+// The table holds the ADC value at temperatures THERMISTOR_TABLE_STEP degrees apart, from THERMISTOR_TABLE_COLDEST up to 400C
+#define THERMISTOR_TABLE_COLDEST -20
+#define THERMISTOR_TABLE_STEP    5
+#define THERMISTOR_TABLE_SIZE    85
+
+// Converts ADC readings of a thermistor given by the beta equation to temperatures. The logarithm the equation needs is
+// too slow for every reading, so build() runs it the other way once per entry, and readings are looked up and
+// interpolated. Spacing the entries by temperature rather than by ADC value keeps the error even over the whole range,
+// r1 squeezing the readings into a part of the ADC range included. See tests/thermistor_table_test.cpp
+class ThermistorTable
+{
+    public:
+        void build(float beta, float r0, float t0, int r1, int r2);
+        float temperature(int adc_value) const;
+
+    private:
+        float adc[THERMISTOR_TABLE_SIZE];   // Going down, the thermistor has less resistance as it gets hotter
+};
+
+#endif
@@ -13,6 +13,7 @@
 #include "ConfigValue.h"
 
 #include "max31855.h"
+#include "platform_memory.h"
 
 #include "MRI_Hooks.h"
 
@@ -20,13 +21,17 @@
 #define spi_channel_checksum CHECKSUM("spi_channel")
 
 Max31855::Max31855() :
-    spi(nullptr)
+    spi(nullptr), have_data(false)
 {
+    // written by the DMA, so in AHB RAM
+    this->data = (uint8_t *)AHB0.alloc(2);
 }
 
 Max31855::~Max31855()
 {
-    delete spi;
+    // the bus may still be writing to us
+    while (this->transaction.busy);
+    if (this->data != NULL) AHB0.dealloc(this->data);
 }
 
 // Get configuration from the config file
@@ -39,22 +44,15 @@ void Max31855::UpdateConfig(uint16_t module_checksum, uint16_t name_checksum)
     
     // select which SPI channel to use
     int spi_channel = THEKERNEL->config->value(module_checksum, name_checksum, spi_channel_checksum)->by_default(0)->as_number();
-    PinName miso;
-    PinName mosi;
-    PinName sclk;
-    if(spi_channel == 0) {
-        // Channel 0
-        mosi=P0_18; miso=P0_17; sclk=P0_15;
-    } else {
-        // Channel 1
-        mosi=P0_9; miso=P0_8; sclk=P0_7;
-    } 
-
-    delete spi;
-    spi = new mbed::SPI(mosi, miso, sclk);
-
-    // Spi settings: 1MHz (default), 16 bits, mode 0 (default)
-    spi->format(16);
+    while (this->transaction.busy);
+    spi = SpiBus::get(spi_channel == 0 ? 0 : 1);
+
+    // Spi settings: 1MHz, 16 bits read as two bytes, mode 0
+    this->transaction.rx = this->data;
+    this->transaction.length = 2;
+    this->transaction.frequency = 1000000;
+    this->transaction.cs = &this->spi_cs_pin;
+    this->have_data = false;
 }
 
 float Max31855::get_temperature()
@@ -81,18 +79,22 @@ float Max31855::get_temperature()
 	return sum / readings.size();
 }
 
+// Returns the reading the previous call started, and starts the next one, so the bus works while the slow ticker
+// goes on instead of being waited for
 float Max31855::read_temp()
 {
-    this->spi_cs_pin.set(false);
-    wait_us(1); // Must wait for first bit valid
+    // Still on the bus, skipped like an error
+    if (this->transaction.busy || this->data == NULL) return infinityf();
 
-    // Read 16 bits (writing something as well is required by the api)
-    uint16_t data = spi->write(0);
-	//  Read next 16 bits (diagnostics)
-//	uint16_t data2 = spi->write(0);
+    bool have_data = this->have_data;
+    uint16_t data = (this->data[0] << 8) | this->data[1];
+    bool failed = this->transaction.failed;
+
+    this->spi->queue(&this->transaction);
+    this->have_data = true;
+
+    if (!have_data || failed) return infinityf();
 
-    this->spi_cs_pin.set(true);
-    
     float temperature;
 
     //Process temp
@@ -11,8 +11,8 @@
 #include "TempSensor.h"
 #include <string>
 #include <libs/Pin.h>
-#include <mbed.h>
 #include "RingBuffer.h"
+#include "libs/SpiBus.h"
 
 class Max31855 : public TempSensor
 {
@@ -25,7 +25,10 @@ public:
 private:
 	float read_temp();
     Pin spi_cs_pin;
-    mbed::SPI *spi;
+    SpiBus *spi;
+    SpiTransaction transaction;
+    uint8_t *data;
+    bool have_data;
     RingBuffer<float,16> readings;
 };
 
@@ -21,6 +21,8 @@ using namespace std;
 #include "checksumm.h"
 #include "PublicData.h"
 #include "Gcode.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 #include <cstdio>
 
 #include "libs/SerialMessage.h"
@@ -31,6 +33,22 @@ using namespace std;
 
 #define return_error_on_unhandled_gcode_checksum    CHECKSUM("return_error_on_unhandled_gcode")
 
+// We must wait for an empty queue before we can disable the current extruder, the dispatch holds on this meanwhile
+class ToolChangeTask : public Task {
+    public:
+        ToolChangeTask(ToolManager *tool_manager, int new_tool) : tool_manager(tool_manager), new_tool(new_tool) {}
+        bool run() {
+            TASK_BEGIN();
+            TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+            tool_manager->change_tool(this->new_tool);
+            TASK_END();
+        }
+
+    private:
+        ToolManager *tool_manager;
+        int new_tool;
+};
+
 ToolManager::ToolManager(){
     active_tool = 0;
     current_tool_name = CHECKSUM("hotend");
@@ -40,8 +58,7 @@ void ToolManager::on_module_loaded(){
     this->on_config_reload(this);
 
     this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
+    this->register_for_public_data(tool_manager_checksum);
 }
 
 void ToolManager::on_config_reload(void *argument){
@@ -63,21 +80,23 @@ void ToolManager::on_gcode_received(void *argument){
             }
         } else {
             if(new_tool != this->active_tool){
-                // We must wait for an empty queue before we can disable the current extruder
-                THEKERNEL->conveyor->wait_for_empty_queue();
-                this->tools[active_tool]->disable();
-                this->active_tool = new_tool;
-                this->current_tool_name = this->tools[active_tool]->get_name();
-                this->tools[active_tool]->enable();
-
-                //send new_tool_offsets to robot
-                const float *new_tool_offset = tools[new_tool]->get_offset();
-                THEKERNEL->robot->setToolOffset(new_tool_offset);
+                THEKERNEL->gcode_dispatch->hold(new ToolChangeTask(this, new_tool));
             }
         }
     }
 }
 
+void ToolManager::change_tool(int new_tool){
+    this->tools[active_tool]->disable();
+    this->active_tool = new_tool;
+    this->current_tool_name = this->tools[active_tool]->get_name();
+    this->tools[active_tool]->enable();
+
+    //send new_tool_offsets to robot
+    const float *new_tool_offset = tools[new_tool]->get_offset();
+    THEKERNEL->robot->setToolOffset(new_tool_offset);
+}
+
 void ToolManager::on_get_public_data(void* argument){
     PublicDataRequest* pdr = static_cast<PublicDataRequest*>(argument);
 
@@ -12,6 +12,7 @@ using namespace std;
 #include <vector>
 
 class Tool;
+class ToolChangeTask;
 
 class ToolManager : public Module
 {
@@ -26,6 +27,10 @@ public:
     void add_tool(Tool *tool_to_add);
 
 private:
+    friend class ToolChangeTask;
+
+    void change_tool(int new_tool);
+
     vector<Tool *> tools;
 
     int active_tool;
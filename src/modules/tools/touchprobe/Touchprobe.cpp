@@ -8,6 +8,9 @@
 #include "Touchprobe.h"
 
 #include "BaseSolution.h"
+#include "Conveyor.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 
 #define touchprobe_enable_checksum           CHECKSUM("touchprobe_enable")
 #define touchprobe_log_enable_checksum       CHECKSUM("touchprobe_log_enable")
@@ -57,39 +60,101 @@ void Touchprobe::on_config_reload(void* argument){
     }
 }
 
-void Touchprobe::wait_for_touch(int distance[]){
-    unsigned int debounce = 0;
-    while(true){
-        THEKERNEL->call_event(ON_IDLE);
-        // if no stepper is moving, moves are finished and there was no touch
-        if( ((this->steppers[0]->moving ? 0:1 ) + (this->steppers[1]->moving ? 0:1 ) + (this->steppers[2]->moving ? 0:1 )) == 3 ){
-            return;
+// G31 runs as a task the dispatch holds on, the probe is then watched from the main loop instead of spinning on ON_IDLE
+class TouchTask : public Task {
+    public:
+        TouchTask(Touchprobe *touchprobe, const float pos[], const float mm[], const int steps[]);
+        bool run();
+
+    private:
+        Touchprobe *touchprobe;
+        float pos[3], mm[3];
+        int steps[3];
+};
+
+TouchTask::TouchTask(Touchprobe *touchprobe, const float pos[], const float mm[], const int steps[]){
+    this->touchprobe = touchprobe;
+    for( int i=0; i<3; i++ ){
+        this->pos[i] = pos[i];
+        this->mm[i] = mm[i];
+        this->steps[i] = steps[i];
+    }
+}
+
+bool TouchTask::run(){
+    TASK_BEGIN();
+
+    // first wait for an empty queue i.e. no moves left
+    TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+
+    touchprobe->start_touch(this->steps);
+    TASK_WAIT_UNTIL(touchprobe->touch_ended());
+
+    // calculate new position
+    for( int i=0; i<3; i++ ){
+        THEKERNEL->robot->reset_axis_position(this->pos[i] + this->mm[i], i);
+    }
+
+    if( touchprobe->should_log ){
+        touchprobe->log_position();
+    }
+
+    TASK_END();
+}
+
+void Touchprobe::start_touch(const int steps[]){
+    Robot* robot = THEKERNEL->robot;
+
+    // Enable the motors
+    THEKERNEL->stepper->turn_enable_pins_on();
+    // move
+    for(char c='X'; c<='Z'; c++){
+        if( steps[c-'X'] == 0 ){
+            continue;
         }
-        // if the touchprobe is active...
-        if( this->pin.get() ){
-            //...increase debounce counter...
-            if( debounce < debounce_count) {
-                // ...but only if the counter hasn't reached the max. value
-                debounce++;
-            } else {
-                // ...otherwise stop the steppers, return its remaining steps
-                for( int i=0; i<3; i++ ){
-                    distance[i] = 0;
-                    if ( this->steppers[i]->moving ){
-                        distance[i] =  this->steppers[i]->stepped;
-                        distance[i] *= this->steppers[i]->direction ? -1 : 1;
-                        this->steppers[i]->move(0,0);
-                    }
+        bool dir = steps[c-'X'] < 0;
+        // probe_rate in mm/s -> speed needs steps/s
+        this->steppers[c-'X']->set_speed(this->probe_rate * robot->actuators[c - 'X']->steps_per_mm);
+        this->steppers[c-'X']->move(dir,abs(steps[c-'X']));
+    }
+    this->debounce = 0;
+}
+
+// One look at the probe, the steppers are stopped once it is triggered, true when the probing is over
+bool Touchprobe::touch_ended(){
+    // if no stepper is moving, moves are finished and there was no touch
+    if( ((this->steppers[0]->moving ? 0:1 ) + (this->steppers[1]->moving ? 0:1 ) + (this->steppers[2]->moving ? 0:1 )) == 3 ){
+        return true;
+    }
+    // if the touchprobe is active...
+    if( this->pin.get() ){
+        //...increase debounce counter...
+        if( this->debounce < debounce_count) {
+            // ...but only if the counter hasn't reached the max. value
+            this->debounce++;
+        } else {
+            // ...otherwise stop the steppers
+            for( int i=0; i<3; i++ ){
+                if ( this->steppers[i]->moving ){
+                    this->steppers[i]->move(0,0);
                 }
-                return;
             }
-        }else{
-            // The probe was not hit yet, reset debounce counter
-            debounce = 0;
+            return true;
         }
+    }else{
+        // The probe was not hit yet, reset debounce counter
+        this->debounce = 0;
     }
+    return false;
 }
 
+void Touchprobe::log_position(){
+    Robot* robot = THEKERNEL->robot;
+    float pos[3];
+    robot->get_axis_position(pos);
+    fprintf(logfile,"%1.3f %1.3f %1.3f\n", robot->from_millimeters(pos[0]), robot->from_millimeters(pos[1]), robot->from_millimeters(pos[2]) );
+    flush_log();
+}
 
 void Touchprobe::flush_log(){
     //FIXME *sigh* fflush doesn't work as expected, see: http://mbed.org/forum/mbed/topic/3234/ or http://mbed.org/search/?type=&q=fflush
@@ -115,8 +180,6 @@ void Touchprobe::on_gcode_received(void* argument)
         if( gcode->g == 31 ) {
             float tmp[3], pos[3], mm[3];
             int steps[3];
-            // first wait for an empty queue i.e. no moves left
-            THEKERNEL->conveyor->wait_for_empty_queue();
 
             robot->get_axis_position(pos);
             for(char c = 'X'; c <= 'Z'; c++){
@@ -137,31 +200,8 @@ void Touchprobe::on_gcode_received(void* argument)
                 return; //TODO coordinated movement not supported yet
             }
 
-            // Enable the motors
-            THEKERNEL->stepper->turn_enable_pins_on();
-            // move
-            for(char c='X'; c<='Z'; c++){
-                tmp[c - 'X'] = robot->actuators[c - 'X']->steps_per_mm;
-                if( steps[c-'X'] == 0 ){
-                    continue;
-                }
-                bool dir = steps[c-'X'] < 0;
-                // tmp is steps/mm, probe_rate in mm/s -> speed needs steps/s
-                this->steppers[c-'X']->set_speed(this->probe_rate * robot->actuators[c]->steps_per_mm);
-                this->steppers[c-'X']->move(dir,abs(steps[c-'X']));
-            }
-
-            wait_for_touch(steps);
-            // calculate new position
-            for(char c='X'; c<='Z'; c++){
-                robot->reset_axis_position(pos[c-'X'] + mm[c-'X'], c-'X');
-            }
-
-            if( this->should_log ){
-                robot->get_axis_position(pos);
-                fprintf(logfile,"%1.3f %1.3f %1.3f\n", robot->from_millimeters(pos[0]), robot->from_millimeters(pos[1]), robot->from_millimeters(pos[2]) );
-                flush_log();
-            }
+            // the ok, and what comes after, wait for the probing to be done
+            THEKERNEL->gcode_dispatch->hold(new TouchTask(this, pos, mm, steps));
         }
     }else if(gcode->has_m) {
         // log rotation
@@ -10,9 +10,15 @@
 
 #include "libs/Module.h"
 
+class TouchTask;
+
 class Touchprobe: public Module {
     private:
-        void wait_for_touch(int distance[]);
+        friend class TouchTask;
+
+        void start_touch(const int steps[]);
+        bool touch_ended();
+        void log_position();
         void flush_log();
 
         FILE*          logfile;
@@ -20,6 +26,7 @@ class Touchprobe: public Module {
         StepperMotor*  steppers[3];
         Pin            pin;
         unsigned int   debounce_count;
+        unsigned int   debounce;
 
     public:
         void on_module_loaded();
@@ -12,9 +12,12 @@
 #include "Conveyor.h"
 #include "ZProbe.h"
 #include "BaseSolution.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 
 #include <tuple>
 #include <algorithm>
+#include <cmath>
 
 #define radius_checksum       CHECKSUM("radius")
 // deprecated
@@ -32,27 +35,43 @@ bool DeltaCalibrationStrategy::handleConfig()
     return true;
 }
 
+// G32 runs as a task the dispatch holds on, the homings, the moves and the probings are waited for from the main loop
+class DeltaCalibrationTask : public Task {
+    public:
+        DeltaCalibrationTask(DeltaCalibrationStrategy *strategy, Gcode *gcode);
+        bool run();
+        void forget_stream(StreamOutput *stream) { if(this->stream == stream) this->stream = &(StreamOutput::NullStream); }
+
+    private:
+        void failed() { this->stream->printf("Calibration failed to complete, probe not triggered\n"); }
+
+        DeltaCalibrationStrategy *strategy;
+        ZProbe *zprobe;
+        StreamOutput *stream;
+        ProbeAt probe;
+        struct {
+            bool endstops:1;
+            bool radius:1;
+            bool keep:1;
+        };
+        float target;
+        float towers[3][2];
+        float trim[3];
+        float tz[3];
+        int steps[3];
+        float bedht;
+        float delta_radius;
+        float cmm;
+        int i, j;
+};
+
 bool DeltaCalibrationStrategy::handleGcode(Gcode *gcode)
 {
     if( gcode->has_g) {
         // G code processing
         if( gcode->g == 32 ) { // auto calibration for delta, Z bed mapping for cartesian
-            // first wait for an empty queue i.e. no moves left
-            THEKERNEL->conveyor->wait_for_empty_queue();
-
-            if(!gcode->has_letter('R')) {
-                if(!calibrate_delta_endstops(gcode)) {
-                    gcode->stream->printf("Calibration failed to complete, probe not triggered\n");
-                    return true;
-                }
-            }
-            if(!gcode->has_letter('E')) {
-                if(!calibrate_delta_radius(gcode)) {
-                    gcode->stream->printf("Calibration failed to complete, probe not triggered\n");
-                    return true;
-                }
-            }
-            gcode->stream->printf("Calibration complete, save settings with M500\n");
+            // the ok, and what comes after, wait for the calibration to be done
+            THEKERNEL->gcode_dispatch->hold(new DeltaCalibrationTask(this, gcode));
             return true;
         }
 
@@ -76,6 +95,23 @@ static std::tuple<float, float, float, float, float, float> getCoordinates(float
     return std::make_tuple(t1x, t1y, t2x, t2y, t3x, t3y);
 }
 
+DeltaCalibrationTask::DeltaCalibrationTask(DeltaCalibrationStrategy *strategy, Gcode *gcode) : probe(strategy->zprobe)
+{
+    this->strategy = strategy;
+    this->zprobe = strategy->zprobe;
+    this->stream = gcode->stream;
+    this->endstops = !gcode->has_letter('R');
+    this->radius = !gcode->has_letter('E');
+    this->keep = gcode->has_letter('K'); // keep current settings
+
+    this->target = 0.03F;
+    if(gcode->has_letter('I')) this->target = gcode->get_value('I'); // override default target
+    if(gcode->has_letter('J')) strategy->probe_radius = gcode->get_value('J'); // override default probe radius
+
+    // get probe points
+    std::tie(towers[0][0], towers[0][1], towers[1][0], towers[1][1], towers[2][0], towers[2][1]) = getCoordinates(strategy->probe_radius);
+}
+
 /* Run a calibration routine for a delta
     1. Home
     2. probe for z bed
@@ -84,206 +120,162 @@ static std::tuple<float, float, float, float, float, float> getCoordinates(float
     5. home, probe three towers again
     6. calculate trim offset and apply to all trims
     7. repeat 5, 6 until it converges on a solution
-*/
 
-bool DeltaCalibrationStrategy::calibrate_delta_endstops(Gcode *gcode)
-{
-    float target = 0.03F;
-    if(gcode->has_letter('I')) target = gcode->get_value('I'); // override default target
-    if(gcode->has_letter('J')) this->probe_radius = gcode->get_value('J'); // override default probe radius
-
-    bool keep = false;
-    if(gcode->has_letter('K')) keep = true; // keep current settings
+   then probe edges to get outer positions, then probe center,
+   modify the delta radius until center and X converge
 
-    gcode->stream->printf("Calibrating Endstops: target %fmm, radius %fmm\n", target, this->probe_radius);
+   The homings go ahead of this task, which yields to them
+*/
+bool DeltaCalibrationTask::run()
+{
+    float trimscale = 1.2522F; // empirically determined
+    TASK_BEGIN();
 
-    // get probe points
-    float t1x, t1y, t2x, t2y, t3x, t3y;
-    std::tie(t1x, t1y, t2x, t2y, t3x, t3y) = getCoordinates(this->probe_radius);
+    // first wait for an empty queue i.e. no moves left
+    TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
 
-    float trimx = 0.0F, trimy = 0.0F, trimz = 0.0F;
-    if(!keep) {
-        // zero trim values
-        if(!set_trim(0, 0, 0, gcode->stream)) return false;
+    if(this->endstops) {
+        stream->printf("Calibrating Endstops: target %fmm, radius %fmm\n", target, strategy->probe_radius);
 
-    } else {
-        // get current trim, and continue from that
-        if (get_trim(trimx, trimy, trimz)) {
-            gcode->stream->printf("Current Trim X: %f, Y: %f, Z: %f\r\n", trimx, trimy, trimz);
+        trim[0] = trim[1] = trim[2] = 0.0F;
+        if(!keep) {
+            // zero trim values
+            if(!strategy->set_trim(0, 0, 0, stream)) { failed(); TASK_EXIT(); }
 
         } else {
-            gcode->stream->printf("Could not get current trim, are endstops enabled?\n");
-            return false;
+            // get current trim, and continue from that
+            if (strategy->get_trim(trim[0], trim[1], trim[2])) {
+                stream->printf("Current Trim X: %f, Y: %f, Z: %f\r\n", trim[0], trim[1], trim[2]);
+
+            } else {
+                stream->printf("Could not get current trim, are endstops enabled?\n");
+                failed();
+                TASK_EXIT();
+            }
         }
-    }
-
-    // home
-    zprobe->home();
 
-    // find bed, run at fast rate
-    int s;
-    if(!zprobe->run_probe(s, true)) return false;
-
-    float bedht = zprobe->zsteps_to_mm(s) - zprobe->getProbeHeight(); // distance to move from home to 5mm above bed
-    gcode->stream->printf("Bed ht is %f mm\n", bedht);
-
-    // move to start position
-    zprobe->home();
-    zprobe->coordinated_move(NAN, NAN, -bedht, zprobe->getFastFeedrate(), true); // do a relative move from home to the point above the bed
-
-    // get initial probes
-    // probe the base of the X tower
-    if(!zprobe->doProbeAt(s, t1x, t1y)) return false;
-    float t1z = zprobe->zsteps_to_mm(s);
-    gcode->stream->printf("T1-0 Z:%1.4f C:%d\n", t1z, s);
-
-    // probe the base of the Y tower
-    if(!zprobe->doProbeAt(s, t2x, t2y)) return false;
-    float t2z = zprobe->zsteps_to_mm(s);
-    gcode->stream->printf("T2-0 Z:%1.4f C:%d\n", t2z, s);
+        // home
+        zprobe->home();
+        TASK_YIELD();
+
+        // find bed, run at fast rate
+        probe.start(NAN, NAN, true, false);
+        TASK_WAIT_UNTIL(probe.run());
+        if(!probe.touched) { failed(); TASK_EXIT(); }
+
+        bedht = zprobe->zsteps_to_mm(probe.steps) - zprobe->getProbeHeight(); // distance to move from home to 5mm above bed
+        stream->printf("Bed ht is %f mm\n", bedht);
+
+        // the initial probes, then up to 10 more with the trims set from the last ones
+        for (i = 0; i <= 10; ++i) {
+            // set trim
+            if(i > 0 && !strategy->set_trim(trim[0], trim[1], trim[2], stream)) { failed(); TASK_EXIT(); }
+
+            // home and move probe to start position just above the bed
+            zprobe->home();
+            TASK_YIELD();
+            zprobe->coordinated_move(NAN, NAN, -bedht, zprobe->getFastFeedrate(), true); // do a relative move from home to the point above the bed
+
+            // probe the base of the X, Y and Z towers
+            for (j = 0; j < 3; ++j) {
+                probe.start(towers[j][0], towers[j][1]);
+                TASK_WAIT_UNTIL(probe.run());
+                if(!probe.touched) { failed(); TASK_EXIT(); }
+                tz[j] = zprobe->zsteps_to_mm(probe.steps);
+                stream->printf("T%d-%d Z:%1.4f C:%d\n", j + 1, i, tz[j], probe.steps);
+            }
 
-    // probe the base of the Z tower
-    if(!zprobe->doProbeAt(s, t3x, t3y)) return false;
-    float t3z = zprobe->zsteps_to_mm(s);
-    gcode->stream->printf("T3-0 Z:%1.4f C:%d\n", t3z, s);
+            auto mm = std::minmax({tz[0], tz[1], tz[2]});
+            if((mm.second - mm.first) <= target) {
+                stream->printf("trim %sset to within required parameters: delta %f\n", i == 0 ? "already " : "", mm.second - mm.first);
+                break;
+            }
 
-    float trimscale = 1.2522F; // empirically determined
+            // set trims to worst case so we always have a negative trim, then from the min difference
+            for (int k = 0; k < 3; ++k) trim[k] += (mm.first - tz[k]) * trimscale;
 
-    auto mm = std::minmax({t1z, t2z, t3z});
-    if((mm.second - mm.first) <= target) {
-        gcode->stream->printf("trim already set within required parameters: delta %f\n", mm.second - mm.first);
-        return true;
+            if(i == 10) {
+                stream->printf("WARNING: trim did not resolve to within required parameters: delta %f\n", mm.second - mm.first);
+            }
+        }
     }
 
-    // set trims to worst case so we always have a negative trim
-    trimx += (mm.first - t1z) * trimscale;
-    trimy += (mm.first - t2z) * trimscale;
-    trimz += (mm.first - t3z) * trimscale;
+    if(this->radius) {
+        stream->printf("Calibrating delta radius: target %f, radius %f\n", target, strategy->probe_radius);
+
+        zprobe->home();
+        TASK_YIELD();
 
-    for (int i = 1; i <= 10; ++i) {
-        // set trim
-        if(!set_trim(trimx, trimy, trimz, gcode->stream)) return false;
+        // find bed, then move to a point 5mm above it
+        probe.start(NAN, NAN, true, false);
+        TASK_WAIT_UNTIL(probe.run());
+        if(!probe.touched) { failed(); TASK_EXIT(); }
+        bedht = zprobe->zsteps_to_mm(probe.steps) - zprobe->getProbeHeight(); // distance to move from home to 5mm above bed
+        stream->printf("Bed ht is %f mm\n", bedht);
 
-        // home and move probe to start position just above the bed
         zprobe->home();
+        TASK_YIELD();
         zprobe->coordinated_move(NAN, NAN, -bedht, zprobe->getFastFeedrate(), true); // do a relative move from home to the point above the bed
 
-        // probe the base of the X tower
-        if(!zprobe->doProbeAt(s, t1x, t1y)) return false;
-        t1z = zprobe->zsteps_to_mm(s);
-        gcode->stream->printf("T1-%d Z:%1.4f C:%d\n", i, t1z, s);
-
-        // probe the base of the Y tower
-        if(!zprobe->doProbeAt(s, t2x, t2y)) return false;
-        t2z = zprobe->zsteps_to_mm(s);
-        gcode->stream->printf("T2-%d Z:%1.4f C:%d\n", i, t2z, s);
-
-        // probe the base of the Z tower
-        if(!zprobe->doProbeAt(s, t3x, t3y)) return false;
-        t3z = zprobe->zsteps_to_mm(s);
-        gcode->stream->printf("T3-%d Z:%1.4f C:%d\n", i, t3z, s);
-
-        mm = std::minmax({t1z, t2z, t3z});
-        if((mm.second - mm.first) <= target) {
-            gcode->stream->printf("trim set to within required parameters: delta %f\n", mm.second - mm.first);
-            break;
+        // probe center to get reference point at this Z height
+        probe.start(0, 0);
+        TASK_WAIT_UNTIL(probe.run());
+        if(!probe.touched) { failed(); TASK_EXIT(); }
+        cmm = zprobe->zsteps_to_mm(probe.steps);
+        stream->printf("CT Z:%1.3f C:%d\n", cmm, probe.steps);
+
+        // get current delta radius
+        delta_radius = 0.0F;
+        {
+            BaseSolution::arm_options_t options;
+            if(THEKERNEL->robot->arm_solution->get_optional(options)) {
+                delta_radius = options['R'];
+            }
+        }
+        if(delta_radius == 0.0F) {
+            stream->printf("This appears to not be a delta arm solution\n");
+            failed();
+            TASK_EXIT();
         }
 
-        // set new trim values based on min difference
-        trimx += (mm.first - t1z) * trimscale;
-        trimy += (mm.first - t2z) * trimscale;
-        trimz += (mm.first - t3z) * trimscale;
-
-        // flush the output
-        THEKERNEL->call_event(ON_IDLE);
-    }
-
-    if((mm.second - mm.first) > target) {
-        gcode->stream->printf("WARNING: trim did not resolve to within required parameters: delta %f\n", mm.second - mm.first);
-    }
+        for (i = 1; i <= 10; ++i) {
+            // probe t1, t2, t3 and get average, but use coordinated moves, probing center won't change
+            for (j = 0; j < 3; ++j) {
+                probe.start(towers[j][0], towers[j][1]);
+                TASK_WAIT_UNTIL(probe.run());
+                if(!probe.touched) { failed(); TASK_EXIT(); }
+                steps[j] = probe.steps;
+                stream->printf("T%d-%d Z:%1.3f C:%d\n", j + 1, i, zprobe->zsteps_to_mm(probe.steps), probe.steps);
+            }
 
-    return true;
-}
+            {
+                // now look at the difference and reduce it by adjusting delta radius
+                float m = zprobe->zsteps_to_mm((steps[0] + steps[1] + steps[2]) / 3.0F);
+                float d = cmm - m;
+                stream->printf("C-%d Z-ave:%1.4f delta: %1.3f\n", i, m, d);
 
-/*
-    probe edges to get outer positions, then probe center
-    modify the delta radius until center and X converge
-*/
+                if(abs(d) <= target) break; // resolution of success
 
-bool DeltaCalibrationStrategy::calibrate_delta_radius(Gcode *gcode)
-{
-    float target = 0.03F;
-    if(gcode->has_letter('I')) target = gcode->get_value('I'); // override default target
-    if(gcode->has_letter('J')) this->probe_radius = gcode->get_value('J'); // override default probe radius
+                // increase delta radius to adjust for low center
+                // decrease delta radius to adjust for high center
+                float drinc = 2.5F; // approx
+                delta_radius += (d * drinc);
 
-    gcode->stream->printf("Calibrating delta radius: target %f, radius %f\n", target, this->probe_radius);
+                // set the new delta radius
+                BaseSolution::arm_options_t options;
+                options['R'] = delta_radius;
+                THEKERNEL->robot->arm_solution->set_optional(options);
+                stream->printf("Setting delta radius to: %1.4f\n", delta_radius);
+            }
 
-    // get probe points
-    float t1x, t1y, t2x, t2y, t3x, t3y;
-    std::tie(t1x, t1y, t2x, t2y, t3x, t3y) = getCoordinates(this->probe_radius);
-
-    zprobe->home();
-    // find bed, then move to a point 5mm above it
-    int s;
-    if(!zprobe->run_probe(s, true)) return false;
-    float bedht = zprobe->zsteps_to_mm(s) - zprobe->getProbeHeight(); // distance to move from home to 5mm above bed
-    gcode->stream->printf("Bed ht is %f mm\n", bedht);
-
-    zprobe->home();
-    zprobe->coordinated_move(NAN, NAN, -bedht, zprobe->getFastFeedrate(), true); // do a relative move from home to the point above the bed
-
-    // probe center to get reference point at this Z height
-    int dc;
-    if(!zprobe->doProbeAt(dc, 0, 0)) return false;
-    gcode->stream->printf("CT Z:%1.3f C:%d\n", zprobe->zsteps_to_mm(dc), dc);
-    float cmm = zprobe->zsteps_to_mm(dc);
-
-    // get current delta radius
-    float delta_radius = 0.0F;
-    BaseSolution::arm_options_t options;
-    if(THEKERNEL->robot->arm_solution->get_optional(options)) {
-        delta_radius = options['R'];
-    }
-    if(delta_radius == 0.0F) {
-        gcode->stream->printf("This appears to not be a delta arm solution\n");
-        return false;
+            zprobe->home();
+            TASK_YIELD();
+            zprobe->coordinated_move(NAN, NAN, -bedht, zprobe->getFastFeedrate(), true); // needs to be a relative coordinated move
+        }
     }
-    options.clear();
-
-    float drinc = 2.5F; // approx
-    for (int i = 1; i <= 10; ++i) {
-        // probe t1, t2, t3 and get average, but use coordinated moves, probing center won't change
-        int dx, dy, dz;
-        if(!zprobe->doProbeAt(dx, t1x, t1y)) return false;
-        gcode->stream->printf("T1-%d Z:%1.3f C:%d\n", i, zprobe->zsteps_to_mm(dx), dx);
-        if(!zprobe->doProbeAt(dy, t2x, t2y)) return false;
-        gcode->stream->printf("T2-%d Z:%1.3f C:%d\n", i, zprobe->zsteps_to_mm(dy), dy);
-        if(!zprobe->doProbeAt(dz, t3x, t3y)) return false;
-        gcode->stream->printf("T3-%d Z:%1.3f C:%d\n", i, zprobe->zsteps_to_mm(dz), dz);
-
-        // now look at the difference and reduce it by adjusting delta radius
-        float m = zprobe->zsteps_to_mm((dx + dy + dz) / 3.0F);
-        float d = cmm - m;
-        gcode->stream->printf("C-%d Z-ave:%1.4f delta: %1.3f\n", i, m, d);
-
-        if(abs(d) <= target) break; // resolution of success
-
-        // increase delta radius to adjust for low center
-        // decrease delta radius to adjust for high center
-        delta_radius += (d * drinc);
-
-        // set the new delta radius
-        options['R'] = delta_radius;
-        THEKERNEL->robot->arm_solution->set_optional(options);
-        gcode->stream->printf("Setting delta radius to: %1.4f\n", delta_radius);
-
-        zprobe->home();
-        zprobe->coordinated_move(NAN, NAN, -bedht, zprobe->getFastFeedrate(), true); // needs to be a relative coordinated move
 
-        // flush the output
-        THEKERNEL->call_event(ON_IDLE);
-    }
-    return true;
+    stream->printf("Calibration complete, save settings with M500\n");
+    TASK_END();
 }
 
 bool DeltaCalibrationStrategy::set_trim(float x, float y, float z, StreamOutput *stream)
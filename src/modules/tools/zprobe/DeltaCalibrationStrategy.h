@@ -6,6 +6,7 @@
 #define delta_calibration_strategy_checksum CHECKSUM("delta-calibration")
 
 class StreamOutput;
+class DeltaCalibrationTask;
 
 class DeltaCalibrationStrategy : public LevelingStrategy
 {
@@ -16,10 +17,10 @@ public:
     bool handleConfig();
 
 private:
+    friend class DeltaCalibrationTask;
+
     bool set_trim(float x, float y, float z, StreamOutput *stream);
     bool get_trim(float& x, float& y, float& z);
-    bool calibrate_delta_endstops(Gcode *gcode);
-    bool calibrate_delta_radius(Gcode *gcode);
 
     float probe_radius;
 };
@@ -64,6 +64,8 @@
 #include "ZProbe.h"
 #include "Plane3D.h"
 #include "nuts_bolts.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 
 #include <string>
 #include <algorithm>
@@ -78,6 +80,21 @@
 #define tolerance_checksum           CHECKSUM("tolerance")
 #define save_plane_checksum          CHECKSUM("save_plane")
 
+// G32 runs as a task the dispatch holds on, the moves and the probings are waited for from the main loop
+class ThreePointProbeTask : public Task {
+    public:
+        ThreePointProbeTask(ThreePointStrategy *strategy, ZProbe *zprobe, StreamOutput *stream) : strategy(strategy), stream(stream), probe(zprobe) {}
+        bool run();
+        void forget_stream(StreamOutput *stream) { if(this->stream == stream) this->stream = &(StreamOutput::NullStream); }
+
+    private:
+        ThreePointStrategy *strategy;
+        StreamOutput *stream;
+        ProbeAt probe;
+        Vector3 v[3];
+        int i;
+};
+
 ThreePointStrategy::ThreePointStrategy(ZProbe *zprobe) : LevelingStrategy(zprobe)
 {
     for (int i = 0; i < 3; ++i) {
@@ -125,13 +142,8 @@ bool ThreePointStrategy::handleGcode(Gcode *gcode)
             return true;
 
         } else if( gcode->g == 32 ) { // three point probe
-            // first wait for an empty queue i.e. no moves left
-            THEKERNEL->conveyor->wait_for_empty_queue();
-            if(!doProbing(gcode->stream)) {
-                gcode->stream->printf("Probe failed to complete, probe not triggered or other error\n");
-            } else {
-                gcode->stream->printf("Probe completed, bed plane defined\n");
-            }
+            // the ok, and what comes after, wait for the probing to be done
+            THEKERNEL->gcode_dispatch->hold(new ThreePointProbeTask(this, zprobe, gcode->stream));
             return true;
         }
 
@@ -235,28 +247,32 @@ void ThreePointStrategy::homeXY()
     THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
 }
 
-bool ThreePointStrategy::doProbing(StreamOutput *stream)
+bool ThreePointProbeTask::run()
 {
-    float x, y;
+    float x, y, z;
+    TASK_BEGIN();
+
     // check the probe points have been defined
     for (int i = 0; i < 3; ++i) {
-        std::tie(x, y) = probe_points[i];
+        std::tie(x, y) = strategy->probe_points[i];
         if(isnan(x) || isnan(y)) {
             stream->printf("Probe point P%d has not been defined, use M557 P%d Xnnn Ynnn to define it\n", i, i);
-            return false;
+            stream->printf("Probe failed to complete, probe not triggered or other error\n");
+            TASK_EXIT();
         }
     }
 
-    // optionally home XY axis first, but allow for manual homing
-    if(this->home)
-        homeXY();
+    // optionally home XY axis first, but allow for manual homing, the homing goes ahead of this task
+    if(strategy->home) {
+        strategy->homeXY();
+        TASK_YIELD();
+    }
 
     // move to the first probe point
-    std::tie(x, y) = probe_points[0];
+    std::tie(x, y) = strategy->probe_points[0];
     // offset by the probe XY offset
-    x -= std::get<X_AXIS>(this->probe_offsets);
-    y -= std::get<Y_AXIS>(this->probe_offsets);
-    zprobe->coordinated_move(x, y, NAN, zprobe->getFastFeedrate());
+    x -= std::get<X_AXIS>(strategy->probe_offsets);
+    y -= std::get<Y_AXIS>(strategy->probe_offsets);
 
     // for now we use probe to find bed and not the Z min endstop
     // the first probe point becomes Z == 0 effectively so if we home Z or manually set z after this, it needs to be at the first probe point
@@ -264,49 +280,61 @@ bool ThreePointStrategy::doProbing(StreamOutput *stream)
     // TODO this needs to be configurable to use min z or probe
 
     // find bed via probe
-    int s;
-    if(!zprobe->run_probe(s)) return false;
+    probe.start(x, y, false, false);
+    TASK_WAIT_UNTIL(probe.run());
+    if(!probe.touched) {
+        stream->printf("Probe failed to complete, probe not triggered or other error\n");
+        TASK_EXIT();
+    }
 
     // TODO if using probe then we probably need to set Z to 0 at first probe point, but take into account probe offset from head
-    THEKERNEL->robot->reset_axis_position(std::get<Z_AXIS>(this->probe_offsets), Z_AXIS);
+    THEKERNEL->robot->reset_axis_position(std::get<Z_AXIS>(strategy->probe_offsets), Z_AXIS);
 
     // move up to specified probe start position
-    zprobe->coordinated_move(NAN, NAN, zprobe->getProbeHeight(), zprobe->getSlowFeedrate()); // move to probe start position
+    strategy->zprobe->coordinated_move(NAN, NAN, strategy->zprobe->getProbeHeight(), strategy->zprobe->getSlowFeedrate()); // move to probe start position
 
     // probe the three points
-    Vector3 v[3];
-    for (int i = 0; i < 3; ++i) {
-        std::tie(x, y) = probe_points[i];
+    for (this->i = 0; this->i < 3; ++this->i) {
+        std::tie(x, y) = strategy->probe_points[this->i];
         // offset moves by the probe XY offset
-        float z = zprobe->probeDistance(x-std::get<X_AXIS>(this->probe_offsets), y-std::get<Y_AXIS>(this->probe_offsets));
-        if(isnan(z)) return false; // probe failed
-        z= zprobe->getProbeHeight() - z; // relative distance between the probe points, lower is negative z
-        stream->printf("DEBUG: P%d:%1.4f\n", i, z);
-        v[i].set(x, y, z);
+        probe.start(x-std::get<X_AXIS>(strategy->probe_offsets), y-std::get<Y_AXIS>(strategy->probe_offsets));
+        TASK_WAIT_UNTIL(probe.run());
+        if(!probe.touched) {
+            stream->printf("Probe failed to complete, probe not triggered or other error\n");
+            TASK_EXIT();
+        }
+
+        std::tie(x, y) = strategy->probe_points[this->i];
+        z= strategy->zprobe->getProbeHeight() - strategy->zprobe->zsteps_to_mm(probe.steps); // relative distance between the probe points, lower is negative z
+        stream->printf("DEBUG: P%d:%1.4f\n", this->i, z);
+        v[this->i].set(x, y, z);
     }
 
     // if first point is not within tolerance report it, it should ideally be 0
-    if(abs(v[0][2]) > this->tolerance) {
-        stream->printf("WARNING: probe is not within tolerance: %f > %f\n", abs(v[0][2]), this->tolerance);
+    if(abs(v[0][2]) > strategy->tolerance) {
+        stream->printf("WARNING: probe is not within tolerance: %f > %f\n", abs(v[0][2]), strategy->tolerance);
     }
 
     // define the plane
-    delete this->plane;
-    // check tolerance level here default 0.03mm
-    auto mm = std::minmax({v[0][2], v[1][2], v[2][2]});
-    if((mm.second - mm.first) <= this->tolerance) {
-        this->plane= nullptr; // plane is flat no need to do anything
-        stream->printf("DEBUG: flat plane\n");
-        // clear the compensationTransform in robot
-        setAdjustFunction(false);
-
-    }else{
-        this->plane = new Plane3D(v[0], v[1], v[2]);
-        stream->printf("DEBUG: plane normal= %f, %f, %f\n", plane->getNormal()[0], plane->getNormal()[1], plane->getNormal()[2]);
-        setAdjustFunction(true);
+    delete strategy->plane;
+    {
+        // check tolerance level here default 0.03mm
+        auto mm = std::minmax({v[0][2], v[1][2], v[2][2]});
+        if((mm.second - mm.first) <= strategy->tolerance) {
+            strategy->plane= nullptr; // plane is flat no need to do anything
+            stream->printf("DEBUG: flat plane\n");
+            // clear the compensationTransform in robot
+            strategy->setAdjustFunction(false);
+
+        }else{
+            strategy->plane = new Plane3D(v[0], v[1], v[2]);
+            stream->printf("DEBUG: plane normal= %f, %f, %f\n", strategy->plane->getNormal()[0], strategy->plane->getNormal()[1], strategy->plane->getNormal()[2]);
+            strategy->setAdjustFunction(true);
+        }
     }
 
-    return true;
+    stream->printf("Probe completed, bed plane defined\n");
+    TASK_END();
 }
 
 void ThreePointStrategy::setAdjustFunction(bool on)
@@ -10,6 +10,7 @@
 
 class StreamOutput;
 class Plane3D;
+class ThreePointProbeTask;
 
 class ThreePointStrategy : public LevelingStrategy
 {
@@ -21,8 +22,9 @@ public:
     float getZOffset(float x, float y);
 
 private:
+    friend class ThreePointProbeTask;
+
     void homeXY();
-    bool doProbing(StreamOutput *stream);
     std::tuple<float, float> parseXY(const char *str);
     std::tuple<float, float, float> parseXYZ(const char *str);
     void setAdjustFunction(bool);
@@ -20,11 +20,12 @@
 #include "ConfigValue.h"
 #include "SlowTicker.h"
 #include "Planner.h"
-#include "SerialMessage.h"
 #include "PublicDataRequest.h"
 #include "EndstopsPublicAccess.h"
 #include "PublicData.h"
 #include "LevelingStrategy.h"
+#include "GcodeDispatch.h"
+#include "Task.h"
 
 // strategies we know about
 #include "DeltaCalibrationStrategy.h"
@@ -121,46 +122,148 @@ void ZProbe::on_config_reload(void *argument)
     this->max_z         = THEKERNEL->config->value(gamma_max_checksum)->by_default(500)->as_number(); // maximum zprobe distance
 }
 
-bool ZProbe::wait_for_probe(int& steps)
+// G30 runs as a task the dispatch holds on, the probe is then watched from the main loop instead of spinning on ON_IDLE
+class ProbeTask : public Task {
+    public:
+        ProbeTask(ZProbe *zprobe, StreamOutput *stream, bool set_z, float z);
+        bool run();
+        void forget_stream(StreamOutput *stream);
+
+    private:
+        ProbeAt probe;
+        StreamOutput *stream;
+        float z;
+        bool set_z;
+};
+
+ProbeTask::ProbeTask(ZProbe *zprobe, StreamOutput *stream, bool set_z, float z) : probe(zprobe)
 {
-    unsigned int debounce = 0;
-    while(true) {
-        THEKERNEL->call_event(ON_IDLE);
-        // if no stepper is moving, moves are finished and there was no touch
-        if( !STEPPER[Z_AXIS]->is_moving() && (!is_delta || (!STEPPER[Y_AXIS]->is_moving() && !STEPPER[Z_AXIS]->is_moving())) ) {
-            return false;
+    this->stream = stream;
+    this->set_z = set_z;
+    this->z = z;
+}
+
+void ProbeTask::forget_stream(StreamOutput *stream)
+{
+    if(this->stream == stream) this->stream = &(StreamOutput::NullStream);
+}
+
+bool ProbeTask::run()
+{
+    TASK_BEGIN();
+
+    // move back to where it started, unless a Z is specified
+    this->probe.start(NAN, NAN, false, !this->set_z);
+    TASK_WAIT_UNTIL(this->probe.run());
+
+    if(this->probe.touched) {
+        this->stream->printf("Z:%1.4f C:%d\n", this->probe.steps / Z_STEPS_PER_MM, this->probe.steps);
+        if(this->set_z) {
+            // set Z to the specified value, and leave probe where it is
+            THEKERNEL->robot->reset_axis_position(this->z, Z_AXIS);
         }
+    } else {
+        this->stream->printf("ZProbe not triggered\n");
+    }
 
-        // if the touchprobe is active...
-        if( this->pin.get() ) {
-            //...increase debounce counter...
-            if( debounce < debounce_count) {
-                // ...but only if the counter hasn't reached the max. value
-                debounce++;
-            } else {
-                // ...otherwise stop the steppers, return its remaining steps
-                if(STEPPER[Z_AXIS]->is_moving()){
-                    steps= STEPPER[Z_AXIS]->get_stepped();
-                    STEPPER[Z_AXIS]->move(0, 0);
-                }
-                if(is_delta) {
-                    for( int i = X_AXIS; i <= Y_AXIS; i++ ) {
-                        if ( STEPPER[i]->is_moving() ) {
-                            STEPPER[i]->move(0, 0);
-                        }
-                    }
-                }
-                return true;
-            }
+    TASK_END();
+}
+
+// Stopped part way through, by a halt
+ProbeAt::~ProbeAt()
+{
+    if(zprobe->running) zprobe->stop();
+}
+
+void ProbeAt::start(float x, float y, bool fast, bool back)
+{
+    this->resume_line = 0;
+    this->x = x;
+    this->y = y;
+    this->fast = fast;
+    this->back = back;
+}
+
+bool ProbeAt::run()
+{
+    TASK_BEGIN();
+
+    if(!isnan(this->x) || !isnan(this->y)) {
+        // the move before this one has to be all in the block queue before the robot takes another
+        TASK_WAIT_UNTIL(!THEKERNEL->robot->is_segmenting());
+        zprobe->coordinated_move(this->x, this->y, NAN, zprobe->getFastFeedrate());
+    }
+
+    // first wait for an empty queue i.e. no moves left
+    TASK_WAIT_UNTIL(THEKERNEL->conveyor->is_idle());
+
+    zprobe->start_probe(this->fast);
+    TASK_WAIT_UNTIL(zprobe->probe_ended());
+    this->touched = zprobe->touched;
+    this->steps = zprobe->touched_steps;
+
+    if(this->touched && this->back) {
+        zprobe->start_return(this->steps);
+        TASK_WAIT_UNTIL(zprobe->return_ended());
+    }
+
+    TASK_END();
+}
+
+// One look at the probe, the steppers are stopped once it is triggered, true when the probing is over
+bool ZProbe::probe_ended()
+{
+    // if no stepper is moving, moves are finished and there was no touch
+    if( !STEPPER[Z_AXIS]->is_moving() && (!is_delta || (!STEPPER[Y_AXIS]->is_moving() && !STEPPER[Z_AXIS]->is_moving())) ) {
+        this->running = false;
+        return true;
+    }
+
+    // if the touchprobe is active...
+    if( this->pin.get() ) {
+        //...increase debounce counter...
+        if( this->debounce < debounce_count) {
+            // ...but only if the counter hasn't reached the max. value
+            this->debounce++;
         } else {
-            // The probe was not hit yet, reset debounce counter
-            debounce = 0;
+            // ...otherwise stop the steppers, keep how far it went
+            if(STEPPER[Z_AXIS]->is_moving()) this->touched_steps= STEPPER[Z_AXIS]->get_stepped();
+            this->stop();
+            this->touched = true;
+            return true;
         }
+    } else {
+        // The probe was not hit yet, reset debounce counter
+        this->debounce = 0;
     }
+    return false;
 }
 
-// single probe and report amount moved
-bool ZProbe::run_probe(int& steps, bool fast)
+bool ZProbe::return_ended()
+{
+    if(STEPPER[Z_AXIS]->is_moving() || (is_delta && (STEPPER[X_AXIS]->is_moving() || STEPPER[Y_AXIS]->is_moving())) ) {
+        return false;
+    }
+
+    this->running = false;
+    return true;
+}
+
+void ZProbe::stop()
+{
+    if(STEPPER[Z_AXIS]->is_moving()) STEPPER[Z_AXIS]->move(0, 0);
+    if(is_delta) {
+        for( int i = X_AXIS; i <= Y_AXIS; i++ ) {
+            if ( STEPPER[i]->is_moving() ) {
+                STEPPER[i]->move(0, 0);
+            }
+        }
+    }
+    this->running = false;
+}
+
+// Start moving down until the probe triggers, probe_ended() tells when it is over
+void ZProbe::start_probe(bool fast)
 {
     // Enable the motors
     THEKERNEL->stepper->turn_enable_pins_on();
@@ -178,15 +281,16 @@ bool ZProbe::run_probe(int& steps, bool fast)
         STEPPER[Y_AXIS]->move(true, maxz * STEPS_PER_MM(Y_AXIS));
     }
 
+    this->debounce = 0;
+    this->touched = false;
+    this->touched_steps = 0;
+
     // start acceration hrprocessing
     this->running = true;
-
-    bool r = wait_for_probe(steps);
-    this->running = false;
-    return r;
 }
 
-bool ZProbe::return_probe(int steps)
+// Start moving the probe back up by as many steps as it went down, return_ended() tells when it is there
+void ZProbe::start_return(int steps)
 {
     // move probe back to where it was
     float fr= this->slow_feedrate*2; // nominally twice slow feedrate
@@ -205,35 +309,6 @@ bool ZProbe::return_probe(int steps)
     }
 
     this->running = true;
-    while(STEPPER[Z_AXIS]->is_moving() || (is_delta && (STEPPER[X_AXIS]->is_moving() || STEPPER[Y_AXIS]->is_moving())) ) {
-        // wait for it to complete
-        THEKERNEL->call_event(ON_IDLE);
-    }
-
-    this->running = false;
-
-    return true;
-}
-
-bool ZProbe::doProbeAt(int &steps, float x, float y)
-{
-    int s;
-    // move to xy
-    coordinated_move(x, y, NAN, getFastFeedrate());
-    if(!run_probe(s)) return false;
-
-    // return to original Z
-    return_probe(s);
-    steps = s;
-
-    return true;
-}
-
-float ZProbe::probeDistance(float x, float y)
-{
-    int s;
-    if(!doProbeAt(s, x, y)) return NAN;
-    return zsteps_to_mm(s);
 }
 
 void ZProbe::on_gcode_received(void *argument)
@@ -253,22 +328,9 @@ void ZProbe::on_gcode_received(void *argument)
 
         if( gcode->g == 30 ) { // simple Z probe
             gcode->mark_as_taken();
-            // first wait for an empty queue i.e. no moves left
-            THEKERNEL->conveyor->wait_for_empty_queue();
-
-            int steps;
-            if(run_probe(steps)) {
-                gcode->stream->printf("Z:%1.4f C:%d\n", steps / Z_STEPS_PER_MM, steps);
-                // move back to where it started, unless a Z is specified
-                if(gcode->has_letter('Z')) {
-                    // set Z to the specified value, and leave probe where it is
-                    THEKERNEL->robot->reset_axis_position(gcode->get_value('Z'), Z_AXIS);
-                } else {
-                    return_probe(steps);
-                }
-            } else {
-                gcode->stream->printf("ZProbe not triggered\n");
-            }
+            // the ok, and what comes after, wait for the probing to be done
+            bool set_z = gcode->has_letter('Z');
+            THEKERNEL->gcode_dispatch->hold(new ProbeTask(this, gcode->stream, set_z, set_z ? gcode->get_value('Z') : 0));
 
         } else {
             // find a strategy to handle the gcode
@@ -336,15 +398,12 @@ void ZProbe::accelerate(int c)
     STEPPER[c]->set_speed(max(current_rate, THEKERNEL->stepper->get_minimum_steps_per_second()));
 }
 
-// issue a coordinated move directly to robot, and return when done
+// issue a coordinated move directly to robot, the caller waits for Conveyor::is_idle() before relying on it being done
 // Only move the coordinates that are passed in as not nan
 void ZProbe::coordinated_move(float x, float y, float z, float feedrate, bool relative)
 {
     char buf[32];
-    char cmd[64];
-
-    if(relative) strcpy(cmd, "G91 G0 ");
-    else strcpy(cmd, "G0 ");
+    char cmd[64] = "G0";
 
     if(!isnan(x)) {
         int n = snprintf(buf, sizeof(buf), " X%1.3f", x);
@@ -362,19 +421,17 @@ void ZProbe::coordinated_move(float x, float y, float z, float feedrate, bool re
     // use specified feedrate (mm/sec)
     int n = snprintf(buf, sizeof(buf), " F%1.1f", feedrate * 60); // feed rate is converted to mm/min
     strncat(cmd, buf, n);
-    if(relative) strcat(cmd, " G90");
 
     //THEKERNEL->streams->printf("DEBUG: move: %s\n", cmd);
 
-    // send as a command line as may have multiple G codes in it
-    struct SerialMessage message;
-    message.message = cmd;
-    message.stream = &(StreamOutput::NullStream);
-    THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
-    THEKERNEL->conveyor->wait_for_empty_queue();
+    Gcode gc(cmd, &(StreamOutput::NullStream));
+    bool oldmode= THEKERNEL->robot->absolute_mode;
+    if(relative) THEKERNEL->robot->absolute_mode= false; // needs to be relative mode
+    THEKERNEL->call_event(ON_GCODE_RECEIVED, &gc);
+    THEKERNEL->robot->absolute_mode= oldmode; // restore mode
 }
 
-// issue home command
+// issue home command, the homing goes ahead of the task calling this, which yields to it with TASK_YIELD()
 void ZProbe::home()
 {
     Gcode gc("G28", &(StreamOutput::NullStream));
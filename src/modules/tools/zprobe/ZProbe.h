@@ -10,6 +10,7 @@
 
 #include "Module.h"
 #include "Pin.h"
+#include "Task.h"
 
 #include <vector>
 
@@ -21,6 +22,7 @@ class StepperMotor;
 class Gcode;
 class StreamOutput;
 class LevelingStrategy;
+class ProbeAt;
 
 class ZProbe: public Module
 {
@@ -31,12 +33,6 @@ public:
     void on_gcode_received(void *argument);
     uint32_t acceleration_tick(uint32_t dummy);
 
-    bool wait_for_probe(int& steps);
-    bool run_probe(int& steps, bool fast= false);
-    bool return_probe(int steps);
-    bool doProbeAt(int &steps, float x, float y);
-    float probeDistance(float x, float y);
-
     void coordinated_move(float x, float y, float z, float feedrate, bool relative=false);
     void home();
 
@@ -47,6 +43,13 @@ public:
     float zsteps_to_mm(float steps);
 
 private:
+    friend class ProbeAt;
+
+    void start_probe(bool fast);
+    bool probe_ended();
+    void start_return(int steps);
+    bool return_ended();
+    void stop();
     void accelerate(int c);
 
     volatile float current_feedrate;
@@ -61,7 +64,29 @@ private:
 
     Pin pin;
     uint8_t debounce_count;
+    uint8_t debounce;
+    bool touched;           // The last probing was stopped by the probe, after going down touched_steps
+    int touched_steps;
     std::vector<LevelingStrategy*> strategies;
 };
 
+// A probing for the tasks of the gcodes that probe : an optional move to X Y, the probe down, and back up by as much
+// unless told not to. Wait for it with TASK_WAIT_UNTIL(probe.run()), touched and steps then tell how it went
+class ProbeAt : public Task
+{
+public:
+    ProbeAt(ZProbe *zprobe) : zprobe(zprobe) {}
+    ~ProbeAt();
+    void start(float x, float y, bool fast= false, bool back= true);
+    bool run();
+
+    bool touched;
+    int steps;
+
+private:
+    ZProbe *zprobe;
+    float x, y;
+    bool fast, back;
+};
+
 #endif /* ZPROBE_H_ */
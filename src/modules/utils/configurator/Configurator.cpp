@@ -27,29 +27,27 @@
 
 void Configurator::on_module_loaded()
 {
-    this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
+    this->register_for_command("config-get");
+    this->register_for_command("config-set");
+    this->register_for_command("config-load");
     //    this->register_for_event(ON_GCODE_RECEIVED);
     //    this->register_for_event(ON_MAIN_LOOP);
 }
 
-// When a new line is received, check if it is a command, and if it is, act upon it
+// The kernel only sends the lines starting with config-get, config-set or config-load here
 void Configurator::on_console_line_received( void *argument )
 {
     SerialMessage new_message = *static_cast<SerialMessage *>(argument);
 
-    // ignore comments and blank lines and if this is a G code then also ignore it
-    char first_char = new_message.message[0];
-    if(strchr(";( \n\rGMTN", first_char) != NULL) return;
-
     string possible_command = new_message.message;
     string cmd = shift_parameter(possible_command);
 
     // Act depending on command
-    if (cmd == "config-get"){
+    if (strcasecmp(cmd.c_str(), "config-get") == 0){
         this->config_get_command(  possible_command, new_message.stream );
-    } else if (cmd == "config-set"){
+    } else if (strcasecmp(cmd.c_str(), "config-set") == 0){
         this->config_set_command(  possible_command, new_message.stream );
-    } else if (cmd == "config-load"){
+    } else if (strcasecmp(cmd.c_str(), "config-load") == 0){
         this->config_load_command(  possible_command, new_message.stream );
     }
 }
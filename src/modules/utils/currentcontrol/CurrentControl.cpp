@@ -83,7 +83,9 @@ void CurrentControl::on_module_loaded()
     this->digipot->set_current(7, THEKERNEL->config->value(theta_current_checksum  )->by_default(-1)->as_number());
 
 
-    this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_gcode('M', 907);
+    this->register_for_gcode('M', 500);
+    this->register_for_gcode('M', 503);
 }
 
 
@@ -5,6 +5,7 @@
 #include "libs/utils.h"
 #include <libs/Pin.h>
 #include "mbed.h"
+#include "libs/SpiBus.h"
 #include <string>
 #include <math.h>
 
@@ -13,7 +14,7 @@
 class AD5206 : public DigipotBase {
     public:
         AD5206(){
-            this->spi= new mbed::SPI(P0_9,P0_8,P0_7); //should be able to set those pins in config
+            this->spi= SpiBus::get(P0_9,P0_8,P0_7); //should be able to set those pins in config
             cs.from_string("4.29")->as_output(); //this also should be configurable
             cs.set(1);
             for (int i = 0; i < 6; i++) currents[i] = -1;
@@ -29,10 +30,12 @@ class AD5206 : public DigipotBase {
 				current = min( max( current, 0.0L ), 2.0L );
 				char adresses[6] = { 0x05, 0x03, 0x01, 0x00, 0x02, 0x04 };
 				currents[channel] = current;
+				spi->acquire(1000000);
 				cs.set(0);
-				spi->write((int)adresses[channel]);
-				spi->write((int)current_to_wiper(current));
+				spi->write(adresses[channel]);
+				spi->write(current_to_wiper(current));
 				cs.set(1);
+				spi->release();
 			}
         }
 
@@ -64,7 +67,7 @@ class AD5206 : public DigipotBase {
     private:
 
         Pin cs;
-        mbed::SPI* spi;
+        SpiBus* spi;
         float currents[6];
 };
 
@@ -54,11 +54,14 @@ PanelScreen *PanelScreen::set_parent(PanelScreen *passed_parent)
     return this;
 }
 
-// Helper for screens to send a gcode, must be called from main loop
+// Helper for screens to send a gcode, must be called from main loop. It goes through the gcode dispatch as a line,
+// so it waits behind a gcode holding the dispatch instead of running in the middle of it
 void PanelScreen::send_gcode(std::string g)
 {
-    Gcode gcode(g, &(StreamOutput::NullStream));
-    THEKERNEL->call_event(ON_GCODE_RECEIVED, &gcode );
+    struct SerialMessage message;
+    message.message = g;
+    message.stream = &(StreamOutput::NullStream);
+    THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
 }
 
 void PanelScreen::send_gcode(const char *gm_code, char parameter, float value)
@@ -21,6 +21,8 @@
 #define LCDHEIGHT 64
 #define LCDPAGES  (LCDHEIGHT+7)/8
 #define FB_SIZE LCDWIDTH*LCDPAGES
+// Commands are copied after the frame buffer, in AHB RAM where the DMA can get them
+#define COMMAND_SIZE 16
 #define FONT_SIZE_X 6
 #define FONT_SIZE_Y 8
 
@@ -74,17 +76,9 @@ ST7565::ST7565(uint8_t variant)
     //SPI com
     // select which SPI channel to use
     int spi_channel = THEKERNEL->config->value(panel_checksum, spi_channel_checksum)->by_default(0)->as_number();
-    PinName mosi, miso, sclk;
-    if(spi_channel == 0) {
-        mosi = P0_18; miso = P0_17; sclk = P0_15;
-    } else if(spi_channel == 1) {
-        mosi = P0_9; miso = P0_8; sclk = P0_7;
-    } else {
-        mosi = P0_18; miso = P0_17; sclk = P0_15;
-    }
-
-    this->spi = new mbed::SPI(mosi, miso, sclk);
-    this->spi->frequency(THEKERNEL->config->value(panel_checksum, spi_frequency_checksum)->by_default(1000000)->as_number()); //4Mhz freq, can try go a little lower
+    this->spi = SpiBus::get(spi_channel == 1 ? 1 : 0);
+    this->spi_frequency = THEKERNEL->config->value(panel_checksum, spi_frequency_checksum)->by_default(1000000)->as_number(); //4Mhz freq, can try go a little lower
+    this->page = -1;
 
     //chip select
     this->cs.from_string(THEKERNEL->config->value( panel_checksum, spi_cs_pin_checksum)->by_default("0.16")->as_string())->as_output();
@@ -144,42 +138,55 @@ ST7565::ST7565(uint8_t variant)
     // reverse display
     this->reversed = THEKERNEL->config->value(panel_checksum, reverse_checksum)->by_default(this->reversed)->as_bool();
 
-    framebuffer = (uint8_t *)AHB0.alloc(FB_SIZE); // grab some memory from USB_RAM
+    framebuffer = (uint8_t *)AHB0.alloc(FB_SIZE + COMMAND_SIZE); // grab some memory from USB_RAM
     if(framebuffer == NULL) {
         THEKERNEL->streams->printf("Not enough memory available for frame buffer");
     }
+    this->command_buffer = framebuffer + FB_SIZE;
 
 }
 
 ST7565::~ST7565()
 {
-    delete this->spi;
+    while(this->page >= 0);
     AHB0.dealloc(framebuffer);
 }
 
 //send commands to lcd
 void ST7565::send_commands(const unsigned char *buf, size_t size)
 {
-    cs.set(0);
+    while(this->page >= 0); // a0 belongs to send_pic() until it is done
     a0.set(0);
-    while(size-- > 0) {
-        spi->write(*buf++);
-    }
-    cs.set(1);
+    send_buffered(buf, size);
 }
 
 //send data to lcd
 void ST7565::send_data(const unsigned char *buf, size_t size)
 {
-    cs.set(0);
+    while(this->page >= 0);
     a0.set(1);
-    while(size-- > 0) {
-        spi->write(*buf++);
-    }
-    cs.set(1);
+    send_buffered(buf, size);
     a0.set(0);
 }
 
+// The caller's bytes may be anywhere, they go through command_buffer a few at a time
+void ST7565::send_buffered(const unsigned char *buf, size_t size)
+{
+    if(framebuffer == NULL) return;
+    SpiTransaction t;
+    t.tx = this->command_buffer;
+    t.frequency = this->spi_frequency;
+    t.cs = &this->cs;
+    while(size > 0) {
+        size_t n = size > COMMAND_SIZE ? COMMAND_SIZE : size;
+        memcpy(this->command_buffer, buf, n);
+        t.length = n;
+        spi->transfer(&t);
+        buf += n;
+        size -= n;
+    }
+}
+
 //clearing screen
 void ST7565::clear()
 {
@@ -188,12 +195,43 @@ void ST7565::clear()
     this->ty = 0;
 }
 
+// Only starts sending, the rest is queued by on_page_sent() as each transfer ends. A refresh still going is left
+// to finish instead
 void ST7565::send_pic(const unsigned char *data)
 {
-    for (int i = 0; i < LCDPAGES; i++) {
-        set_xy(0, i);
-        send_data(data + i * LCDWIDTH, LCDWIDTH);
+    if(this->page >= 0 || framebuffer == NULL) return;
+
+    this->page_data = data;
+    this->page_transaction.frequency = this->spi_frequency;
+    this->page_transaction.cs = &this->cs;
+    this->page_transaction.done.attach(this, &ST7565::on_page_sent);
+    this->page = 0;
+    this->on_page_sent(0);
+}
+
+// Alternates the command selecting a page and the page itself
+uint32_t ST7565::on_page_sent(uint32_t error)
+{
+    if(this->page_transaction.tx == this->command_buffer) {
+        a0.set(1);
+        this->page_transaction.tx = this->page_data + this->page * LCDWIDTH;
+        this->page_transaction.length = LCDWIDTH;
+        this->page++;
+    } else if(this->page < LCDPAGES) {
+        a0.set(0);
+        this->command_buffer[0] = 0xb0 | (this->page & 0x07);
+        this->command_buffer[1] = 0x10;
+        this->command_buffer[2] = 0x00;
+        this->page_transaction.tx = this->command_buffer;
+        this->page_transaction.length = 3;
+    } else {
+        a0.set(0);
+        this->page_transaction.tx = NULL;
+        this->page = -1;
+        return 0;
     }
+    spi->queue(&this->page_transaction);
+    return 0;
 }
 
 // set column and page number
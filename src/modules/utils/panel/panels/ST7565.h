@@ -11,6 +11,7 @@
 #include "LcdBase.h"
 #include "mbed.h"
 #include "libs/Pin.h"
+#include "libs/SpiBus.h"
 
 class ST7565: public LcdBase {
 public:
@@ -35,10 +36,12 @@ public:
 	//added ST7565 commands
 	void send_commands(const unsigned char* buf, size_t size);
 	void send_data(const unsigned char* buf, size_t size);
+	void send_buffered(const unsigned char* buf, size_t size);
 	// set column and page number
 	void set_xy(int x, int y);
 	//send pic to whole screen
 	void send_pic(const unsigned char* data);
+	uint32_t on_page_sent(uint32_t error);
 	//drawing char
 	int drawChar(int x, int y, unsigned char c, int color);
     // blit a glyph of w pixels wide and h pixels high to x, y. offset pixel position in glyph by x_offset, y_offset.
@@ -58,7 +61,14 @@ private:
 
     //buffer
 	unsigned char *framebuffer;
-	mbed::SPI* spi;
+	SpiBus* spi;
+	uint32_t spi_frequency;
+	// send_pic() goes on from the DMA interrupt, a page command and then the page
+	SpiTransaction page_transaction;
+	// After the frame buffer, commands are sent from here, page commands included
+	unsigned char *command_buffer;
+	const unsigned char* page_data;
+	volatile int page;
 	Pin cs;
 	Pin rst;
 	Pin a0;
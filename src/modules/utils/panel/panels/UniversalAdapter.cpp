@@ -37,11 +37,13 @@
 UniversalAdapter::SPIFrame::SPIFrame(UniversalAdapter *pu)
 {
     this->u = pu;
+    u->spi->acquire(u->spi_frequency);
     u->cs_pin->set(0);
 }
 UniversalAdapter::SPIFrame::~SPIFrame()
 {
     u->cs_pin->set(1);
+    u->spi->release();
 }
 
 UniversalAdapter::UniversalAdapter()
@@ -55,21 +57,11 @@ UniversalAdapter::UniversalAdapter()
 
     // select which SPI channel to use
     int spi_channel = THEKERNEL->config->value(panel_checksum, spi_channel_checksum)->by_default(0)->as_number();
-    PinName mosi, miso, sclk;
-    if(spi_channel == 0) {
-        mosi = P0_18; miso = P0_17; sclk = P0_15;
-    } else if(spi_channel == 1) {
-        mosi = P0_9; miso = P0_8; sclk = P0_7;
-    } else {
-        mosi = P0_18; miso = P0_17; sclk = P0_15;
-    }
-
-    this->spi = new mbed::SPI(mosi, miso, sclk);
+    this->spi = SpiBus::get(spi_channel == 1 ? 1 : 0);
     // chip select not selected
     this->cs_pin->set(1);
 
-    int spi_frequency = THEKERNEL->config->value(panel_checksum, spi_frequency_checksum)->by_default(500000)->as_int();
-    this->spi->frequency(spi_frequency);
+    this->spi_frequency = THEKERNEL->config->value(panel_checksum, spi_frequency_checksum)->by_default(500000)->as_int();
     ledBits = 0;
 }
 
@@ -78,7 +70,6 @@ UniversalAdapter::~UniversalAdapter()
     this->cs_pin->set(1);
     delete cs_pin;
     delete busy_pin;
-    delete this->spi;
 }
 
 // void UniversalAdapter::on_refresh(bool now)
@@ -10,6 +10,7 @@
 
 #include "LcdBase.h"
 #include "mbed.h"
+#include "libs/SpiBus.h"
 
 class Pin;
 
@@ -50,7 +51,8 @@ class UniversalAdapter : public LcdBase {
         void wait_until_ready();
         uint8_t sendReadCmd(uint8_t cmd);
         uint16_t ledBits;
-        mbed::SPI* spi;
+        SpiBus* spi;
+        int spi_frequency;
         Pin *cs_pin;
         Pin *busy_pin;
 };
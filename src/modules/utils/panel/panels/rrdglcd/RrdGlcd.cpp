@@ -136,8 +136,8 @@ static const uint8_t font5x8[] = {
     0x00,0x00,0x78,0x78,0x78,0x78,0x00,0x00
 };
 
-#define ST7920_CS()              {cs.set(1);wait_us(10);}
-#define ST7920_NCS()             {cs.set(0);wait_us(10);}
+#define ST7920_CS()              {this->spi->acquire(this->frequency);cs.set(1);wait_us(10);}
+#define ST7920_NCS()             {cs.set(0);wait_us(10);this->spi->release();}
 #define ST7920_WRITE_BYTE(a)     {this->spi->write((a)&0xf0);this->spi->write((a)<<4);wait_us(10);}
 #define ST7920_WRITE_BYTES(p,l)  {uint8_t i;for(i=0;i<l;i++){this->spi->write(*p&0xf0);this->spi->write(*p<<4);p++;} wait_us(10); }
 #define ST7920_SET_CMD()         {this->spi->write(0xf8);wait_us(10);}
@@ -148,16 +148,8 @@ static const uint8_t font5x8[] = {
 #define FB_SIZE WIDTH*HEIGHT/8
 
 RrdGlcd::RrdGlcd(int spi_channel, Pin cs) {
-    PinName mosi, miso, sclk;
-    if(spi_channel == 0) {
-        mosi = P0_18; miso = P0_17; sclk = P0_15;
-    } else if(spi_channel == 1) {
-        mosi = P0_9; miso = P0_8; sclk = P0_7;
-    } else {
-        mosi = P0_18; miso = P0_17; sclk = P0_15;
-    }
-
-    this->spi = new mbed::SPI(mosi, miso, sclk);
+    this->spi = SpiBus::get(spi_channel == 1 ? 1 : 0);
+    this->frequency = 1000000;
 
     //chip select
     this->cs= cs;
@@ -171,12 +163,11 @@ RrdGlcd::RrdGlcd(int spi_channel, Pin cs) {
 }
 
 RrdGlcd::~RrdGlcd() {
-    delete this->spi;
     AHB0.dealloc(fb);
 }
 
 void RrdGlcd::setFrequency(int freq) {
-       this->spi->frequency(freq);
+       this->frequency = freq;
 }
 
 void RrdGlcd::initDisplay() {
@@ -17,6 +17,7 @@
 #include "libs/Kernel.h"
 #include "libs/utils.h"
 #include <libs/Pin.h>
+#include "libs/SpiBus.h"
 
 
 class RrdGlcd {
@@ -53,7 +54,8 @@ public:
 
 private:
     Pin cs;
-    mbed::SPI* spi;
+    SpiBus* spi;
+    int frequency;
     void renderChar(uint8_t *fb, char c, int ox, int oy);
     void displayChar(int row, int column,char inpChr);
 
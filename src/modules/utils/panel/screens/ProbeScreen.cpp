@@ -15,6 +15,7 @@
 #include "libs/utils.h"
 #include "StringStream.h"
 #include "Gcode.h"
+#include "GcodeDispatch.h"
 
 #include <string>
 
@@ -23,6 +24,7 @@ using namespace std;
 ProbeScreen::ProbeScreen()
 {
     this->do_probe= false;
+    this->probing= false;
     this->do_status= false;
     this->new_result= false;
 }
@@ -32,6 +34,8 @@ void ProbeScreen::on_exit()
     this->do_probe= false;
     this->do_status= false;
     this->new_result= false;
+    // a probing still going on answers nowhere once we are gone
+    THEKERNEL->gcode_dispatch->forget_stream(&this->probe_output);
     delete this;
 }
 
@@ -85,11 +89,22 @@ void ProbeScreen::on_main_loop()
 {
     if (this->do_probe) {
         this->do_probe= false;
-        StringStream string_stream;
-        Gcode gcode("G30", &string_stream);
-        THEKERNEL->call_event(ON_GCODE_RECEIVED, &gcode);
-        this->result= string_stream.getOutput();
-        this->new_result= true;
+        // the probing holds the dispatch, its result is there once the ok is
+        this->probe_output.clear();
+        this->probing= true;
+        struct SerialMessage message;
+        message.message = "G30";
+        message.stream = &this->probe_output;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+
+    }else if (this->probing) {
+        std::string output= this->probe_output.getOutput();
+        size_t ok= output.find("ok\r\n");
+        if(ok != string::npos) {
+            this->probing= false;
+            this->result= output.substr(0, ok);
+            this->new_result= true;
+        }
 
     }else if (this->do_status && --this->tcnt == 0) {
         // this will refresh the results every 10 main loop iterations
@@ -9,6 +9,7 @@
 #define PROBESCREEN_H
 
 #include "PanelScreen.h"
+#include "StringStream.h"
 
 #include <string>
 
@@ -26,8 +27,10 @@ class ProbeScreen : public PanelScreen {
     private:
       int tcnt;
       std::string result;
+      StringStream probe_output;
       struct {
         bool do_probe:1;
+        bool probing:1;
         bool do_status:1;
         bool new_result:1;
       };
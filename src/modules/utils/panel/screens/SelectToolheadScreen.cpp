@@ -149,7 +149,7 @@ void SelectToolheadScreen::clicked_menu_entry(uint16_t line)
         case 7: {
             if (!Laser::isActivated()) {
                 Laser::enableDynamicActivation();
-                THEKERNEL->add_module( new Laser() );
+                THEKERNEL->add_module( new Laser(), "laser" );
             }
             toolhead_number = 7;
             this->refresh_menu();
@@ -1,7 +1,6 @@
 #include "libs/Kernel.h"
 #include "PauseButton.h"
 #include "libs/nuts_bolts.h"
-#include "libs/utils.h"
 #include "Config.h"
 #include "SlowTicker.h"
 #include "libs/SerialMessage.h"
@@ -10,12 +9,12 @@
 #include "checksumm.h"
 #include "ConfigValue.h"
 
+#include <ctype.h>
+
 using namespace std;
 
 #define pause_button_enable_checksum CHECKSUM("pause_button_enable")
 #define pause_button_pin_checksum    CHECKSUM("pause_button_pin")
-#define freeze_command_checksum      CHECKSUM("freeze")
-#define unfreeze_command_checksum    CHECKSUM("unfreeze")
 
 PauseButton::PauseButton(){}
 
@@ -25,7 +24,8 @@ void PauseButton::on_module_loaded(){
     this->enable     =  THEKERNEL->config->value( pause_button_enable_checksum )->by_default(false)->as_bool();
     this->button.from_string( THEKERNEL->config->value( pause_button_pin_checksum )->by_default("2.12")->as_string())->as_input();
 
-    this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
+    this->register_for_command("freeze");
+    this->register_for_command("unfreeze");
 
     if(this->enable) THEKERNEL->slow_ticker->attach( 100, this, &PauseButton::button_tick );
 }
@@ -50,23 +50,17 @@ uint32_t PauseButton::button_tick(uint32_t dummy){
     return 0;
 }
 
-// When a new line is received, check if it is a command, and if it is, act upon it
+// The kernel only sends the lines starting with freeze or unfreeze here
 void PauseButton::on_console_line_received( void *argument )
 {
     SerialMessage new_message = *static_cast<SerialMessage *>(argument);
 
-    // ignore comments and blank lines and if this is a G code then also ignore it
-    char first_char = new_message.message[0];
-    if(strchr(";( \n\rGMTN", first_char) != NULL) return;
-
-    int checksum = get_checksum(shift_parameter(new_message.message));
-
-    if (checksum == freeze_command_checksum) {
+    if (tolower(new_message.message[0]) == 'f') {
         if( !THEKERNEL->pauser->paused() ){
             THEKERNEL->pauser->take();
         }
 
-    }else if (checksum == unfreeze_command_checksum) {
+    }else{
         if( THEKERNEL->pauser->paused() ){
             THEKERNEL->pauser->release();
         }
@@ -22,6 +22,7 @@
 #include "SDFAT.h"
 
 #include "modules/robot/Conveyor.h"
+#include "modules/communication/GcodeDispatch.h"
 #include "DirHandle.h"
 #include "PublicDataRequest.h"
 #include "PlayerPublicAccess.h"
@@ -36,12 +37,14 @@ void Player::on_module_loaded()
     this->playing_file = false;
     this->current_file_handler = NULL;
     this->booted = false;
-    this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
+    this->register_for_command("play");
+    this->register_for_command("progress");
+    this->register_for_command("abort");
     this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_SECOND_TICK);
-    this->register_for_event(ON_GET_PUBLIC_DATA);
-    this->register_for_event(ON_SET_PUBLIC_DATA);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_public_data(player_checksum);
+    static const uint16_t m_codes[] = {21, 23, 24, 25, 26, 27, 32};
+    for (auto m : m_codes) this->register_for_gcode('M', m);
 
     this->on_boot_gcode = THEKERNEL->config->value(on_boot_gcode_checksum)->by_default("/sd/on_boot.gcode")->as_string();
     this->on_boot_gcode_enable = THEKERNEL->config->value(on_boot_gcode_enable_checksum)->by_default(true)->as_bool();
@@ -176,26 +179,22 @@ void Player::on_gcode_received(void *argument)
     }
 }
 
-// When a new line is received, check if it is a command, and if it is, act upon it
+// The kernel only sends the lines starting with play, progress or abort here
 void Player::on_console_line_received( void *argument )
 {
     SerialMessage new_message = *static_cast<SerialMessage *>(argument);
 
-    // ignore comments and blank lines and if this is a G code then also ignore it
-    char first_char = new_message.message[0];
-    if(strchr(";( \n\rGMTN", first_char) != NULL) return;
-
     string possible_command = new_message.message;
     string cmd = shift_parameter(possible_command);
 
     //new_message.stream->printf("Received %s\r\n", possible_command.c_str());
 
     // Act depending on command
-    if (cmd == "play"){
+    if (strcasecmp(cmd.c_str(), "play") == 0){
         this->play_command( possible_command, new_message.stream );
-    }else if (cmd == "progress"){
+    }else if (strcasecmp(cmd.c_str(), "progress") == 0){
         this->progress_command( possible_command, new_message.stream );
-    }else if (cmd == "abort")
+    }else if (strcasecmp(cmd.c_str(), "abort") == 0)
         this->abort_command( possible_command, new_message.stream );
 }
 
@@ -319,7 +318,8 @@ void Player::on_main_loop(void *argument)
         }
     }
 
-    if( this->playing_file ) {
+    // the file is read on while the gcode dispatch can take its lines
+    if( this->playing_file && THEKERNEL->gcode_dispatch->can_take_line() ) {
         char buf[130]; // lines upto 128 characters are allowed, anything longer is discarded
         bool discard = false;
 
@@ -338,7 +338,6 @@ void Player::on_main_loop(void *argument)
                 message.message = buf;
                 message.stream = this->current_stream;
 
-                // waits for the queue to have enough room
                 THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
                 played_cnt += len;
                 return; // we feed one line per main loop
@@ -30,6 +30,7 @@
 #include "platform_memory.h"
 #include "SwitchPublicAccess.h"
 #include "SDFAT.h"
+#include "SlowTicker.h"
 
 #include "system_LPC17xx.h"
 #include "LPC17xx.h"
@@ -56,9 +57,10 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
     {"dfu",      SimpleShell::dfu_command},
     {"break",    SimpleShell::break_command},
     {"help",     SimpleShell::help_command},
-    {"?",        SimpleShell::help_command},
     {"version",  SimpleShell::version_command},
     {"mem",      SimpleShell::mem_command},
+    {"events",   SimpleShell::events_command},
+    {"ticker",   SimpleShell::ticker_command},
     {"get",      SimpleShell::get_command},
     {"set_temp", SimpleShell::set_temp_command},
     {"switch",   SimpleShell::switch_command},
@@ -132,8 +134,13 @@ static uint32_t heapWalk(StreamOutput *stream, bool verbose)
 
 void SimpleShell::on_module_loaded()
 {
-    this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
-    this->register_for_event(ON_GCODE_RECEIVED);
+    for (const ptentry_t *p = commands_table; p->command != NULL; ++p) {
+        this->register_for_command(p->command);
+    }
+    this->register_for_gcode('M', 20);
+    this->register_for_gcode('M', 30);
+    this->register_for_gcode('M', 501);
+    this->register_for_gcode('M', 504);
     this->register_for_event(ON_SECOND_TICK);
 
     reset_delay_secs = 0;
@@ -187,7 +194,7 @@ void SimpleShell::on_gcode_received(void *argument)
 bool SimpleShell::parse_command(const char *cmd, string args, StreamOutput *stream)
 {
     for (const ptentry_t *p = commands_table; p->command != NULL; ++p) {
-        if (strncasecmp(cmd, p->command, strlen(p->command)) == 0) {
+        if (strcasecmp(cmd, p->command) == 0) {
             p->func(args, stream);
             return true;
         }
@@ -196,15 +203,11 @@ bool SimpleShell::parse_command(const char *cmd, string args, StreamOutput *stre
     return false;
 }
 
-// When a new line is received, check if it is a command, and if it is, act upon it
+// The kernel only sends the lines starting with one of the commands in commands_table here
 void SimpleShell::on_console_line_received( void *argument )
 {
     SerialMessage new_message = *static_cast<SerialMessage *>(argument);
 
-    // ignore comments and blank lines and if this is a G code then also ignore it
-    char first_char = new_message.message[0];
-    if(strchr(";( \n\rGMTN", first_char) != NULL) return;
-
     string possible_command = new_message.message;
 
     //new_message.stream->printf("Received %s\r\n", possible_command.c_str());
@@ -402,6 +405,80 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
     }
 }
 
+static void print_event_handlers(const string &name, const EventHandler *handler, StreamOutput *stream)
+{
+    if (handler == NULL || handler->module == NULL) return;
+
+    uint32_t cycles_per_ms = SystemCoreClock / 1000;
+    stream->printf("%s:\r\n", name.c_str());
+    for (; handler->module != NULL; handler++) {
+        unsigned long average = handler->calls > 0 ? (unsigned long)(handler->cycles / handler->calls) : 0;
+        const char *module = handler->module->module_name != NULL ? handler->module->module_name : "(unnamed)";
+        stream->printf("  %s calls: %lu, average: %lu cycles, max: %lu cycles, total: %lu ms\r\n",
+                       module, (unsigned long)handler->calls, average, (unsigned long)handler->max_cycles,
+                       (unsigned long)(handler->cycles / cycles_per_ms));
+    }
+}
+
+// show how often each module's event handlers were called and how long they took, by the name the module was added
+// with. Counting is off until "events on", it costs every call including those from interrupts
+void SimpleShell::events_command( string parameters, StreamOutput *stream)
+{
+    string what = shift_parameter( parameters );
+    if (what == "reset") {
+        THEKERNEL->reset_event_profile();
+        stream->printf("Event profile reset\r\n");
+        return;
+    }
+    if (what == "on" || what == "off") {
+        THEKERNEL->profile_events = (what == "on");
+        stream->printf("Event profiling %s\r\n", what.c_str());
+        return;
+    }
+
+    if (!THEKERNEL->profile_events) stream->printf("Event profiling is off, events on starts it\r\n");
+
+    for (int i = 0; i < NUMBER_OF_DEFINED_EVENTS; i++) {
+        string name = string("on_") + kernel_event_names[i];
+        if (i == ON_GCODE_RECEIVED) name.append(" (no or several numbers)");
+        if (i == ON_CONSOLE_LINE_RECEIVED) name.append(" (not a command)");
+        print_event_handlers(name, THEKERNEL->get_event_handlers((_EVENT_ENUM)i), stream);
+    }
+
+    // gcodes are routed by number
+    for (auto &route : THEKERNEL->get_gcode_routes()) {
+        char name[32];
+        snprintf(name, sizeof(name), "on_gcode_received %c%u", (route.key & GCODE_ROUTE_M) ? 'M' : 'G', (unsigned int)(route.key & ~GCODE_ROUTE_M));
+        print_event_handlers(name, route.handlers, stream);
+    }
+    print_event_handlers("on_gcode_received (other numbers)", THEKERNEL->get_gcode_fallback(), stream);
+
+    // and shell commands by name
+    for (auto &command : THEKERNEL->get_console_commands()) {
+        print_event_handlers(string("on_console_line_received ") + command.name, command.handler, stream);
+    }
+}
+
+// show what each slow ticker hook costs in interrupt time, the share of the cpu is the average call at the hook's frequency
+void SimpleShell::ticker_command( string parameters, StreamOutput *stream)
+{
+    if (shift_parameter( parameters ) == "reset") {
+        THEKERNEL->slow_ticker->reset_profile();
+        stream->printf("Ticker profile reset\r\n");
+        return;
+    }
+
+    uint32_t ticks_per_second = SystemCoreClock / 4;
+    stream->printf("Ticker interrupts: %lu\r\n", (unsigned long)THEKERNEL->slow_ticker->get_wakes());
+    for (auto hook : THEKERNEL->slow_ticker->get_hooks()) {
+        unsigned long average = hook->calls > 0 ? (unsigned long)(hook->cycles / hook->calls) : 0;
+        float frequency = (float)ticks_per_second / hook->interval;
+        stream->printf("  %p at %1.1f Hz, calls: %lu, average: %lu cycles, max: %lu cycles, cpu: %1.3f%%\r\n",
+                       hook->get_object(), frequency, (unsigned long)hook->calls, average, (unsigned long)hook->max_cycles,
+                       100.0F * average * frequency / SystemCoreClock);
+    }
+}
+
 static uint32_t getDeviceType()
 {
 #define IAP_LOCATION 0x1FFF1FF1
@@ -544,6 +621,8 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("Commands:\r\n");
     stream->printf("version\r\n");
     stream->printf("mem [-v]\r\n");
+    stream->printf("events [on|off|reset] - shows the calls and cycles of each event handler, counted while on\r\n");
+    stream->printf("ticker [reset] - shows the calls and cycles of each slow ticker hook\r\n");
     stream->printf("ls [-s] [folder]\r\n");
     stream->printf("cd folder\r\n");
     stream->printf("pwd\r\n");
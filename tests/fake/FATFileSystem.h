@@ -0,0 +1,32 @@
+// Host stand-in for what SDFAT uses of the ChaNFS FATFileSystem, see tests/sdfat_test.cpp. Nothing is mounted, so
+// SDFAT takes no sector for the FAT
+
+#ifndef FAKE_FATFILESYSTEM_H
+#define FAKE_FATFILESYSTEM_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t  fs_type;
+    uint8_t  n_fats;
+    uint32_t fsize;
+    uint32_t fatbase;
+} FATFS;
+
+static inline int f_mount(int, FATFS *) { return 0; }
+
+namespace mbed {
+
+class FATFileSystem {
+    public:
+        FATFileSystem(const char *) : _fsid(0) { _fs.fs_type = 0; }
+        virtual ~FATFileSystem() {}
+
+    protected:
+        FATFS _fs;
+        int _fsid;
+};
+
+}
+
+#endif
@@ -0,0 +1,16 @@
+// Host stand-in for MemoryPool, plain heap, see tests/sdfat_test.cpp. The real header replaces the global operator
+// delete, which the host library does not allow, so the makefile includes this one first and its guard keeps the real
+// one out
+
+#ifndef _MEMORYPOOL_H
+#define _MEMORYPOOL_H
+
+#include <stdlib.h>
+
+class MemoryPool {
+    public:
+        void* alloc(size_t nbytes) { return malloc(nbytes); }
+        void  dealloc(void* p) { free(p); }
+};
+
+#endif /* _MEMORYPOOL_H */
@@ -0,0 +1,50 @@
+// Host stand-in for SpiBus, the bytes go to the fake card in tests/sdcard_test.cpp. Exchanged transactions are done
+// right away, or when the test calls dma_interrupt() if deferred is set
+
+#ifndef FAKE_SPIBUS_H
+#define FAKE_SPIBUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mbed.h"
+#include "libs/FPointer.h"
+
+class Pin;
+
+class SpiTransaction {
+    public:
+        SpiTransaction() : tx(NULL), rx(NULL), length(0), frequency(1000000), cs(NULL), busy(false), failed(false), next(NULL) {}
+
+        const uint8_t* tx;
+        uint8_t* rx;
+        uint16_t length;
+        uint32_t frequency;
+        Pin* cs;
+        FPointer done;
+
+        volatile bool busy;
+        volatile bool failed;
+
+        SpiTransaction* next;
+};
+
+class SpiBus {
+    public:
+        static SpiBus* get(PinName mosi, PinName miso, PinName sclk);
+
+        void acquire(uint32_t frequency);
+        bool try_acquire(uint32_t frequency);
+        uint8_t write(uint8_t data);
+        void exchange(SpiTransaction* transaction);
+        void release();
+
+        void dma_interrupt();
+
+        bool held;
+        bool deferred;
+        SpiTransaction* pending;
+        int acquired_in_interrupt;
+};
+
+#endif
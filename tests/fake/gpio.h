@@ -0,0 +1,17 @@
+// Host stand-in for the card select pin, see tests/sdcard_test.cpp
+
+#ifndef FAKE_GPIO_H
+#define FAKE_GPIO_H
+
+#include "mbed.h"
+
+extern int fake_cs;
+
+class GPIO {
+public:
+    GPIO(PinName) {}
+    void output() {}
+    int operator=(int value) { fake_cs = value; return value; }
+};
+
+#endif
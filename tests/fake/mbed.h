@@ -0,0 +1,25 @@
+// Host stand-in for what SDCard uses of mbed.h, see tests/sdcard_test.cpp
+
+#ifndef FAKE_MBED_H
+#define FAKE_MBED_H
+
+#include <stdint.h>
+
+typedef int PinName;
+typedef int IRQn_Type;
+
+#define DMA_IRQn 26
+
+// Set by the test, 0 for the main loop, or 16 + the interrupt it pretends to be in
+extern uint32_t fake_ipsr;
+extern uint32_t fake_priority[64];
+extern bool fake_dma_reachable;
+
+#define DMA_REACHABLE(p, n) (fake_dma_reachable)
+
+static inline uint32_t __get_IPSR() { return fake_ipsr; }
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+static inline uint32_t NVIC_GetPriority(IRQn_Type irq) { return fake_priority[irq]; }
+
+#endif
@@ -0,0 +1 @@
+// SDCard only needs SpiBus.h, see tests/sdcard_test.cpp
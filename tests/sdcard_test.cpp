@@ -0,0 +1,361 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs SDCard on the host against a fake SPI bus and a fake SDHC card, the headers in tests/fake stand in for the
+// hardware ones. Built and run by make test
+
+#include "libs/USBDevice/USBMSD/SDCard.h"
+
+#include <deque>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+uint32_t fake_ipsr = 0;
+uint32_t fake_priority[64];
+bool fake_dma_reachable = true;
+int fake_cs = 1;
+
+#define USB_IRQ 24
+
+// THE CARD
+
+// Answers in SPI mode, a byte out for every byte in, and only while selected. Enough of the protocol for what SDCard
+// sends: initialisation, CMD9, CMD16, single and multiple block reads and writes
+class FakeCard {
+    public:
+        FakeCard() : blocks(1024), data(1024 * 512), state(IDLE), received(0), multiple(false) {}
+
+        uint8_t exchange(uint8_t in)
+        {
+            if (fake_cs) return 0xFF;
+
+            uint8_t out = 0xFF;
+            if (!output.empty()) {
+                out = output.front();
+                output.pop_front();
+            } else if (state == READING && multiple) {
+                queue_block(++block);
+            }
+
+            switch (state) {
+                case WRITE_TOKEN:
+                    if (in == 0xFE || in == 0xFC) {
+                        state = WRITE_DATA;
+                        received = 0;
+                    } else if (in == 0xFD) {
+                        state = IDLE;
+                        busy(4);
+                    }
+                    break;
+
+                case WRITE_DATA:
+                    if (received < 512) data[(block * 512) + received] = in;
+                    if (++received == 512 + 2) {
+                        output.push_back(0x05);
+                        busy(4);
+                        if (multiple) {
+                            block++;
+                            state = WRITE_TOKEN;
+                        } else {
+                            state = IDLE;
+                        }
+                    }
+                    break;
+
+                default:
+                    if (command.empty() && (in & 0xC0) != 0x40) break;
+                    command.push_back(in);
+                    if (command.size() == 6) {
+                        run(command[0] & 0x3F, (command[1] << 24) | (command[2] << 16) | (command[3] << 8) | command[4]);
+                        command.clear();
+                    }
+                    break;
+            }
+            return out;
+        }
+
+        uint32_t blocks;
+        std::vector<uint8_t> data;
+
+    private:
+        enum { IDLE, READING, WRITE_TOKEN, WRITE_DATA } state;
+
+        void run(int cmd, uint32_t arg)
+        {
+            output.clear();
+            output.push_back(0xFF);
+            switch (cmd) {
+                case 0:  output.push_back(0x01); break;
+                case 8:  output.push_back(0x01); output.push_back(0x00); output.push_back(0x00); output.push_back(0x01); output.push_back(0xAA); break;
+                case 55: output.push_back(0x01); break;
+                case 41: output.push_back(0x00); break;
+                case 58: output.push_back(0x00); output.push_back(0xC0); output.push_back(0xFF); output.push_back(0x80); output.push_back(0x00); break;
+                case 16: output.push_back(0x00); break;
+
+                case 9: {
+                    // version 2 CSD, c_size 0 is 1024 blocks
+                    output.push_back(0x00);
+                    output.push_back(0xFF);
+                    output.push_back(0xFE);
+                    output.push_back(0x40);
+                    for (int i = 1; i < 16 + 2; i++) output.push_back(0x00);
+                    break;
+                }
+
+                case 17:
+                case 18:
+                    output.push_back(0x00);
+                    state = READING;
+                    multiple = (cmd == 18);
+                    block = arg;
+                    queue_block(block);
+                    break;
+
+                case 12:
+                    // after the stuff byte
+                    output.push_back(0x00);
+                    state = IDLE;
+                    busy(2);
+                    break;
+
+                case 24:
+                case 25:
+                    output.push_back(0x00);
+                    state = WRITE_TOKEN;
+                    multiple = (cmd == 25);
+                    block = arg;
+                    break;
+
+                default:
+                    output.push_back(0x04);
+                    break;
+            }
+        }
+
+        // A few bytes of waiting before the start byte, as a real card does
+        void queue_block(uint32_t n)
+        {
+            if (n >= blocks) return;
+            for (int i = 0; i < 5; i++) output.push_back(0xFF);
+            output.push_back(0xFE);
+            for (int i = 0; i < 512; i++) output.push_back(data[(n * 512) + i]);
+            output.push_back(0x12);
+            output.push_back(0x34);
+        }
+
+        void busy(int bytes)
+        {
+            for (int i = 0; i < bytes; i++) output.push_back(0x00);
+        }
+
+        std::deque<uint8_t> output;
+        std::vector<uint8_t> command;
+        uint32_t block;
+        int received;
+        bool multiple;
+};
+
+static FakeCard card;
+
+// THE BUS
+
+static SpiBus bus;
+
+SpiBus* SpiBus::get(PinName, PinName, PinName)
+{
+    return &bus;
+}
+
+void SpiBus::acquire(uint32_t)
+{
+    if (fake_ipsr != 0) {
+        // would spin forever on the target
+        acquired_in_interrupt++;
+        return;
+    }
+    held = true;
+}
+
+bool SpiBus::try_acquire(uint32_t)
+{
+    if (held || pending) return false;
+    held = true;
+    return true;
+}
+
+uint8_t SpiBus::write(uint8_t data)
+{
+    return card.exchange(data);
+}
+
+void SpiBus::exchange(SpiTransaction* transaction)
+{
+    transaction->busy = true;
+    pending = transaction;
+    if (!deferred) dma_interrupt();
+}
+
+void SpiBus::release()
+{
+    held = false;
+}
+
+void SpiBus::dma_interrupt()
+{
+    SpiTransaction* transaction = pending;
+    if (transaction == NULL) return;
+    pending = NULL;
+
+    for (int i = 0; i < transaction->length; i++) {
+        uint8_t in = card.exchange(transaction->tx ? transaction->tx[i] : 0xFF);
+        if (transaction->rx) transaction->rx[i] = in;
+    }
+    transaction->busy = false;
+
+    uint32_t saved = fake_ipsr;
+    fake_ipsr = 16 + DMA_IRQn;
+    transaction->done.call(0);
+    fake_ipsr = saved;
+}
+
+// THE TESTS
+
+static int failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static void fill(char *buffer, uint32_t count, int seed)
+{
+    for (uint32_t i = 0; i < count * 512; i++) buffer[i] = (char)((i * 7) + seed);
+}
+
+static bool on_card(const char *buffer, uint32_t block, uint32_t count)
+{
+    return memcmp(buffer, &card.data[block * 512], count * 512) == 0;
+}
+
+static int done_calls = 0;
+static uint32_t done_result = 0;
+static uint32_t on_done(uint32_t result)
+{
+    done_calls++;
+    done_result = result;
+    return 0;
+}
+
+static void test_blocking(SDCard &sd)
+{
+    char out[4 * 512], in[4 * 512];
+
+    fill(out, 1, 1);
+    CHECK(sd.disk_write(out, 10) == 0);
+    CHECK(on_card(out, 10, 1));
+    CHECK(sd.disk_sync() == 0);
+
+    fill(out, 4, 2);
+    CHECK(sd.disk_write_blocks(out, 20, 4) == 0);
+    CHECK(on_card(out, 20, 4));
+
+    memset(in, 0, sizeof(in));
+    CHECK(sd.disk_read(in, 10) == 0);
+    CHECK(on_card(in, 10, 1));
+
+    memset(in, 0, sizeof(in));
+    CHECK(sd.disk_read_blocks(in, 20, 4) == 0);
+    CHECK(on_card(in, 20, 4));
+
+    CHECK(!bus.held && !sd.busy());
+}
+
+static void test_async(SDCard &sd)
+{
+    char in[4 * 512];
+    FPointer done;
+    done.attach(&on_done);
+
+    bus.deferred = true;
+    done_calls = 0;
+    memset(in, 0, sizeof(in));
+    CHECK(sd.disk_read_async(in, 20, 4, done) == 0);
+
+    // returned with the transfer still going on, and the bus kept for it
+    CHECK(sd.busy() && bus.held && done_calls == 0);
+
+    for (int i = 0; i < 10000 && bus.pending; i++) bus.dma_interrupt();
+    CHECK(done_calls == 1 && done_result == 0);
+    CHECK(on_card(in, 20, 4));
+    CHECK(!sd.busy() && !bus.held);
+    bus.deferred = false;
+}
+
+// From an interrupt, where nothing may wait for the main loop
+static void test_interrupt(SDCard &sd)
+{
+    char buffer[512];
+    FPointer done;
+    done.attach(&on_done);
+
+    fake_ipsr = 16 + USB_IRQ;
+
+    // everything free, the DMA interrupt can preempt this one
+    CHECK(sd.disk_read(buffer, 10) == 0);
+    CHECK(on_card(buffer, 10, 1));
+
+    // the main loop's read ahead is still going on
+    if (fake_dma_reachable) {
+        bus.deferred = true;
+        fake_ipsr = 0;
+        CHECK(sd.disk_read_async(buffer, 20, 1, done) == 0);
+        fake_ipsr = 16 + USB_IRQ;
+        CHECK(sd.disk_read(buffer, 10) != 0);
+        CHECK(sd.disk_write(buffer, 10) != 0);
+        while (bus.pending) bus.dma_interrupt();
+        bus.deferred = false;
+    }
+
+    // another device on the bus has it
+    bus.held = true;
+    CHECK(sd.disk_read(buffer, 10) != 0);
+    CHECK(!sd.busy());
+    bus.held = false;
+
+    // an interrupt the DMA interrupt cannot preempt
+    fake_ipsr = 16 + DMA_IRQn;
+    CHECK(sd.disk_read(buffer, 10) != 0);
+
+    fake_ipsr = 0;
+    CHECK(bus.acquired_in_interrupt == 0);
+    CHECK(sd.disk_read(buffer, 10) == 0);
+}
+
+int main()
+{
+    // a hang is a failure too
+    alarm(10);
+
+    fake_priority[DMA_IRQn] = 4;
+    fake_priority[USB_IRQ] = 5;
+
+    for (int dma = 1; dma >= 0; dma--) {
+        fake_dma_reachable = dma;
+        card = FakeCard();
+
+        SDCard sd(0, 0, 0, 0);
+        CHECK(sd.disk_initialize() == 0);
+        CHECK(sd.card_type() == SDCard::SDCARD_V2HC);
+        CHECK(sd.disk_sectors() == 1024);
+
+        test_blocking(sd);
+        if (dma) test_async(sd);
+        test_interrupt(sd);
+
+        printf("%s with%s the DMA\n", failures ? "FAIL" : "ok  ", dma ? "" : "out");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs SDFAT's cache on the host against a fake disk whose background transfers finish when the test says so. Built
+// and run by make test
+
+#include "libs/SDFAT.h"
+#include "libs/platform_memory.h"
+
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// THE MEMORY, plain heap on the host
+
+MemoryPool* _AHB0 = NULL;
+MemoryPool* _AHB1 = NULL;
+
+// THE DISK
+
+// Does one transfer at a time like SDCard. Blocking calls are done right away, background ones too unless deferred is
+// set, then they wait for finish()
+class FakeDisk : public MSD_Disk {
+    public:
+        FakeDisk() : data(1024 * 512), deferred(false), fail_writes(false), reads(0), writes(0), overlapped(0), pending(false) {}
+
+        int disk_read(char *buffer, uint32_t block) { return disk_read_blocks(buffer, block, 1); }
+        int disk_write(const char *buffer, uint32_t block) { return disk_write_blocks(buffer, block, 1); }
+
+        int disk_read_blocks(char *buffer, uint32_t block, uint32_t count)
+        {
+            if (pending) overlapped++;
+            reads += count;
+            memcpy(buffer, &data[block * 512], count * 512);
+            return 0;
+        }
+
+        int disk_write_blocks(const char *buffer, uint32_t block, uint32_t count)
+        {
+            if (pending) overlapped++;
+            writes += count;
+            if (fail_writes) return 1;
+            memcpy(&data[block * 512], buffer, count * 512);
+            return 0;
+        }
+
+        int disk_read_async(char *buffer, uint32_t block, uint32_t count, FPointer d)
+        {
+            return start(buffer, NULL, block, count, d);
+        }
+
+        int disk_write_async(const char *buffer, uint32_t block, uint32_t count, FPointer d)
+        {
+            return start(NULL, buffer, block, count, d);
+        }
+
+        // The DMA interrupt at the end of the transfer
+        void finish()
+        {
+            if (!pending) return;
+            pending = false;
+            int r = rx ? disk_read_blocks(rx, block, count) : disk_write_blocks(tx, block, count);
+            done.call(r ? 1 : 0);
+        }
+
+        uint32_t disk_sectors() { return 1024; }
+        uint32_t disk_blocksize() { return 512; }
+        bool busy() { return pending; }
+
+        std::vector<uint8_t> data;
+        bool deferred;
+        bool fail_writes;
+        int reads;
+        int writes;
+        int overlapped;
+        bool pending;
+
+    private:
+        int start(char *r, const char *t, uint32_t b, uint32_t c, FPointer d)
+        {
+            if (pending) overlapped++;
+            rx = r;
+            tx = t;
+            block = b;
+            count = c;
+            done = d;
+            pending = true;
+            if (!deferred) finish();
+            return 0;
+        }
+
+        char *rx;
+        const char *tx;
+        uint32_t block;
+        uint32_t count;
+        FPointer done;
+};
+
+// THE TESTS
+
+static int failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static void fill(char *buffer, uint32_t count, int seed)
+{
+    for (uint32_t i = 0; i < count * 512; i++) buffer[i] = (char)((i * 7) + seed);
+}
+
+static bool on_disk(FakeDisk &disk, const char *buffer, uint32_t block, uint32_t count)
+{
+    return memcmp(buffer, &disk.data[block * 512], count * 512) == 0;
+}
+
+// Uploads write files several sectors at a time, from buffers the DMA does not reach
+static void test_write_behind(FakeDisk &disk, SDFAT &fs)
+{
+    char out[4 * 512], copy[4 * 512], in[512];
+
+    fill(out, 4, 1);
+    memcpy(copy, out, sizeof(out));
+    disk.deferred = true;
+    CHECK(fs.disk_write_blocks(out, 100, 4) == 0);
+
+    // returned with the write still going on, and the buffer free again
+    CHECK(disk.pending && !on_disk(disk, copy, 100, 4));
+    memset(out, 0, sizeof(out));
+
+    // read back from the window meanwhile, without the disk
+    int reads = disk.reads;
+    CHECK(fs.disk_read(in, 102) == 0);
+    CHECK(memcmp(in, copy + (2 * 512), 512) == 0);
+    CHECK(disk.reads == reads);
+
+    disk.finish();
+    CHECK(on_disk(disk, copy, 100, 4));
+    disk.deferred = false;
+
+    // longer than a window
+    char big[10 * 512];
+    fill(big, 10, 2);
+    CHECK(fs.disk_write_blocks(big, 200, 10) == 0);
+    CHECK(fs.disk_sync() == 0);
+    CHECK(on_disk(disk, big, 200, 10));
+}
+
+// Sectors written on their own stay in the cache until written back, newer writes of several sectors win over them
+static void test_write_back(FakeDisk &disk, SDFAT &fs)
+{
+    char one[512], four[4 * 512], in[4 * 512];
+
+    fill(one, 1, 3);
+    int writes = disk.writes;
+    CHECK(fs.disk_write(one, 300) == 0);
+    CHECK(disk.writes == writes);
+    CHECK(fs.disk_sync() == 0);
+    CHECK(on_disk(disk, one, 300, 1));
+
+    fill(one, 1, 4);
+    CHECK(fs.disk_write(one, 301) == 0);
+    fill(four, 4, 5);
+    CHECK(fs.disk_write_blocks(four, 300, 4) == 0);
+    CHECK(fs.disk_sync() == 0);
+    CHECK(on_disk(disk, four, 300, 4));
+
+    // and a read of several sectors sees the ones not written back yet
+    fill(one, 1, 6);
+    CHECK(fs.disk_write(one, 400) == 0);
+    memset(in, 0, sizeof(in));
+    CHECK(fs.disk_read_blocks(in, 398, 4) == 0);
+    CHECK(memcmp(in + (2 * 512), one, 512) == 0);
+    CHECK(on_disk(disk, in, 398, 4));
+}
+
+// A write in the background fails after it returned, disk_sync() tells
+static void test_write_failed(FakeDisk &disk, SDFAT &fs)
+{
+    char out[4 * 512];
+
+    fill(out, 4, 7);
+    disk.fail_writes = true;
+    CHECK(fs.disk_write_blocks(out, 500, 4) == 0);
+    CHECK(fs.disk_sync() != 0);
+    disk.fail_writes = false;
+    CHECK(fs.disk_sync() == 0);
+}
+
+// USB mass storage goes through usb_disk(): the host reads what the cache has yet to write back, and writing back
+// later does not go over what the host wrote
+static void test_usb(FakeDisk &disk, SDFAT &fs)
+{
+    MSD_Disk *usb = fs.usb_disk();
+    char firmware[4 * 512], host[4 * 512], in[4 * 512];
+
+    fill(firmware, 1, 8);
+    CHECK(fs.disk_write(firmware, 600) == 0);
+    CHECK(usb->disk_read(in, 600) == 0);
+    CHECK(memcmp(in, firmware, 512) == 0);
+
+    fill(firmware, 1, 9);
+    CHECK(fs.disk_write(firmware, 700) == 0);
+    fill(firmware, 4, 10);
+    CHECK(fs.disk_write_blocks(firmware, 710, 4) == 0);
+    fill(host, 4, 11);
+    CHECK(usb->disk_write(host, 700) == 0);
+    CHECK(usb->disk_write_blocks(host, 710, 4) == 0);
+
+    CHECK(fs.remount() == 0);
+    CHECK(on_disk(disk, host, 700, 1));
+    CHECK(on_disk(disk, host, 710, 4));
+    CHECK(fs.disk_read_blocks(in, 710, 4) == 0);
+    CHECK(memcmp(in, host, sizeof(in)) == 0);
+}
+
+int main()
+{
+    // a hang is a failure too
+    alarm(10);
+
+    MemoryPool pool;
+    _AHB1 = &pool;
+
+    FakeDisk disk;
+    {
+        SDFAT fs("sd", &disk);
+        CHECK(fs.disk_initialize() == 0);
+
+        test_write_behind(disk, fs);
+        test_write_back(disk, fs);
+        test_write_failed(disk, fs);
+        test_usb(disk, fs);
+    }
+    CHECK(disk.overlapped == 0);
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the thermistor lookup table against the beta equation, on the host. Built and run by make test
+
+#include "ThermistorTable.h"
+#include "predefined_thermistors.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// Worst error allowed between 0C and 300C, what a printer can be set to
+#define MAX_ERROR 0.25
+
+static const thermistor_table_t extra_thermistors[] {
+    // r1 squeezes the readings into the low half of the ADC range
+    {"100K with 1K in parallel", 4066.0F, 100000.0F, 25.0F, 1000, 4700},
+};
+
+// What the firmware used to work out for every reading
+static double exact_temperature(const thermistor_table_t &t, int adc_value)
+{
+    double r = t.r2 / ((4095.0 / adc_value) - 1.0);
+    if (t.r1 > 0)
+        r = (t.r1 * r) / (t.r1 - r);
+    return (1.0 / ((1.0 / (t.t0 + 273.15)) + (log(r / t.r0) / t.beta))) - 273.15;
+}
+
+static bool check(const thermistor_table_t &t)
+{
+    ThermistorTable table;
+    table.build(t.beta, t.r0, t.t0, t.r1, t.r2);
+
+    double worst = 0;
+    int worst_adc = 0;
+    float last = INFINITY;
+    for (int adc_value = 1; adc_value < 4095; adc_value++) {
+        float temperature = table.temperature(adc_value);
+        if (temperature > last) {
+            printf("FAIL %s: %.3fC at ADC %d is hotter than %.3fC just below it\n", t.name, temperature, adc_value, last);
+            return false;
+        }
+        last = temperature;
+
+        // r1 leaves readings that no resistance of the thermistor gives
+        if (t.r1 > 0 && t.r2 / ((4095.0 / adc_value) - 1.0) >= t.r1)
+            continue;
+
+        double exact = exact_temperature(t, adc_value);
+        if (exact < 0 || exact > 300)
+            continue;
+        if (fabs(temperature - exact) > worst) {
+            worst = fabs(temperature - exact);
+            worst_adc = adc_value;
+        }
+    }
+
+    printf("%s %s: worst error %.3fC at ADC %d\n", worst < MAX_ERROR ? "ok  " : "FAIL", t.name, worst, worst_adc);
+    return worst < MAX_ERROR;
+}
+
+int main()
+{
+    bool ok = true;
+    for (auto &t : predefined_thermistors)
+        ok = check(t) && ok;
+    for (auto &t : extra_thermistors)
+        ok = check(t) && ok;
+    return ok ? 0 : 1;
+}